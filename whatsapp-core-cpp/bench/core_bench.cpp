@@ -0,0 +1,412 @@
+// Suite de microbenchmarks del core. Escribe un JSON (stdout o --out) para comparar builds:
+//   {"build": {...}, "config": {...}, "results": [{"name", "params", "ops", "ns_per_op", "p50_ns", "p99_ns"}, ...]}
+// p50/p99 son de las tandas (lotes de 'batch' operaciones), no de cada operación suelta.
+//
+//   ./core_bench [--sizes 10000,100000,1000000] [--index none,matryoshka,pca] [--dim 768]
+//                [--reduced 256] [--min-time 0.5] [--filter vector_store] [--db] [--out results.json]
+//
+// --db mide MessageDatabase contra MariaDB (DB_HOST, DB_USER, DB_PASSWORD, DB_NAME). DB_HOST y DB_NAME
+// son obligatorios: sin ellos db_connect iría a la base del despliegue. Los mensajes y el chat
+// "core_bench@bench" se borran al terminar.
+#include "rag/vector_store.h"
+#include "rag/vector_transform.h"
+#include "rag/context_builder.h"
+#include "persistence/message_database.h"
+#include "persistence/database_pool.h"
+#include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using json = nlohmann::json;
+
+namespace {
+struct Options {
+    std::vector<long> sizes{10000, 100000, 1000000};
+    std::vector<std::string> indexes{"none", "matryoshka", "pca"};
+    int dim = 768;
+    int reduced = 256;
+    double min_time_s = 0.5;
+    std::string filter;
+    bool db = false;
+    std::string out;
+};
+
+std::vector<std::string> SplitList(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+Options ParseArgs(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&]() -> std::string {
+            if (i + 1 >= argc) throw std::invalid_argument("Falta el valor de " + arg);
+            return argv[++i];
+        };
+        if (arg == "--sizes") {
+            options.sizes.clear();
+            for (const auto& size : SplitList(next())) options.sizes.push_back(std::stol(size));
+        } else if (arg == "--index") {
+            options.indexes = SplitList(next());
+        } else if (arg == "--dim") {
+            options.dim = std::stoi(next());
+        } else if (arg == "--reduced") {
+            options.reduced = std::stoi(next());
+        } else if (arg == "--min-time") {
+            options.min_time_s = std::stod(next());
+        } else if (arg == "--filter") {
+            options.filter = next();
+        } else if (arg == "--db") {
+            if (!std::getenv("DB_HOST") || !std::getenv("DB_NAME")) {
+                throw std::invalid_argument("--db necesita DB_HOST y DB_NAME explícitos (nunca la base de producción)");
+            }
+            options.db = true;
+        } else if (arg == "--out") {
+            options.out = next();
+        } else {
+            throw std::invalid_argument("Argumento desconocido: " + arg);
+        }
+    }
+    return options;
+}
+
+class Bench {
+public:
+    explicit Bench(const Options& options) : m_options(options) {}
+
+    bool Enabled(const std::string& name) const {
+        return m_options.filter.empty() || name.find(m_options.filter) != std::string::npos;
+    }
+
+    // Para saltarse la preparación de un grupo entero ("vector_store", "db"...): el grupo corre con
+    // --filter vector_store, con --filter vector_store/search_k8 (y solo mide ese) o con --filter vector
+    bool GroupEnabled(const std::string& group) const {
+        const auto& filter = m_options.filter;
+        return filter.empty() || filter.rfind(group, 0) == 0 || group.find(filter) != std::string::npos;
+    }
+
+    // Repite 'fn' (que hace 'batch' operaciones) hasta cubrir min_time_s o max_batches tandas
+    void Measure(const std::string& name, json params, size_t batch, const std::function<void()>& fn,
+                 size_t max_batches = 1000000) {
+        if (!Enabled(name)) return;
+        fn(); // Calentamiento
+        std::vector<double> samples;
+        double total_ns = 0;
+        while ((total_ns < m_options.min_time_s * 1e9 || samples.size() < 3) && samples.size() < max_batches) {
+            auto start = std::chrono::steady_clock::now();
+            fn();
+            double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            total_ns += ns;
+            samples.push_back(ns / batch);
+        }
+        Record(name, std::move(params), samples, samples.size() * batch, total_ns);
+    }
+
+    // Para lo que no se puede repetir (construir un índice): una pasada, tandas de 'batch'
+    void Record(const std::string& name, json params, std::vector<double> samples, uint64_t ops, double total_ns) {
+        std::sort(samples.begin(), samples.end());
+        // Rango más cercano: el menor valor que deja por debajo al menos p de las tandas
+        auto percentile = [&](double p) {
+            if (samples.empty()) return 0.0;
+            size_t rank = static_cast<size_t>(std::ceil(p * samples.size()));
+            return samples[std::clamp<size_t>(rank, 1, samples.size()) - 1];
+        };
+        double ns_per_op = ops ? total_ns / ops : 0;
+        m_results.push_back({
+            {"name", name}, {"params", std::move(params)}, {"ops", ops},
+            {"ns_per_op", ns_per_op}, {"p50_ns", percentile(0.5)}, {"p99_ns", percentile(0.99)},
+            {"ops_per_s", ns_per_op > 0 ? 1e9 / ns_per_op : 0}
+        });
+        std::fprintf(stderr, "%-34s %-40s %12.0f ns/op  p99 %12.0f ns\n", name.c_str(),
+                     m_results.back()["params"].dump().c_str(), ns_per_op, percentile(0.99));
+    }
+
+    json Results() const { return m_results; }
+
+private:
+    const Options& m_options;
+    json m_results = json::array();
+};
+
+// Vectores normalizados (como los de nomic-embed-text); se reutiliza un banco fijo para que
+// generar números aleatorios no entre en la medida
+std::vector<std::vector<float>> MakeVectors(size_t count, int dim, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> dist(0.0f, 1.0f);
+    std::vector<std::vector<float>> vectors(count, std::vector<float>(dim));
+    for (auto& v : vectors) {
+        float norm = 0;
+        for (auto& x : v) {
+            x = dist(rng);
+            norm += x * x;
+        }
+        norm = std::sqrt(norm);
+        for (auto& x : v) x /= norm;
+    }
+    return vectors;
+}
+
+void BenchVectorStore(Bench& bench, const Options& options) {
+    if (!bench.GroupEnabled("vector_store")) return;
+    constexpr size_t kBank = 4096;
+    constexpr size_t kAddBatch = 1000;
+    auto bank = MakeVectors(kBank, options.dim, 1);
+    auto queries = MakeVectors(256, options.dim, 2);
+
+    for (const auto& kind : options.indexes) {
+        for (long size : options.sizes) {
+            json params = {{"index", kind}, {"vectors", size}, {"dim", options.dim}};
+            if (kind != "none") params["reduced_dim"] = options.reduced;
+            VectorStore store(options.dim, MakeVectorTransform(kind == "none" ? "" : kind, options.dim, options.reduced));
+
+            // AddIndex: el índice crece de 0 a 'size' (los reentrenamientos de PCA salen en el p99)
+            std::vector<double> samples;
+            double total_ns = 0;
+            for (long added = 0; added < size;) {
+                size_t batch = std::min<size_t>(kAddBatch, size - added);
+                auto start = std::chrono::steady_clock::now();
+                for (size_t i = 0; i < batch; ++i, ++added) {
+                    store.AddIndex("msg-" + std::to_string(added), bank[added % kBank]);
+                }
+                double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+                total_ns += ns;
+                samples.push_back(ns / batch);
+            }
+            // El índice se llena siempre (lo necesitan las búsquedas), pero solo se informa si toca
+            if (bench.Enabled("vector_store/add_index")) bench.Record("vector_store/add_index", params, samples, size, total_ns);
+
+            size_t q = 0;
+            bench.Measure("vector_store/search_k8", params, 1, [&] {
+                auto ids = store.Search(queries[q++ % queries.size()], 8);
+                if (ids.empty()) std::abort();
+            });
+            bench.Measure("vector_store/search_with_vectors_k32", params, 1, [&] {
+                auto candidates = store.SearchWithVectors(queries[q++ % queries.size()], 32);
+                if (candidates.ids.empty()) std::abort();
+            });
+            bench.Measure("vector_store/upsert", params, 1, [&] {
+                store.Upsert("msg-" + std::to_string(q % size), bank[q % kBank]);
+                q++;
+            });
+        }
+    }
+}
+
+// Mismos contenedores que VectorStore usa para traducir ids (privados allí): FAISS id -> id de
+// WhatsApp tras cada búsqueda y el inverso en cada Upsert
+void BenchIdMaps(Bench& bench, const Options& options) {
+    if (!bench.GroupEnabled("id_map")) return;
+    std::mt19937_64 rng(3);
+    for (long size : options.sizes) {
+        json params = {{"entries", size}};
+        std::map<long, std::string> id_map;
+        std::unordered_map<std::string, long> key_to_id;
+        for (long i = 0; i < size; ++i) {
+            std::string key = "3EB0" + std::to_string(rng()) + "@s.whatsapp.net";
+            id_map.emplace(i, key);
+            key_to_id.emplace(std::move(key), i);
+        }
+        std::vector<long> probes(4096);
+        for (auto& p : probes) p = static_cast<long>(rng() % size);
+        std::vector<std::string> keys;
+        for (long p : probes) keys.push_back(id_map[p]);
+
+        constexpr size_t kBatch = 4096;
+        volatile size_t sink = 0;
+        bench.Measure("id_map/faiss_to_msg", params, kBatch, [&] {
+            for (long p : probes) sink = sink + id_map.find(p)->second.size();
+        });
+        bench.Measure("id_map/msg_to_faiss", params, kBatch, [&] {
+            for (const auto& key : keys) sink = sink + key_to_id.find(key)->second;
+        });
+    }
+}
+
+std::string MakeIngestBody(int i) {
+    return json{
+        {"id", "3EB0C4F1A2B3C4D5E6F7" + std::to_string(i)},
+        {"chat_jid", "34600111222@s.whatsapp.net"},
+        {"chat_name", "Grupo de la familia"},
+        {"sender", "María"},
+        {"content", "Mañana a las 10 en la estación, ¿alguien se trae el cargador del portátil? 🙏"},
+        {"timestamp", 1760000000LL + i},
+        {"is_from_me", false}
+    }.dump();
+}
+
+// Lo que hace el handler de /ingest con el cuerpo antes de tocar la DB
+void BenchIngestJson(Bench& bench) {
+    std::vector<std::string> bodies;
+    for (int i = 0; i < 64; ++i) bodies.push_back(MakeIngestBody(i));
+    constexpr size_t kBatch = 256;
+    volatile size_t sink = 0;
+    bench.Measure("ingest/json_decode", {{"body_bytes", bodies[0].size()}}, kBatch, [&] {
+        for (size_t i = 0; i < kBatch; ++i) {
+            auto j = json::parse(bodies[i % bodies.size()]);
+            std::string id = j.value("id", "");
+            std::string content = j.value("content", "");
+            std::string sender = j.value("sender", "Unknown");
+            std::string chat_jid = j.value("chat_jid", "");
+            long long timestamp = j.value("timestamp", 0LL);
+            sink = sink + id.size() + content.size() + sender.size() + chat_jid.size() + timestamp;
+        }
+    });
+}
+
+// Montaje del prompt de Ask: ventanas de contexto de top_k hits -> fusión y recorte -> user prompt
+void BenchPromptAssembly(Bench& bench) {
+    const std::vector<std::string> senders{"María", "Juan", "Lucía", "Pedro"};
+    for (int hits : {8, 32}) {
+        constexpr int kRadius = 2;
+        std::vector<std::vector<DBMessage>> windows;
+        for (int h = 0; h < hits; ++h) {
+            std::vector<DBMessage> window;
+            // Cada dos hits comparten chat y se solapan (el caso que fusiona ContextBuilder)
+            long long base = 1760000000LL + (h / 2) * 1000 + (h % 2) * 2;
+            for (int m = -kRadius; m <= kRadius; ++m) {
+                DBMessage msg;
+                msg.id = "m" + std::to_string(h / 2) + "_" + std::to_string(base + m);
+                msg.sender = senders[(h + m + kRadius) % senders.size()];
+                msg.content = "Mensaje " + std::to_string(m) + " sobre el viaje: quedamos a las 10, ¿vale? 👍";
+                msg.chat_jid = "chat" + std::to_string(h / 2) + "@g.us";
+                msg.timestamp = base + m;
+                window.push_back(std::move(msg));
+            }
+            windows.push_back(std::move(window));
+        }
+        const std::string question = "¿A qué hora quedamos para el viaje y quién trae el cargador?";
+        volatile size_t sink = 0;
+        bench.Measure("rag/prompt_assembly", {{"hits", hits}, {"radius", kRadius}, {"token_budget", 6000}}, 1, [&] {
+            ContextBuilder builder;
+            for (int h = 0; h < hits; ++h) builder.AddWindow(windows[h], windows[h][kRadius].id);
+            auto context = builder.Build(6000);
+            sink = sink + BuildUserPrompt(context.text, question).size();
+        });
+    }
+}
+
+void BenchDatabase(Bench& bench, const Options& options) {
+    if (!options.db || !bench.GroupEnabled("db")) return;
+    MessageDatabase db(db_connect());
+    // Al salir (también si algo lanza) borramos todo lo de core_bench, incluido lo de ejecuciones anteriores
+    struct Cleanup {
+        ~Cleanup() {
+            try {
+                ScopedConnection lease;
+                for (const char* query : {"DELETE FROM messages WHERE chat_jid = 'core_bench@bench'",
+                                          "DELETE FROM chats WHERE jid = 'core_bench@bench'"}) {
+                    if (mysql_query(lease.get(), query)) {
+                        std::fprintf(stderr, "⚠️ core_bench: no se pudo limpiar (%s): %s\n", query, mysql_error(lease.get()));
+                    }
+                }
+            } catch (const std::exception& e) {
+                std::fprintf(stderr, "⚠️ core_bench: no se pudo limpiar: %s\n", e.what());
+            }
+        }
+    } cleanup;
+    const std::string run = std::to_string(std::chrono::system_clock::now().time_since_epoch().count());
+    json chat = {{"chat_jid", "core_bench@bench"}, {"chat_name", "core_bench"}};
+    db.upsert_chat(chat);
+
+    int next = 0;
+    std::vector<std::string> ids;
+    auto insert = [&] {
+        json msg = {
+            {"id", "core_bench-" + run + "-" + std::to_string(next)},
+            {"chat_jid", "core_bench@bench"}, {"sender", "bench"},
+            {"content", "mensaje de prueba " + std::to_string(next) + " cargador estación"},
+            {"timestamp", 1760000000LL + next}, {"is_from_me", false}
+        };
+        db.insert_message(msg);
+        ids.push_back(msg["id"]);
+        next++;
+    };
+    bench.Measure("db/insert_message", {}, 1, insert, 2000);
+    // Con --filter db/get_message_by_id no se ha insertado nada: las lecturas necesitan filas propias
+    while (ids.size() < 100) insert();
+
+    size_t q = 0;
+    bench.Measure("db/get_message_by_id", {}, 1, [&] { db.GetMessageById(ids[q++ % ids.size()]); });
+    bench.Measure("db/get_message_window", {{"radius", 2}}, 1, [&] { db.GetMessageWindow(ids[q++ % ids.size()], 2); });
+    bench.Measure("db/search_by_text", {{"limit", 5}}, 1, [&] { db.SearchMessagesByText("cargador estación", 5); });
+    bench.Measure("db/get_all_messages", {{"limit", 1000}}, 1, [&] { db.GetAllMessages(1000); }, 50);
+}
+
+json BuildInfo() {
+    json info = {
+        {"compiler", __VERSION__},
+#ifdef NDEBUG
+        {"assertions", false},
+#else
+        {"assertions", true},
+#endif
+        {"timestamp", std::chrono::duration_cast<std::chrono::seconds>(
+                          std::chrono::system_clock::now().time_since_epoch()).count()}
+    };
+#ifdef CORE_BENCH_BUILD_TYPE
+    info["build_type"] = CORE_BENCH_BUILD_TYPE;
+#endif
+#ifdef CORE_BENCH_GIT_REV
+    info["git_rev"] = CORE_BENCH_GIT_REV;
+#endif
+    return info;
+}
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    try {
+        options = ParseArgs(argc, argv);
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "❌ %s\n", e.what());
+        return 2;
+    }
+    // stdout queda para el JSON
+    spdlog::set_default_logger(spdlog::stderr_color_mt("bench"));
+    spdlog::set_level(spdlog::level::warn);
+
+    Bench bench(options);
+    try {
+        BenchVectorStore(bench, options);
+        BenchIdMaps(bench, options);
+        BenchIngestJson(bench);
+        BenchPromptAssembly(bench);
+        BenchDatabase(bench, options);
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "❌ %s\n", e.what());
+        return 1;
+    }
+
+    json config = {
+        {"sizes", options.sizes}, {"indexes", options.indexes}, {"dim", options.dim},
+        {"reduced_dim", options.reduced}, {"min_time_s", options.min_time_s}, {"db", options.db}
+    };
+    json report = {{"build", BuildInfo()}, {"config", config}, {"results", bench.Results()}};
+    if (options.out.empty()) {
+        std::cout << report.dump(2) << "\n";
+    } else {
+        std::ofstream(options.out) << report.dump(2) << "\n";
+        std::fprintf(stderr, "📄 Resultados en %s\n", options.out.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,87 @@
+// Microbenchmark: decodificación de una respuesta de /api/embeddings (768 floats)
+// con el DOM de nlohmann::json frente al decodificador directo (llm/embedding_decoder.h).
+//
+//   ./embedding_decode_bench [iteraciones] [dimensión]
+#include "llm/embedding_decoder.h"
+#include <nlohmann/json.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+// Cuerpo con la misma pinta que el de Ollama: floats de Go con 15-17 cifras y alguno en notación e
+std::string MakeBody(size_t dim) {
+    std::mt19937 rng(42);
+    std::normal_distribution<double> dist(0.0, 0.8);
+    std::string body = "{\"embedding\":[";
+    char buf[40];
+    for (size_t i = 0; i < dim; ++i) {
+        double v = dist(rng);
+        if (i % 50 == 0) v *= 1e-5;
+        std::snprintf(buf, sizeof(buf), "%.17g", v);
+        if (i) body += ',';
+        body += buf;
+    }
+    body += "]}";
+    return body;
+}
+
+template <typename Fn>
+double NsPerOp(int iterations, Fn&& fn) {
+    for (int i = 0; i < iterations / 10 + 1; ++i) fn(); // Calentamiento
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) fn();
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iterations;
+}
+}
+
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? std::atoi(argv[1]) : 20000;
+    size_t dim = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 768;
+
+    const std::string body = MakeBody(dim);
+    std::string binary(dim * sizeof(float), '\0');
+
+    // Los tres caminos deben dar exactamente los mismos floats
+    auto reference = nlohmann::json::parse(body)["embedding"].get<std::vector<float>>();
+    std::vector<float> fast;
+    if (!DecodeEmbeddingJson(body, fast) || fast != reference) {
+        std::fprintf(stderr, "❌ El decodificador directo no coincide con nlohmann\n");
+        return 1;
+    }
+    std::memcpy(binary.data(), reference.data(), binary.size());
+
+    volatile float sink = 0;
+    double dom_ns = NsPerOp(iterations, [&] {
+        auto v = nlohmann::json::parse(body)["embedding"].get<std::vector<float>>();
+        sink = sink + v[0];
+    });
+    double fast_ns = NsPerOp(iterations, [&] {
+        std::vector<float> v;
+        DecodeEmbeddingJson(body, v);
+        sink = sink + v[0];
+    });
+    std::vector<float> buffer(dim);
+    double buffer_ns = NsPerOp(iterations, [&] {
+        DecodeEmbeddingJson(body, buffer.data(), buffer.size());
+        sink = sink + buffer[0];
+    });
+    std::vector<float> reused;
+    double binary_ns = NsPerOp(iterations, [&] {
+        DecodeEmbeddingBinary(binary, reused);
+        sink = sink + reused[0];
+    });
+
+    auto mb_s = [&](double ns) { return body.size() / ns * 1e3; };
+    std::printf("Cuerpo: %zu floats, %zu bytes JSON, %zu bytes binario, %d iteraciones\n",
+                dim, body.size(), binary.size(), iterations);
+    std::printf("%-28s %10.0f ns/op %8.1f MB/s\n", "nlohmann DOM + get<vector>", dom_ns, mb_s(dom_ns));
+    std::printf("%-28s %10.0f ns/op %8.1f MB/s  x%.1f\n", "directo -> std::vector", fast_ns, mb_s(fast_ns), dom_ns / fast_ns);
+    std::printf("%-28s %10.0f ns/op %8.1f MB/s  x%.1f\n", "directo -> buffer propio", buffer_ns, mb_s(buffer_ns), dom_ns / buffer_ns);
+    std::printf("%-28s %10.0f ns/op\n", "binario (float32 LE)", binary_ns);
+    return 0;
+}
@@ -5,17 +5,25 @@
 #include "persistence/repository.h" 
 
 class RagService; 
+class OllamaClient;
 
 class IngestController {
 public:
     // ACTUALIZADO: El constructor ahora pide RAG + Base de Datos
-    IngestController(std::shared_ptr<RagService> rag_service, std::shared_ptr<Repository> db);
+    IngestController(std::shared_ptr<RagService> rag_service, std::shared_ptr<Repository> db,
+                     std::shared_ptr<OllamaClient> llm = nullptr);
 
     void RegisterRoutes(httplib::Server& server);
 
 private:
+    // /metrics, contadores y latencia por ruta y gauges de colas y pools
+    void RegisterMetrics(httplib::Server& server);
+
     std::shared_ptr<RagService> m_rag_service;
     
     // NUEVO: Variable para guardar la conexión a base de datos
     std::shared_ptr<Repository> m_db; 
+
+    // Reparto entre servidores de Ollama (/stats/ollama, /ollama/drain); opcional
+    std::shared_ptr<OllamaClient> m_llm;
 };
\ No newline at end of file
@@ -0,0 +1,97 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+#include "llm/resilience.h"
+
+class CurlMultiLoop;
+
+// Qué sabe servir un servidor de Ollama (un servidor puede tener solo nomic-embed-text cargado)
+enum class BackendRole { Embed, Chat };
+
+struct BackendConfig {
+    std::string url;
+    bool embed = true;
+    bool chat = true;
+    double weight = 1.0;   // Capacidad relativa: una GPU el doble de rápida => 2
+};
+
+// Lista de OLLAMA_HOSTS: "url[=roles[:peso]],..." con roles "embed", "chat" o "embed+chat".
+// Ej.: "http://gpu1:11434=embed+chat,http://gpu2:11434=embed:2". Sin roles sirve ambos.
+std::vector<BackendConfig> ParseBackendList(const std::string& spec);
+
+// Estado de un servidor: peticiones en vuelo, salud (sondeo periódico), breaker y latencias propios.
+// Los fallos de un servidor no abren el breaker de los demás.
+struct Backend {
+    explicit Backend(BackendConfig c) : config(std::move(c)) {}
+
+    bool Serves(BackendRole role) const { return role == BackendRole::Embed ? config.embed : config.chat; }
+    // Peso efectivo: el configurado por el factor de drenaje (0 = no recibe tráfico nuevo)
+    double EffectiveWeight() const { return config.weight * drain.load(); }
+    bool Eligible(BackendRole role) const {
+        return Serves(role) && healthy.load() && EffectiveWeight() > 0 && !breaker.IsOpen();
+    }
+
+    BackendConfig config;
+    std::atomic<int> outstanding{0};
+    std::atomic<bool> healthy{true};    // Optimista hasta que el sondeo diga lo contrario
+    std::atomic<double> drain{1.0};
+    int probe_failures = 0;             // Solo lo toca el hilo del event loop
+    CircuitBreaker breaker;
+    LatencyTracker latency;
+    std::atomic<long> requests{0}, failures{0};
+};
+
+struct BackendStats {
+    std::string url;
+    bool embed = false;
+    bool chat = false;
+    double weight = 0;
+    double drain = 0;
+    bool healthy = false;
+    std::string breaker;
+    int outstanding = 0;
+    long requests = 0;
+    long failures = 0;
+    double p50_ms = 0;
+    double p95_ms = 0;
+};
+
+// Reparto de peticiones entre varios servidores de Ollama.
+// Power-of-two-choices ponderado: se sortean dos candidatos (proporcional al peso) y gana el que
+// tenga menos peticiones en vuelo por unidad de peso. Con un único servidor equivale a no balancear.
+class BackendPool {
+public:
+    explicit BackendPool(std::vector<BackendConfig> configs);
+
+    // Servidor para la siguiente petición, ya admitido por su breaker (el llamante informa del
+    // resultado con OnSuccess/OnFailure). 'avoid' (p. ej. el del intento original en un hedge o un
+    // reintento) solo se elige si no queda otro. nullptr si no hay ninguno disponible.
+    Backend* Pick(BackendRole role, const Backend* avoid = nullptr);
+
+    // ¿Hay algún servidor sano, sin drenar y con el breaker cerrado para este rol?
+    bool Available(BackendRole role) const;
+
+    // Drenaje ponderado: factor 0..1 sobre el peso (0 = sacarlo del reparto sin cortar lo que tiene en vuelo)
+    bool SetDrain(const std::string& url, double factor);
+
+    // Sondea GET /api/version de cada servidor cada 'interval' en el event loop. Tras kProbeFailures
+    // fallos seguidos se marca caído; el primer sondeo correcto lo devuelve al reparto.
+    void StartProbing(CurlMultiLoop& loop, std::chrono::milliseconds interval);
+
+    const std::vector<std::unique_ptr<Backend>>& Backends() const { return m_backends; }
+    std::vector<BackendStats> GetStats() const;
+
+    static constexpr int kProbeFailures = 2;
+
+private:
+    void Probe(CurlMultiLoop& loop, Backend* backend, std::chrono::milliseconds interval);
+
+    std::vector<std::unique_ptr<Backend>> m_backends;
+    std::mutex m_rng_mutex;
+    std::mt19937 m_rng{std::random_device{}()};
+};
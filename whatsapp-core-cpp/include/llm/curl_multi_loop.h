@@ -0,0 +1,96 @@
+#pragma once
+#include <curl/curl.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "llm/http_session_pool.h"
+
+// Resultado de una transferencia asíncrona
+struct HttpResult {
+    long status_code = 0;     // 0 si no hubo respuesta HTTP (timeout, conexión rechazada...)
+    std::string text;         // Cuerpo (vacío si la respuesta se consumió en streaming)
+    std::string error;        // Mensaje de libcurl si falló la transferencia
+    std::string content_type; // Content-Type de la respuesta (vacío si no vino)
+    bool aborted = false;     // El callback de datos pidió cortar
+};
+
+// Event loop de libcurl multi en un único hilo: cientos de peticiones a Ollama en vuelo
+// sin un hilo del SO bloqueado por cada una. Las conexiones quedan abiertas en la caché
+// del multi handle (keep-alive) y se reutilizan entre transferencias.
+//
+// Los callbacks (datos y finalización) se ejecutan EN EL HILO DEL LOOP: deben ser breves
+// y no bloquear, o retrasan todas las demás transferencias.
+class CurlMultiLoop {
+public:
+    using Completion = std::function<void(HttpResult)>;
+    using DataCallback = std::function<bool(std::string_view data)>; // false = abortar
+
+    CurlMultiLoop();
+    ~CurlMultiLoop();
+
+    CurlMultiLoop(const CurlMultiLoop&) = delete;
+    CurlMultiLoop& operator=(const CurlMultiLoop&) = delete;
+
+    // POST JSON no bloqueante. Con on_data el cuerpo se entrega por trozos en vez de en HttpResult::text.
+    // 'done' se llama siempre exactamente una vez (también si el loop se detiene antes de terminar).
+    // 'accept' (opcional) va en la cabecera Accept. Devuelve un ID para Cancel.
+    uint64_t Post(const std::string& url, std::string body, int timeout_ms, Completion done,
+                  DataCallback on_data = nullptr, const std::string& accept = "");
+    // GET no bloqueante (sondeos de salud); mismas garantías que Post
+    uint64_t Get(const std::string& url, int timeout_ms, Completion done);
+
+    // Corta una transferencia en vuelo: su 'done' recibe aborted = true. Sin efecto si ya terminó.
+    void Cancel(uint64_t id);
+
+    // Ejecuta 'fn' en el hilo del loop pasado 'delay' (backoff de reintentos, hedging)
+    void After(std::chrono::milliseconds delay, std::function<void()> fn);
+
+    size_t InFlight() const { return m_in_flight.load(); }
+
+    // HttpResult::error de las transferencias completadas porque el loop se está deteniendo
+    static constexpr const char* kStoppedError = "event loop detenido";
+    // ...y de las cortadas con Cancel
+    static constexpr const char* kCancelledError = "cancelada";
+    HttpStats GetStats() const;
+
+private:
+    struct Transfer;
+
+    uint64_t Enqueue(std::unique_ptr<Transfer> transfer);
+    void Run();
+    // Ejecuta los timers vencidos y devuelve cuánto falta para el siguiente (máx. kPollTimeoutMs)
+    int RunTimers();
+    void Start(std::unique_ptr<Transfer> transfer);
+    void Finish(CURL* easy, CURLcode code);
+    static size_t WriteBody(char* ptr, size_t size, size_t nmemb, void* userdata);
+
+    CURLM* m_multi = nullptr;
+    std::thread m_thread;
+
+    // Cola de entrada (cualquier hilo) -> loop
+    std::deque<std::unique_ptr<Transfer>> m_pending;
+    std::vector<uint64_t> m_cancels;
+    std::multimap<std::chrono::steady_clock::time_point, std::function<void()>> m_timers;
+    std::mutex m_mutex;
+    bool m_stopping = false;
+    uint64_t m_next_id = 1;
+
+    // Solo las toca el hilo del loop
+    std::unordered_map<CURL*, std::unique_ptr<Transfer>> m_active;
+    std::unordered_map<uint64_t, CURL*> m_active_ids;
+    std::vector<CURL*> m_idle_handles;
+
+    std::atomic<size_t> m_in_flight{0};
+    HttpStats m_stats;
+    mutable std::mutex m_stats_mutex;
+};
@@ -0,0 +1,50 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "utils/deadline.h"
+
+class OllamaClient;
+
+// Fuente de embeddings de RagService. La de producción es Ollama (OllamaEmbedder); con
+// HashingEmbedder (llm/hashing_embedder.h) se puede medir ingesta y recuperación sin servidor.
+class Embedder {
+public:
+    using Handler = std::function<void(std::vector<float>)>;
+    // Corta un StartEmbed en vuelo ('done' recibe un vector vacío). Vacío si no hay nada que cortar.
+    using Canceller = std::function<void()>;
+
+    virtual ~Embedder() = default;
+
+    // Bloqueante. Vector vacío si falla.
+    virtual std::vector<float> Embed(const std::string& text, const Deadline& deadline = {}) = 0;
+
+    // No bloqueante: 'done' se llama exactamente una vez, en cualquier hilo (también en el del llamante
+    // si el resultado ya está). Debe ser breve, igual que los handlers de OllamaClient.
+    virtual Canceller StartEmbed(const std::string& text, const Deadline& deadline, Handler done) = 0;
+
+    // false => el backend no está disponible ahora mismo (mejor no encolar trabajo)
+    virtual bool Available() const { return true; }
+
+    virtual int Dimension() const = 0;
+    // Para logs y métricas, p. ej. "ollama:nomic-embed-text" o "hashing:768"
+    virtual std::string Name() const = 0;
+};
+
+// Embeddings de Ollama (hedging, reintentos y reparto entre servidores los pone OllamaClient)
+class OllamaEmbedder : public Embedder {
+public:
+    // 'dimension' es la del modelo configurado en el cliente (768 para nomic-embed-text)
+    OllamaEmbedder(std::shared_ptr<OllamaClient> client, int dimension = 768);
+
+    std::vector<float> Embed(const std::string& text, const Deadline& deadline = {}) override;
+    Canceller StartEmbed(const std::string& text, const Deadline& deadline, Handler done) override;
+    bool Available() const override;
+    int Dimension() const override { return m_dimension; }
+    std::string Name() const override;
+
+private:
+    std::shared_ptr<OllamaClient> m_client;
+    int m_dimension;
+};
@@ -0,0 +1,23 @@
+#pragma once
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+// Decodificación directa de las respuestas de embeddings, sin construir un DOM de nlohmann::json.
+// Una respuesta de nomic-embed-text son ~768 floats en texto (~15 KB): parsearla a json y copiarla
+// a un vector se nota en CPU cuando se indexa mucho. Aquí se salta directamente al array y cada
+// número se convierte con std::from_chars (algoritmo Eisel-Lemire en libstdc++, sin locale).
+
+// Tipo MIME del formato binario: floats IEEE-754 de 32 bits en little-endian, uno detrás de otro.
+// Se ofrece en la cabecera Accept; Ollama lo ignora y sigue respondiendo JSON.
+inline constexpr const char* kEmbeddingBinaryMime = "application/x-float32";
+
+// Busca "embedding": [...] (o el primer vector de "embeddings": [[...]]) y escribe los floats en 'out'.
+// Devuelve cuántos escribió, o -1 si el cuerpo no tiene esa forma o no caben en 'capacity'.
+long DecodeEmbeddingJson(std::string_view body, float* out, size_t capacity);
+
+// Igual, creciendo el vector (reutiliza su capacidad si ya la tenía). false si el formato no encaja.
+bool DecodeEmbeddingJson(std::string_view body, std::vector<float>& out);
+
+// Cuerpo en kEmbeddingBinaryMime. false si la longitud no es múltiplo de 4 bytes.
+bool DecodeEmbeddingBinary(std::string_view body, std::vector<float>& out);
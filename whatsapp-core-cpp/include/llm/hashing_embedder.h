@@ -0,0 +1,25 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+#include "llm/embedder.h"
+
+// Embedder determinista en proceso: feature hashing de n-gramas de caracteres (3 y 4) y de palabras
+// completas en 'dimension' posiciones con signo, normalizado a norma 1. No entiende de semántica,
+// pero textos que comparten palabras quedan cerca, que es lo que necesitan las pruebas de carga y
+// los benchmarks de ingesta/recuperación sin un servidor de modelos. Mismo texto => mismo vector.
+class HashingEmbedder : public Embedder {
+public:
+    explicit HashingEmbedder(int dimension = 768);
+
+    std::vector<float> Embed(const std::string& text, const Deadline& deadline = {}) override;
+    // Se calcula en el hilo del llamante (unos pocos µs) y 'done' se llama antes de volver
+    Canceller StartEmbed(const std::string& text, const Deadline& deadline, Handler done) override;
+    int Dimension() const override { return m_dimension; }
+    std::string Name() const override;
+
+    // Escribe el vector en 'out' (Dimension() floats)
+    void EmbedInto(std::string_view text, float* out) const;
+
+private:
+    int m_dimension;
+};
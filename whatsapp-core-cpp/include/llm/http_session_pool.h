@@ -0,0 +1,70 @@
+#pragma once
+#include <cpr/cpr.h>
+#include <curl/curl.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Tiempos de red hacia Ollama (ms). connect_ms ~ 0 cuando se reutiliza una conexión abierta.
+struct HttpStats {
+    long requests = 0;
+    long new_connections = 0;     // Peticiones que abrieron conexión TCP (el resto reutilizó una keep-alive)
+    long sessions = 0;            // Sesiones creadas (el pool crece hasta la concurrencia máxima vista)
+    double dns_ms_sum = 0;
+    double connect_ms_sum = 0;
+    double total_ms_sum = 0;
+    double last_connect_ms = 0;
+    double last_total_ms = 0;
+};
+
+// Pool de cpr::Session reutilizables. Cada sesión conserva su handle de libcurl y con él
+// la conexión keep-alive; además todas comparten caché DNS y de conexiones (CURLSH),
+// así que un hilo que toma otra sesión tampoco paga TCP ni resolución de nombres.
+class HttpSessionPool {
+public:
+    HttpSessionPool();
+    ~HttpSessionPool();
+
+    HttpSessionPool(const HttpSessionPool&) = delete;
+    HttpSessionPool& operator=(const HttpSessionPool&) = delete;
+
+    // Préstamo RAII de una sesión: un cpr::Session no admite uso concurrente,
+    // así que cada petición en curso tiene la suya y la devuelve al salir de ámbito.
+    class Lease {
+    public:
+        Lease(HttpSessionPool& pool, std::unique_ptr<cpr::Session> session)
+            : m_pool(pool), m_session(std::move(session)) {}
+        ~Lease() { m_pool.Release(std::move(m_session)); }
+
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+        cpr::Session& operator*() const { return *m_session; }
+        cpr::Session* operator->() const { return m_session.get(); }
+
+    private:
+        HttpSessionPool& m_pool;
+        std::unique_ptr<cpr::Session> m_session;
+    };
+
+    Lease Acquire();
+
+    // Apunta los tiempos de la última transferencia de la sesión (llamar tras cada petición)
+    void Record(cpr::Session& session, const cpr::Response& response);
+
+    HttpStats GetStats() const;
+
+private:
+    void Release(std::unique_ptr<cpr::Session> session);
+    std::unique_ptr<cpr::Session> CreateSession();
+
+    static void LockShare(CURL*, curl_lock_data data, curl_lock_access, void* userptr);
+    static void UnlockShare(CURL*, curl_lock_data data, void* userptr);
+
+    CURLSH* m_share = nullptr;
+    std::mutex m_share_mutexes[CURL_LOCK_DATA_LAST];
+
+    std::vector<std::unique_ptr<cpr::Session>> m_idle;
+    mutable std::mutex m_mutex;
+    HttpStats m_stats;
+};
@@ -2,18 +2,203 @@
 #include <string>
 #include <vector>
 #include <optional>
+#include <functional>
+#include <mutex>
+#include <future>
 #include <nlohmann/json.hpp>
+#include "utils/deadline.h"
+#include "llm/http_session_pool.h"
+#include "llm/curl_multi_loop.h"
+#include "llm/resilience.h"
+#include "llm/backend_pool.h"
+#include "llm/embedding_decoder.h"
+#include <atomic>
+
+// Tiempos que Ollama devuelve al terminar una generación (vienen en ns, aquí en ms).
+// prompt_tokens baja cuando el servidor reutiliza la caché KV del prefijo común.
+struct ChatTimings {
+    int prompt_tokens = 0;
+    double prompt_eval_ms = 0;
+    double load_ms = 0;        // > 0 si el modelo estaba descargado y hubo que cargarlo
+    int eval_tokens = 0;
+    double eval_ms = 0;
+    double total_ms = 0;
+};
+
+struct ChatStats {
+    long requests = 0;
+    long cold_loads = 0;       // Peticiones que pagaron carga de modelo
+    double prompt_eval_ms_sum = 0;
+    long prompt_tokens_sum = 0;
+    ChatTimings last;
+    // Media móvil (EWMA) del rendimiento del servidor: sirve para estimar si una generación cabe en el plazo
+    double prompt_tokens_per_s = 0;
+    double eval_tokens_per_s = 0;
+};
+
+// Límites de una generación concreta
+struct GenerationOptions {
+    Deadline deadline;      // Sin plazo => timeout de 60 s como siempre
+    int num_predict = -1;   // -1 = sin límite de tokens de respuesta
+};
+
+// Estado de un endpoint de Ollama (latencias de las peticiones correctas, breaker, reintentos)
+struct EndpointStats {
+    // Con varios servidores: "closed" si todos los del rol están sanos, "degraded" si solo algunos,
+    // "open" si no queda ninguno
+    std::string breaker = "closed";
+    double p50_ms = 0;
+    double p95_ms = 0;
+    double p99_ms = 0;
+    long requests = 0;
+    long failures = 0;       // Intentos fallidos (timeout, conexión, 5xx)
+    long retries = 0;
+    long hedges = 0;         // Peticiones duplicadas lanzadas al pasar el p95
+    long hedge_wins = 0;     // ...que respondieron antes que la original
+    long fast_fails = 0;     // Rechazadas al instante con el breaker abierto
+};
+
+struct ResilienceStats {
+    EndpointStats embeddings;
+    EndpointStats chat;
+};
 
 class OllamaClient {
 public:
     OllamaClient(const std::string& base_url, const std::string& chat_model);    
-    // Convierte texto a vector (Embedding)
-    std::vector<float> GetEmbedding(const std::string& text);
+    // Varios servidores de Ollama: embeddings y chat se reparten entre los que sirven cada rol
+    OllamaClient(std::vector<BackendConfig> backends, const std::string& chat_model);
+    // Convierte texto a vector (Embedding). El timeout es min(10 s, lo que quede del plazo).
+    // Pasa por la capa de resiliencia: hedging tras el p95, reintentos con backoff y circuit breaker.
+    std::vector<float> GetEmbedding(const std::string& text, const Deadline& deadline = {});
     
     // Genera respuesta chat (Contexto + Pregunta)
-    std::optional<std::string> Chat(const std::string& system_prompt, const std::string& user_query);
+    std::optional<std::string> Chat(const std::string& system_prompt, const std::string& user_query,
+                                    const GenerationOptions& gen = {});
+
+    // Versión streaming: consume el NDJSON de Ollama según llega y entrega cada token.
+    // Si on_token devuelve false (cliente desconectado) se aborta la generación.
+    // Devuelve la respuesta completa, o nullopt si hubo error o se abortó.
+    using TokenCallback = std::function<bool(const std::string& token)>;
+    std::optional<std::string> ChatStream(const std::string& system_prompt, const std::string& user_query,
+                                          const TokenCallback& on_token, const GenerationOptions& gen = {});
+
+    // --- API no bloqueante (event loop de libcurl multi, un único hilo para todas las peticiones) ---
+    // El handler se ejecuta en el hilo del event loop: debe ser breve (p. ej. reanudar una corrutina
+    // en otro pool, ver AwaitCallback en utils/executor.h). Igual para on_token en StartChat.
+    using EmbeddingHandler = std::function<void(std::vector<float>)>;
+    using ChatHandler = std::function<void(std::optional<std::string>)>;
+    // Corta la petición en vuelo: el handler recibe el resultado vacío enseguida (si no había terminado ya)
+    using Canceller = std::function<void()>;
+    Canceller StartEmbedding(const std::string& text, const Deadline& deadline, EmbeddingHandler done);
+    // Con on_token la respuesta llega en streaming (igual que ChatStream); sin él, de una vez (como Chat)
+    void StartChat(const std::string& system_prompt, const std::string& user_query, TokenCallback on_token,
+                   const GenerationOptions& gen, ChatHandler done);
+
+    // Lo mismo con futures, para llamantes que no son corrutinas
+    std::future<std::vector<float>> GetEmbeddingAsync(const std::string& text, const Deadline& deadline = {});
+    std::future<std::optional<std::string>> ChatAsync(const std::string& system_prompt, const std::string& user_query,
+                                                      TokenCallback on_token = nullptr, const GenerationOptions& gen = {});
+
+    // Estimación de lo que tardaría una generación con el rendimiento medido hasta ahora
+    double EstimateChatMs(int prompt_tokens, int answer_tokens) const;
+
+    // Tamaño de ventana (num_ctx) que pedimos a Ollama: el presupuesto del prompt sale de aquí
+    int ContextSize() const { return m_num_ctx; }
+
+    // Modelo de embeddings (por defecto "nomic-embed-text"). Su dimensión tiene que coincidir con la
+    // del índice FAISS: cambiarlo obliga a reindexar.
+    void SetEmbeddingModel(const std::string& model) { m_embed_model = model; }
+    const std::string& EmbeddingModel() const { return m_embed_model; }
+
+    // Cuánto tiempo mantiene Ollama el modelo en VRAM tras cada petición ("30m", "-1" = siempre)
+    void SetKeepAlive(const std::string& keep_alive) { m_keep_alive = keep_alive; }
+
+    // Carga los modelos (chat + embeddings) y deja el system prompt en la caché KV.
+    // Pensado para el arranque: la primera pregunta real no paga la carga del 7B.
+    // Con varios servidores calienta cada uno según sus roles.
+    bool WarmUp(const std::string& system_prompt);
+
+    ChatStats GetChatStats() const;
+    // Conexiones nuevas vs. reutilizadas y tiempos de conexión / totales de las peticiones HTTP
+    // (bloqueantes y del event loop)
+    HttpStats GetHttpStats() const;
+    size_t AsyncInFlight() const { return m_loop.InFlight(); }
+
+    // false mientras no quede ningún servidor del rol disponible (caídos, drenados o con el breaker
+    // abierto): mejor no encolar trabajo que va a fallar al instante
+    bool EmbeddingsAvailable() const { return m_backends.Available(BackendRole::Embed); }
+    bool ChatAvailable() const { return m_backends.Available(BackendRole::Chat); }
+    ResilienceStats GetResilienceStats() const;
+
+    // Reparto entre servidores (peticiones en vuelo, salud, drenaje) y drenaje en caliente
+    std::vector<BackendStats> GetBackendStats() const { return m_backends.GetStats(); }
+    bool SetBackendDrain(const std::string& url, double factor) { return m_backends.SetDrain(url, factor); }
 
 private:
-    std::string m_host;
+    // Operación (embeddings o chat): el breaker y la salud son de cada servidor (Backend);
+    // aquí quedan las latencias de la operación (umbral del hedging) y los contadores agregados
+    struct Endpoint {
+        Endpoint(std::string p, BackendRole r, std::string a = "")
+            : path(std::move(p)), role(r), accept(std::move(a)) {}
+        std::string path;
+        BackendRole role;
+        std::string accept;     // Cabecera Accept de las peticiones asíncronas (vacía = la de libcurl)
+        LatencyTracker latency;
+        std::atomic<long> requests{0}, failures{0}, retries{0}, hedges{0}, hedge_wins{0}, fast_fails{0};
+    };
+    // Una llamada asíncrona con sus intentos (definida en el .cpp)
+    struct ResilientCall;
+
+    // POST asíncrono con breaker, reintentos (max_attempts) y, si hedge, duplicado tras el p95
+    Canceller ResilientPost(Endpoint& endpoint, std::string body, int timeout_cap_ms, const Deadline& deadline,
+                       bool hedge, int max_attempts, CurlMultiLoop::Completion done,
+                       CurlMultiLoop::DataCallback on_data = nullptr);
+    EndpointStats SnapshotEndpoint(const Endpoint& endpoint) const;
+
+    // POST JSON bloqueante con una sesión keep-alive del pool (on_data != nullptr => respuesta en streaming).
+    // Va al servidor que toque en el reparto (o a 'pinned'), respeta su breaker y alimenta las
+    // estadísticas, pero no reintenta.
+    cpr::Response Post(Endpoint& endpoint, const std::string& body, int timeout_ms,
+                       const cpr::WriteCallback& on_data = {}, Backend* pinned = nullptr);
+    // Cuenta el resultado de una petición en su servidor (breaker, latencia, fallos)
+    static void RecordBackendResult(Backend& backend, long status_code, bool aborted, bool cancelled, double ms);
+
+    // Parser incremental del NDJSON de /api/chat (definido en el .cpp)
+    class StreamParser;
+
+    nlohmann::json BuildEmbeddingPayload(const std::string& text) const;
+    // Comunes a la versión bloqueante y a la asíncrona
+    // Decodificador directo (JSON o binario según content_type); el DOM de nlohmann solo si no encaja
+    std::vector<float> ParseEmbedding(long status_code, const std::string& text, const std::string& error,
+                                      const std::string& content_type = "") const;
+    std::optional<std::string> ParseChat(long status_code, const std::string& text, const std::string& error);
+    std::optional<std::string> FinishStream(StreamParser& parser, long status_code, const std::string& error);
+
+    nlohmann::json BuildChatPayload(const std::string& system_prompt, const std::string& user_query, bool stream,
+                                    const GenerationOptions& gen = {}) const;
+    // Lee los tiempos del último objeto JSON de Ollama (done: true) y los acumula
+    void RecordTimings(const nlohmann::json& final_chunk);
+
     std::string m_model;
+    std::string m_embed_model = "nomic-embed-text";
+    int m_num_ctx = 8192;
+    std::string m_keep_alive = "30m";
+
+    ChatStats m_stats;
+    mutable std::mutex m_stats_mutex;
+
+    HttpSessionPool m_sessions;
+
+    // Pedimos floats en binario si el servidor los sabe servir; si no, JSON como siempre
+    Endpoint m_embed_endpoint{"/api/embeddings", BackendRole::Embed,
+                              std::string(kEmbeddingBinaryMime) + ", application/json;q=0.9"};
+    Endpoint m_chat_endpoint{"/api/chat", BackendRole::Chat};
+    RetryBudget m_retry_budget;
+
+    // Antes que m_loop: los sondeos de salud pendientes la usan mientras el loop se detiene
+    BackendPool m_backends;
+
+    // El último miembro: se destruye primero y sus callbacks pendientes aún ven el resto del objeto
+    CurlMultiLoop m_loop;
 };
\ No newline at end of file
@@ -0,0 +1,132 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "llm/resilience.h"
+
+// Clases de tráfico hacia Ollama, de más a menos urgente
+enum class RequestClass { Interactive = 0, Live = 1, Backfill = 2 };
+constexpr int kRequestClasses = 3;
+const char* RequestClassName(RequestClass cls);
+
+// Cada operación de Ollama tiene su propio límite de concurrencia
+enum class RequestLane { Embed = 0, Chat = 1 };
+constexpr int kRequestLanes = 2;
+
+struct SchedulerOptions {
+    int embed_concurrency = 16;   // Embeddings en vuelo como máximo (todas las clases)
+    int chat_concurrency = 4;     // Generaciones en vuelo como máximo
+    // Reparto con todas las clases esperando: de cada 13 huecos, 8 interactivos, 4 en vivo y 1 backfill
+    std::array<double, kRequestClasses> weights{8.0, 4.0, 1.0};
+};
+
+struct SchedulerClassStats {
+    std::string name;
+    size_t queued = 0;
+    long submitted = 0;
+    long started = 0;
+    long preempted = 0;       // Backfill cortado en vuelo para dejar sitio (y reencolado)
+    double avg_wait_ms = 0;   // Espera en cola hasta tener hueco
+    double p95_wait_ms = 0;
+    double max_wait_ms = 0;
+};
+
+struct SchedulerLaneStats {
+    std::string name;
+    int concurrency = 0;
+    int running = 0;
+    std::array<SchedulerClassStats, kRequestClasses> classes;
+};
+
+struct SchedulerStats {
+    std::array<SchedulerLaneStats, kRequestLanes> lanes;
+};
+
+// Planificador central de las peticiones a Ollama (entre RagService y el Embedder / OllamaClient).
+// Cada lane admite como mucho 'concurrency' trabajos a la vez; lo que no cabe espera en una cola
+// por clase y los huecos se reparten por weighted fair queuing (stride: cada trabajo avanza el
+// "pase" de su clase 1/peso y sale siempre la clase con el pase más bajo). Así el backfill avanza
+// aunque haya tráfico, pero una pregunta nunca espera detrás de mil embeddings del historial.
+// El backfill además es expropiable: si llega trabajo más urgente con el lane lleno, se cancela
+// un backfill en vuelo (Slot::SetPreempt) y quien lo lanzó lo vuelve a encolar.
+// Crear con std::make_shared: los Slot retienen el planificador.
+class RequestScheduler : public std::enable_shared_from_this<RequestScheduler> {
+public:
+    // Turno concedido. Hay que soltarlo (Release o destruir el último shared_ptr) al terminar.
+    class Slot;
+    using SlotPtr = std::shared_ptr<Slot>;
+    // Arranca el trabajo (no bloqueante). Se ejecuta en el hilo que libera el hueco o en el de Submit.
+    using Job = std::function<void(SlotPtr)>;
+
+    explicit RequestScheduler(SchedulerOptions options = {});
+
+    // front = true: el trabajo vuelve al principio de su cola (reencolado tras una expropiación)
+    void Submit(RequestLane lane, RequestClass cls, Job job, bool front = false);
+
+    SchedulerStats GetStats() const;
+
+private:
+    struct Pending {
+        Job job;
+        std::chrono::steady_clock::time_point queued_at;
+    };
+    struct ClassState {
+        std::deque<Pending> queue;
+        double pass = 0;          // Tiempo virtual de la clase (stride scheduling)
+        long submitted = 0, started = 0, preempted = 0;
+        double wait_ms_sum = 0, wait_ms_max = 0;
+        LatencyTracker wait;
+    };
+    struct LaneState {
+        int concurrency = 1;
+        int running = 0;
+        int preempting = 0;       // Expropiaciones pedidas cuyo hueco aún no se ha liberado
+        double vtime = 0;         // Pase del último trabajo despachado
+        std::array<ClassState, kRequestClasses> classes;
+        std::vector<std::weak_ptr<Slot>> preemptible;
+    };
+
+    // Despacha mientras haya hueco y trabajo en algún lane (sin recursión: ver .cpp)
+    void Dispatch();
+    void Release(Slot& slot);
+    // Con m_mutex tomado: elige un backfill en vuelo para cortarlo y devuelve su cancelación
+    std::function<void()> PreemptLocked(LaneState& lane);
+    void RegisterPreemptible(const SlotPtr& slot);
+
+    SchedulerOptions m_options;
+    mutable std::mutex m_mutex;
+    std::array<LaneState, kRequestLanes> m_lanes;
+};
+
+class RequestScheduler::Slot : public std::enable_shared_from_this<Slot> {
+public:
+    Slot(std::shared_ptr<RequestScheduler> scheduler, RequestLane lane, RequestClass cls)
+        : m_scheduler(std::move(scheduler)), m_lane(lane), m_class(cls) {}
+    ~Slot() { Release(); }
+
+    // Libera el hueco (idempotente). Conviene hacerlo en cuanto acaba la petición, sin esperar
+    // a que se destruya la última copia del callback.
+    void Release();
+
+    // Solo para Backfill: cómo cortar el trabajo en vuelo. Si ya estaba expropiado o liberado no hace nada.
+    void SetPreempt(std::function<void()> cancel);
+    // true => se cortó para dejar sitio: el resultado no vale y hay que volver a encolarlo
+    bool Preempted() const { return m_preempted.load(); }
+
+    RequestClass Class() const { return m_class; }
+
+private:
+    friend class RequestScheduler;
+    std::shared_ptr<RequestScheduler> m_scheduler;
+    RequestLane m_lane;
+    RequestClass m_class;
+    std::function<void()> m_cancel;   // Protegido por el mutex del planificador
+    std::atomic<bool> m_released{false};
+    std::atomic<bool> m_preempted{false};
+};
@@ -0,0 +1,83 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <string>
+
+// Latencias recientes de un endpoint (ventana deslizante de las últimas kWindow peticiones correctas)
+class LatencyTracker {
+public:
+    static constexpr size_t kWindow = 256;
+
+    void Record(double ms);
+    // Percentil 0..1 de la ventana (0 si aún no hay suficientes muestras)
+    double Percentile(double p) const;
+    // p95 cacheado: se recalcula cada pocas muestras, se consulta en cada petición (hedging)
+    double P95() const;
+    size_t Samples() const;
+
+private:
+    mutable std::mutex m_mutex;
+    std::array<double, kWindow> m_samples{};
+    size_t m_count = 0;
+    size_t m_next = 0;
+    double m_p95 = 0;
+};
+
+// Presupuesto de reintentos (y peticiones duplicadas de hedging): cada petición aporta 'ratio'
+// fichas y cada reintento gasta una. Con Ollama caído no multiplicamos la carga por N reintentos.
+class RetryBudget {
+public:
+    explicit RetryBudget(double ratio = 0.1, double min_per_second = 2.0, double max_tokens = 20.0);
+
+    void OnRequest();
+    bool TryWithdraw();
+    // Espera con jitter completo: aleatoria en [0, min(cap, base * 2^intento)]
+    std::chrono::milliseconds Backoff(int attempt);
+
+private:
+    void RefillLocked();
+
+    std::mutex m_mutex;
+    double m_ratio;
+    double m_min_per_second;
+    double m_max_tokens;
+    double m_tokens;
+    std::chrono::steady_clock::time_point m_last_refill;
+    std::mt19937 m_rng{std::random_device{}()};
+};
+
+// Circuit breaker clásico: tras N fallos seguidos deja de llamar durante un tiempo (falla al instante),
+// después deja pasar una única petición de prueba y vuelve a cerrarse si sale bien.
+class CircuitBreaker {
+public:
+    enum class State { Closed, Open, HalfOpen };
+
+    explicit CircuitBreaker(int failure_threshold = 5,
+                            std::chrono::milliseconds open_for = std::chrono::seconds(5),
+                            std::chrono::milliseconds max_open_for = std::chrono::seconds(60));
+
+    // ¿Puede salir una petición? En HalfOpen solo la primera (la de prueba)
+    bool Allow();
+    // Sin efectos: para decidir antes de encolar trabajo (¿merece la pena intentarlo?)
+    bool IsOpen() const;
+    void OnSuccess();
+    void OnFailure();
+    // La petición admitida se canceló sin veredicto (perdedor de un hedge): libera la prueba de HalfOpen
+    void OnCancel();
+
+    State GetState() const;
+    static const char* StateName(State state);
+
+private:
+    mutable std::mutex m_mutex;
+    State m_state = State::Closed;
+    int m_failures = 0;
+    int m_threshold;
+    std::chrono::milliseconds m_base_open_for;
+    std::chrono::milliseconds m_max_open_for;
+    std::chrono::milliseconds m_open_for;   // Crece x2 cada vez que la prueba falla
+    std::chrono::steady_clock::time_point m_opened_at;
+    bool m_probe_in_flight = false;
+};
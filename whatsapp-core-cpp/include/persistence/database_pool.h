@@ -2,9 +2,62 @@
 #include <mariadb/mysql.h>
 #include <queue>
 #include <mutex>
+#include "utils/memory.h"
+
+struct DBPoolStats {
+    size_t idle = 0;      // Conexiones abiertas esperando en el pool
+    size_t in_use = 0;    // Prestadas ahora mismo (incluidas las que se están abriendo)
+    size_t created = 0;   // Abiertas desde el arranque
+    size_t closed = 0;    // Cerradas por trim (límite de memoria) o caídas (ping fallido al prestarlas)
+    size_t result_bytes = 0;   // Resultados de mysql_store_result aún sin liberar
+};
 
 class DBPool {
 public:
+    // Máximo de conexiones abiertas (prestadas + ociosas). Por defecto kDefaultMaxConnections
+    static constexpr size_t kDefaultMaxConnections = 32;
+    static void configure(size_t max_connections);
+
+    // Con el pool lleno espera a que se devuelva una; si no llega en unos segundos, lanza.
+    // Las ociosas se comprueban con mysql_ping antes de prestarlas (si MariaDB las cortó, se reabren)
     static MYSQL* acquire();
     static void release(MYSQL* conn);
+    // Conexión abierta fuera del pool (db_connect en main) que pasa a ser suya: cuenta como creada y ociosa
+    static void adopt(MYSQL* conn);
+    static DBPoolStats stats();
+
+    // Cierra conexiones ociosas hasta dejar 'keep_idle'. Devuelve cuántas cerró.
+    static size_t trim(size_t keep_idle);
+    // +bytes al guardar un resultado en el cliente, -bytes al liberarlo
+    static void track_result(long bytes);
+};
+
+// El pool en /debug/memory: conexiones abiertas (cada MYSQL* guarda su buffer de red, que crece
+// hasta el paquete más grande leído y no vuelve a encoger) y resultados en memoria.
+// Soltar memoria = cerrar conexiones ociosas; las prestadas no se tocan.
+class DBPoolMemory : public MemoryReporter {
+public:
+    // Estimación por conexión: estructura MYSQL + buffer de red de Connector/C
+    static constexpr size_t kConnectionBytes = 32 * 1024;
+
+    MemoryUsage GetMemoryUsage() const override;
+    size_t ReleaseMemory(size_t target_bytes) override;
+};
+
+// Préstamo RAII de una conexión del pool: se devuelve sola al salir de ámbito.
+// Una conexión MYSQL* no admite uso concurrente, así que cada llamada toma la suya.
+class ScopedConnection {
+public:
+    ScopedConnection() : m_conn(DBPool::acquire()) {}
+    ~ScopedConnection() {
+        if (m_conn) DBPool::release(m_conn);
+    }
+
+    ScopedConnection(const ScopedConnection&) = delete;
+    ScopedConnection& operator=(const ScopedConnection&) = delete;
+
+    MYSQL* get() const { return m_conn; }
+
+private:
+    MYSQL* m_conn;
 };
@@ -14,7 +14,11 @@ public:
     void upsert_chat(const nlohmann::json& msg) override;
     void insert_message(const nlohmann::json& msg) override;
     std::string GetMessageContentById(const std::string& id) override;
+    std::optional<DBMessage> GetMessageById(const std::string& id) override;
     std::vector<DBMessage> GetAllMessages(int limit) override;
+    std::vector<DBMessage> GetMessageWindow(const std::string& id, int radius) override;
+    std::vector<std::string> SearchMessagesByText(const std::string& text, int limit) override;
 private:
+    // Conexión inicial: se entrega a DBPool en el constructor (solo se usa para saber si la DB está disponible)
     MYSQL* m_conn;
 };
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 #include <string>
 #include <vector>
+#include <optional>
 #include <nlohmann/json.hpp>
 
 // Estructura simple para mover datos de DB a RAG
@@ -8,6 +9,8 @@ struct DBMessage {
     std::string id;
     std::string sender;
     std::string content;
+    std::string chat_jid;
+    long long timestamp = 0;
 };
 // Interfaz Abstracta
 class Repository {
@@ -21,5 +24,14 @@ public:
 
     // EL NUEVO MÉTODO QUE NECESITAS PARA RAG
     virtual std::string GetMessageContentById(const std::string& id) = 0;
+    // Igual que el anterior pero con chat y timestamp (la caché de respuestas necesita saber el chat)
+    virtual std::optional<DBMessage> GetMessageById(const std::string& id) = 0;
     virtual std::vector<DBMessage> GetAllMessages(int limit = 100) = 0;
+
+    // Conversación alrededor de un mensaje: el propio mensaje y hasta 'radius' mensajes
+    // antes y después en el mismo chat, en orden cronológico. Una sola query sobre (chat_jid, timestamp).
+    virtual std::vector<DBMessage> GetMessageWindow(const std::string& id, int radius) = 0;
+
+    // Búsqueda léxica (LIKE por palabras clave) para complementar a FAISS con nombres, claves, números...
+    virtual std::vector<std::string> SearchMessagesByText(const std::string& text, int limit) = 0;
 };
\ No newline at end of file
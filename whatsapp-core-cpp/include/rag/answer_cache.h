@@ -0,0 +1,85 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <list>
+#include <set>
+#include <mutex>
+#include <optional>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include "utils/memory.h"
+
+// Estadísticas exportadas (GET /stats/cache)
+struct AnswerCacheStats {
+    long hits = 0;
+    long misses = 0;
+    long invalidations = 0;
+    long evictions = 0;    // Expulsadas para cumplir el límite de memoria
+    size_t entries = 0;
+    double saved_ms = 0;   // Tiempo de DB + LLM que nos ahorramos con los aciertos
+    size_t bytes = 0;
+
+    double HitRatio() const {
+        long total = hits + misses;
+        return total > 0 ? static_cast<double>(hits) / total : 0.0;
+    }
+};
+
+// Caché semántica de respuestas para /chat.
+// Clave: embedding de la pregunta (comparado por coseno) + IDs de contexto recuperados.
+// Si la pregunta nueva se parece lo suficiente a una cacheada Y FAISS devuelve exactamente
+// el mismo contexto, reutilizamos la respuesta sin pasar por MariaDB ni por Ollama.
+class AnswerCache : public MemoryReporter {
+public:
+    AnswerCache(size_t capacity = 256, float cosine_threshold = 0.95f);
+
+    std::optional<std::string> Lookup(const std::vector<float>& query_vec,
+                                      const std::vector<std::string>& context_ids);
+
+    // Avanza con cada InvalidateChat. Se lee antes de recuperar el contexto y se pasa a Insert
+    uint64_t Generation() const;
+
+    // cost_ms: lo que costó generar la respuesta (se suma a saved_ms en cada acierto).
+    // generation: la de antes de recuperar el contexto; si alguno de 'chats' recibió mensajes
+    // desde entonces, la respuesta ya nació vieja y no se guarda
+    void Insert(const std::vector<float>& query_vec,
+                const std::vector<std::string>& context_ids,
+                const std::set<std::string>& chats,
+                const std::string& answer,
+                double cost_ms,
+                uint64_t generation);
+
+    // Ha llegado un mensaje nuevo a este chat: las respuestas que lo usaban ya no son fiables
+    void InvalidateChat(const std::string& chat_jid);
+
+    AnswerCacheStats GetStats() const;
+
+    MemoryUsage GetMemoryUsage() const override;
+    // Expulsa por el final del LRU hasta quedar en target_bytes
+    size_t ReleaseMemory(size_t target_bytes) override;
+
+private:
+    struct Entry {
+        std::vector<float> query_vec;  // Normalizado (L2 = 1) para que coseno = producto escalar
+        std::vector<std::string> context_ids;
+        std::set<std::string> chats;
+        std::string answer;
+        double cost_ms = 0;
+    };
+    static size_t EntryBytes(const Entry& entry);
+    // Con m_mutex tomado
+    void PopBack();
+
+    size_t m_capacity;
+    float m_threshold;
+
+    // Orden LRU: el más reciente al principio
+    std::list<Entry> m_entries;
+    AnswerCacheStats m_stats;
+    size_t m_bytes = 0;   // Suma de EntryBytes de m_entries
+    uint64_t m_generation = 0;
+    std::unordered_map<std::string, uint64_t> m_chat_generation;   // chat -> generación de su último mensaje
+    size_t m_generation_bytes = 0;   // Nodos de m_chat_generation (un nodo por chat, no se expulsan)
+    mutable std::mutex m_mutex;
+};
@@ -0,0 +1,46 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <set>
+#include "persistence/repository.h"
+
+// Estimación rápida de tokens (sin cargar el tokenizer de Qwen).
+// Palabras: 1 token cada ~4 caracteres; signos y emojis: 1 token cada uno.
+// Tiende a sobreestimar un poco, que es lo seguro para no desbordar num_ctx.
+int ApproxTokenCount(std::string_view text);
+
+// User prompt de /chat: el contexto y, al final, la pregunta (lo fijo va en el system prompt)
+std::string BuildUserPrompt(const std::string& context, const std::string& question);
+
+struct BuiltContext {
+    std::string text;
+    std::set<std::string> chats;
+    int tokens = 0;
+    int messages = 0;
+    int windows = 0;
+};
+
+// Construye el bloque CONTEXTO del prompt a partir de los hits de FAISS:
+// 1. Cada hit se amplía con sus vecinos del mismo chat (ventana de conversación).
+// 2. Las ventanas que se solapan se fusionan (dos hits seguidos no repiten mensajes).
+// 3. Se rellena por orden de relevancia hasta agotar el presupuesto de tokens.
+class ContextBuilder {
+public:
+    // window: mensajes en orden cronológico que contienen a hit_id. Llamar en orden de relevancia.
+    void AddWindow(std::vector<DBMessage> window, const std::string& hit_id);
+
+    BuiltContext Build(int token_budget) const;
+
+private:
+    struct Window {
+        std::string chat_jid;
+        std::vector<DBMessage> messages;  // Cronológico, sin duplicados
+        std::set<std::string> hit_ids;
+    };
+
+    static bool Overlaps(const Window& a, const Window& b);
+    static void Merge(Window& into, std::vector<DBMessage>&& extra);
+
+    std::vector<Window> m_windows;  // Orden = relevancia del mejor hit que contiene
+};
@@ -0,0 +1,25 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "rag/vector_store.h"
+
+struct ScoredHit {
+    std::string id;
+    float relevance = 0;  // Coseno con la pregunta
+    float score = 0;      // Puntuación MMR con la que se eligió
+};
+
+// Maximal Marginal Relevance: elige k candidatos equilibrando parecido con la pregunta
+// y diferencia con los ya elegidos. Así ocho "ok, nos vemos a las 8" casi iguales
+// no se comen el contexto del prompt.
+//   score = lambda * sim(q, d) - (1 - lambda) * max sim(d, elegidos)
+// Todo en local con los productos escalares SIMD de FAISS: ~n*k productos, microsegundos.
+class MmrReranker {
+public:
+    explicit MmrReranker(float lambda = 0.7f) : m_lambda(lambda) {}
+
+    std::vector<ScoredHit> Rerank(const SearchCandidates& candidates, int k) const;
+
+private:
+    float m_lambda;
+};
@@ -5,30 +5,274 @@
 #include <memory>
 #include <optional>
 #include <mutex>
+#include <functional>
+#include <deque>
+#include <thread>
+#include <condition_variable>
+#include <atomic>
+#include <unordered_set>
+#include <unordered_map>
+#include <stdexcept>
+#include "utils/deadline.h"
+#include "utils/task.h"
+#include "rag/window_chunker.h"
+#include "utils/trace.h"
+#include "utils/memory.h"
 
 // Forward declarations para no incluir todos los headers aquí y compilar más rápido
 class OllamaClient;
+class Embedder;
+class RequestScheduler;
 class VectorStore;
 class Repository; // Asumo que tu clase de DB se llama Repository o MessageDatabase
+class AnswerCache;
+class ThreadPool;
+class SingleFlight;
+struct DBMessage;
+struct AnswerCacheStats;
+struct ChatStats;
+struct HttpStats;
+struct ResilienceStats;
+struct SingleFlightStats;
+struct SchedulerStats;
+struct TransformReport;
+enum class RequestClass;
 
-class RagService {
+// La generación falló cuando el cliente ya había recibido tokens: la respuesta quedó a medias.
+// Solo la lanza Ask con on_token (en streaming hay que avisar al cliente, no dar por buena la mitad).
+class GenerationInterrupted : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Parámetros de recuperación / construcción del prompt
+struct RagOptions {
+    int top_k = 8;                       // Hits que pedimos a FAISS
+    int neighbor_radius = 2;             // Mensajes vecinos (antes y después) por hit
+    int mmr_fetch_k = 32;                // Candidatos que re-ordena MMR para elegir top_k diversos (0 = sin MMR)
+    float mmr_lambda = 0.7f;             // 1 = solo relevancia, 0 = solo diversidad
+    int answer_reserve_tokens = 1024;    // Parte de num_ctx que dejamos libre para la respuesta
+
+    // --- Plazo de /chat (SLO) ---
+    int default_deadline_ms = 0;         // 0 = sin plazo salvo que lo pida la cabecera X-Request-Timeout-Ms
+    int min_answer_tokens = 48;          // Si el plazo no da ni para esto, devolvemos los fragmentos sin LLM
+    int snippet_tokens = 300;            // Tamaño del bloque de fragmentos en la respuesta degradada
+
+    // --- Ejecución concurrente ---
+    int io_threads = 16;                 // Hilos para MariaDB y para reanudar las corrutinas de Ask (Ollama va por el event loop)
+    int lexical_k = 0;                   // Hits extra por búsqueda léxica en MariaDB (0 = desactivada)
+    bool single_flight = true;           // Preguntas idénticas simultáneas comparten una sola generación
+
+    // --- Ingesta ---
+    bool window_ingest = false;          // true: un vector por ventana de conversación en vez de por mensaje
+    WindowOptions window;
+
+    // --- Carga del historial (backfill) ---
+    int history_limit = 1000;            // Mensajes de MariaDB que se indexan al arrancar
+    int backfill_concurrency = 8;        // Embeddings del historial en vuelo a la vez
+
+    // --- Planificador de Ollama (prioridades: /chat > ingesta en vivo > backfill) ---
+    int embed_concurrency = 16;          // Embeddings en vuelo como máximo, de todas las clases
+    int chat_concurrency = 4;            // Generaciones en vuelo como máximo
+};
+
+// Hilos de m_io_pool (MariaDB y reanudación de las corrutinas de Ask)
+struct IoPoolStats {
+    size_t threads = 0;
+    size_t busy = 0;
+    size_t pending = 0;   // Trabajos esperando hilo
+};
+
+// Progreso de la carga del historial (/readyz)
+struct BackfillProgress {
+    std::string state = "pending";   // pending | running | done | failed
+    size_t total = 0;                // Embeddings a calcular (mensajes o ventanas)
+    size_t done = 0;                 // Terminados, bien o mal
+    size_t failed = 0;               // ...de ellos, aparcados en la cola de reintentos
+    double percent = 0;
+    double elapsed_s = 0;
+    double rate_per_s = 0;
+    double eta_s = 0;                // Estimación con el ritmo medio hasta ahora
+    std::string error;
+};
+
+// En /debug/memory, RagService es "ingest_queues": cola de reintentos, historial pendiente de
+// embeber y ventanas de conversación abiertas
+class RagService : public MemoryReporter {
 public:
     RagService(std::shared_ptr<OllamaClient> llm, 
                std::shared_ptr<VectorStore> v_store,
-               std::shared_ptr<Repository> db);
+               std::shared_ptr<Repository> db,
+               std::shared_ptr<AnswerCache> answer_cache = nullptr,
+               RagOptions options = {},
+               std::shared_ptr<Embedder> embedder = nullptr);   // nullptr => embeddings de Ollama (llm)
+    ~RagService();
 
     // 1. INGESTIÓN: Procesa un mensaje nuevo (Lo guarda en FAISS)
-    // Se llama automáticamente cuando llega un mensaje de WhatsApp
-    void IngestMessage(const std::string& msg_id, const std::string& content, const std::string& sender);
+    // Se llama automáticamente cuando llega un mensaje de WhatsApp. No espera al embedding:
+    // el vector entra en FAISS desde el pool de I/O cuando Ollama responde (si falla, a la cola de reintentos).
+    void IngestMessage(const std::string& msg_id, const std::string& content, const std::string& sender,
+                       RequestTrace* trace = nullptr);
+    // Igual, pero conociendo el chat: invalida las respuestas cacheadas que usaban ese chat.
+    // Con window_ingest el mensaje se suma a la ventana abierta de su chat y se indexa la ventana
+    // antes de volver (en orden dentro del chat); con trace, espera, embedding y Upsert dejan su tramo.
+    void IngestMessage(const DBMessage& msg, RequestTrace* trace = nullptr);
 
     // 2. CONSULTA: El usuario hace una pregunta y respondemos con datos
-    std::string Ask(const std::string& question);
+    // Con on_token la respuesta se entrega token a token según la genera el LLM
+    // (si on_token devuelve false se aborta la generación). Siempre devuelve la respuesta completa,
+    // salvo que falle con tokens ya entregados: entonces lanza GenerationInterrupted.
+    // on_token se llama desde el hilo del event loop de OllamaClient: no debe bloquear mucho tiempo.
+    using TokenCallback = std::function<bool(const std::string& token)>;
+    // Con deadline cada etapa recibe solo el tiempo restante; si no cabe una generación completa
+    // se acorta num_predict o, en último caso, se devuelven los fragmentos relevantes sin LLM.
+    // Con trace, cada etapa del pipeline (embedding, búsquedas, contexto, cola y generación del LLM)
+    // deja su tramo; la traza debe vivir hasta que Ask vuelva.
+    // Si ya hay una pregunta idéntica en curso (single-flight), esta se engancha a su generación
+    // en lugar de lanzar otra: recibe los tokens ya emitidos y sigue el stream del líder.
+    // Nota: manda el plazo del líder; el del seguidor solo limita cuánto espera.
+    std::string Ask(const std::string& question, const TokenCallback& on_token = nullptr,
+                    const Deadline& deadline = {}, RequestTrace* trace = nullptr);
+
+    // Versión corrutina: las etapas independientes (embedding + búsqueda léxica, las ventanas de
+    // contexto de cada hit) corren a la vez y ningún hilo del llamante espera a la red.
+    Task<std::string> AskAsync(std::string question, TokenCallback on_token = nullptr, Deadline deadline = {},
+                               RequestTrace* trace = nullptr);
+
+    // Plazo por defecto (RagOptions::default_deadline_ms) para peticiones que no traen el suyo
+    Deadline DefaultDeadline() const;
 
+    // Indexa el historial de MariaDB con hasta backfill_concurrency embeddings en vuelo.
+    // Bloqueante; va con la prioridad más baja del planificador (las preguntas y la ingesta en vivo
+    // pasan delante y pueden cortar sus embeddings en vuelo).
     void LoadHistoryFromDB();
 
+    // Carga el modelo y precalienta la caché KV con el system prompt (llamar al arrancar)
+    void WarmUp();
+
+    // Arranque: lee el historial de MariaDB antes de volver (llamar antes de aceptar /ingest) y deja
+    // warm-up (si warm_up) + embeddings del historial en un hilo propio.
+    // El servidor HTTP puede escuchar mientras tanto; IsReady() pasa a true al terminar.
+    void StartBackgroundLoad(bool warm_up);
+    bool IsReady() const { return m_ready.load(); }
+    BackfillProgress GetBackfillProgress() const;
+
+    // Estadísticas de la caché semántica (hits/misses/latencia ahorrada). Vacías si está desactivada.
+    AnswerCacheStats GetCacheStats() const;
+    // Tiempos de prompt-eval / carga de modelo que reporta Ollama
+    ChatStats GetLlmStats() const;
+    // Conexiones keep-alive hacia Ollama (nuevas vs. reutilizadas, tiempos de conexión)
+    HttpStats GetHttpStats() const;
+    // Latencias por endpoint, breaker, reintentos y hedging de las llamadas a Ollama
+    ResilienceStats GetResilienceStats() const;
+    // Embeddings que fallaron y esperan en la cola de reintentos
+    size_t ParkedEmbeddings() const;
+    // Generaciones reales vs. peticiones que se engancharon a una en curso
+    SingleFlightStats GetSingleFlightStats() const;
+    // Colas del planificador de Ollama: en vuelo por lane, esperas y expropiaciones por clase
+    SchedulerStats GetSchedulerStats() const;
+    // Vectores en FAISS y uso del pool de I/O (/metrics)
+    size_t IndexSize() const;
+    IoPoolStats GetIoPoolStats() const;
+    // Etapa de reducción del índice (PCA / Matryoshka): dimensión activa y recall estimado
+    TransformReport GetTransformReport() const;
+
+    // Nada de esto se puede soltar sin perder mensajes: por encima del límite, presión (ver utils/memory.h)
+    MemoryUsage GetMemoryUsage() const override;
+
 private:
+    Task<void> EmbedQuery(const std::string& question, const Deadline& deadline, std::vector<float>& out,
+                          RequestTrace* trace);
+    Task<void> LexicalSearch(const std::string& question, std::vector<std::string>& out, RequestTrace* trace);
+    Task<void> FetchWindow(const std::string& id, int radius, const Deadline& deadline, std::vector<DBMessage>& out,
+                           RequestTrace* trace, uint64_t parent_span);
+    // Cuerpo de la ingesta por mensaje: encola el embedding y vuelve
+    void IngestAsync(const std::string& msg_id, const std::string& content, const std::string& sender,
+                     const std::string& chat_jid);
+    // Embebe las ventanas indicadas y las sustituye/añade en FAISS (con el candado del chat tomado)
+    void IndexWindows(const std::vector<WindowUpdate>& updates, RequestTrace* trace = nullptr);
+
+    // Embedding a través del planificador. Si la clase es Backfill y lo expropian, se reencola solo:
+    // 'done' recibe siempre el resultado de verdad (vacío = falló).
+    void ScheduleEmbed(RequestClass cls, std::string text, Deadline deadline,
+                       std::function<void(std::vector<float>)> done, bool requeue = false);
+    // Lo mismo, bloqueante
+    std::vector<float> EmbedScheduled(RequestClass cls, const std::string& text);
+
+    // Cola de reintentos: un embedding que falla (Ollama caído, breaker abierto) no se pierde,
+    // se aparca y un hilo lo reintenta cuando Ollama vuelve a responder
+    struct ParkedEmbedding {
+        std::string key;     // ID de mensaje o clave de ventana
+        std::string text;
+        bool upsert = false; // Ventanas: sustituye el vector existente
+        int attempts = 0;
+        size_t Bytes() const { return sizeof(ParkedEmbedding) + StringHeapBytes(key) + StringHeapBytes(text); }
+    };
+    void ParkEmbedding(ParkedEmbedding item);
+    // Con m_window_write_mutex tomado: la ventana se acaba de indexar y su versión aparcada (o la que
+    // esté reintentando RetryParkedLoop) ya es vieja
+    void UnparkEmbedding(const std::string& key);
+    // Hilo de mantenimiento: reintenta la cola y, en modo ventana, cierra las ventanas inactivas
+    void RetryParkedLoop();
+    // Embebe la última versión de las ventanas de chats que se callaron (WindowChunker::FlushIdle)
+    void FlushIdleWindows();
+
+    // Backfill: embeddings del historial con concurrencia acotada (ver LoadHistoryFromDB)
+    struct BackfillItem {
+        std::string key;
+        std::string text;
+        bool upsert = false;   // Ventanas
+        size_t Bytes() const { return sizeof(BackfillItem) + StringHeapBytes(key) + StringHeapBytes(text); }
+    };
+    // Lee el historial de MariaDB y decide qué embeber (en modo ventana, ya pasado por el chunker)
+    std::vector<BackfillItem> SnapshotHistory();
+    // Embebe esos items y marca el servicio como listo
+    void RunHistoryBackfill(std::vector<BackfillItem> items);
+    void RunBackfill(std::vector<BackfillItem> items);
+    void OnBackfillEmbedding(const BackfillItem& item, std::vector<float> embedding);
+
     std::shared_ptr<OllamaClient> m_llm;
+    std::shared_ptr<Embedder> m_embedder;
+    std::shared_ptr<RequestScheduler> m_scheduler;
     std::shared_ptr<VectorStore> m_vec_store;
     std::shared_ptr<Repository> m_db;
+    std::shared_ptr<AnswerCache> m_answer_cache;
+    RagOptions m_options;
+    std::shared_ptr<ThreadPool> m_io_pool;
+    std::unique_ptr<SingleFlight> m_single_flight;   // nullptr si RagOptions::single_flight = false
+    std::unique_ptr<WindowChunker> m_chunker;        // nullptr salvo con RagOptions::window_ingest
+    // Protege el chunker frente a la carga del historial y m_chat_ingest (un candado por chat con
+    // ventanas en curso; se borra cuando nadie espera)
     std::mutex m_ingest_mutex;
+    std::unordered_map<std::string, std::shared_ptr<std::mutex>> m_chat_ingest;
+    // Mensajes en vivo cuyo embedding aún no ha vuelto (el destructor los espera)
+    int m_live_in_flight = 0;
+    std::mutex m_live_mutex;
+    std::condition_variable m_live_cv;
+    // Unpark + Upsert de una ventana, atómico frente a la escritura de un reintento de la misma clave
+    std::mutex m_window_write_mutex;
+
+    std::deque<ParkedEmbedding> m_parked;
+    size_t m_parked_bytes = 0;     // Suma de Bytes() de m_parked (GetMemoryUsage no recorre la cola)
+    std::string m_retrying;            // Ventana que RetryParkedLoop está embebiendo fuera de la cola
+    bool m_retry_superseded = false;   // ... y que la ingesta en vivo ha indexado mientras tanto
+    mutable std::mutex m_parked_mutex;
+    std::condition_variable m_parked_cv;
+    bool m_stopping = false;
+
+    BackfillProgress m_backfill;
+    std::chrono::steady_clock::time_point m_backfill_started;
+    int m_backfill_in_flight = 0;
+    size_t m_backfill_bytes = 0;   // Textos del historial que aún esperan su embedding
+    bool m_backfill_cancel = false;
+    // Ventanas del historial pendientes: si la ingesta en vivo reindexa una antes, la del backfill
+    // (más vieja) ya no se escribe
+    std::unordered_set<std::string> m_backfill_keys;
+    size_t m_backfill_key_bytes = 0;   // Nodos + claves de m_backfill_keys, al insertar y borrar
+    mutable std::mutex m_backfill_mutex;
+    std::condition_variable m_backfill_cv;
+    std::atomic<bool> m_ready{false};
+    std::thread m_backfill_thread;
+
+    std::thread m_retry_thread;   // El último: arranca cuando todo lo demás ya está construido
 };
\ No newline at end of file
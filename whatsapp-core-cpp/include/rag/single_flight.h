@@ -0,0 +1,68 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <unordered_map>
+#include <exception>
+#include "utils/deadline.h"
+
+// Una respuesta en curso que varias peticiones /chat pueden compartir.
+// El líder publica los tokens según los genera Ollama; los seguidores reciben
+// los ya emitidos y después los nuevos, así que también funciona en streaming.
+class InFlightAnswer {
+public:
+    using TokenCallback = std::function<bool(const std::string& token)>;
+
+    void Publish(const std::string& token);
+    void Finish(const std::string& answer);
+    // 'message' es la respuesta de los seguidores; con 'error', los que ya reenviaron tokens a su
+    // cliente lo relanzan en lugar de devolver una respuesta a medias
+    void Fail(const std::string& message, std::exception_ptr error = nullptr);
+
+    // Bloquea al seguidor hasta que el líder termine (o venza su propio plazo).
+    // Devuelve la respuesta completa (o lo generado hasta el plazo).
+    std::string Follow(const TokenCallback& on_token, const Deadline& deadline);
+
+    bool HasFollowers() const;
+
+private:
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::vector<std::string> m_tokens;
+    std::string m_answer;
+    std::exception_ptr m_error;
+    bool m_done = false;
+    int m_followers = 0;
+};
+
+struct SingleFlightStats {
+    long leaders = 0;     // Generaciones reales
+    long followers = 0;   // Peticiones que se engancharon a una en curso
+};
+
+// Agrupa las preguntas idénticas que llegan a la vez: una sola generación por pregunta distinta
+class SingleFlight {
+public:
+    struct Ticket {
+        std::shared_ptr<InFlightAnswer> call;
+        bool leader = false;
+    };
+
+    // Clave: texto normalizado (minúsculas, sin signos, espacios colapsados) + filtros de la consulta.
+    // Hoy Ask no tiene filtros; si se añaden (chat, fechas...) deben entrar en 'filters'.
+    static std::string MakeKey(const std::string& question, const std::string& filters = "");
+
+    Ticket Join(const std::string& key);
+    // El líder la retira al terminar: las preguntas posteriores ya no se enganchan (para eso está la caché)
+    void Leave(const std::string& key, const std::shared_ptr<InFlightAnswer>& call);
+
+    SingleFlightStats GetStats() const;
+
+private:
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::string, std::shared_ptr<InFlightAnswer>> m_calls;
+    SingleFlightStats m_stats;
+};
@@ -3,29 +3,99 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <unordered_map>
 #include <memory>
+#include <random>
+#include <shared_mutex>
+#include "rag/vector_transform.h"
+#include "utils/memory.h"
 
-class VectorStore {
+// Informe de la etapa de reducción (para logs / diagnóstico)
+struct TransformReport {
+    std::string name = "none";
+    int input_dim = 0;
+    int index_dim = 0;        // Dimensión real del índice ahora mismo
+    bool active = false;      // false mientras PCA aún no tiene datos suficientes
+    long trained_at = 0;      // Nº de vectores en el último entrenamiento
+    double recall_at_10 = -1; // Recall estimado frente a la búsqueda exacta sin reducir (-1 = sin medir)
+    double last_train_ms = 0;
+};
+
+// Candidatos de FAISS junto con sus vectores guardados (para re-ranking local, p. ej. MMR)
+struct SearchCandidates {
+    int dim = 0;
+    std::vector<float> query;        // Consulta ya proyectada al espacio del índice
+    std::vector<std::string> ids;
+    std::vector<float> distances;    // L2² que devuelve FAISS
+    std::vector<float> vectors;      // ids.size() * dim, contiguos
+};
+
+class VectorStore : public MemoryReporter {
 public:
     // Ajusta la dimensión según tu modelo (Qwen 0.5b suele ser 1024)
-    VectorStore(int dimension = 1024);
+    // transform (opcional): reduce los vectores antes de indexarlos (PCA / Matryoshka)
+    VectorStore(int dimension = 1024, std::unique_ptr<VectorTransform> transform = nullptr);
     ~VectorStore();
 
-    // Añade un vector asociado a un ID de mensaje de WhatsApp
+    // Añade un vector asociado a un ID de mensaje de WhatsApp (si el ID ya está indexado, no hace nada)
     void AddIndex(const std::string& whatsapp_msg_id, const std::vector<float>& embedding);
 
+    // Como AddIndex, pero si 'key' ya está indexada sustituye su vector en el sitio
+    // (mismo ID de FAISS). Para ventanas de conversación que siguen creciendo.
+    void Upsert(const std::string& key, const std::vector<float>& embedding);
+
     // Busca los IDs de WhatsApp más cercanos
     std::vector<std::string> Search(const std::vector<float>& query_embedding, int k = 5);
+    // Igual, pero devuelve también distancias y una copia de los vectores del índice
+    SearchCandidates SearchWithVectors(const std::vector<float>& query_embedding, int k);
+
+    TransformReport GetTransformReport() const;
+    // Vectores en el índice (las ventanas sustituidas con Upsert cuentan una vez)
+    size_t Size() const;
+
+    // Índice FAISS, mapas de IDs y muestra de entrenamiento. No libera nada bajo presión:
+    // expulsar vectores sería perder mensajes en las respuestas (el freno va en la ingesta)
+    MemoryUsage GetMemoryUsage() const override;
 
     // Persistencia básica
     void Save(const std::string& filepath);
     void Load(const std::string& filepath);
 
 private:
+    // Cuerpo de AddIndex, con m_mutex ya tomado en exclusiva.
+    // Devuelve true si toca reentrenar: el llamador lanza Retrain() después de soltar el candado.
+    bool AddLocked(const std::string& key, const std::vector<float>& embedding);
+
+    // Aplica la transformación (si está activa) a un único vector
+    std::vector<float> Project(const std::vector<float>& embedding) const;
+    bool TransformActive() const;
+
+    // Reservorio de vectores originales: datos de entrenamiento + medición de recall
+    void SampleForTraining(const std::vector<float>& embedding);
+    // Entrena una base nueva y re-proyecta el índice sin el candado exclusivo (solo para el cambio final)
+    void Retrain();
+    void MeasureRecall();
+    // Filas [i0, i0 + n) del índice de vuelta al espacio original, con m_mutex tomado (compartido basta)
+    void ReconstructLocked(long i0, long n, float* out) const;
+
     int m_dimension;
     std::unique_ptr<faiss::IndexFlatL2> m_index;
-    
+
     // Mapa: ID_FAISS (long) -> ID_WHATSAPP (string)
     std::map<long, std::string> m_id_map;
+    std::unordered_map<std::string, long> m_key_to_id;  // Inverso, para Upsert
     long m_current_faiss_id = 0;
-};
\ No newline at end of file
+    size_t m_key_bytes = 0;   // Heap de las claves (string) de los dos mapas, al día en AddLocked
+
+    // --- Reducción de dimensión ---
+    std::unique_ptr<VectorTransform> m_transform;
+    std::vector<float> m_sample;  // Hasta kSampleSize vectores originales (muestreo por reservorio)
+    long m_seen = 0;
+    std::mt19937 m_rng{42};
+    TransformReport m_report;
+    bool m_retraining = false;         // Solo un Retrain a la vez
+    std::vector<long> m_dirty_rows;    // Filas sustituidas con Upsert mientras Retrain re-proyecta
+
+    // Search puede llegar desde /chat mientras se indexa o se reentrena
+    mutable std::shared_mutex m_mutex;
+};
@@ -0,0 +1,74 @@
+#pragma once
+#include <faiss/VectorTransform.h>
+#include <memory>
+#include <string>
+#include <cstddef>
+
+// Etapa opcional delante del índice FAISS: reduce la dimensión de los embeddings
+// (768 en nomic-embed-text) antes de guardarlos o buscarlos.
+// VectorStore aplica SIEMPRE la misma transformación en AddIndex y en Search.
+class VectorTransform {
+public:
+    virtual ~VectorTransform() = default;
+
+    virtual int InputDim() const = 0;
+    virtual int OutputDim() const = 0;
+    virtual std::string Name() const = 0;
+
+    // PCA necesita aprender del corpus; Matryoshka se puede aplicar desde el primer vector
+    virtual bool RequiresTraining() const = 0;
+    virtual bool IsTrained() const = 0;
+    virtual void Train(const float* x, size_t n) = 0;
+
+    // in: n * InputDim() floats -> out: n * OutputDim() floats
+    virtual void Apply(const float* in, size_t n, float* out) const = 0;
+
+    // Reconstrucción aproximada al espacio original (para re-proyectar el índice tras reentrenar)
+    virtual void Reverse(const float* in, size_t n, float* out) const = 0;
+};
+
+// Truncado estilo Matryoshka: nos quedamos con las primeras N componentes y renormalizamos (L2 = 1)
+class MatryoshkaTransform : public VectorTransform {
+public:
+    MatryoshkaTransform(int input_dim, int output_dim);
+
+    int InputDim() const override { return m_input_dim; }
+    int OutputDim() const override { return m_output_dim; }
+    std::string Name() const override { return "matryoshka"; }
+
+    bool RequiresTraining() const override { return false; }
+    bool IsTrained() const override { return true; }
+    void Train(const float*, size_t) override {}
+
+    void Apply(const float* in, size_t n, float* out) const override;
+    void Reverse(const float* in, size_t n, float* out) const override;
+
+private:
+    int m_input_dim;
+    int m_output_dim;
+};
+
+// PCA entrenada sobre los vectores del propio corpus (faiss::PCAMatrix)
+class PcaTransform : public VectorTransform {
+public:
+    PcaTransform(int input_dim, int output_dim);
+
+    int InputDim() const override { return m_input_dim; }
+    int OutputDim() const override { return m_output_dim; }
+    std::string Name() const override { return "pca"; }
+
+    bool RequiresTraining() const override { return true; }
+    bool IsTrained() const override;
+    void Train(const float* x, size_t n) override;
+
+    void Apply(const float* in, size_t n, float* out) const override;
+    void Reverse(const float* in, size_t n, float* out) const override;
+
+private:
+    int m_input_dim;
+    int m_output_dim;
+    std::unique_ptr<faiss::PCAMatrix> m_pca;
+};
+
+// Fábrica: kind = "pca" | "matryoshka". Devuelve nullptr si kind está vacío o es "none".
+std::unique_ptr<VectorTransform> MakeVectorTransform(const std::string& kind, int input_dim, int output_dim);
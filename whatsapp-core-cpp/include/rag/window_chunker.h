@@ -0,0 +1,106 @@
+#pragma once
+#include <chrono>
+#include <deque>
+#include <optional>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include "persistence/repository.h"
+
+// Parámetros de las ventanas de conversación (modo de ingesta RAG_INGEST_MODE=window)
+struct WindowOptions {
+    long long max_gap_seconds = 600;  // Silencio que corta la conversación
+    int max_tokens = 256;             // Tamaño máximo del texto de la ventana
+    int max_messages = 24;
+    int overlap_messages = 1;         // Mensajes finales que se repiten al abrir la siguiente ventana
+    int refresh_every = 4;            // La ventana abierta se re-embebe cada N mensajes nuevos
+    size_t max_tracked_windows = 100000; // Anclas de ventanas cerradas que se recuerdan (se olvidan las más viejas)
+};
+
+// Ventana que hay que (re)embeber y guardar en FAISS con la clave 'key'
+struct WindowUpdate {
+    std::string key;
+    std::string text;       // "sender: content" por línea, en orden cronológico
+    size_t members = 0;
+};
+
+// Mensaje central de una ventana y cuántos mensajes cubre: Ask trae la ventana anclándose en él
+struct WindowAnchor {
+    std::string message_id;
+    size_t members = 0;
+};
+
+struct WindowStats {
+    long messages = 0;      // Mensajes recibidos
+    long windows = 0;       // Ventanas creadas
+    long updates = 0;       // Embeddings pedidos (ventanas nuevas + refrescos de ventanas abiertas)
+};
+
+// Agrupa los mensajes consecutivos de cada chat en ventanas por hueco temporal y tokens.
+// Un único vector por ventana en lugar de uno por mensaje: "ok", "jaja", "👍" dejan de costar
+// una llamada a Ollama y un hueco en el índice cada uno.
+//
+// La ventana de la cola del chat sigue abierta: se refresca (misma clave, vector sustituido)
+// cada refresh_every mensajes y una última vez al cerrarse. Si el chat se calla, FlushIdle la cierra.
+// De una ventana cerrada solo se guarda su ancla, y como mucho max_tracked_windows.
+class WindowChunker {
+public:
+    explicit WindowChunker(WindowOptions options = {});
+
+    // Los mensajes de un chat deben llegar en orden cronológico.
+    // Devuelve las ventanas que hay que embeber ahora (cerradas con cambios pendientes y,
+    // si toca refresco, la ventana abierta de este chat).
+    // refresh_open = false en cargas masivas: la ventana abierta solo se embebe al cerrarse o en Flush.
+    std::vector<WindowUpdate> Add(const DBMessage& msg, bool refresh_open = true);
+
+    // Devuelve todas las ventanas con cambios sin embeber (fin de la carga de historial)
+    std::vector<WindowUpdate> Flush();
+
+    // Cierra las ventanas de los chats sin mensajes nuevos desde hace max_gap_seconds (tiempo de
+    // llegada, no el timestamp del mensaje) y devuelve las que tenían mensajes sin embeber.
+    // Sin esto la última ventana de un chat que se calla no se embebería nunca.
+    std::vector<WindowUpdate> FlushIdle();
+
+    // Ancla de una ventana (nullopt si 'key' no es una clave de ventana o ya se olvidó)
+    std::optional<WindowAnchor> Anchor(const std::string& key) const;
+
+    static bool IsWindowKey(const std::string& key);
+
+    WindowStats GetStats() const;
+
+    // Ventanas abiertas (mensajes completos) + anclas de las cerradas.
+    // Contador mantenido al añadir y cerrar: no recorre nada
+    size_t MemoryBytes() const;
+
+private:
+    struct OpenWindow {
+        std::string key;
+        std::vector<DBMessage> messages;
+        int tokens = 0;
+        int pending = 0;            // Mensajes añadidos desde el último embedding
+        std::chrono::steady_clock::time_point touched;   // Llegada del último mensaje (FlushIdle)
+    };
+
+    static int MessageTokens(const DBMessage& msg);
+    // Heap de una ventana abierta (clave, mensajes); como mucho max_messages mensajes
+    static size_t WindowBytes(const OpenWindow& window);
+    // Guarda el ancla de una ventana que ya no crecerá y olvida las más viejas si sobran
+    void Close(const OpenWindow& window);
+    WindowUpdate MakeUpdate(OpenWindow& window);
+    // Cierra 'window' y la sustituye por la siguiente del chat (con solape si se cortó por tamaño)
+    void OpenNext(const std::string& chat_jid, OpenWindow& window, bool carry_overlap);
+    // Ventanas de otros chats que llevan más de max_gap_seconds en silencio: ya no crecerán
+    void CollectExpired(long long now, const std::string& except_chat, std::vector<WindowUpdate>& out);
+
+    WindowOptions m_options;
+    std::unordered_map<std::string, OpenWindow> m_open;          // chat_jid -> ventana abierta
+    std::unordered_map<std::string, long> m_next_seq;            // chat_jid -> siguiente nº de ventana
+    std::unordered_map<std::string, WindowAnchor> m_anchors;     // clave -> ancla, ventanas cerradas
+    std::deque<std::string> m_anchor_order;                      // Orden de cierre, para olvidar las viejas
+    WindowStats m_stats;
+    size_t m_bytes = 0;             // Nodos y heap de los contenedores, sin los arrays de buckets
+
+    // Ask consulta Anchor mientras la ingesta añade mensajes
+    mutable std::mutex m_mutex;
+};
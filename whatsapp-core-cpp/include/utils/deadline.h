@@ -0,0 +1,45 @@
+#pragma once
+#include <chrono>
+#include <algorithm>
+
+// Plazo absoluto de una petición (reloj monotónico).
+// Se crea una vez al entrar en /chat y cada etapa pide solo lo que queda:
+//   cpr::Timeout{deadline.TimeoutMs(10000)}  => min(10 s, tiempo restante)
+class Deadline {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Sin plazo: las etapas usan sus timeouts de siempre
+    Deadline() = default;
+
+    static Deadline After(std::chrono::milliseconds budget) {
+        Deadline d;
+        d.m_set = true;
+        d.m_at = Clock::now() + budget;
+        return d;
+    }
+
+    bool IsSet() const { return m_set; }
+    bool Expired() const { return m_set && Clock::now() >= m_at; }
+
+    std::chrono::milliseconds Remaining() const {
+        if (!m_set) return std::chrono::milliseconds::max();
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(m_at - Clock::now());
+        return std::max(left, std::chrono::milliseconds(0));
+    }
+
+    long RemainingMs() const {
+        return m_set ? static_cast<long>(Remaining().count()) : -1;
+    }
+
+    // Timeout para una etapa: su propio máximo, recortado a lo que queda del plazo (mínimo 1 ms)
+    int TimeoutMs(int stage_cap_ms) const {
+        if (!m_set) return stage_cap_ms;
+        auto left = std::min<long long>(stage_cap_ms, Remaining().count());
+        return static_cast<int>(std::max<long long>(1, left));
+    }
+
+private:
+    bool m_set = false;
+    Clock::time_point m_at{};
+};
@@ -0,0 +1,112 @@
+#pragma once
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Pool de hilos sencillo que sirve de executor para las corrutinas (utils/task.h)
+class ThreadPool {
+public:
+    ThreadPool(size_t threads, std::string name);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void Post(std::function<void()> fn);
+
+    size_t Size() const { return m_workers.size(); }
+    size_t Pending() const;
+    size_t Busy() const;
+
+    // co_await pool.Schedule(): la corrutina continúa en un hilo del pool
+    auto Schedule() {
+        struct Awaiter {
+            ThreadPool* pool;
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> h) { pool->Post([h] { h.resume(); }); }
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{this};
+    }
+
+private:
+    void WorkerLoop();
+
+    std::string m_name;
+    std::vector<std::thread> m_workers;
+    std::deque<std::function<void()>> m_queue;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    size_t m_busy = 0;
+    bool m_stopping = false;
+};
+
+// co_await Offload(pool, fn): ejecuta una llamada bloqueante (MariaDB, cpr) en 'pool'
+// y reanuda la corrutina en ese mismo hilo con el resultado. El hilo que hizo co_await queda libre.
+template <typename F>
+auto Offload(ThreadPool& pool, F fn) {
+    using R = std::invoke_result_t<F>;
+
+    struct Awaiter {
+        ThreadPool& pool;
+        F fn;
+        std::conditional_t<std::is_void_v<R>, bool, std::optional<R>> result{};
+        std::exception_ptr error;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> h) {
+            pool.Post([this, h] {
+                try {
+                    if constexpr (std::is_void_v<R>) {
+                        fn();
+                    } else {
+                        result.emplace(fn());
+                    }
+                } catch (...) {
+                    error = std::current_exception();
+                }
+                h.resume();
+            });
+        }
+        R await_resume() {
+            if (error) std::rethrow_exception(error);
+            if constexpr (!std::is_void_v<R>) return std::move(*result);
+        }
+    };
+    return Awaiter{pool, std::move(fn)};
+}
+
+// co_await AwaitCallback<T>(pool, [&](std::function<void(T)> resume) { StartAlgo(..., std::move(resume)); })
+// Para APIs asíncronas con callback (p. ej. OllamaClient::StartEmbedding): mientras la operación
+// está en vuelo no se ocupa ningún hilo, y la corrutina se reanuda en 'pool' (no en el hilo que
+// llama al callback, que suele ser un event loop que no debe hacer trabajo pesado).
+template <typename T, typename Start>
+auto AwaitCallback(ThreadPool& pool, Start start) {
+    struct Awaiter {
+        ThreadPool& pool;
+        Start start;
+        std::optional<T> result{};
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> h) {
+            // 'start' puede llamar al callback antes de volver y la corrutina reanudarse (y destruir
+            // este awaiter) en otro hilo: lo sacamos a la pila para no tocar el awaiter después.
+            Start fn = std::move(start);
+            ThreadPool* target = &pool;
+            fn(std::function<void(T)>([this, target, h](T value) {
+                result.emplace(std::move(value));
+                target->Post([h] { h.resume(); });
+            }));
+        }
+        T await_resume() { return std::move(*result); }
+    };
+    return Awaiter{pool, std::move(start)};
+}
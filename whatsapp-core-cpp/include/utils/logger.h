@@ -0,0 +1,81 @@
+#pragma once
+#include <spdlog/spdlog.h>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class MetricCounter;
+
+struct LoggerOptions {
+    std::string level = "info";
+    bool json = false;              // Una línea JSON por log (ts, level, thread, site, msg) en lugar de texto
+    size_t queue_size = 8192;       // Mensajes en cola hacia el hilo que escribe; llena => se pisa el más viejo
+};
+
+// Logger asíncrono: el hilo que loguea solo formatea y encola, un hilo aparte escribe en stdout.
+// Se vuelca cada segundo y en cada warn/error.
+void init_logger(const LoggerOptions& options = {});
+
+// Nivel global en caliente ("trace", "debug", "info", "warn", "error", "critical", "off").
+// Devuelve false si el nombre no es un nivel.
+bool SetLogLevel(const std::string& level);
+std::string GetLogLevel();
+
+// =========================================================================
+// MUESTREO POR SITIO
+// =========================================================================
+// Cada LOG_SAMPLED es un sitio con nombre y sus propios contadores: deja pasar 1 de cada every_n
+// llamadas y, de esas, como mucho per_second por segundo (0 = sin límite). Decidir es un par de
+// atomics; lo descartado ni se formatea y se cuenta en whatsapp_log_suppressed_total{site}.
+struct LogSampling {
+    uint32_t every_n = 1;
+    uint32_t per_second = 0;
+};
+
+struct LogSiteStats {
+    std::string name;
+    LogSampling sampling;
+    uint64_t logged = 0;
+    uint64_t suppressed = 0;
+};
+
+class LogSite {
+public:
+    // Se registra al construirse (un static local por sitio: solo la primera vez)
+    LogSite(const char* name, LogSampling defaults);
+
+    bool ShouldLog();
+    void Configure(LogSampling sampling);
+    LogSiteStats Stats() const;
+    const char* Name() const { return m_name; }
+
+private:
+    const char* m_name;
+    std::atomic<uint32_t> m_every_n;
+    std::atomic<uint32_t> m_per_second;
+    std::atomic<uint64_t> m_calls{0};
+    std::atomic<uint64_t> m_logged{0};
+    std::atomic<int64_t> m_window{0};        // Segundo (reloj monótono) del contador m_in_window
+    std::atomic<uint32_t> m_in_window{0};
+    MetricCounter* m_suppressed;
+};
+
+// Cambia el muestreo de un sitio ("*" = todos), también de los que aún no han logueado nada
+void SetLogSampling(const std::string& site, LogSampling sampling);
+std::vector<LogSiteStats> GetLogSites();
+
+// LOG_SAMPLED("ingest.indexed", 1, 5, spdlog::level::info, "🧠 Mensaje indexado en RAG: {}", id);
+// (every_n y per_second son los valores por defecto del sitio; SetLogSampling los cambia)
+// Con el nivel desactivado no se toca ni el contador del sitio. El nombre del sitio sale en el
+// campo "site" del formato JSON.
+#define LOG_SAMPLED(site, every_n, per_second, level, ...)                                           \
+    do {                                                                                            \
+        if (spdlog::should_log(level)) {                                                            \
+            static LogSite s_log_site(site, LogSampling{every_n, per_second});                      \
+            if (s_log_site.ShouldLog()) {                                                           \
+                spdlog::default_logger_raw()->log(spdlog::source_loc{__FILE__, __LINE__, site},     \
+                                                  level, __VA_ARGS__);                              \
+            }                                                                                       \
+        }                                                                                           \
+    } while (0)
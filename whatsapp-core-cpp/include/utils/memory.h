@@ -0,0 +1,129 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Contabilidad de memoria por componente (GET /debug/memory) y límites blandos.
+// Cada componente grande (índice FAISS, cachés, colas de ingesta, pool de MariaDB) estima lo que
+// ocupa en el heap; junto con el RSS y las cifras de malloc se ve en qué se va la memoria del pod.
+// Con límites configurados, un hilo los vigila: primero se pide a los componentes que suelten
+// memoria (expulsar de cachés, cerrar conexiones ociosas) y, si no basta, se activa la presión
+// (UnderPressure): /ingest responde 503 y el historial deja de cargarse hasta que baje.
+
+struct MemoryUsage {
+    size_t bytes = 0;       // Estimación (contenido + nodos de los contenedores, sin la cabecera de malloc)
+    size_t items = 0;       // Vectores, entradas, conexiones... lo que cuente el componente
+    std::vector<std::pair<std::string, size_t>> parts;   // Desglose opcional ("index", "id_map"...)
+};
+
+// Interfaz común de los componentes que se contabilizan
+class MemoryReporter {
+public:
+    virtual ~MemoryReporter() = default;
+
+    // Debe ser barato (se llama en cada /metrics y en cada pasada del vigilante)
+    virtual MemoryUsage GetMemoryUsage() const = 0;
+
+    // Intenta bajar hasta target_bytes y devuelve lo liberado. Por defecto no puede: si el
+    // componente pasa de su límite, el vigilante lo convierte en presión (backpressure).
+    virtual size_t ReleaseMemory(size_t /*target_bytes*/) { return 0; }
+};
+
+// Bytes de heap de un std::string (0 si cabe en el buffer interno, SSO)
+inline size_t StringHeapBytes(const std::string& s) {
+    static const size_t kInline = std::string().capacity();
+    return s.capacity() > kInline ? s.capacity() + 1 : 0;
+}
+
+// Proceso y asignador (glibc malloc)
+struct AllocatorStats {
+    size_t rss = 0;              // /proc/self/statm
+    size_t heap_in_use = 0;      // mallinfo2: uordblks + hblkhd (bloques entregados, incluido mmap)
+    size_t heap_free = 0;        // fordblks: libre dentro del heap, aún no devuelto al sistema
+    size_t mmapped = 0;          // hblkhd: bloques grandes servidos con mmap (el índice FAISS suele estar aquí)
+    size_t releasable = 0;       // keepcost: lo que malloc_trim puede devolver del final del heap
+    size_t cgroup_limit = 0;     // memory.max del contenedor (0 = sin límite o desconocido)
+};
+AllocatorStats ReadAllocatorStats();
+
+struct MemoryLimits {
+    // Límite blando del proceso (RSS). 0 = 85 % del límite del cgroup si lo hay; si no, sin límite
+    size_t process_soft_limit = 0;
+    std::map<std::string, size_t> components;   // Nombre del componente -> bytes
+    int check_interval_ms = 1000;
+};
+
+// "answer_cache=64,vector_store=4096" (MB por componente)
+std::map<std::string, size_t> ParseMemoryLimits(const std::string& spec);
+
+struct MemoryComponentReport {
+    std::string name;
+    MemoryUsage usage;
+    size_t soft_limit = 0;      // 0 = sin límite propio
+    size_t released = 0;        // Liberado por el vigilante desde el arranque
+};
+
+struct MemoryReport {
+    std::vector<MemoryComponentReport> components;
+    size_t accounted = 0;       // Suma de los componentes
+    AllocatorStats allocator;
+    size_t process_soft_limit = 0;
+    bool pressure = false;
+    std::string pressure_reason;
+    long trims = 0;             // Pasadas del vigilante que liberaron algo o llamaron a malloc_trim
+};
+
+class MemoryAccounting {
+public:
+    ~MemoryAccounting();
+
+    // El orden de registro es el orden en que se pide memoria con el proceso por encima de su límite:
+    // primero lo que más barato es reconstruir (cachés), al final lo que no se puede soltar.
+    // Guarda un weak_ptr: el registro no alarga la vida del componente.
+    void Register(const std::string& name, std::shared_ptr<MemoryReporter> reporter);
+
+    // Fija los límites y arranca el vigilante (si hay alguno)
+    void Configure(const MemoryLimits& limits);
+
+    // Lo consultan /ingest y la carga del historial antes de añadir más datos
+    bool UnderPressure() const { return m_pressure.load(std::memory_order_relaxed); }
+
+    MemoryReport Report() const;
+
+    // Una pasada del vigilante (también se puede llamar a mano)
+    void Enforce();
+
+private:
+    struct Entry {
+        std::string name;
+        std::weak_ptr<MemoryReporter> reporter;
+        size_t released = 0;
+    };
+
+    void MonitorLoop();
+    size_t ProcessLimit() const;
+
+    mutable std::mutex m_mutex;
+    std::vector<Entry> m_entries;
+    MemoryLimits m_limits;
+    std::string m_pressure_reason;
+    long m_trims = 0;
+    std::atomic<bool> m_pressure{false};
+
+    std::mutex m_enforce_mutex;   // Una pasada cada vez (vigilante o llamada manual)
+    std::chrono::steady_clock::time_point m_last_trim;   // Último malloc_trim (con m_enforce_mutex)
+    std::condition_variable m_cv;
+    bool m_stopping = false;
+    std::thread m_thread;
+};
+
+// Registro global del proceso
+MemoryAccounting& Memory();
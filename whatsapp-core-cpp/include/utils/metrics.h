@@ -0,0 +1,146 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Métricas en memoria con exportación en formato de texto de Prometheus (/metrics).
+// Registrar una serie (GetCounter/GetHistogram...) toma un mutex: se hace una vez y se guarda la
+// referencia. Registrar valores no toma ninguno: cada hilo escribe en su propio shard (línea de
+// caché aparte) con atomics relaxed, y los shards solo se suman al exportar.
+
+constexpr size_t kMetricShards = 8;
+// Shard del hilo actual (asignado por turnos la primera vez que el hilo registra algo)
+size_t MetricShard();
+
+using MetricLabels = std::vector<std::pair<std::string, std::string>>;
+
+class MetricCounter {
+public:
+    void Inc(uint64_t n = 1) { m_shards[MetricShard()].value.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t Value() const;
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> value{0};
+    };
+    std::array<Shard, kMetricShards> m_shards;
+};
+
+class MetricGauge {
+public:
+    void Set(double value) { m_value.store(value, std::memory_order_relaxed); }
+    void Add(double delta) { m_value.fetch_add(delta, std::memory_order_relaxed); }
+    double Value() const { return m_value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<double> m_value{0};
+};
+
+// Histograma de latencias estilo HDR: cubos log-lineales en microsegundos (16 sub-cubos por
+// potencia de 2 => error relativo < 6 %) de 1 µs a ~70 min. Registrar = un clz y dos fetch_add.
+// Prometheus recibe los cubos acumulados en los límites fijos de kExportBounds.
+class MetricHistogram {
+public:
+    static constexpr int kSubBits = 4;
+    static constexpr uint64_t kSub = 1ull << kSubBits;
+    static constexpr int kMaxExponent = 32;   // 2^32 µs
+    static constexpr size_t kBuckets = (kMaxExponent - kSubBits + 2) * kSub;
+
+    void ObserveMicros(uint64_t us) {
+        auto& shard = m_shards[MetricShard()];
+        shard.buckets[BucketIndex(us)].fetch_add(1, std::memory_order_relaxed);
+        shard.sum_us.fetch_add(us, std::memory_order_relaxed);
+    }
+    void Observe(std::chrono::steady_clock::duration elapsed) {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+        ObserveMicros(us > 0 ? static_cast<uint64_t>(us) : 0);
+    }
+
+    static size_t BucketIndex(uint64_t us);
+    // Límite superior (exclusivo) del cubo, en µs
+    static uint64_t BucketUpperBound(size_t index);
+
+    struct Snapshot {
+        std::array<uint64_t, kBuckets> buckets{};
+        uint64_t count = 0;
+        double sum_seconds = 0;
+        // Percentil 0..1 (límite superior del cubo donde cae), en segundos
+        double Percentile(double p) const;
+    };
+    Snapshot Collect() const;
+
+private:
+    struct alignas(64) Shard {
+        std::array<std::atomic<uint64_t>, kBuckets> buckets{};
+        std::atomic<uint64_t> sum_us{0};
+    };
+    std::array<Shard, kMetricShards> m_shards;
+};
+
+// Mide desde la construcción hasta la destrucción (o Stop) y lo registra en el histograma
+class ScopedMetricTimer {
+public:
+    explicit ScopedMetricTimer(MetricHistogram& histogram)
+        : m_histogram(&histogram), m_start(std::chrono::steady_clock::now()) {}
+    ~ScopedMetricTimer() { Stop(); }
+
+    ScopedMetricTimer(const ScopedMetricTimer&) = delete;
+    ScopedMetricTimer& operator=(const ScopedMetricTimer&) = delete;
+
+    void Stop() {
+        if (!m_histogram) return;
+        m_histogram->Observe(std::chrono::steady_clock::now() - m_start);
+        m_histogram = nullptr;
+    }
+
+private:
+    MetricHistogram* m_histogram;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+class MetricsRegistry {
+public:
+    // Mismo nombre + etiquetas => misma serie. Las referencias valen toda la vida del registro.
+    MetricCounter& GetCounter(const std::string& name, const std::string& help, const MetricLabels& labels = {});
+    MetricGauge& GetGauge(const std::string& name, const std::string& help, const MetricLabels& labels = {});
+    MetricHistogram& GetHistogram(const std::string& name, const std::string& help, const MetricLabels& labels = {});
+    // Gauge que se lee al exportar (tamaño del índice, colas, uso de pools). 'read' no debe bloquear
+    // mucho: se llama con el mutex del registro tomado. Registrar otra vez la misma serie la sustituye.
+    void AddCallbackGauge(const std::string& name, const std::string& help, const MetricLabels& labels,
+                          std::function<double()> read);
+
+    // Formato de texto de Prometheus (text/plain; version=0.0.4)
+    std::string Render() const;
+
+private:
+    enum class Type { Counter, Gauge, Histogram };
+    struct Series {
+        std::unique_ptr<MetricCounter> counter;
+        std::unique_ptr<MetricGauge> gauge;
+        std::unique_ptr<MetricHistogram> histogram;
+        std::function<double()> read;
+    };
+    struct Family {
+        std::string help;
+        Type type;
+        std::map<std::string, Series> series;   // Clave: etiquetas ya formateadas ({a="b",...})
+    };
+    Series& GetSeries(const std::string& name, const std::string& help, Type type, const MetricLabels& labels);
+
+    mutable std::mutex m_mutex;
+    std::map<std::string, Family> m_families;
+};
+
+// Registro global del proceso
+MetricsRegistry& Metrics();
+
+// Latencia de una etapa de /ingest o /chat: whatsapp_stage_duration_seconds{stage="..."}
+MetricHistogram& StageHistogram(const std::string& stage);
@@ -0,0 +1,204 @@
+#pragma once
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <future>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+// =========================================================================
+// Corrutinas C++20 mínimas para orquestar el pipeline RAG.
+//   Task<T>   : corrutina perezosa (no arranca hasta que alguien hace co_await)
+//   WhenAll   : lanza varias Task<void> a la vez y espera a que terminen todas
+//   SyncWait  : puente para código no-corrutina (handlers de httplib)
+// Para saltar de hilo ver utils/executor.h (Schedule / Offload).
+// =========================================================================
+
+template <typename T>
+class Task;
+
+namespace detail {
+
+struct TaskPromiseBase {
+    std::coroutine_handle<> continuation = std::noop_coroutine();
+    std::exception_ptr exception;
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    // Al terminar saltamos directamente a quien nos esperaba (transferencia simétrica, sin recursión)
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        template <typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+            return h.promise().continuation;
+        }
+        void await_resume() noexcept {}
+    };
+    FinalAwaiter final_suspend() noexcept { return {}; }
+
+    void unhandled_exception() { exception = std::current_exception(); }
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase {
+    std::optional<T> value;
+
+    Task<T> get_return_object();
+    template <typename U>
+    void return_value(U&& v) { value.emplace(std::forward<U>(v)); }
+
+    T take() {
+        if (exception) std::rethrow_exception(exception);
+        return std::move(*value);
+    }
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase {
+    Task<void> get_return_object();
+    void return_void() {}
+
+    void take() {
+        if (exception) std::rethrow_exception(exception);
+    }
+};
+
+// Corrutina "lanzar y olvidar": arranca al crearse y se destruye sola al terminar
+struct Detached {
+    struct promise_type {
+        Detached get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+} // namespace detail
+
+template <typename T = void>
+class Task {
+public:
+    using promise_type = detail::TaskPromise<T>;
+
+    Task(Task&& other) noexcept : m_handle(std::exchange(other.m_handle, {})) {}
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (m_handle) m_handle.destroy();
+            m_handle = std::exchange(other.m_handle, {});
+        }
+        return *this;
+    }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() {
+        if (m_handle) m_handle.destroy();
+    }
+
+    // co_await task: arranca la corrutina y nos reanuda cuando termine
+    bool await_ready() const noexcept { return !m_handle || m_handle.done(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept {
+        m_handle.promise().continuation = caller;
+        return m_handle;
+    }
+    T await_resume() { return m_handle.promise().take(); }
+
+private:
+    friend struct detail::TaskPromise<T>;
+    explicit Task(std::coroutine_handle<promise_type> h) : m_handle(h) {}
+
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+template <typename T>
+Task<T> detail::TaskPromise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> detail::TaskPromise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+// =========================================================================
+// WhenAll: las tareas arrancan a la vez (cada una corre hasta su primer Offload/Schedule)
+// y la corrutina que espera se reanuda en el hilo donde termine la última.
+// Si alguna lanza, se relanza la primera excepción tras esperar a todas.
+// =========================================================================
+namespace detail {
+
+struct WhenAllState {
+    std::atomic<size_t> remaining;
+    std::coroutine_handle<> waiter;
+    std::vector<std::exception_ptr> errors;
+
+    explicit WhenAllState(size_t n) : remaining(n + 1), errors(n) {}
+};
+
+inline Detached RunWhenAllChild(Task<void> task, std::shared_ptr<WhenAllState> state, size_t index) {
+    try {
+        co_await std::move(task);
+    } catch (...) {
+        state->errors[index] = std::current_exception();
+    }
+    if (state->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) state->waiter.resume();
+}
+
+} // namespace detail
+
+class WhenAll {
+public:
+    explicit WhenAll(std::vector<Task<void>> tasks)
+        : m_tasks(std::move(tasks)), m_state(std::make_shared<detail::WhenAllState>(m_tasks.size())) {}
+
+    bool await_ready() const noexcept { return m_tasks.empty(); }
+
+    bool await_suspend(std::coroutine_handle<> waiter) {
+        m_state->waiter = waiter;
+        for (size_t i = 0; i < m_tasks.size(); ++i) {
+            detail::RunWhenAllChild(std::move(m_tasks[i]), m_state, i);
+        }
+        // El contador empieza en n + 1: si todas acabaron ya (síncronas), no llegamos a suspender
+        return m_state->remaining.fetch_sub(1, std::memory_order_acq_rel) != 1;
+    }
+
+    void await_resume() {
+        for (auto& e : m_state->errors) {
+            if (e) std::rethrow_exception(e);
+        }
+    }
+
+private:
+    std::vector<Task<void>> m_tasks;
+    std::shared_ptr<detail::WhenAllState> m_state;
+};
+
+// =========================================================================
+// SyncWait: bloquea el hilo actual hasta que la tarea termina (solo en la frontera con httplib)
+// =========================================================================
+namespace detail {
+
+template <typename T>
+Detached RunIntoPromise(Task<T> task, std::promise<T>& out) {
+    try {
+        if constexpr (std::is_void_v<T>) {
+            co_await std::move(task);
+            out.set_value();
+        } else {
+            out.set_value(co_await std::move(task));
+        }
+    } catch (...) {
+        out.set_exception(std::current_exception());
+    }
+}
+
+} // namespace detail
+
+template <typename T>
+T SyncWait(Task<T> task) {
+    std::promise<T> result;
+    auto future = result.get_future();
+    detail::RunIntoPromise(std::move(task), result);
+    return future.get();
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+class MetricHistogram;
+
+// Trazas por petición: cada etapa de /chat o /ingest deja un tramo (span) medido con reloj
+// monótono. Los tramos que cuelgan de la raíz salen en la cabecera Server-Timing; la traza
+// completa se exporta (si se muestrea) como JSON compatible con OTLP, una línea por traza.
+class RequestTrace {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Attributes = std::vector<std::pair<std::string, std::string>>;
+
+    // 'traceparent' (W3C, opcional): si viene bien formado la traza continúa la del llamante
+    explicit RequestTrace(std::string name, const std::string& traceparent = "");
+
+    // Id para un tramo que aún no ha terminado (para colgarle hijos antes de cerrarlo)
+    uint64_t NewSpanId();
+    uint64_t RootId() const { return m_root_id; }
+
+    // Registra un tramo terminado. parent = 0 => cuelga de la raíz. Se puede llamar desde cualquier hilo.
+    void AddSpan(uint64_t id, std::string name, Clock::time_point start, Clock::time_point end,
+                 uint64_t parent = 0, Attributes attributes = {});
+    void SetAttribute(std::string key, std::string value);
+
+    // "embedding;dur=12.3, faiss_search;dur=0.4, ..., total;dur=85.1" (solo los hijos de la raíz)
+    std::string ServerTiming() const;
+    // Lo mismo en JSON (para el evento final del streaming, cuando las cabeceras ya salieron)
+    nlohmann::json TimingJson() const;
+
+    // Cierra la raíz y, si toca muestrearla, la entrega al exportador. Solo la primera llamada cuenta.
+    void Finish(int http_status);
+
+    double ElapsedMs() const;
+    const std::string& TraceId() const { return m_trace_id; }
+    // ExportTraceServiceRequest de OTLP/JSON con todos los tramos
+    nlohmann::json ToOtlp() const;
+
+private:
+    struct Span {
+        uint64_t id;
+        uint64_t parent;
+        std::string name;
+        Clock::time_point start;
+        Clock::time_point end;
+        Attributes attributes;
+    };
+
+    std::string m_name;
+    std::string m_trace_id;               // 32 hex
+    std::string m_remote_parent;          // 16 hex del traceparent entrante (vacío si no hay)
+    uint64_t m_root_id;
+    Clock::time_point m_start;
+    std::chrono::system_clock::time_point m_start_wall;   // Ancla para pasar a Unix ns al exportar
+    Clock::time_point m_end;
+
+    mutable std::mutex m_mutex;
+    std::vector<Span> m_spans;
+    Attributes m_attributes;
+    bool m_finished = false;
+};
+
+// Tramo RAII: mide desde la construcción hasta End() o el destructor. Con trace == nullptr solo
+// alimenta el histograma (si lo hay), así el mismo código sirve con y sin traza.
+class TraceSpan {
+public:
+    TraceSpan(RequestTrace* trace, std::string name, uint64_t parent = 0, MetricHistogram* histogram = nullptr);
+    TraceSpan(RequestTrace* trace, std::string name, MetricHistogram* histogram)
+        : TraceSpan(trace, std::move(name), 0, histogram) {}
+    ~TraceSpan() { End(); }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    void SetAttribute(std::string key, std::string value);
+    void End();
+    // Para colgar hijos (0 sin traza)
+    uint64_t Id() const { return m_id; }
+
+private:
+    RequestTrace* m_trace;
+    std::string m_name;
+    uint64_t m_id = 0;
+    uint64_t m_parent;
+    MetricHistogram* m_histogram;
+    RequestTrace::Clock::time_point m_start;
+    RequestTrace::Attributes m_attributes;
+    bool m_ended = false;
+};
+
+// Exportación de trazas muestreadas a fichero (OTLP/JSON, una ExportTraceServiceRequest por línea;
+// la lee p. ej. el receiver otlpjsonfile del OpenTelemetry Collector)
+struct TraceOptions {
+    std::string export_path;    // Vacío => no se exporta nada
+    double sample_rate = 0.0;   // Fracción de peticiones que se exportan
+    int slow_ms = 0;            // Además, siempre las que tarden más que esto (0 = desactivado)
+};
+// Llamar una vez al arrancar, antes de servir peticiones
+void ConfigureTracing(const TraceOptions& options);
@@ -1,13 +1,72 @@
 #include "ingest/ingest_controller.h"
 #include "rag/rag_service.h"
+#include "rag/answer_cache.h"
+#include "rag/single_flight.h"
+#include "rag/vector_store.h"
+#include "llm/ollama_client.h"
+#include "llm/request_scheduler.h"
+#include "persistence/database_pool.h"
+#include "utils/metrics.h"
+#include "utils/trace.h"
+#include "utils/logger.h"
+#include "utils/memory.h"
 #include <nlohmann/json.hpp>
 #include <spdlog/spdlog.h>
+#include <unordered_map>
+#include <charconv>
 
 using json = nlohmann::json;
 
+namespace {
+// httplib atiende cada petición entera en un hilo: el pre-routing apunta aquí cuándo empezó
+thread_local std::chrono::steady_clock::time_point t_request_start;
+
+// Series de una ruta, resueltas al registrar: contar una petición no busca nada en el registro
+struct RouteMetrics {
+    MetricCounter* ok = nullptr;            // < 400 (no servimos 1xx/3xx)
+    MetricCounter* client_error = nullptr;  // 4xx
+    MetricCounter* server_error = nullptr;  // 5xx
+    MetricHistogram* latency = nullptr;
+};
+
+RouteMetrics MakeRouteMetrics(const std::string& route) {
+    auto& registry = Metrics();
+    const std::string help = "Peticiones HTTP atendidas por ruta y clase de código";
+    return {
+        &registry.GetCounter("whatsapp_http_requests_total", help, {{"route", route}, {"code", "2xx"}}),
+        &registry.GetCounter("whatsapp_http_requests_total", help, {{"route", route}, {"code", "4xx"}}),
+        &registry.GetCounter("whatsapp_http_requests_total", help, {{"route", route}, {"code", "5xx"}}),
+        &registry.GetHistogram("whatsapp_http_request_duration_seconds",
+                               "Latencia del handler por ruta (en streaming, hasta que empieza la respuesta)",
+                               {{"route", route}})
+    };
+}
+
+// Al salir del handler (por el camino que sea): cabecera Server-Timing y cierre de la traza
+class TraceResponse {
+public:
+    TraceResponse(RequestTrace& trace, httplib::Response& res) : m_trace(&trace), m_res(res) {}
+    ~TraceResponse() {
+        if (!m_trace) return;
+        // httplib deja status en -1 hasta después del handler si nadie lo fijó (=> 200)
+        int status = m_res.status > 0 ? m_res.status : 200;
+        m_trace->Finish(status);
+        m_res.set_header("Server-Timing", m_trace->ServerTiming());
+    }
+
+    // Streaming: la respuesta sigue después del handler y la traza la cierra quien la termine
+    void Release() { m_trace = nullptr; }
+
+private:
+    RequestTrace* m_trace;
+    httplib::Response& m_res;
+};
+}
+
 // ACTUALIZADO: Inicializamos tanto el servicio RAG como la DB
-IngestController::IngestController(std::shared_ptr<RagService> rag_service, std::shared_ptr<Repository> db)
-    : m_rag_service(rag_service), m_db(db) {}
+IngestController::IngestController(std::shared_ptr<RagService> rag_service, std::shared_ptr<Repository> db,
+                                   std::shared_ptr<OllamaClient> llm)
+    : m_rag_service(rag_service), m_db(db), m_llm(llm) {}
 
 void IngestController::RegisterRoutes(httplib::Server& server) {
     
@@ -15,8 +74,24 @@ void IngestController::RegisterRoutes(httplib::Server& server) {
     // RUTA 1: INGESTA (Recibir mensajes de WhatsApp)
     // ==========================================
     server.Post("/ingest", [this](const httplib::Request& req, httplib::Response& res) {
+        static MetricHistogram& s_parse = StageHistogram("json_parse");
+        static MetricHistogram& s_db_write = StageHistogram("db_write");
+        static MetricHistogram& s_rag_ingest = StageHistogram("rag_ingest");
+        // traceparent (W3C): si el bridge de WhatsApp la manda, la traza continúa la suya
+        RequestTrace trace("POST /ingest", req.get_header_value("traceparent"));
+        TraceResponse trace_response(trace, res);
+
+        // Memoria por encima del límite blando: antes de guardar nada, el bridge reintenta luego
+        if (Memory().UnderPressure()) {
+            res.status = 503;
+            res.set_header("Retry-After", "5");
+            res.set_content("Memory pressure", "text/plain");
+            return;
+        }
         try {
+            TraceSpan parse_span(&trace, "json_parse", &s_parse);
             auto j = json::parse(req.body);
+            parse_span.End();
             
             // Extraer datos básicos
             std::string id = j.value("id", "");
@@ -33,18 +108,34 @@ void IngestController::RegisterRoutes(httplib::Server& server) {
             // --- PASO 1: GUARDAR EN BASE DE DATOS SQL (MariaDB) ---
             // Esto asegura que el mensaje persista en disco duro y pueda ser consultado
             
+            TraceSpan db_span(&trace, "db_write", &s_db_write);
             // A. Asegurar que el chat existe
+            TraceSpan chat_span(&trace, "upsert_chat", db_span.Id());
             m_db->upsert_chat(j);
+            chat_span.End();
             
             // B. Insertar el mensaje
+            TraceSpan insert_span(&trace, "insert_message", db_span.Id());
             m_db->insert_message(j);
+            insert_span.End();
+            db_span.End();
             
-            spdlog::info("💾 Mensaje guardado en MariaDB: {}", id);
+            LOG_SAMPLED("ingest.saved", 1, 5, spdlog::level::info, "💾 Mensaje guardado en MariaDB: {}", id);
             // ------------------------------------------------------
 
             // --- PASO 2: INDEXAR EN IA (RAG) ---
             // Esto guarda el vector en FAISS para búsquedas semánticas
-            m_rag_service->IngestMessage(id, content, sender);
+            DBMessage msg;
+            msg.id = id;
+            msg.content = content;
+            msg.sender = sender;
+            msg.chat_jid = j.value("chat_jid", "");
+            msg.timestamp = j.value("timestamp", 0LL);
+            // Sin tramo propio: en modo ventana sus etapas (ingest_wait, embedding, index_upsert) cuelgan de la
+            // raíz; por mensaje solo se encola el embedding y FAISS se escribe después
+            ScopedMetricTimer rag_timer(s_rag_ingest);
+            m_rag_service->IngestMessage(msg, &trace);
+            rag_timer.Stop();
 
             res.set_content("Ack", "text/plain");
             
@@ -59,8 +150,14 @@ void IngestController::RegisterRoutes(httplib::Server& server) {
     // RUTA 2: CHAT (Preguntar a la IA)
     // ==========================================
     server.Post("/chat", [this](const httplib::Request& req, httplib::Response& res) {
+        static MetricHistogram& s_parse = StageHistogram("json_parse");
+        // shared_ptr: en streaming la traza sigue viva en el content provider
+        auto trace = std::make_shared<RequestTrace>("POST /chat", req.get_header_value("traceparent"));
+        TraceResponse trace_response(*trace, res);
         try {
+            TraceSpan parse_span(trace.get(), "json_parse", &s_parse);
             auto j = json::parse(req.body);
+            parse_span.End();
             std::string query = j.value("query", "");
 
             if (query.empty()) {
@@ -69,8 +166,58 @@ void IngestController::RegisterRoutes(httplib::Server& server) {
                 return;
             }
 
+            // Plazo de la petición: cabecera X-Request-Timeout-Ms o el configurado por defecto
+            Deadline deadline = m_rag_service->DefaultDeadline();
+            if (req.has_header("X-Request-Timeout-Ms")) {
+                // Entero positivo y nada más: "abc", "10s" o "-5" son un error del cliente, no un 500
+                std::string header = req.get_header_value("X-Request-Timeout-Ms");
+                long budget_ms = 0;
+                auto [end, ec] = std::from_chars(header.data(), header.data() + header.size(), budget_ms);
+                if (ec != std::errc() || end != header.data() + header.size() || budget_ms <= 0) {
+                    res.status = 400;
+                    res.set_content("Invalid X-Request-Timeout-Ms", "text/plain");
+                    return;
+                }
+                deadline = Deadline::After(std::chrono::milliseconds(budget_ms));
+            }
+
+            // Modo streaming (Server-Sent Events): {"stream": true} o "Accept: text/event-stream".
+            // El primer byte sale con el primer token en vez de esperar a la generación completa.
+            bool stream = j.value("stream", false) ||
+                          req.get_header_value("Accept").find("text/event-stream") != std::string::npos;
+            if (stream) {
+                trace_response.Release();
+                res.set_header("Cache-Control", "no-cache");
+                res.set_chunked_content_provider("text/event-stream",
+                    [this, query, deadline, trace](size_t, httplib::DataSink& sink) {
+                        // Las cabeceras (200) ya salieron: un fallo a mitad solo se puede contar con un evento
+                        std::string error;
+                        try {
+                            m_rag_service->Ask(query, [&sink](const std::string& token) {
+                                std::string event = "data: " + json{{"token", token}}.dump() + "\n\n";
+                                // false => el cliente se ha ido y dejamos de generar
+                                return sink.write(event.data(), event.size());
+                            }, deadline, trace.get());
+                        } catch (const GenerationInterrupted& e) {
+                            error = e.what();
+                        } catch (const std::exception& e) {
+                            spdlog::error("Error en chat endpoint (streaming): {}", e.what());
+                            error = "Error interno procesando la pregunta.";
+                        }
+                        // Los tiempos van en el evento final
+                        trace->Finish(error.empty() ? 200 : 500);
+                        json payload = {{"server_timing", trace->TimingJson()}};
+                        if (!error.empty()) payload["error"] = error;
+                        std::string last = (error.empty() ? "event: done\ndata: " : "event: error\ndata: ") + payload.dump() + "\n\n";
+                        sink.write(last.data(), last.size());
+                        sink.done();
+                        return true;
+                    });
+                return;
+            }
+
             // Preguntar al servicio RAG
-            std::string answer = m_rag_service->Ask(query);
+            std::string answer = m_rag_service->Ask(query, nullptr, deadline, trace.get());
 
             json response_json = {
                 {"status", "success"},
@@ -84,4 +231,329 @@ void IngestController::RegisterRoutes(httplib::Server& server) {
             res.set_content("Internal Server Error", "text/plain");
         }
     });
-}
\ No newline at end of file
+
+    // ==========================================
+    // RUTA 3: ESTADÍSTICAS DE LA CACHÉ DE RESPUESTAS
+    // ==========================================
+    server.Get("/stats/cache", [this](const httplib::Request&, httplib::Response& res) {
+        auto stats = m_rag_service->GetCacheStats();
+        json response_json = {
+            {"hits", stats.hits},
+            {"misses", stats.misses},
+            {"hit_ratio", stats.HitRatio()},
+            {"entries", stats.entries},
+            {"invalidations", stats.invalidations},
+            {"evictions", stats.evictions},
+            {"bytes", stats.bytes},
+            {"saved_ms", stats.saved_ms}
+        };
+        res.set_content(response_json.dump(), "application/json");
+    });
+
+    // ==========================================
+    // RUTA 4: TIEMPOS DEL LLM (prompt-eval, cargas de modelo)
+    // ==========================================
+    server.Get("/stats/llm", [this](const httplib::Request&, httplib::Response& res) {
+        auto stats = m_rag_service->GetLlmStats();
+        auto flights = m_rag_service->GetSingleFlightStats();
+        auto http = m_rag_service->GetHttpStats();
+        auto resilience = m_rag_service->GetResilienceStats();
+        auto scheduler = m_rag_service->GetSchedulerStats();
+        auto transform = m_rag_service->GetTransformReport();
+        auto endpoint_json = [](const EndpointStats& e) {
+            return json{
+                {"breaker", e.breaker},
+                {"p50_ms", e.p50_ms}, {"p95_ms", e.p95_ms}, {"p99_ms", e.p99_ms},
+                {"requests", e.requests}, {"failures", e.failures}, {"retries", e.retries},
+                {"hedges", e.hedges}, {"hedge_wins", e.hedge_wins}, {"fast_fails", e.fast_fails}
+            };
+        };
+        json response_json = {
+            {"requests", stats.requests},
+            {"coalesced", flights.followers},
+            {"cold_loads", stats.cold_loads},
+            {"avg_prompt_eval_ms", stats.requests ? stats.prompt_eval_ms_sum / stats.requests : 0.0},
+            {"avg_prompt_tokens", stats.requests ? static_cast<double>(stats.prompt_tokens_sum) / stats.requests : 0.0},
+            {"last", {
+                {"prompt_tokens", stats.last.prompt_tokens},
+                {"prompt_eval_ms", stats.last.prompt_eval_ms},
+                {"load_ms", stats.last.load_ms},
+                {"eval_tokens", stats.last.eval_tokens},
+                {"eval_ms", stats.last.eval_ms}
+            }},
+            {"http", {
+                {"requests", http.requests},
+                {"new_connections", http.new_connections},
+                {"sessions", http.sessions},
+                {"avg_dns_ms", http.requests ? http.dns_ms_sum / http.requests : 0.0},
+                {"avg_connect_ms", http.requests ? http.connect_ms_sum / http.requests : 0.0},
+                {"avg_total_ms", http.requests ? http.total_ms_sum / http.requests : 0.0},
+                {"last_connect_ms", http.last_connect_ms},
+                {"last_total_ms", http.last_total_ms}
+            }},
+            {"resilience", {
+                {"embeddings", endpoint_json(resilience.embeddings)},
+                {"chat", endpoint_json(resilience.chat)},
+                {"parked_embeddings", m_rag_service->ParkedEmbeddings()}
+            }},
+            // Reducción del índice: recall@10 frente a la búsqueda exacta (-1 = aún sin medir)
+            {"index", {
+                {"vectors", m_rag_service->IndexSize()},
+                {"transform", transform.name},
+                {"active", transform.active},
+                {"input_dim", transform.input_dim},
+                {"index_dim", transform.index_dim},
+                {"trained_at", transform.trained_at},
+                {"recall_at_10", transform.recall_at_10},
+                {"last_train_ms", transform.last_train_ms}
+            }}
+        };
+        // Planificador: por lane (embeddings / chat) y clase, cuánto se espera en cola por un hueco
+        for (const auto& lane : scheduler.lanes) {
+            json classes = json::object();
+            for (const auto& c : lane.classes) {
+                classes[c.name] = {
+                    {"queued", c.queued}, {"submitted", c.submitted}, {"started", c.started},
+                    {"preempted", c.preempted}, {"avg_wait_ms", c.avg_wait_ms},
+                    {"p95_wait_ms", c.p95_wait_ms}, {"max_wait_ms", c.max_wait_ms}
+                };
+            }
+            response_json["scheduler"][lane.name] = {
+                {"concurrency", lane.concurrency}, {"running", lane.running}, {"classes", classes}
+            };
+        }
+        res.set_content(response_json.dump(), "application/json");
+    });
+
+    // ==========================================
+    // RUTA 5: SONDAS (Kubernetes / gateway)
+    // ==========================================
+    // Vivo: el proceso atiende HTTP (aunque el índice aún se esté cargando)
+    server.Get("/healthz", [](const httplib::Request&, httplib::Response& res) {
+        res.set_content(json{{"status", "ok"}}.dump(), "application/json");
+    });
+
+    // Listo: warm-up hecho e historial indexado. 503 con el progreso mientras tanto
+    server.Get("/readyz", [this](const httplib::Request&, httplib::Response& res) {
+        auto progress = m_rag_service->GetBackfillProgress();
+        json body = {
+            {"ready", m_rag_service->IsReady()},
+            {"state", progress.state},
+            {"progress", {
+                {"percent", progress.percent},
+                {"done", progress.done},
+                {"total", progress.total},
+                {"failed", progress.failed},
+                {"elapsed_s", progress.elapsed_s},
+                {"rate_per_s", progress.rate_per_s},
+                {"eta_s", progress.eta_s}
+            }}
+        };
+        if (!progress.error.empty()) body["error"] = progress.error;
+        if (!m_rag_service->IsReady()) res.status = 503;
+        res.set_content(body.dump(), "application/json");
+    });
+
+    // ==========================================
+    // RUTA 6: MÉTRICAS (Prometheus)
+    // ==========================================
+    RegisterMetrics(server);
+
+    // ==========================================
+    // RUTA 7: NIVEL Y MUESTREO DE LOGS (en caliente)
+    // ==========================================
+    server.Get("/debug/log", [](const httplib::Request&, httplib::Response& res) {
+        json sites = json::array();
+        for (const auto& site : GetLogSites()) {
+            sites.push_back({
+                {"site", site.name}, {"every_n", site.sampling.every_n}, {"per_second", site.sampling.per_second},
+                {"logged", site.logged}, {"suppressed", site.suppressed}
+            });
+        }
+        res.set_content(json{{"level", GetLogLevel()}, {"sites", sites}}.dump(), "application/json");
+    });
+
+    // {"level": "debug", "sites": {"rag.indexed": {"every_n": 10, "per_second": 0}, "*": {...}}}
+    server.Post("/debug/log", [](const httplib::Request& req, httplib::Response& res) {
+        try {
+            auto j = json::parse(req.body);
+            if (j.contains("level") && !SetLogLevel(j["level"].get<std::string>())) {
+                res.status = 400;
+                res.set_content("Unknown level", "text/plain");
+                return;
+            }
+            if (j.contains("sites")) {
+                for (const auto& [site, sampling] : j["sites"].items()) {
+                    SetLogSampling(site, {sampling.value("every_n", 1u), sampling.value("per_second", 0u)});
+                }
+            }
+            spdlog::warn("🔧 Logs: nivel {} ({} sitios con muestreo)", GetLogLevel(), GetLogSites().size());
+            res.set_content("Ack", "text/plain");
+        } catch (const std::exception& e) {
+            spdlog::error("Error en /debug/log: {}", e.what());
+            res.status = 400;
+            res.set_content("Invalid JSON", "text/plain");
+        }
+    });
+
+    // ==========================================
+    // RUTA 8: MEMORIA POR COMPONENTE Y DEL ASIGNADOR
+    // ==========================================
+    // "unaccounted" = RSS menos lo que declaran los componentes: librerías, pilas de hilos,
+    // fragmentación de malloc y lo que aún no tiene contabilidad propia
+    server.Get("/debug/memory", [](const httplib::Request&, httplib::Response& res) {
+        auto report = Memory().Report();
+        json components = json::array();
+        for (const auto& c : report.components) {
+            json parts = json::object();
+            for (const auto& [name, bytes] : c.usage.parts) parts[name] = bytes;
+            components.push_back({
+                {"name", c.name}, {"bytes", c.usage.bytes}, {"items", c.usage.items}, {"parts", parts},
+                {"soft_limit", c.soft_limit}, {"released", c.released}
+            });
+        }
+        const auto& a = report.allocator;
+        json body = {
+            {"process", {
+                {"rss", a.rss}, {"soft_limit", report.process_soft_limit}, {"cgroup_limit", a.cgroup_limit},
+                {"pressure", report.pressure}, {"pressure_reason", report.pressure_reason}, {"trims", report.trims}
+            }},
+            {"allocator", {
+                {"heap_in_use", a.heap_in_use}, {"heap_free", a.heap_free},
+                {"mmapped", a.mmapped}, {"releasable", a.releasable}
+            }},
+            {"accounted", report.accounted},
+            {"unaccounted", a.rss > report.accounted ? a.rss - report.accounted : 0},
+            {"components", components}
+        };
+        res.set_content(body.dump(), "application/json");
+    });
+
+    if (!m_llm) return;
+
+    // ==========================================
+    // RUTA 9: SERVIDORES DE OLLAMA (reparto, salud, drenaje)
+    // ==========================================
+    server.Get("/stats/ollama", [this](const httplib::Request&, httplib::Response& res) {
+        json backends = json::array();
+        for (const auto& b : m_llm->GetBackendStats()) {
+            backends.push_back({
+                {"url", b.url}, {"embed", b.embed}, {"chat", b.chat},
+                {"weight", b.weight}, {"drain", b.drain}, {"healthy", b.healthy}, {"breaker", b.breaker},
+                {"outstanding", b.outstanding}, {"requests", b.requests}, {"failures", b.failures},
+                {"p50_ms", b.p50_ms}, {"p95_ms", b.p95_ms}
+            });
+        }
+        res.set_content(json{{"backends", backends}}.dump(), "application/json");
+    });
+
+    // {"url": "http://gpu2:11434", "factor": 0} saca un servidor del reparto sin cortar lo que tiene en vuelo;
+    // "factor": 1 lo devuelve con su peso completo
+    server.Post("/ollama/drain", [this](const httplib::Request& req, httplib::Response& res) {
+        try {
+            auto j = json::parse(req.body);
+            std::string url = j.value("url", "");
+            double factor = j.value("factor", 0.0);
+            if (!m_llm->SetBackendDrain(url, factor)) {
+                res.status = 404;
+                res.set_content("Unknown backend", "text/plain");
+                return;
+            }
+            res.set_content("Ack", "text/plain");
+        } catch (const std::exception& e) {
+            spdlog::error("Error en drain endpoint: {}", e.what());
+            res.status = 400;
+            res.set_content("Invalid JSON", "text/plain");
+        }
+    });
+}
+void IngestController::RegisterMetrics(httplib::Server& server) {
+    // Peticiones y latencia por ruta. Las rutas desconocidas van todas a "other" (sin cardinalidad libre)
+    auto routes = std::make_shared<std::unordered_map<std::string, RouteMetrics>>();
+    for (const char* route : {"/ingest", "/chat", "/stats/cache", "/stats/llm", "/healthz", "/readyz",
+                              "/metrics", "/debug/log", "/debug/memory", "/stats/ollama", "/ollama/drain"}) {
+        (*routes)[route] = MakeRouteMetrics(route);
+    }
+    auto other = std::make_shared<RouteMetrics>(MakeRouteMetrics("other"));
+
+    server.set_pre_routing_handler([](const httplib::Request&, httplib::Response&) {
+        t_request_start = std::chrono::steady_clock::now();
+        return httplib::Server::HandlerResponse::Unhandled;
+    });
+    server.set_post_routing_handler([routes, other](const httplib::Request& req, httplib::Response& res) {
+        auto it = routes->find(req.path);
+        const RouteMetrics& route = it != routes->end() ? it->second : *other;
+        if (res.status >= 500) {
+            route.server_error->Inc();
+        } else if (res.status >= 400) {
+            route.client_error->Inc();
+        } else {
+            route.ok->Inc();
+        }
+        route.latency->Observe(std::chrono::steady_clock::now() - t_request_start);
+    });
+
+    // Gauges que se leen al exportar: índice, colas y uso de pools
+    auto& registry = Metrics();
+    auto rag = m_rag_service;
+    registry.AddCallbackGauge("whatsapp_index_vectors", "Vectores en el índice FAISS", {},
+                              [rag] { return static_cast<double>(rag->IndexSize()); });
+    registry.AddCallbackGauge("whatsapp_index_dimensions", "Dimensión de los vectores guardados en FAISS", {},
+                              [rag] { return static_cast<double>(rag->GetTransformReport().index_dim); });
+    registry.AddCallbackGauge("whatsapp_index_recall_at_10", "Recall@10 estimado de la reducción frente a la búsqueda exacta (-1 = sin medir)", {},
+                              [rag] { return rag->GetTransformReport().recall_at_10; });
+    registry.AddCallbackGauge("whatsapp_parked_embeddings", "Embeddings en la cola de reintentos", {},
+                              [rag] { return static_cast<double>(rag->ParkedEmbeddings()); });
+    registry.AddCallbackGauge("whatsapp_backfill_pending", "Embeddings del historial por calcular", {}, [rag] {
+        auto progress = rag->GetBackfillProgress();
+        return static_cast<double>(progress.total - progress.done);
+    });
+
+    for (int l = 0; l < kRequestLanes; ++l) {
+        const std::string lane = l == static_cast<int>(RequestLane::Embed) ? "embeddings" : "chat";
+        registry.AddCallbackGauge("whatsapp_scheduler_running", "Peticiones a Ollama en vuelo por lane", {{"lane", lane}},
+                                  [rag, l] { return static_cast<double>(rag->GetSchedulerStats().lanes[l].running); });
+        registry.AddCallbackGauge("whatsapp_scheduler_concurrency", "Límite de peticiones en vuelo por lane", {{"lane", lane}},
+                                  [rag, l] { return static_cast<double>(rag->GetSchedulerStats().lanes[l].concurrency); });
+        for (int c = 0; c < kRequestClasses; ++c) {
+            registry.AddCallbackGauge("whatsapp_scheduler_queued", "Peticiones esperando hueco en el planificador",
+                                      {{"lane", lane}, {"class", RequestClassName(static_cast<RequestClass>(c))}},
+                                      [rag, l, c] { return static_cast<double>(rag->GetSchedulerStats().lanes[l].classes[c].queued); });
+        }
+    }
+
+    registry.AddCallbackGauge("whatsapp_io_pool_threads", "Hilos del pool de I/O de RagService", {{"state", "busy"}},
+                              [rag] { return static_cast<double>(rag->GetIoPoolStats().busy); });
+    registry.AddCallbackGauge("whatsapp_io_pool_threads", "Hilos del pool de I/O de RagService", {{"state", "total"}},
+                              [rag] { return static_cast<double>(rag->GetIoPoolStats().threads); });
+    registry.AddCallbackGauge("whatsapp_io_pool_queued", "Trabajos esperando hilo en el pool de I/O", {},
+                              [rag] { return static_cast<double>(rag->GetIoPoolStats().pending); });
+    registry.AddCallbackGauge("whatsapp_db_connections", "Conexiones a MariaDB del pool", {{"state", "in_use"}},
+                              [] { return static_cast<double>(DBPool::stats().in_use); });
+    registry.AddCallbackGauge("whatsapp_db_connections", "Conexiones a MariaDB del pool", {{"state", "idle"}},
+                              [] { return static_cast<double>(DBPool::stats().idle); });
+
+    if (m_llm) {
+        auto llm = m_llm;
+        registry.AddCallbackGauge("whatsapp_ollama_in_flight", "Peticiones HTTP a Ollama en el event loop", {},
+                                  [llm] { return static_cast<double>(llm->AsyncInFlight()); });
+        for (const auto& backend : llm->GetBackendStats()) {
+            auto read = [llm, url = backend.url](auto field) {
+                return [llm, url, field] {
+                    for (const auto& b : llm->GetBackendStats()) {
+                        if (b.url == url) return static_cast<double>(field(b));
+                    }
+                    return 0.0;
+                };
+            };
+            registry.AddCallbackGauge("whatsapp_ollama_backend_outstanding", "Peticiones en vuelo por servidor de Ollama",
+                                      {{"url", backend.url}}, read([](const BackendStats& b) { return b.outstanding; }));
+            registry.AddCallbackGauge("whatsapp_ollama_backend_healthy", "1 si el sondeo de salud del servidor responde",
+                                      {{"url", backend.url}}, read([](const BackendStats& b) { return b.healthy ? 1 : 0; }));
+        }
+    }
+
+    server.Get("/metrics", [](const httplib::Request&, httplib::Response& res) {
+        res.set_content(Metrics().Render(), "text/plain; version=0.0.4");
+    });
+}
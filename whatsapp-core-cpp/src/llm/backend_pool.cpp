@@ -0,0 +1,167 @@
+#include "llm/backend_pool.h"
+#include "llm/curl_multi_loop.h"
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+#include <spdlog/spdlog.h>
+
+namespace {
+// El sondeo solo comprueba que el servidor contesta: /api/version no toca ningún modelo
+constexpr int kProbeTimeoutMs = 2000;
+
+std::string Trim(const std::string& s) {
+    size_t first = s.find_first_not_of(" \t");
+    if (first == std::string::npos) return "";
+    size_t last = s.find_last_not_of(" \t");
+    return s.substr(first, last - first + 1);
+}
+}
+
+std::vector<BackendConfig> ParseBackendList(const std::string& spec) {
+    std::vector<BackendConfig> configs;
+    std::stringstream items(spec);
+    std::string item;
+    while (std::getline(items, item, ',')) {
+        item = Trim(item);
+        if (item.empty()) continue;
+
+        BackendConfig config;
+        size_t eq = item.find('=');
+        config.url = Trim(item.substr(0, eq));
+        while (!config.url.empty() && config.url.back() == '/') config.url.pop_back();
+        if (eq != std::string::npos) {
+            // La URL lleva ':' (puerto), así que el peso solo se busca detrás del '='
+            std::string options = item.substr(eq + 1);
+            size_t colon = options.find(':');
+            if (colon != std::string::npos) {
+                double weight = std::strtod(options.c_str() + colon + 1, nullptr);
+                if (weight > 0) config.weight = weight;
+                options.resize(colon);
+            }
+            if (!Trim(options).empty()) {
+                config.embed = options.find("embed") != std::string::npos;
+                config.chat = options.find("chat") != std::string::npos;
+            }
+        }
+        if (config.url.empty() || (!config.embed && !config.chat)) {
+            spdlog::warn("⚠️ OLLAMA_HOSTS: entrada ignorada '{}'", item);
+            continue;
+        }
+        configs.push_back(std::move(config));
+    }
+    return configs;
+}
+
+BackendPool::BackendPool(std::vector<BackendConfig> configs) {
+    for (auto& config : configs) m_backends.push_back(std::make_unique<Backend>(std::move(config)));
+}
+
+Backend* BackendPool::Pick(BackendRole role, const Backend* avoid) {
+    std::vector<Backend*> candidates;
+    for (const auto& backend : m_backends) {
+        if (backend->Eligible(role)) candidates.push_back(backend.get());
+    }
+    // El que hay que evitar solo vale como último recurso
+    if (avoid && candidates.size() > 1) {
+        auto it = std::find(candidates.begin(), candidates.end(), avoid);
+        if (it != candidates.end()) candidates.erase(it);
+    }
+
+    while (!candidates.empty()) {
+        Backend* chosen = candidates.front();
+        if (candidates.size() > 1) {
+            // Dos sorteos sin reemplazo, proporcionales al peso efectivo
+            auto draw = [&](const Backend* skip) {
+                double total = 0;
+                for (Backend* b : candidates) if (b != skip) total += b->EffectiveWeight();
+                std::uniform_real_distribution<double> dist(0.0, total);
+                double r;
+                {
+                    std::lock_guard<std::mutex> lock(m_rng_mutex);
+                    r = dist(m_rng);
+                }
+                Backend* last = nullptr;
+                for (Backend* b : candidates) {
+                    if (b == skip) continue;
+                    last = b;
+                    r -= b->EffectiveWeight();
+                    if (r <= 0) return b;
+                }
+                return last;
+            };
+            Backend* first = draw(nullptr);
+            Backend* second = draw(first);
+            // Menos peticiones en vuelo por unidad de peso; +1 para que el peso cuente también en vacío
+            auto load = [](const Backend* b) { return (b->outstanding.load() + 1) / b->EffectiveWeight(); };
+            chosen = load(second) < load(first) ? second : first;
+        }
+        if (chosen->breaker.Allow()) return chosen;
+        // Breaker a medio abrir con su petición de prueba ya en vuelo: probamos con otro
+        candidates.erase(std::find(candidates.begin(), candidates.end(), chosen));
+    }
+    return nullptr;
+}
+
+bool BackendPool::Available(BackendRole role) const {
+    return std::any_of(m_backends.begin(), m_backends.end(),
+                       [role](const auto& backend) { return backend->Eligible(role); });
+}
+
+bool BackendPool::SetDrain(const std::string& url, double factor) {
+    factor = std::clamp(factor, 0.0, 1.0);
+    for (const auto& backend : m_backends) {
+        if (backend->config.url != url) continue;
+        backend->drain = factor;
+        spdlog::info("🚰 Ollama {}: peso {:.2f} x {:.2f}{}", url, backend->config.weight, factor,
+                     factor == 0 ? " (drenando, sin tráfico nuevo)" : "");
+        return true;
+    }
+    return false;
+}
+
+void BackendPool::StartProbing(CurlMultiLoop& loop, std::chrono::milliseconds interval) {
+    for (const auto& backend : m_backends) {
+        Backend* b = backend.get();
+        loop.After(interval, [this, &loop, b, interval] { Probe(loop, b, interval); });
+    }
+}
+
+void BackendPool::Probe(CurlMultiLoop& loop, Backend* backend, std::chrono::milliseconds interval) {
+    loop.Get(backend->config.url + "/api/version", kProbeTimeoutMs,
+        [this, &loop, backend, interval](HttpResult result) {
+            // El loop se está deteniendo: no se reprograma
+            if (result.error == CurlMultiLoop::kStoppedError) return;
+
+            if (result.status_code == 200) {
+                backend->probe_failures = 0;
+                if (!backend->healthy.exchange(true)) {
+                    spdlog::info("💚 Ollama {} responde de nuevo: vuelve al reparto", backend->config.url);
+                }
+            } else if (++backend->probe_failures >= kProbeFailures && backend->healthy.exchange(false)) {
+                spdlog::warn("💔 Ollama {} no responde al sondeo ({}): fuera del reparto", backend->config.url,
+                             result.error.empty() ? std::to_string(result.status_code) : result.error);
+            }
+            loop.After(interval, [this, &loop, backend, interval] { Probe(loop, backend, interval); });
+        });
+}
+
+std::vector<BackendStats> BackendPool::GetStats() const {
+    std::vector<BackendStats> stats;
+    for (const auto& backend : m_backends) {
+        BackendStats s;
+        s.url = backend->config.url;
+        s.embed = backend->config.embed;
+        s.chat = backend->config.chat;
+        s.weight = backend->config.weight;
+        s.drain = backend->drain;
+        s.healthy = backend->healthy;
+        s.breaker = CircuitBreaker::StateName(backend->breaker.GetState());
+        s.outstanding = backend->outstanding;
+        s.requests = backend->requests;
+        s.failures = backend->failures;
+        s.p50_ms = backend->latency.Percentile(0.50);
+        s.p95_ms = backend->latency.Percentile(0.95);
+        stats.push_back(std::move(s));
+    }
+    return stats;
+}
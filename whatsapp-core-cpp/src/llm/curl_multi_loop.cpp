@@ -0,0 +1,286 @@
+#include "llm/curl_multi_loop.h"
+#include <spdlog/spdlog.h>
+
+namespace {
+// Conexiones abiertas que conserva el multi handle para reutilizar
+constexpr long kMaxCachedConnections = 64;
+// Handles easy ociosos que guardamos (curl_easy_reset es más barato que init + cleanup)
+constexpr size_t kMaxIdleHandles = 64;
+// Espera máxima de curl_multi_poll sin actividad (curl_multi_wakeup la interrumpe antes)
+constexpr int kPollTimeoutMs = 1000;
+}
+
+struct CurlMultiLoop::Transfer {
+    uint64_t id = 0;
+    CURL* easy = nullptr;
+    std::string url;
+    std::string body;
+    int timeout_ms = 0;
+    bool get = false;
+    std::string accept;
+    curl_slist* headers = nullptr;
+    Completion done;
+    DataCallback on_data;
+    HttpResult result;
+    char error_buffer[CURL_ERROR_SIZE] = {0};
+};
+
+CurlMultiLoop::CurlMultiLoop() {
+    m_multi = curl_multi_init();
+    curl_multi_setopt(m_multi, CURLMOPT_MAXCONNECTS, kMaxCachedConnections);
+    m_thread = std::thread([this] { Run(); });
+}
+
+CurlMultiLoop::~CurlMultiLoop() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    curl_multi_wakeup(m_multi);
+    m_thread.join();
+    for (CURL* easy : m_idle_handles) curl_easy_cleanup(easy);
+    curl_multi_cleanup(m_multi);
+}
+
+uint64_t CurlMultiLoop::Post(const std::string& url, std::string body, int timeout_ms, Completion done,
+                             DataCallback on_data, const std::string& accept) {
+    auto transfer = std::make_unique<Transfer>();
+    transfer->url = url;
+    transfer->body = std::move(body);
+    transfer->accept = accept;
+    transfer->timeout_ms = timeout_ms;
+    transfer->done = std::move(done);
+    transfer->on_data = std::move(on_data);
+    return Enqueue(std::move(transfer));
+}
+
+uint64_t CurlMultiLoop::Get(const std::string& url, int timeout_ms, Completion done) {
+    auto transfer = std::make_unique<Transfer>();
+    transfer->url = url;
+    transfer->get = true;
+    transfer->timeout_ms = timeout_ms;
+    transfer->done = std::move(done);
+    return Enqueue(std::move(transfer));
+}
+
+uint64_t CurlMultiLoop::Enqueue(std::unique_ptr<Transfer> transfer) {
+    uint64_t id = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_stopping) {
+            id = m_next_id++;
+            transfer->id = id;
+            m_pending.push_back(std::move(transfer));
+            m_in_flight++;
+        }
+    }
+    // Loop detenido: se completa aquí mismo con error para no dejar a nadie esperando
+    if (transfer) {
+        transfer->result.error = kStoppedError;
+        transfer->done(std::move(transfer->result));
+        return 0;
+    }
+    curl_multi_wakeup(m_multi);
+    return id;
+}
+
+void CurlMultiLoop::Cancel(uint64_t id) {
+    if (id == 0) return;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_cancels.push_back(id);
+    }
+    curl_multi_wakeup(m_multi);
+}
+
+void CurlMultiLoop::After(std::chrono::milliseconds delay, std::function<void()> fn) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_timers.emplace(std::chrono::steady_clock::now() + delay, std::move(fn));
+    }
+    curl_multi_wakeup(m_multi);
+}
+
+int CurlMultiLoop::RunTimers() {
+    for (;;) {
+        std::function<void()> fn;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_timers.empty()) return kPollTimeoutMs;
+            auto first = m_timers.begin();
+            auto now = std::chrono::steady_clock::now();
+            if (first->first > now) {
+                auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(first->first - now).count() + 1;
+                return static_cast<int>(std::min<long long>(wait, kPollTimeoutMs));
+            }
+            fn = std::move(first->second);
+            m_timers.erase(first);
+        }
+        try {
+            fn();
+        } catch (const std::exception& e) {
+            spdlog::error("CurlMultiLoop: excepción en un timer: {}", e.what());
+        }
+    }
+}
+
+size_t CurlMultiLoop::WriteBody(char* ptr, size_t size, size_t nmemb, void* userdata) {
+    auto* transfer = static_cast<Transfer*>(userdata);
+    size_t n = size * nmemb;
+    if (!transfer->on_data) {
+        transfer->result.text.append(ptr, n);
+        return n;
+    }
+    if (!transfer->on_data(std::string_view(ptr, n))) {
+        transfer->result.aborted = true;
+        return 0; // Devolver menos de n corta la transferencia
+    }
+    return n;
+}
+
+void CurlMultiLoop::Start(std::unique_ptr<Transfer> transfer) {
+    CURL* easy;
+    if (!m_idle_handles.empty()) {
+        easy = m_idle_handles.back();
+        m_idle_handles.pop_back();
+    } else {
+        easy = curl_easy_init();
+    }
+    transfer->easy = easy;
+
+    curl_easy_setopt(easy, CURLOPT_URL, transfer->url.c_str());
+    if (transfer->get) {
+        curl_easy_setopt(easy, CURLOPT_HTTPGET, 1L);
+    } else {
+        transfer->headers = curl_slist_append(nullptr, "Content-Type: application/json");
+        if (!transfer->accept.empty()) {
+            transfer->headers = curl_slist_append(transfer->headers, ("Accept: " + transfer->accept).c_str());
+        }
+        curl_easy_setopt(easy, CURLOPT_HTTPHEADER, transfer->headers);
+        curl_easy_setopt(easy, CURLOPT_POSTFIELDS, transfer->body.data());
+        curl_easy_setopt(easy, CURLOPT_POSTFIELDSIZE_LARGE, static_cast<curl_off_t>(transfer->body.size()));
+    }
+    curl_easy_setopt(easy, CURLOPT_TIMEOUT_MS, static_cast<long>(transfer->timeout_ms));
+    curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, &CurlMultiLoop::WriteBody);
+    curl_easy_setopt(easy, CURLOPT_WRITEDATA, transfer.get());
+    curl_easy_setopt(easy, CURLOPT_ERRORBUFFER, transfer->error_buffer);
+    curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(easy, CURLOPT_TCP_KEEPALIVE, 1L);
+
+    curl_multi_add_handle(m_multi, easy);
+    m_active_ids.emplace(transfer->id, easy);
+    m_active.emplace(easy, std::move(transfer));
+}
+
+void CurlMultiLoop::Finish(CURL* easy, CURLcode code) {
+    auto node = m_active.extract(easy);
+    if (node.empty()) return;
+    auto& transfer = node.mapped();
+    m_active_ids.erase(transfer->id);
+
+    curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &transfer->result.status_code);
+    char* content_type = nullptr;
+    curl_easy_getinfo(easy, CURLINFO_CONTENT_TYPE, &content_type);
+    if (content_type) transfer->result.content_type = content_type;
+    if (code != CURLE_OK && !transfer->result.aborted && transfer->result.error.empty()) {
+        transfer->result.error = transfer->error_buffer[0] ? transfer->error_buffer : curl_easy_strerror(code);
+    }
+
+    curl_off_t dns_us = 0, connect_us = 0, total_us = 0;
+    long connects = 0;
+    curl_easy_getinfo(easy, CURLINFO_NAMELOOKUP_TIME_T, &dns_us);
+    curl_easy_getinfo(easy, CURLINFO_CONNECT_TIME_T, &connect_us);
+    curl_easy_getinfo(easy, CURLINFO_TOTAL_TIME_T, &total_us);
+    curl_easy_getinfo(easy, CURLINFO_NUM_CONNECTS, &connects);
+    {
+        std::lock_guard<std::mutex> lock(m_stats_mutex);
+        m_stats.requests++;
+        m_stats.new_connections += connects;
+        m_stats.dns_ms_sum += dns_us / 1000.0;
+        m_stats.connect_ms_sum += connect_us / 1000.0;
+        m_stats.total_ms_sum += total_us / 1000.0;
+        m_stats.last_connect_ms = connect_us / 1000.0;
+        m_stats.last_total_ms = total_us / 1000.0;
+    }
+
+    curl_multi_remove_handle(m_multi, easy);
+    curl_slist_free_all(transfer->headers);
+    // La conexión sigue en la caché del multi handle aunque reseteemos el easy
+    curl_easy_reset(easy);
+    if (m_idle_handles.size() < kMaxIdleHandles) {
+        m_idle_handles.push_back(easy);
+    } else {
+        curl_easy_cleanup(easy);
+    }
+
+    m_in_flight--;
+    try {
+        transfer->done(std::move(transfer->result));
+    } catch (const std::exception& e) {
+        spdlog::error("CurlMultiLoop: excepción en el callback de finalización: {}", e.what());
+    }
+}
+
+void CurlMultiLoop::Run() {
+    for (;;) {
+        std::deque<std::unique_ptr<Transfer>> incoming;
+        std::vector<uint64_t> cancels;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_stopping) break;
+            incoming.swap(m_pending);
+            cancels.swap(m_cancels);
+        }
+        for (auto& transfer : incoming) Start(std::move(transfer));
+        for (uint64_t id : cancels) {
+            auto it = m_active_ids.find(id);
+            if (it == m_active_ids.end()) continue;
+            CURL* easy = it->second;
+            auto& transfer = m_active[easy];
+            transfer->result.aborted = true;
+            transfer->result.error = kCancelledError;
+            Finish(easy, CURLE_ABORTED_BY_CALLBACK);
+        }
+
+        int running = 0;
+        curl_multi_perform(m_multi, &running);
+
+        int queued = 0;
+        while (CURLMsg* msg = curl_multi_info_read(m_multi, &queued)) {
+            if (msg->msg == CURLMSG_DONE) Finish(msg->easy_handle, msg->data.result);
+        }
+
+        int timeout_ms = RunTimers();
+        curl_multi_poll(m_multi, nullptr, 0, timeout_ms, nullptr);
+    }
+
+    // Parada: los timers pendientes se ejecutan ya (si relanzan una petición, Post la completa con
+    // error al momento) y todo lo que quedaba en vuelo o en cola termina con error
+    std::multimap<std::chrono::steady_clock::time_point, std::function<void()>> timers;
+    std::deque<std::unique_ptr<Transfer>> leftover;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        timers.swap(m_timers);
+    }
+    for (auto& [when, fn] : timers) fn();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        leftover.swap(m_pending);
+    }
+    for (auto& transfer : leftover) {
+        m_in_flight--;
+        transfer->result.error = kStoppedError;
+        transfer->done(std::move(transfer->result));
+    }
+    std::vector<CURL*> active;
+    for (auto& [easy, transfer] : m_active) {
+        transfer->result.error = kStoppedError;
+        active.push_back(easy);
+    }
+    for (CURL* easy : active) Finish(easy, CURLE_ABORTED_BY_CALLBACK);
+}
+
+HttpStats CurlMultiLoop::GetStats() const {
+    std::lock_guard<std::mutex> lock(m_stats_mutex);
+    return m_stats;
+}
@@ -0,0 +1,21 @@
+#include "llm/embedder.h"
+#include "llm/ollama_client.h"
+
+OllamaEmbedder::OllamaEmbedder(std::shared_ptr<OllamaClient> client, int dimension)
+    : m_client(std::move(client)), m_dimension(dimension) {}
+
+std::vector<float> OllamaEmbedder::Embed(const std::string& text, const Deadline& deadline) {
+    return m_client->GetEmbedding(text, deadline);
+}
+
+Embedder::Canceller OllamaEmbedder::StartEmbed(const std::string& text, const Deadline& deadline, Handler done) {
+    return m_client->StartEmbedding(text, deadline, std::move(done));
+}
+
+bool OllamaEmbedder::Available() const {
+    return m_client->EmbeddingsAvailable();
+}
+
+std::string OllamaEmbedder::Name() const {
+    return "ollama:" + m_client->EmbeddingModel();
+}
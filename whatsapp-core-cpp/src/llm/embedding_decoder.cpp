@@ -0,0 +1,88 @@
+#include "llm/embedding_decoder.h"
+#include <bit>
+#include <charconv>
+#include <cstring>
+
+// El formato binario viaja en little-endian y se copia tal cual
+static_assert(std::endian::native == std::endian::little, "DecodeEmbeddingBinary asume un host little-endian");
+
+namespace {
+// Dimensión habitual (nomic-embed-text): evita realojar el vector mientras se llena
+constexpr size_t kTypicalDim = 768;
+
+const char* SkipSpace(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) ++p;
+    return p;
+}
+
+// Posición del primer número del vector de embedding, o nullptr si no está
+const char* FindArray(std::string_view body, const char* end) {
+    // "embedding" (POST /api/embeddings) o "embeddings" (POST /api/embed, un vector por entrada)
+    for (std::string_view key : {std::string_view("\"embedding\""), std::string_view("\"embeddings\"")}) {
+        size_t pos = body.find(key);
+        if (pos == std::string_view::npos) continue;
+        const char* p = SkipSpace(body.data() + pos + key.size(), end);
+        if (p == end || *p != ':') continue;
+        p = SkipSpace(p + 1, end);
+        if (p == end || *p != '[') continue;
+        p = SkipSpace(p + 1, end);
+        if (key.size() == sizeof("\"embeddings\"") - 1) {
+            if (p == end || *p != '[') continue;
+            p = SkipSpace(p + 1, end);
+        }
+        return p;
+    }
+    return nullptr;
+}
+
+// Recorre el array llamando a emit(valor) por cada número; false si está mal formado
+template <typename Emit>
+bool ParseFloats(const char* p, const char* end, Emit&& emit) {
+    if (p < end && *p == ']') return true; // Vector vacío
+    while (p < end) {
+        float value;
+        auto [next, ec] = std::from_chars(p, end, value);
+        if (ec != std::errc() || !emit(value)) return false;
+        p = SkipSpace(next, end);
+        if (p == end) return false;
+        if (*p == ']') return true;
+        if (*p != ',') return false;
+        p = SkipSpace(p + 1, end);
+    }
+    return false;
+}
+}
+
+long DecodeEmbeddingJson(std::string_view body, float* out, size_t capacity) {
+    const char* end = body.data() + body.size();
+    const char* p = FindArray(body, end);
+    if (!p) return -1;
+    size_t count = 0;
+    bool ok = ParseFloats(p, end, [&](float value) {
+        if (count == capacity) return false;
+        out[count++] = value;
+        return true;
+    });
+    return ok ? static_cast<long>(count) : -1;
+}
+
+bool DecodeEmbeddingJson(std::string_view body, std::vector<float>& out) {
+    out.clear();
+    const char* end = body.data() + body.size();
+    const char* p = FindArray(body, end);
+    if (!p) return false;
+    if (out.capacity() < kTypicalDim) out.reserve(kTypicalDim);
+    bool ok = ParseFloats(p, end, [&](float value) {
+        out.push_back(value);
+        return true;
+    });
+    if (!ok) out.clear();
+    return ok;
+}
+
+bool DecodeEmbeddingBinary(std::string_view body, std::vector<float>& out) {
+    if (body.size() % sizeof(float) != 0) return false;
+    out.resize(body.size() / sizeof(float));
+    std::memcpy(out.data(), body.data(), body.size());
+    return true;
+}
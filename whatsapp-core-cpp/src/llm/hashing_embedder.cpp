@@ -0,0 +1,90 @@
+#include "llm/hashing_embedder.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <string>
+
+namespace {
+constexpr uint64_t kFnvOffset = 1469598103934665603ULL;
+constexpr uint64_t kFnvPrime = 1099511628211ULL;
+// Semillas distintas para que el trigrama "abc" y la palabra "abc" no caigan en la misma posición
+constexpr uint64_t kWordSeed = 0x9E3779B97F4A7C15ULL;
+
+uint64_t Fnv1a(std::string_view data, uint64_t seed = 0) {
+    uint64_t h = kFnvOffset ^ seed;
+    for (unsigned char c : data) {
+        h ^= c;
+        h *= kFnvPrime;
+    }
+    // Mezcla final (splitmix64): FNV deja los bits bajos poco repartidos para el módulo
+    h ^= h >> 30;
+    h *= 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 27;
+    h *= 0x94D049BB133111EBULL;
+    h ^= h >> 31;
+    return h;
+}
+
+bool IsSeparator(unsigned char c) {
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == ',' || c == '.' || c == ';' ||
+           c == ':' || c == '!' || c == '?' || c == '"' || c == '(' || c == ')';
+}
+}
+
+HashingEmbedder::HashingEmbedder(int dimension) : m_dimension(dimension) {}
+
+std::string HashingEmbedder::Name() const {
+    return "hashing:" + std::to_string(m_dimension);
+}
+
+void HashingEmbedder::EmbedInto(std::string_view text, float* out) const {
+    // Minúsculas ASCII y separadores colapsados a un espacio, con espacios en los extremos
+    // para que los n-gramas marquen principio y final de palabra
+    std::string norm = " ";
+    norm.reserve(text.size() + 2);
+    for (unsigned char c : text) {
+        if (IsSeparator(c)) {
+            if (norm.back() != ' ') norm += ' ';
+        } else {
+            norm += static_cast<char>(c < 0x80 ? std::tolower(c) : c);
+        }
+    }
+    if (norm.back() != ' ') norm += ' ';
+
+    std::fill(out, out + m_dimension, 0.0f);
+    const uint64_t dim = static_cast<uint64_t>(m_dimension);
+    auto add = [&](uint64_t h, float weight) {
+        // El bit alto decide el signo: las colisiones tienden a cancelarse en vez de acumularse
+        out[h % dim] += (h >> 63) ? -weight : weight;
+    };
+
+    std::string_view view(norm);
+    for (size_t n = 3; n <= 4; ++n) {
+        for (size_t i = 0; i + n <= view.size(); ++i) add(Fnv1a(view.substr(i, n)), 1.0f);
+    }
+    // Palabras completas: pesan más que un n-grama suelto
+    size_t start = 1;
+    for (size_t i = 1; i < view.size(); ++i) {
+        if (view[i] != ' ') continue;
+        if (i > start) add(Fnv1a(view.substr(start, i - start), kWordSeed), 2.0f);
+        start = i + 1;
+    }
+
+    // Norma 1 (como los vectores de nomic): con IndexFlatL2 la distancia ordena igual que el coseno
+    float norm2 = 0.0f;
+    for (int i = 0; i < m_dimension; ++i) norm2 += out[i] * out[i];
+    if (norm2 <= 0.0f) return; // Texto vacío: vector nulo
+    const float inv = 1.0f / std::sqrt(norm2);
+    for (int i = 0; i < m_dimension; ++i) out[i] *= inv;
+}
+
+std::vector<float> HashingEmbedder::Embed(const std::string& text, const Deadline&) {
+    std::vector<float> embedding(m_dimension);
+    EmbedInto(text, embedding.data());
+    return embedding;
+}
+
+Embedder::Canceller HashingEmbedder::StartEmbed(const std::string& text, const Deadline&, Handler done) {
+    done(Embed(text));
+    return nullptr;
+}
@@ -0,0 +1,89 @@
+#include "llm/http_session_pool.h"
+#include <spdlog/spdlog.h>
+
+namespace {
+// Ollama vive en una IP fija (WSL2 / LAN): no hace falta volver a resolver cada minuto
+constexpr long kDnsCacheSeconds = 600;
+// Sesiones ociosas que guardamos; las que sobran en un pico se cierran al devolverlas
+constexpr size_t kMaxIdleSessions = 32;
+}
+
+HttpSessionPool::HttpSessionPool() {
+    m_share = curl_share_init();
+    if (!m_share) {
+        spdlog::warn("HttpSessionPool: curl_share_init falló, cada sesión tendrá su propia caché");
+        return;
+    }
+    curl_share_setopt(m_share, CURLSHOPT_LOCKFUNC, &HttpSessionPool::LockShare);
+    curl_share_setopt(m_share, CURLSHOPT_UNLOCKFUNC, &HttpSessionPool::UnlockShare);
+    curl_share_setopt(m_share, CURLSHOPT_USERDATA, this);
+    curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+}
+
+HttpSessionPool::~HttpSessionPool() {
+    // Las sesiones (handles que usan el share) deben cerrarse antes que el share
+    m_idle.clear();
+    if (m_share) curl_share_cleanup(m_share);
+}
+
+void HttpSessionPool::LockShare(CURL*, curl_lock_data data, curl_lock_access, void* userptr) {
+    static_cast<HttpSessionPool*>(userptr)->m_share_mutexes[data].lock();
+}
+
+void HttpSessionPool::UnlockShare(CURL*, curl_lock_data data, void* userptr) {
+    static_cast<HttpSessionPool*>(userptr)->m_share_mutexes[data].unlock();
+}
+
+std::unique_ptr<cpr::Session> HttpSessionPool::CreateSession() {
+    auto session = std::make_unique<cpr::Session>();
+    CURL* handle = session->GetCurlHolder()->handle;
+    curl_easy_setopt(handle, CURLOPT_DNS_CACHE_TIMEOUT, kDnsCacheSeconds);
+    curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+    if (m_share) curl_easy_setopt(handle, CURLOPT_SHARE, m_share);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stats.sessions++;
+    return session;
+}
+
+HttpSessionPool::Lease HttpSessionPool::Acquire() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_idle.empty()) {
+            auto session = std::move(m_idle.back());
+            m_idle.pop_back();
+            return Lease(*this, std::move(session));
+        }
+    }
+    return Lease(*this, CreateSession());
+}
+
+void HttpSessionPool::Release(std::unique_ptr<cpr::Session> session) {
+    if (!session) return;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_idle.size() < kMaxIdleSessions) m_idle.push_back(std::move(session));
+}
+
+void HttpSessionPool::Record(cpr::Session& session, const cpr::Response& response) {
+    CURL* handle = session.GetCurlHolder()->handle;
+    curl_off_t dns_us = 0, connect_us = 0;
+    long connects = 0;
+    curl_easy_getinfo(handle, CURLINFO_NAMELOOKUP_TIME_T, &dns_us);
+    curl_easy_getinfo(handle, CURLINFO_CONNECT_TIME_T, &connect_us);
+    curl_easy_getinfo(handle, CURLINFO_NUM_CONNECTS, &connects);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stats.requests++;
+    m_stats.new_connections += connects;
+    m_stats.dns_ms_sum += dns_us / 1000.0;
+    m_stats.connect_ms_sum += connect_us / 1000.0;
+    m_stats.total_ms_sum += response.elapsed * 1000.0;
+    m_stats.last_connect_ms = connect_us / 1000.0;
+    m_stats.last_total_ms = response.elapsed * 1000.0;
+}
+
+HttpStats HttpSessionPool::GetStats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
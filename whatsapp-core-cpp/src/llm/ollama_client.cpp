@@ -1,78 +1,647 @@
 #include "llm/ollama_client.h"
 #include <cpr/cpr.h>
 #include <iostream>
+#include <chrono>
 #include <spdlog/spdlog.h>
 
 using json = nlohmann::json;
 
+namespace {
+// Cada cuánto se sondea la salud de cada servidor de Ollama
+constexpr auto kProbeInterval = std::chrono::seconds(5);
+constexpr const char* kNoBackend = "ningún servidor de Ollama disponible";
+}
+
 // Constructor: Recibe la URL (Host) y el nombre del modelo de Chat (Qwen)
 OllamaClient::OllamaClient(const std::string& host, const std::string& model)
-    : m_host(host), m_model(model) {}
+    : OllamaClient(std::vector<BackendConfig>{BackendConfig{host}}, model) {}
 
-std::vector<float> OllamaClient::GetEmbedding(const std::string& text) {
-    // ⚠️ IMPORTANTE: Aquí mantenemos HARDCODED "nomic-embed-text".
-    // No usamos m_model porque Qwen no es bueno haciendo embeddings, 
-    // y necesitamos compatibilidad exacta (768 dimensiones) con tu base de datos FAISS.
-    json payload = {
-        {"model", "nomic-embed-text"},
-        {"prompt", text}
+OllamaClient::OllamaClient(std::vector<BackendConfig> backends, const std::string& model)
+    : m_model(model), m_backends(std::move(backends)) {
+    m_backends.StartProbing(m_loop, kProbeInterval);
+}
+
+void OllamaClient::RecordBackendResult(Backend& backend, long status_code, bool aborted, bool cancelled, double ms) {
+    if (cancelled) {
+        // Perdedor de un hedge: no sabemos si el servidor iba a responder
+        backend.breaker.OnCancel();
+    } else if (!aborted && (status_code == 0 || status_code >= 500)) {
+        backend.failures++;
+        backend.breaker.OnFailure();
+    } else {
+        // 200, 4xx o streaming cortado por el cliente: el servidor contesta
+        if (status_code == 200 && !aborted) backend.latency.Record(ms);
+        backend.breaker.OnSuccess();
+    }
+}
+
+cpr::Response OllamaClient::Post(Endpoint& endpoint, const std::string& body, int timeout_ms,
+                                 const cpr::WriteCallback& on_data, Backend* pinned) {
+    Backend* backend = pinned ? (pinned->breaker.Allow() ? pinned : nullptr) : m_backends.Pick(endpoint.role);
+    if (!backend) {
+        endpoint.fast_fails++;
+        cpr::Response rejected;
+        rejected.error.message = kNoBackend;
+        return rejected;
+    }
+    endpoint.requests++;
+    backend->requests++;
+    backend->outstanding++;
+
+    auto session = m_sessions.Acquire();
+    session->SetUrl(cpr::Url{backend->config.url + endpoint.path});
+    session->SetHeader(cpr::Header{{"Content-Type", "application/json"}});
+    session->SetBody(cpr::Body{body});
+    session->SetTimeout(cpr::Timeout{timeout_ms});
+    // La sesión pudo usarse antes en streaming: un callback vacío vuelve a guardar la respuesta en .text
+    session->SetWriteCallback(on_data);
+
+    auto response = session->Post();
+    m_sessions.Record(*session, response);
+    backend->outstanding--;
+
+    RecordBackendResult(*backend, response.status_code, false, false, response.elapsed * 1000.0);
+    if (response.status_code == 200) {
+        endpoint.latency.Record(response.elapsed * 1000.0);
+    } else if (response.status_code == 0 || response.status_code >= 500) {
+        endpoint.failures++;
+    }
+    return response;
+}
+
+// ==========================================
+// RESILIENCIA (hedging, reintentos, circuit breaker)
+// ==========================================
+
+// Estado compartido por todos los intentos de una misma llamada. Vive en shared_ptr:
+// lo retienen las transferencias en vuelo y los timers del event loop.
+// Cada intento elige servidor en el reparto; el duplicado y los reintentos evitan el anterior.
+struct OllamaClient::ResilientCall : std::enable_shared_from_this<ResilientCall> {
+    OllamaClient* client = nullptr;
+    Endpoint* endpoint = nullptr;
+    std::string body;
+    int timeout_cap_ms = 0;
+    Deadline deadline;
+    bool hedge = false;
+    int max_attempts = 1;
+    CurlMultiLoop::Completion done;
+    CurlMultiLoop::DataCallback on_data;
+
+    std::mutex mutex;
+    bool finished = false;
+    int attempts = 0;
+    int outstanding = 0;
+    std::atomic<bool> got_data{false};   // En streaming no se reintenta si ya salieron tokens
+    std::vector<uint64_t> transfer_ids;
+    Backend* last_backend = nullptr;
+
+    void Start() {
+        Backend* backend = client->m_backends.Pick(endpoint->role);
+        if (!backend) {
+            endpoint->fast_fails++;
+            Complete(Rejected(kNoBackend));
+            return;
+        }
+        endpoint->requests++;
+        client->m_retry_budget.OnRequest();
+        Launch(false, backend);
+
+        // Hedging: si la original tarda más que el p95 reciente, lanzamos un duplicado y gana la primera
+        double p95 = hedge ? endpoint->latency.P95() : 0;
+        if (p95 > 0) {
+            auto self = shared_from_this();
+            client->m_loop.After(std::chrono::milliseconds(static_cast<long>(p95)), [self] { self->MaybeHedge(); });
+        }
+    }
+
+    void Launch(bool is_hedge, Backend* backend) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!is_hedge) attempts++;
+            outstanding++;
+            last_backend = backend;
+        }
+        backend->requests++;
+        backend->outstanding++;
+        auto self = shared_from_this();
+        auto launched = std::chrono::steady_clock::now();
+
+        CurlMultiLoop::DataCallback data;
+        if (on_data) {
+            data = [self](std::string_view chunk) {
+                self->got_data = true;
+                return self->on_data(chunk);
+            };
+        }
+        uint64_t id = client->m_loop.Post(backend->config.url + endpoint->path, body, deadline.TimeoutMs(timeout_cap_ms),
+            [self, launched, is_hedge, backend](HttpResult result) {
+                self->OnResult(std::move(result), launched, is_hedge, backend);
+            },
+            std::move(data), endpoint->accept);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        transfer_ids.push_back(id);
+    }
+
+    void MaybeHedge() {
+        Backend* first;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (finished || outstanding != 1) return;
+            first = last_backend;
+        }
+        if (deadline.Expired() || !client->m_retry_budget.TryWithdraw()) return;
+        // El duplicado va a otro servidor si lo hay: el lento suele ser el servidor, no la petición
+        Backend* backend = client->m_backends.Pick(endpoint->role, first);
+        if (!backend) return;
+        endpoint->hedges++;
+        Launch(true, backend);
+    }
+
+    void Retry() {
+        Backend* failed;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (finished) return; // Cancelada durante el backoff
+            failed = last_backend;
+        }
+        Backend* backend = client->m_backends.Pick(endpoint->role, failed);
+        if (!backend) {
+            endpoint->fast_fails++;
+            Complete(Rejected(kNoBackend));
+            return;
+        }
+        Launch(false, backend);
+    }
+
+    void OnResult(HttpResult result, std::chrono::steady_clock::time_point launched, bool is_hedge, Backend* backend) {
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - launched).count();
+        backend->outstanding--;
+        // El servidor se evalúa siempre, también el perdedor del hedge si llegó a responder
+        bool cancelled = result.aborted && result.error == CurlMultiLoop::kCancelledError;
+        RecordBackendResult(*backend, result.status_code, result.aborted, cancelled, ms);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        outstanding--;
+        if (finished) return; // El perdedor del hedge (cancelado o llegado tarde)
+
+        bool ok = result.status_code == 200 && result.error.empty();
+        if (ok || result.aborted) {
+            // aborted: el cliente cortó el streaming; Ollama sí estaba respondiendo
+            finished = true;
+            auto others = transfer_ids;
+            lock.unlock();
+            if (ok) endpoint->latency.Record(ms);
+            if (ok && is_hedge) endpoint->hedge_wins++;
+            for (uint64_t id : others) client->m_loop.Cancel(id);
+            done(std::move(result));
+            return;
+        }
+
+        bool retryable = result.status_code == 0 || result.status_code >= 500;
+        if (retryable) endpoint->failures++;
+        if (outstanding > 0) return; // Aún queda el otro intento del hedge
+
+        if (retryable && attempts < max_attempts && !got_data && !deadline.Expired()) {
+            auto backoff = client->m_retry_budget.Backoff(attempts);
+            bool fits = !deadline.IsSet() || deadline.Remaining() > backoff;
+            if (fits && client->m_retry_budget.TryWithdraw()) {
+                endpoint->retries++;
+                lock.unlock();
+                spdlog::warn("🔁 Ollama {}: reintento {} en {} ms ({})", endpoint->path, attempts, backoff.count(),
+                             result.error.empty() ? std::to_string(result.status_code) : result.error);
+                auto self = shared_from_this();
+                client->m_loop.After(backoff, [self] { self->Retry(); });
+                return;
+            }
+        }
+        finished = true;
+        lock.unlock();
+        done(std::move(result));
+    }
+
+    // Cancelación desde fuera (expropiación del RequestScheduler): corta los intentos en vuelo
+    // y termina como abortada, sin contar fallo
+    void Cancel() {
+        std::vector<uint64_t> ids;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (finished) return;
+            finished = true;
+            ids = transfer_ids;
+        }
+        for (uint64_t id : ids) client->m_loop.Cancel(id);
+        HttpResult result;
+        result.aborted = true;
+        result.error = CurlMultiLoop::kCancelledError;
+        done(std::move(result));
+    }
+
+    void Complete(HttpResult result) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (finished) return;
+            finished = true;
+        }
+        done(std::move(result));
+    }
+
+    static HttpResult Rejected(const char* why) {
+        HttpResult result;
+        result.error = why;
+        return result;
+    }
+};
+
+OllamaClient::Canceller OllamaClient::ResilientPost(Endpoint& endpoint, std::string body, int timeout_cap_ms,
+                                                   const Deadline& deadline, bool hedge, int max_attempts,
+                                                   CurlMultiLoop::Completion done, CurlMultiLoop::DataCallback on_data) {
+    auto call = std::make_shared<ResilientCall>();
+    call->client = this;
+    call->endpoint = &endpoint;
+    call->body = std::move(body);
+    call->timeout_cap_ms = timeout_cap_ms;
+    call->deadline = deadline;
+    call->hedge = hedge;
+    call->max_attempts = max_attempts;
+    call->done = std::move(done);
+    call->on_data = std::move(on_data);
+    call->Start();
+    // weak_ptr: la cancelación no debe alargar la vida de la llamada una vez terminada
+    return [weak = std::weak_ptr<ResilientCall>(call)] {
+        if (auto call = weak.lock()) call->Cancel();
     };
+}
 
+EndpointStats OllamaClient::SnapshotEndpoint(const Endpoint& endpoint) const {
+    EndpointStats stats;
+    int serving = 0, available = 0;
+    for (const auto& backend : m_backends.Backends()) {
+        if (!backend->Serves(endpoint.role)) continue;
+        serving++;
+        if (backend->Eligible(endpoint.role) && backend->breaker.GetState() == CircuitBreaker::State::Closed) available++;
+    }
+    if (!m_backends.Available(endpoint.role)) {
+        stats.breaker = "open";
+    } else {
+        stats.breaker = available == serving ? "closed" : "degraded";
+    }
+    stats.p50_ms = endpoint.latency.Percentile(0.50);
+    stats.p95_ms = endpoint.latency.Percentile(0.95);
+    stats.p99_ms = endpoint.latency.Percentile(0.99);
+    stats.requests = endpoint.requests;
+    stats.failures = endpoint.failures;
+    stats.retries = endpoint.retries;
+    stats.hedges = endpoint.hedges;
+    stats.hedge_wins = endpoint.hedge_wins;
+    stats.fast_fails = endpoint.fast_fails;
+    return stats;
+}
+
+ResilienceStats OllamaClient::GetResilienceStats() const {
+    return {SnapshotEndpoint(m_embed_endpoint), SnapshotEndpoint(m_chat_endpoint)};
+}
+
+json OllamaClient::BuildEmbeddingPayload(const std::string& text) const {
+    // ⚠️ IMPORTANTE: No usamos m_model porque Qwen no es bueno haciendo embeddings.
+    // m_embed_model es "nomic-embed-text" salvo que se cambie, y su dimensión (768) tiene que
+    // coincidir exactamente con la de tu base de datos FAISS.
+    return {
+        {"model", m_embed_model},
+        {"prompt", text},
+        {"keep_alive", m_keep_alive}
+    };
+}
+
+std::vector<float> OllamaClient::ParseEmbedding(long status_code, const std::string& text, const std::string& error,
+                                                const std::string& content_type) const {
     try {
-        auto response = cpr::Post(
-            cpr::Url{m_host + "/api/embeddings"}, // Usa la IP dinámica (WSL2)
-            cpr::Body{payload.dump()},
-            cpr::Header{{"Content-Type", "application/json"}},
-            cpr::Timeout{10000} // 10s es suficiente para Nomic en GPU (antes 60s)
-        );
-
-        if (response.status_code == 200) {
-            auto j = json::parse(response.text);
+        if (status_code == 200) {
+            std::vector<float> embedding;
+            if (content_type.rfind(kEmbeddingBinaryMime, 0) == 0) {
+                if (DecodeEmbeddingBinary(text, embedding)) return embedding;
+                spdlog::error("❌ Ollama Embedding binario truncado ({} bytes)", text.size());
+                return {};
+            }
+            // Camino rápido: directo al array sin DOM. Si no encaja (p. ej. {"error": ...}) vamos al lento
+            if (DecodeEmbeddingJson(text, embedding)) return embedding;
+            auto j = json::parse(text);
             return j["embedding"].get<std::vector<float>>();
-        } else {
-            spdlog::error("❌ Ollama Embedding Error {}: {}", response.status_code, response.text);
         }
+        spdlog::error("❌ Ollama Embedding Error {}: {}", status_code, error.empty() ? text : error);
     } catch (const std::exception& e) {
         spdlog::error("🔥 Ollama Connection Exception (Embedding): {}", e.what());
     }
     return {};
 }
 
-std::optional<std::string> OllamaClient::Chat(const std::string& system_prompt, const std::string& user_query) {
+std::vector<float> OllamaClient::GetEmbedding(const std::string& text, const Deadline& deadline) {
+    // Misma ruta que la versión asíncrona (hedging + reintentos); aquí solo esperamos el resultado
+    return GetEmbeddingAsync(text, deadline).get();
+}
+
+json OllamaClient::BuildChatPayload(const std::string& system_prompt, const std::string& user_query, bool stream,
+                                    const GenerationOptions& gen) const {
     json payload = {
         {"model", m_model}, // Aquí sí usamos Qwen 2.5
-        {"stream", false},
+        {"stream", stream},
+        {"keep_alive", m_keep_alive}, // Sin esto Ollama descarga el 7B a los 5 min y la siguiente pregunta lo recarga
         {"messages", {
             {{"role", "system"}, {"content", system_prompt}},
             {{"role", "user"}, {"content", user_query}}
         }},
         // ⚙️ OPCIONES DE RENDIMIENTO PARA QWEN EN GPU
         {"options", {
-            {"num_ctx", 8192},    // Aumentamos memoria de contexto (tienes 8GB VRAM, úsalos)
+            {"num_ctx", m_num_ctx}, // Aumentamos memoria de contexto (tienes 8GB VRAM, úsalos)
             {"temperature", 0.3}, // Baja creatividad para ser fiel a los datos (RAG)
             {"top_k", 40},
             {"top_p", 0.9}
         }}
     };
+    // Respuesta acortada cuando el plazo no da para una generación completa
+    if (gen.num_predict > 0) payload["options"]["num_predict"] = gen.num_predict;
+    return payload;
+}
 
+std::optional<std::string> OllamaClient::ParseChat(long status_code, const std::string& text, const std::string& error) {
     try {
-        auto response = cpr::Post(
-            cpr::Url{m_host + "/api/chat"},
-            cpr::Body{payload.dump()},
-            cpr::Header{{"Content-Type", "application/json"}},
-            // Aunque la GPU es rápida, dejamos margen por si procesa mucho texto
-            cpr::Timeout{60000} 
-        );
-
-        if (response.status_code == 200) {
-            auto j = json::parse(response.text);
+        if (status_code == 200) {
+            auto j = json::parse(text);
+            RecordTimings(j);
             return j["message"]["content"].get<std::string>();
-        } else {
-            // Añadido log de error que faltaba aquí
-            spdlog::error("❌ Ollama Chat Error {}: {}", response.status_code, response.text);
         }
+        // Añadido log de error que faltaba aquí
+        spdlog::error("❌ Ollama Chat Error {}: {}", status_code, error.empty() ? text : error);
+    } catch (const std::exception& e) {
+        spdlog::error("🔥 Ollama Chat Exception: {}", e.what());
+    }
+    return std::nullopt;
+}
+
+std::optional<std::string> OllamaClient::Chat(const std::string& system_prompt, const std::string& user_query,
+                                              const GenerationOptions& gen) {
+    if (gen.deadline.Expired()) return std::nullopt;
+    json payload = BuildChatPayload(system_prompt, user_query, false, gen);
+
+    try {
+        // Aunque la GPU es rápida, dejamos margen por si procesa mucho texto
+        auto response = Post(m_chat_endpoint, payload.dump(), gen.deadline.TimeoutMs(60000));
+        return ParseChat(response.status_code, response.text, response.error.message);
     } catch (const std::exception& e) {
         spdlog::error("🔥 Ollama Chat Exception: {}", e.what());
     }
     return std::nullopt;
-}
\ No newline at end of file
+}
+
+// Ollama manda un objeto JSON por línea (NDJSON). Los trozos de red no respetan
+// las líneas, así que acumulamos en 'pending' y procesamos solo líneas completas.
+class OllamaClient::StreamParser {
+public:
+    explicit StreamParser(TokenCallback on_token) : m_on_token(std::move(on_token)) {}
+
+    // false => cortar la transferencia (error de Ollama o el cliente se fue)
+    bool Feed(std::string_view data) {
+        m_pending.append(data);
+
+        size_t start = 0;
+        size_t newline;
+        while ((newline = m_pending.find('\n', start)) != std::string::npos) {
+            std::string_view line(m_pending.data() + start, newline - start);
+            start = newline + 1;
+            if (line.empty()) continue;
+
+            auto j = json::parse(line, nullptr, false);
+            if (j.is_discarded()) continue;
+
+            if (j.contains("error")) {
+                spdlog::error("❌ Ollama Chat Stream Error: {}", j["error"].dump());
+                return false;
+            }
+
+            std::string token = j.value("/message/content"_json_pointer, "");
+            if (!token.empty()) {
+                full_answer += token;
+                if (!m_on_token(token)) {
+                    aborted = true;
+                    return false; // Devolver false corta la transferencia en libcurl
+                }
+            }
+            if (j.value("done", false)) {
+                finished = true;
+                final_chunk = std::move(j);
+            }
+        }
+        m_pending.erase(0, start);
+        return true;
+    }
+
+    std::string full_answer;
+    bool finished = false;
+    bool aborted = false;
+    json final_chunk;
+
+private:
+    TokenCallback m_on_token;
+    std::string m_pending;
+};
+
+std::optional<std::string> OllamaClient::FinishStream(StreamParser& parser, long status_code, const std::string& error) {
+    if (parser.aborted) {
+        spdlog::warn("⚠️ Ollama Chat Stream abortado por el cliente");
+        return std::nullopt;
+    }
+    if (status_code == 200 && parser.finished) {
+        RecordTimings(parser.final_chunk);
+        return parser.full_answer;
+    }
+    spdlog::error("❌ Ollama Chat Stream Error {}: {}", status_code, error);
+    return std::nullopt;
+}
+
+std::optional<std::string> OllamaClient::ChatStream(const std::string& system_prompt, const std::string& user_query,
+                                                    const TokenCallback& on_token, const GenerationOptions& gen) {
+    if (gen.deadline.Expired()) return std::nullopt;
+    json payload = BuildChatPayload(system_prompt, user_query, true, gen);
+
+    StreamParser parser(on_token);
+    auto on_data = [&](std::string_view data, intptr_t) { return parser.Feed(data); };
+
+    try {
+        auto response = Post(m_chat_endpoint, payload.dump(), gen.deadline.TimeoutMs(60000), cpr::WriteCallback{on_data});
+        return FinishStream(parser, response.status_code, response.error.message);
+    } catch (const std::exception& e) {
+        spdlog::error("🔥 Ollama Chat Stream Exception: {}", e.what());
+    }
+    return std::nullopt;
+}
+
+// ==========================================
+// API NO BLOQUEANTE (CurlMultiLoop)
+// ==========================================
+
+OllamaClient::Canceller OllamaClient::StartEmbedding(const std::string& text, const Deadline& deadline,
+                                                    EmbeddingHandler done) {
+    if (deadline.Expired()) {
+        spdlog::warn("⏰ Embedding omitido: plazo agotado");
+        done({});
+        return nullptr;
+    }
+    // Hasta 3 intentos; el duplicado tras el p95 no cuenta como intento
+    return ResilientPost(m_embed_endpoint, BuildEmbeddingPayload(text).dump(), 10000, deadline, true, 3,
+        [this, done = std::move(done)](HttpResult result) {
+            // Cancelada a propósito: no es un error de Ollama
+            if (result.aborted) return done({});
+            done(ParseEmbedding(result.status_code, result.text, result.error, result.content_type));
+        });
+}
+
+void OllamaClient::StartChat(const std::string& system_prompt, const std::string& user_query, TokenCallback on_token,
+                             const GenerationOptions& gen, ChatHandler done) {
+    if (gen.deadline.Expired()) {
+        done(std::nullopt);
+        return;
+    }
+
+    const bool stream = static_cast<bool>(on_token);
+    std::string body = BuildChatPayload(system_prompt, user_query, stream, gen).dump();
+
+    // Chat: sin hedging (duplicar una generación del 7B sale caro) y un único reintento,
+    // solo si Ollama no llegó a mandar nada
+    if (!stream) {
+        ResilientPost(m_chat_endpoint, std::move(body), 60000, gen.deadline, false, 2,
+            [this, done = std::move(done)](HttpResult result) {
+                done(ParseChat(result.status_code, result.text, result.error));
+            });
+        return;
+    }
+
+    auto parser = std::make_shared<StreamParser>(std::move(on_token));
+    ResilientPost(m_chat_endpoint, std::move(body), 60000, gen.deadline, false, 2,
+        [this, parser, done = std::move(done)](HttpResult result) {
+            done(FinishStream(*parser, result.status_code, result.error));
+        },
+        [parser](std::string_view data) { return parser->Feed(data); });
+}
+
+std::future<std::vector<float>> OllamaClient::GetEmbeddingAsync(const std::string& text, const Deadline& deadline) {
+    auto promise = std::make_shared<std::promise<std::vector<float>>>();
+    auto future = promise->get_future();
+    StartEmbedding(text, deadline, [promise](std::vector<float> embedding) { promise->set_value(std::move(embedding)); });
+    return future;
+}
+
+std::future<std::optional<std::string>> OllamaClient::ChatAsync(const std::string& system_prompt, const std::string& user_query,
+                                                                TokenCallback on_token, const GenerationOptions& gen) {
+    auto promise = std::make_shared<std::promise<std::optional<std::string>>>();
+    auto future = promise->get_future();
+    StartChat(system_prompt, user_query, std::move(on_token), gen,
+              [promise](std::optional<std::string> answer) { promise->set_value(std::move(answer)); });
+    return future;
+}
+
+HttpStats OllamaClient::GetHttpStats() const {
+    auto stats = m_sessions.GetStats();
+    auto async = m_loop.GetStats();
+    stats.requests += async.requests;
+    stats.new_connections += async.new_connections;
+    stats.dns_ms_sum += async.dns_ms_sum;
+    stats.connect_ms_sum += async.connect_ms_sum;
+    stats.total_ms_sum += async.total_ms_sum;
+    if (async.requests > 0) {
+        stats.last_connect_ms = async.last_connect_ms;
+        stats.last_total_ms = async.last_total_ms;
+    }
+    return stats;
+}
+
+void OllamaClient::RecordTimings(const json& final_chunk) {
+    // Ollama da las duraciones en nanosegundos
+    auto ns_to_ms = [&](const char* key) { return final_chunk.value(key, 0.0) / 1e6; };
+
+    ChatTimings t;
+    t.prompt_tokens = final_chunk.value("prompt_eval_count", 0);
+    t.prompt_eval_ms = ns_to_ms("prompt_eval_duration");
+    t.load_ms = ns_to_ms("load_duration");
+    t.eval_tokens = final_chunk.value("eval_count", 0);
+    t.eval_ms = ns_to_ms("eval_duration");
+    t.total_ms = ns_to_ms("total_duration");
+
+    {
+        std::lock_guard<std::mutex> lock(m_stats_mutex);
+        m_stats.requests++;
+        // Una carga "en caliente" cuesta unos pocos ms; por encima de 500 ms el modelo estaba fuera de VRAM
+        if (t.load_ms > 500) m_stats.cold_loads++;
+        m_stats.prompt_eval_ms_sum += t.prompt_eval_ms;
+        m_stats.prompt_tokens_sum += t.prompt_tokens;
+        m_stats.last = t;
+
+        // EWMA (alfa = 0.2) de tokens/s: con pocos datos manda la primera medida
+        auto ewma = [](double& avg, double sample) { avg = avg > 0 ? 0.8 * avg + 0.2 * sample : sample; };
+        if (t.prompt_tokens > 0 && t.prompt_eval_ms > 0) ewma(m_stats.prompt_tokens_per_s, t.prompt_tokens * 1000.0 / t.prompt_eval_ms);
+        if (t.eval_tokens > 0 && t.eval_ms > 0) ewma(m_stats.eval_tokens_per_s, t.eval_tokens * 1000.0 / t.eval_ms);
+    }
+
+    spdlog::info("⏱️ Ollama: prompt {} tokens en {:.0f} ms | carga {:.0f} ms | respuesta {} tokens en {:.0f} ms",
+                 t.prompt_tokens, t.prompt_eval_ms, t.load_ms, t.eval_tokens, t.eval_ms);
+}
+
+double OllamaClient::EstimateChatMs(int prompt_tokens, int answer_tokens) const {
+    // Sin medidas todavía: valores conservadores para un 7B en GPU de consumo
+    constexpr double kDefaultPromptTps = 800.0;
+    constexpr double kDefaultEvalTps = 30.0;
+
+    std::lock_guard<std::mutex> lock(m_stats_mutex);
+    double prompt_tps = m_stats.prompt_tokens_per_s > 0 ? m_stats.prompt_tokens_per_s : kDefaultPromptTps;
+    double eval_tps = m_stats.eval_tokens_per_s > 0 ? m_stats.eval_tokens_per_s : kDefaultEvalTps;
+    return prompt_tokens * 1000.0 / prompt_tps + answer_tokens * 1000.0 / eval_tps;
+}
+
+ChatStats OllamaClient::GetChatStats() const {
+    std::lock_guard<std::mutex> lock(m_stats_mutex);
+    return m_stats;
+}
+
+bool OllamaClient::WarmUp(const std::string& system_prompt) {
+    auto start = std::chrono::steady_clock::now();
+
+    // 1. Modelo de embeddings (también se descarga si no se usa)
+    std::string embed_body = BuildEmbeddingPayload("warmup").dump();
+
+    // 2. Modelo de chat: mismo system prompt que las preguntas reales y num_predict = 1.
+    //    Así el 7B queda en VRAM y el prefijo del system prompt en la caché KV.
+    json payload = BuildChatPayload(system_prompt, "", false);
+    payload["options"]["num_predict"] = 1;
+    std::string chat_body = payload.dump();
+
+    // Cada servidor carga sus propios modelos: se calientan todos, no solo el que tocaría en el reparto
+    bool all_ok = true;
+    for (const auto& backend : m_backends.Backends()) {
+        if (backend->config.embed) {
+            auto response = Post(m_embed_endpoint, embed_body, 10000, {}, backend.get());
+            if (response.status_code != 200) {
+                all_ok = false;
+                spdlog::warn("⚠️ Warm-up de {} en {} falló {}: {}", m_embed_model, backend->config.url,
+                             response.status_code, response.error.message.empty() ? response.text : response.error.message);
+            }
+        }
+        if (backend->config.chat) {
+            try {
+                // La primera carga del 7B desde disco puede ir lenta
+                auto response = Post(m_chat_endpoint, chat_body, 120000, {}, backend.get());
+                if (response.status_code != 200) {
+                    all_ok = false;
+                    spdlog::warn("⚠️ Warm-up de {} en {} falló {}: {}", m_model, backend->config.url,
+                                 response.status_code, response.error.message.empty() ? response.text : response.error.message);
+                }
+            } catch (const std::exception& e) {
+                all_ok = false;
+                spdlog::warn("⚠️ Warm-up de {} en {} falló: {}", m_model, backend->config.url, e.what());
+            }
+        }
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    spdlog::info("🔥 Warm-up Ollama ({} + {}, keep_alive={}, {} servidores) en {:.0f} ms",
+                 m_model, m_embed_model, m_keep_alive, m_backends.Backends().size(), ms);
+    return all_ok;
+}
@@ -0,0 +1,173 @@
+#include "llm/request_scheduler.h"
+#include <algorithm>
+#include <spdlog/spdlog.h>
+
+namespace {
+const char* LaneName(RequestLane lane) {
+    return lane == RequestLane::Embed ? "embeddings" : "chat";
+}
+}
+
+const char* RequestClassName(RequestClass cls) {
+    switch (cls) {
+        case RequestClass::Interactive: return "interactive";
+        case RequestClass::Live: return "live";
+        case RequestClass::Backfill: return "backfill";
+    }
+    return "unknown";
+}
+
+RequestScheduler::RequestScheduler(SchedulerOptions options) : m_options(options) {
+    m_lanes[static_cast<int>(RequestLane::Embed)].concurrency = std::max(1, options.embed_concurrency);
+    m_lanes[static_cast<int>(RequestLane::Chat)].concurrency = std::max(1, options.chat_concurrency);
+    for (auto& weight : m_options.weights) weight = std::max(weight, 0.01);
+}
+
+void RequestScheduler::Submit(RequestLane lane_id, RequestClass cls, Job job, bool front) {
+    std::function<void()> cancel;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto& lane = m_lanes[static_cast<int>(lane_id)];
+        auto& state = lane.classes[static_cast<int>(cls)];
+        // Una clase que estaba inactiva entra al ritmo actual: no acumula crédito por el tiempo parada
+        if (state.queue.empty()) state.pass = std::max(state.pass, lane.vtime);
+        Pending pending{std::move(job), std::chrono::steady_clock::now()};
+        if (front) {
+            state.queue.push_front(std::move(pending));
+        } else {
+            state.queue.push_back(std::move(pending));
+            state.submitted++;
+        }
+        if (cls != RequestClass::Backfill && lane.running >= lane.concurrency) cancel = PreemptLocked(lane);
+    }
+    // Fuera del candado: la cancelación puede completar el trabajo (y liberar su hueco) aquí mismo
+    if (cancel) cancel();
+    Dispatch();
+}
+
+std::function<void()> RequestScheduler::PreemptLocked(LaneState& lane) {
+    // Una expropiación por trabajo urgente en espera, no más
+    size_t urgent = lane.classes[static_cast<int>(RequestClass::Interactive)].queue.size() +
+                    lane.classes[static_cast<int>(RequestClass::Live)].queue.size();
+    if (urgent <= static_cast<size_t>(lane.preempting)) return nullptr;
+
+    auto& list = lane.preemptible;
+    for (auto it = list.begin(); it != list.end();) {
+        auto slot = it->lock();
+        it = list.erase(it);
+        if (!slot || slot->m_released || slot->m_preempted || !slot->m_cancel) continue;
+        slot->m_preempted = true;
+        lane.preempting++;
+        lane.classes[static_cast<int>(RequestClass::Backfill)].preempted++;
+        return std::move(slot->m_cancel);
+    }
+    return nullptr;
+}
+
+void RequestScheduler::Dispatch() {
+    // Un trabajo puede terminar dentro de job() (p. ej. un embedder en proceso) y liberar su hueco:
+    // ese Release no vuelve a despachar, lo recoge este mismo bucle. Así la pila no crece por cada trabajo.
+    thread_local const RequestScheduler* t_dispatching = nullptr;
+    if (t_dispatching == this) return;
+    const RequestScheduler* outer = t_dispatching;
+    t_dispatching = this;
+
+    for (;;) {
+        Job job;
+        SlotPtr slot;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (int l = 0; l < kRequestLanes && !job; ++l) {
+                auto& lane = m_lanes[l];
+                if (lane.running >= lane.concurrency) continue;
+                // La clase con el pase más bajo; a igualdad, la más urgente
+                int best = -1;
+                for (int c = 0; c < kRequestClasses; ++c) {
+                    if (lane.classes[c].queue.empty()) continue;
+                    if (best < 0 || lane.classes[c].pass < lane.classes[best].pass) best = c;
+                }
+                if (best < 0) continue;
+
+                auto& state = lane.classes[best];
+                Pending pending = std::move(state.queue.front());
+                state.queue.pop_front();
+                lane.vtime = state.pass;
+                state.pass += 1.0 / m_options.weights[best];
+                lane.running++;
+                state.started++;
+                double waited = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - pending.queued_at).count();
+                state.wait_ms_sum += waited;
+                state.wait_ms_max = std::max(state.wait_ms_max, waited);
+                state.wait.Record(waited);
+
+                job = std::move(pending.job);
+                slot = std::make_shared<Slot>(shared_from_this(), static_cast<RequestLane>(l), static_cast<RequestClass>(best));
+            }
+        }
+        if (!job) break;
+        try {
+            job(slot);
+        } catch (const std::exception& e) {
+            spdlog::error("🔥 RequestScheduler: el trabajo lanzó una excepción: {}", e.what());
+            slot->Release();
+        }
+    }
+    t_dispatching = outer;
+}
+
+void RequestScheduler::Release(Slot& slot) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto& lane = m_lanes[static_cast<int>(slot.m_lane)];
+        lane.running--;
+        if (slot.m_preempted) lane.preempting--;
+        slot.m_cancel = nullptr;
+        auto& list = lane.preemptible;
+        list.erase(std::remove_if(list.begin(), list.end(),
+                                  [](const std::weak_ptr<Slot>& weak) { return weak.expired(); }),
+                   list.end());
+    }
+    Dispatch();
+}
+
+void RequestScheduler::RegisterPreemptible(const SlotPtr& slot) {
+    m_lanes[static_cast<int>(slot->m_lane)].preemptible.push_back(slot);
+}
+
+void RequestScheduler::Slot::Release() {
+    if (m_released.exchange(true)) return;
+    m_scheduler->Release(*this);
+}
+
+void RequestScheduler::Slot::SetPreempt(std::function<void()> cancel) {
+    if (m_class != RequestClass::Backfill || !cancel) return;
+    std::lock_guard<std::mutex> lock(m_scheduler->m_mutex);
+    if (m_released || m_preempted) return;
+    m_cancel = std::move(cancel);
+    m_scheduler->RegisterPreemptible(shared_from_this());
+}
+
+SchedulerStats RequestScheduler::GetStats() const {
+    SchedulerStats stats;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (int l = 0; l < kRequestLanes; ++l) {
+        const auto& lane = m_lanes[l];
+        auto& out = stats.lanes[l];
+        out.name = LaneName(static_cast<RequestLane>(l));
+        out.concurrency = lane.concurrency;
+        out.running = lane.running;
+        for (int c = 0; c < kRequestClasses; ++c) {
+            const auto& state = lane.classes[c];
+            auto& cls = out.classes[c];
+            cls.name = RequestClassName(static_cast<RequestClass>(c));
+            cls.queued = state.queue.size();
+            cls.submitted = state.submitted;
+            cls.started = state.started;
+            cls.preempted = state.preempted;
+            cls.avg_wait_ms = state.started ? state.wait_ms_sum / state.started : 0.0;
+            cls.p95_wait_ms = state.wait.Percentile(0.95);
+            cls.max_wait_ms = state.wait_ms_max;
+        }
+    }
+    return stats;
+}
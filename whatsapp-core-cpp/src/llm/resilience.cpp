@@ -0,0 +1,157 @@
+#include "llm/resilience.h"
+#include <algorithm>
+#include <vector>
+#include <spdlog/spdlog.h>
+
+namespace {
+// Con menos muestras el p95 no significa nada y no hacemos hedging
+constexpr size_t kMinSamples = 20;
+constexpr size_t kRecomputeEvery = 16;
+constexpr double kBackoffBaseMs = 100;
+constexpr double kBackoffCapMs = 2000;
+}
+
+// ==========================================
+// LatencyTracker
+// ==========================================
+void LatencyTracker::Record(double ms) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_samples[m_next] = ms;
+    m_next = (m_next + 1) % kWindow;
+    m_count++;
+    if (m_count >= kMinSamples && m_count % kRecomputeEvery == 0) {
+        size_t n = std::min(m_count, kWindow);
+        std::vector<double> sorted(m_samples.begin(), m_samples.begin() + n);
+        size_t idx = static_cast<size_t>(0.95 * (n - 1));
+        std::nth_element(sorted.begin(), sorted.begin() + idx, sorted.end());
+        m_p95 = sorted[idx];
+    }
+}
+
+double LatencyTracker::Percentile(double p) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t n = std::min(m_count, kWindow);
+    if (n == 0) return 0;
+    std::vector<double> sorted(m_samples.begin(), m_samples.begin() + n);
+    size_t idx = static_cast<size_t>(std::clamp(p, 0.0, 1.0) * (n - 1));
+    std::nth_element(sorted.begin(), sorted.begin() + idx, sorted.end());
+    return sorted[idx];
+}
+
+double LatencyTracker::P95() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_p95;
+}
+
+size_t LatencyTracker::Samples() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_count;
+}
+
+// ==========================================
+// RetryBudget
+// ==========================================
+RetryBudget::RetryBudget(double ratio, double min_per_second, double max_tokens)
+    : m_ratio(ratio), m_min_per_second(min_per_second), m_max_tokens(max_tokens), m_tokens(max_tokens),
+      m_last_refill(std::chrono::steady_clock::now()) {}
+
+void RetryBudget::RefillLocked() {
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - m_last_refill).count();
+    m_last_refill = now;
+    m_tokens = std::min(m_max_tokens, m_tokens + seconds * m_min_per_second);
+}
+
+void RetryBudget::OnRequest() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_tokens = std::min(m_max_tokens, m_tokens + m_ratio);
+}
+
+bool RetryBudget::TryWithdraw() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    RefillLocked();
+    if (m_tokens < 1.0) return false;
+    m_tokens -= 1.0;
+    return true;
+}
+
+std::chrono::milliseconds RetryBudget::Backoff(int attempt) {
+    double ceiling = std::min(kBackoffCapMs, kBackoffBaseMs * (1 << std::min(attempt, 10)));
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::uniform_real_distribution<double> dist(0.0, ceiling);
+    return std::chrono::milliseconds(static_cast<long>(dist(m_rng)));
+}
+
+// ==========================================
+// CircuitBreaker
+// ==========================================
+CircuitBreaker::CircuitBreaker(int failure_threshold, std::chrono::milliseconds open_for,
+                               std::chrono::milliseconds max_open_for)
+    : m_threshold(failure_threshold), m_base_open_for(open_for), m_max_open_for(max_open_for), m_open_for(open_for) {}
+
+bool CircuitBreaker::Allow() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    switch (m_state) {
+        case State::Closed:
+            return true;
+        case State::Open:
+            if (std::chrono::steady_clock::now() - m_opened_at < m_open_for) return false;
+            m_state = State::HalfOpen;
+            m_probe_in_flight = true;
+            return true;
+        case State::HalfOpen:
+            if (m_probe_in_flight) return false;
+            m_probe_in_flight = true;
+            return true;
+    }
+    return true;
+}
+
+bool CircuitBreaker::IsOpen() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_state == State::Open && std::chrono::steady_clock::now() - m_opened_at < m_open_for;
+}
+
+void CircuitBreaker::OnSuccess() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_state != State::Closed) spdlog::info("🟢 Circuit breaker cerrado: Ollama responde de nuevo");
+    m_state = State::Closed;
+    m_failures = 0;
+    m_open_for = m_base_open_for;
+    m_probe_in_flight = false;
+}
+
+void CircuitBreaker::OnFailure() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_failures++;
+    if (m_state == State::HalfOpen) {
+        // La prueba falló: otra vez abierto y más tiempo
+        m_open_for = std::min(m_max_open_for, m_open_for * 2);
+    } else if (m_state != State::Closed || m_failures < m_threshold) {
+        return;
+    }
+    m_state = State::Open;
+    m_opened_at = std::chrono::steady_clock::now();
+    m_probe_in_flight = false;
+    spdlog::warn("🔴 Circuit breaker abierto tras {} fallos: se falla al instante durante {} ms",
+                 m_failures, m_open_for.count());
+}
+
+void CircuitBreaker::OnCancel() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_probe_in_flight = false;
+}
+
+CircuitBreaker::State CircuitBreaker::GetState() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_state;
+}
+
+const char* CircuitBreaker::StateName(State state) {
+    switch (state) {
+        case State::Closed: return "closed";
+        case State::Open: return "open";
+        case State::HalfOpen: return "half_open";
+    }
+    return "unknown";
+}
@@ -1,6 +1,7 @@
 #include <iostream>
 #include <memory>
 #include <cstdlib> // Necesario para std::getenv
+#include <stdexcept>
 #include <spdlog/spdlog.h>
 
 // Librerías del Servidor
@@ -8,20 +9,34 @@
 
 // Componentes del Sistema
 #include "utils/logger.h"
+#include "utils/trace.h"
+#include "utils/memory.h"
 #include "ingest/ingest_controller.h"
 
 // Componentes RAG y Persistencia
 #include "persistence/message_database.h"
+#include "persistence/database_pool.h"
 #include "llm/ollama_client.h"
+#include "llm/embedder.h"
+#include "llm/hashing_embedder.h"
 #include "rag/vector_store.h"
 #include "rag/rag_service.h"
+#include "rag/answer_cache.h"
 
 // Declaración externa de la función de conexión
 MYSQL* db_connect(); 
 
 int main() {
-    // 1. Inicializar Logger
-    init_logger();
+    // 1. Inicializar Logger (asíncrono). LOG_LEVEL: nivel inicial; LOG_FORMAT=json: una línea JSON
+    // por log; LOG_QUEUE_SIZE: mensajes en cola hacia stdout. Nivel y muestreo cambian luego en /debug/log
+    LoggerOptions logger_options;
+    const char* env_log_level = std::getenv("LOG_LEVEL");
+    if (env_log_level) logger_options.level = env_log_level;
+    const char* env_log_format = std::getenv("LOG_FORMAT");
+    if (env_log_format && std::string(env_log_format) == "json") logger_options.json = true;
+    const char* env_log_queue = std::getenv("LOG_QUEUE_SIZE");
+    if (env_log_queue && std::atoi(env_log_queue) > 0) logger_options.queue_size = std::atoi(env_log_queue);
+    init_logger(logger_options);
     spdlog::info("🚀 WhatsApp Core Backend iniciando...");
 
     try {
@@ -31,6 +46,9 @@ int main() {
         
         // A. Conexión a MariaDB
         spdlog::info("🔌 Conectando a Base de Datos...");
+        // DB_POOL_SIZE: conexiones abiertas como máximo (las peticiones de más esperan su turno)
+        const char* env_pool_size = std::getenv("DB_POOL_SIZE");
+        if (env_pool_size && std::atoi(env_pool_size) > 0) DBPool::configure(std::atoi(env_pool_size));
         MYSQL* conn = db_connect();
         
         // B. Crear Repositorio (MessageDatabase)
@@ -44,27 +62,153 @@ int main() {
         const char* env_host = std::getenv("OLLAMA_HOST");
         std::string ollama_url = env_host ? env_host : "http://localhost:11434"; // Fallback por defecto
 
-        spdlog::info("🔌 Conectando a Cerebro IA (Ollama) en: {}", ollama_url);
+        // OLLAMA_HOSTS: varios servidores con roles y peso, p. ej.
+        // "http://gpu1:11434=embed+chat,http://gpu2:11434=embed:2" (si está, manda sobre OLLAMA_HOST)
+        const char* env_hosts = std::getenv("OLLAMA_HOSTS");
+        std::vector<BackendConfig> backends;
+        if (env_hosts) backends = ParseBackendList(env_hosts);
+        if (backends.empty()) backends.push_back(BackendConfig{ollama_url});
+
+        for (const auto& backend : backends) {
+            spdlog::info("🔌 Conectando a Cerebro IA (Ollama) en: {} ({}{}, peso {:.1f})", backend.url,
+                         backend.embed ? "embed" : "", backend.chat ? (backend.embed ? "+chat" : "chat") : "",
+                         backend.weight);
+        }
 
         // B. Cliente Ollama
         // Usamos "qwen2.5:7b" como modelo principal de Chat (tu GPU lo moverá rápido)
-        // Nota: El modelo de embeddings ("nomic-embed-text") está hardcoded dentro de OllamaClient.cpp
-        auto ollama = std::make_shared<OllamaClient>(ollama_url, "qwen2.5:7b");
+        // Nota: El modelo de embeddings es "nomic-embed-text" salvo que OLLAMA_EMBED_MODEL diga otro
+        auto ollama = std::make_shared<OllamaClient>(backends, "qwen2.5:7b");
+        // OLLAMA_KEEP_ALIVE: cuánto tiempo se queda el modelo en VRAM entre preguntas ("-1" = siempre)
+        const char* env_keep_alive = std::getenv("OLLAMA_KEEP_ALIVE");
+        if (env_keep_alive) ollama->SetKeepAlive(env_keep_alive);
+        const char* env_embed_model = std::getenv("OLLAMA_EMBED_MODEL");
+        if (env_embed_model) ollama->SetEmbeddingModel(env_embed_model);
+
+        // EMBEDDER=hashing: embeddings deterministas en proceso (pruebas de carga y benchmarks sin
+        // servidor de modelos; no sirven para preguntas reales)
+        // OLLAMA_EMBED_DIM: dimensión de los vectores del modelo de embeddings. Sin ella se le pregunta
+        // a Ollama con un embedding de prueba; si no responde no arrancamos (con una dimensión
+        // equivocada el índice rechazaría todos los vectores y la ingesta se perdería entera)
+        const char* env_embedder = std::getenv("EMBEDDER");
+        const char* env_embed_dim = std::getenv("OLLAMA_EMBED_DIM");
+        int embed_dim_hint = env_embed_dim ? std::atoi(env_embed_dim) : 0;
+        std::shared_ptr<Embedder> embedder;
+        if (env_embedder && std::string(env_embedder) == "hashing") {
+            embedder = std::make_shared<HashingEmbedder>(embed_dim_hint > 0 ? embed_dim_hint : 768);
+        } else {
+            int dimension = embed_dim_hint;
+            if (dimension <= 0) {
+                auto probe = OllamaEmbedder(ollama).Embed("dimension", Deadline::After(std::chrono::seconds(10)));
+                if (probe.empty()) {
+                    throw std::runtime_error("Ollama no devolvió el embedding de prueba: define OLLAMA_EMBED_DIM "
+                                             "(p. ej. 768 para nomic-embed-text) para arrancar sin preguntarle");
+                }
+                dimension = static_cast<int>(probe.size());
+            }
+            embedder = std::make_shared<OllamaEmbedder>(ollama, dimension);
+        }
+        spdlog::info("🧬 Embeddings: {} ({} dimensiones)", embedder->Name(), embedder->Dimension());
         
         // C. Almacén Vectorial (FAISS)
-        // Usamos dimensión 768 porque es lo que genera "nomic-embed-text"
-        auto vector_store = std::make_shared<VectorStore>(768); 
+        // La dimensión es la del modelo de embeddings (ver OLLAMA_EMBED_DIM)
+        const int embed_dim = embedder->Dimension();
+        // Opcional: VECTOR_TRANSFORM=pca|matryoshka + VECTOR_DIM=256|384 reduce los vectores antes de indexarlos
+        const char* env_transform = std::getenv("VECTOR_TRANSFORM");
+        const char* env_vector_dim = std::getenv("VECTOR_DIM");
+        int reduced_dim = env_vector_dim ? std::atoi(env_vector_dim) : 256;
+        auto transform = MakeVectorTransform(env_transform ? env_transform : "", embed_dim, reduced_dim);
+        if (transform) {
+            spdlog::info("📐 Reducción de embeddings activa: {} {} -> {} dims", transform->Name(), embed_dim, reduced_dim);
+        }
+        auto vector_store = std::make_shared<VectorStore>(embed_dim, std::move(transform)); 
         
-        // D. Servicio RAG (El orquestador)
-        auto rag_service = std::make_shared<RagService>(ollama, vector_store, db);
+        // D. Caché semántica de respuestas (ANSWER_CACHE_SIZE=0 la desactiva)
+        const char* env_cache_size = std::getenv("ANSWER_CACHE_SIZE");
+        const char* env_cache_threshold = std::getenv("ANSWER_CACHE_THRESHOLD");
+        int cache_size = env_cache_size ? std::atoi(env_cache_size) : 256;
+        float cache_threshold = env_cache_threshold ? std::strtof(env_cache_threshold, nullptr) : 0.95f;
+        std::shared_ptr<AnswerCache> answer_cache;
+        if (cache_size > 0) {
+            answer_cache = std::make_shared<AnswerCache>(cache_size, cache_threshold);
+            spdlog::info("⚡ Caché de respuestas: {} entradas, umbral coseno {:.2f}", cache_size, cache_threshold);
+        }
+
+        // E. Servicio RAG (El orquestador)
+        // RAG_NEIGHBORS: mensajes vecinos que acompañan a cada hit en el contexto
+        RagOptions rag_options;
+        const char* env_neighbors = std::getenv("RAG_NEIGHBORS");
+        if (env_neighbors) rag_options.neighbor_radius = std::atoi(env_neighbors);
+        // RAG_MMR_FETCH: candidatos que re-ordena MMR (0 = top-k directo); RAG_MMR_LAMBDA: relevancia vs. diversidad
+        const char* env_mmr_fetch = std::getenv("RAG_MMR_FETCH");
+        if (env_mmr_fetch) rag_options.mmr_fetch_k = std::atoi(env_mmr_fetch);
+        const char* env_mmr_lambda = std::getenv("RAG_MMR_LAMBDA");
+        if (env_mmr_lambda) rag_options.mmr_lambda = std::strtof(env_mmr_lambda, nullptr);
+        // CHAT_DEADLINE_MS: plazo por defecto de /chat (la cabecera X-Request-Timeout-Ms lo sobreescribe)
+        const char* env_deadline = std::getenv("CHAT_DEADLINE_MS");
+        if (env_deadline) rag_options.default_deadline_ms = std::atoi(env_deadline);
+        // RAG_IO_THREADS: llamadas bloqueantes simultáneas de /chat; RAG_LEXICAL_K: hits extra por LIKE en MariaDB
+        const char* env_io_threads = std::getenv("RAG_IO_THREADS");
+        if (env_io_threads) rag_options.io_threads = std::atoi(env_io_threads);
+        const char* env_lexical_k = std::getenv("RAG_LEXICAL_K");
+        if (env_lexical_k) rag_options.lexical_k = std::atoi(env_lexical_k);
+        // RAG_SINGLE_FLIGHT=0: cada /chat genera por su cuenta aunque la pregunta sea idéntica
+        const char* env_single_flight = std::getenv("RAG_SINGLE_FLIGHT");
+        if (env_single_flight && std::string(env_single_flight) == "0") rag_options.single_flight = false;
+        // RAG_INGEST_MODE=window: indexa ventanas de conversación (RAG_WINDOW_GAP_S de silencio
+        // o RAG_WINDOW_TOKENS de texto las cortan) en lugar de un vector por mensaje
+        const char* env_ingest_mode = std::getenv("RAG_INGEST_MODE");
+        if (env_ingest_mode && std::string(env_ingest_mode) == "window") rag_options.window_ingest = true;
+        const char* env_window_gap = std::getenv("RAG_WINDOW_GAP_S");
+        if (env_window_gap) rag_options.window.max_gap_seconds = std::atoll(env_window_gap);
+        const char* env_window_tokens = std::getenv("RAG_WINDOW_TOKENS");
+        if (env_window_tokens) rag_options.window.max_tokens = std::atoi(env_window_tokens);
+        // RAG_WINDOW_TRACKED: ventanas cerradas cuyo ancla (mensaje central) se recuerda para Ask
+        const char* env_window_tracked = std::getenv("RAG_WINDOW_TRACKED");
+        if (env_window_tracked) rag_options.window.max_tracked_windows = std::strtoul(env_window_tracked, nullptr, 10);
+        // RAG_HISTORY_LIMIT: mensajes del historial que se indexan al arrancar;
+        // RAG_BACKFILL_CONCURRENCY: embeddings de ese historial en vuelo a la vez
+        const char* env_history_limit = std::getenv("RAG_HISTORY_LIMIT");
+        if (env_history_limit) rag_options.history_limit = std::atoi(env_history_limit);
+        const char* env_backfill = std::getenv("RAG_BACKFILL_CONCURRENCY");
+        if (env_backfill) rag_options.backfill_concurrency = std::atoi(env_backfill);
+        // RAG_EMBED_CONCURRENCY / RAG_CHAT_CONCURRENCY: peticiones a Ollama en vuelo como máximo;
+        // lo que no cabe espera en el planificador (/chat primero, luego ingesta en vivo, luego historial)
+        const char* env_embed_conc = std::getenv("RAG_EMBED_CONCURRENCY");
+        if (env_embed_conc) rag_options.embed_concurrency = std::atoi(env_embed_conc);
+        const char* env_chat_conc = std::getenv("RAG_CHAT_CONCURRENCY");
+        if (env_chat_conc) rag_options.chat_concurrency = std::atoi(env_chat_conc);
+        auto rag_service = std::make_shared<RagService>(ollama, vector_store, db, answer_cache, rag_options, embedder);
         spdlog::info("🧠 Servicio RAG inicializado correctamente");
 
+        // F. Contabilidad de memoria (/debug/memory). En este orden se pide memoria si el proceso
+        // pasa de su límite: la caché se reconstruye sola, las conexiones se reabren, el resto no se toca.
+        // MEMORY_SOFT_LIMIT_MB: límite blando del RSS (por defecto, 85 % del límite del contenedor);
+        // MEMORY_LIMITS: por componente en MB, p. ej. "answer_cache=64,vector_store=4096"
+        if (answer_cache) Memory().Register("answer_cache", answer_cache);
+        Memory().Register("db_pool", std::make_shared<DBPoolMemory>());
+        Memory().Register("ingest_queues", rag_service);
+        Memory().Register("vector_store", vector_store);
+        MemoryLimits memory_limits;
+        const char* env_memory_limit = std::getenv("MEMORY_SOFT_LIMIT_MB");
+        if (env_memory_limit) memory_limits.process_soft_limit = std::strtoull(env_memory_limit, nullptr, 10) * 1024 * 1024;
+        const char* env_memory_components = std::getenv("MEMORY_LIMITS");
+        if (env_memory_components) memory_limits.components = ParseMemoryLimits(env_memory_components);
+        Memory().Configure(memory_limits);
+        if (auto report = Memory().Report(); report.process_soft_limit > 0) {
+            spdlog::info("🧯 Límite blando de memoria: {} MB (RSS actual {} MB)",
+                         report.process_soft_limit / (1024 * 1024), report.allocator.rss / (1024 * 1024));
+        }
+
         // ==========================================
-        // 🆕 CARGAR MEMORIA DEL PASADO
+        // 🆕 CARGAR MEMORIA DEL PASADO (en segundo plano)
         // ==========================================
-        // Esto leerá los mensajes antiguos de la DB, generará embeddings con Nomic
-        // y los indexará en FAISS RAM.
-        rag_service->LoadHistoryFromDB();
+        // Warm-up: carga el 7B y deja el system prompt en la caché KV (OLLAMA_WARMUP=0 lo desactiva).
+        // Después leerá los mensajes antiguos de la DB, generará embeddings con Nomic
+        // y los indexará en FAISS RAM. El servidor escucha desde ya: /healthz responde al momento
+        // y /readyz da 503 con el progreso hasta que el índice está cargado.
+        const char* env_warmup = std::getenv("OLLAMA_WARMUP");
+        rag_service->StartBackgroundLoad(!env_warmup || std::string(env_warmup) != "0");
 
 
         // ==========================================
@@ -72,10 +216,23 @@ int main() {
         // ==========================================
         httplib::Server server;
 
+        // Trazas por petición: /chat e /ingest responden siempre con Server-Timing. Con
+        // TRACE_EXPORT_FILE además se guardan en OTLP/JSON las muestreadas (TRACE_SAMPLE_RATE,
+        // fracción 0..1) y todas las que tarden más de TRACE_SLOW_MS
+        TraceOptions trace_options;
+        const char* env_trace_file = std::getenv("TRACE_EXPORT_FILE");
+        if (env_trace_file) trace_options.export_path = env_trace_file;
+        const char* env_trace_rate = std::getenv("TRACE_SAMPLE_RATE");
+        if (env_trace_rate) trace_options.sample_rate = std::strtod(env_trace_rate, nullptr);
+        const char* env_trace_slow = std::getenv("TRACE_SLOW_MS");
+        if (env_trace_slow) trace_options.slow_ms = std::atoi(env_trace_slow);
+        ConfigureTracing(trace_options);
+
         // Instanciamos el controlador pasando:
         // 1. El cerebro (rag_service) para embedding/chat
         // 2. La memoria (db) para guardar mensajes nuevos
-        IngestController controller(rag_service, db);
+        // 3. El cliente de Ollama para ver y drenar sus servidores
+        IngestController controller(rag_service, db, ollama);
         
         // Registramos las rutas definidas en el controlador
         controller.RegisterRoutes(server);
@@ -85,7 +242,14 @@ int main() {
         // ==========================================
         std::cout << "\n✅ Core backend listening on port 8080\n";
         std::cout << "   - /ingest (POST): Recibe mensajes de WhatsApp\n";
-        std::cout << "   - /chat   (POST): Responde preguntas con RAG (Qwen 7B)\n\n";
+        std::cout << "   - /chat   (POST): Responde preguntas con RAG (Qwen 7B). {\"stream\": true} => SSE token a token\n";
+        std::cout << "   - /stats/cache (GET): Aciertos y latencia ahorrada por la caché de respuestas\n";
+        std::cout << "   - /stats/llm   (GET): Prompt-eval, cargas de modelo y colas del planificador\n";
+        std::cout << "   - /stats/ollama (GET) y /ollama/drain (POST): Servidores de Ollama, salud y drenaje\n";
+        std::cout << "   - /metrics     (GET): Métricas en formato Prometheus (latencias por etapa, colas, pools)\n";
+        std::cout << "   - /debug/log   (GET/POST): Nivel de log y muestreo por sitio, en caliente\n";
+        std::cout << "   - /debug/memory (GET): Memoria por componente, RSS, malloc y límites blandos\n";
+        std::cout << "   - /healthz, /readyz (GET): Sondas de vida y de índice cargado (con progreso y ETA)\n\n";
         
         // Escuchar en todas las interfaces
         server.listen("0.0.0.0", 8080);
@@ -1,19 +1,132 @@
 #include "persistence/database_pool.h"
 #include "persistence/message_database.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <stdexcept>
+#include <vector>
 
 static std::queue<MYSQL*> pool;
 static std::mutex mtx;
+static std::condition_variable returned;   // Una conexión vuelve al pool o se libera un hueco
+static size_t max_connections = DBPool::kDefaultMaxConnections;
+static size_t in_use = 0;   // Incluye las que se están abriendo (reservan su hueco)
+static size_t created = 0;
+static size_t closed = 0;
+static std::atomic<long> result_bytes{0};   // Sin mtx: se toca en cada fila leída
+
+// Más que el timeout de conexión de db_connect: si el pool está lleno tanto tiempo, MariaDB va mal
+static constexpr auto kAcquireTimeout = std::chrono::seconds(10);
+
+void DBPool::configure(size_t max) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        max_connections = std::max<size_t>(max, 1);
+    }
+    returned.notify_all();
+}
 
 MYSQL* DBPool::acquire() {
-    std::lock_guard<std::mutex> lock(mtx);
-    if (pool.empty())
-        return db_connect();
-    auto c = pool.front();
-    pool.pop();
+    std::unique_lock<std::mutex> lock(mtx);
+    bool ready = returned.wait_for(lock, kAcquireTimeout, [] {
+        return !pool.empty() || in_use + pool.size() < max_connections;
+    });
+    if (!ready) throw std::runtime_error("DBPool: sin conexiones libres");
+
+    MYSQL* c = nullptr;
+    if (!pool.empty()) {
+        c = pool.front();
+        pool.pop();
+    }
+    // Hueco reservado; el ping o la conexión nueva (hasta connect_timeout contra MariaDB) van sin el candado
+    in_use++;
+    lock.unlock();
+
+    if (c) {
+        // Ociosa: MariaDB puede haberla cortado (wait_timeout, reinicio). Mejor comprobarlo aquí que
+        // devolverle al llamador una conexión que falla en su primera query
+        if (mysql_ping(c) == 0) return c;
+        spdlog::warn("DBPool: conexión ociosa caída ({}), se abre otra", mysql_error(c));
+        mysql_close(c);
+        lock.lock();
+        closed++;
+        lock.unlock();
+    }
+
+    try {
+        c = db_connect();   // Lanza si MariaDB no responde: entonces no cuenta
+    } catch (...) {
+        lock.lock();
+        in_use--;
+        lock.unlock();
+        returned.notify_one();
+        throw;
+    }
+    lock.lock();
+    created++;
     return c;
 }
 
 void DBPool::release(MYSQL* conn) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        in_use--;
+        pool.push(conn);
+    }
+    returned.notify_one();
+}
+
+void DBPool::adopt(MYSQL* conn) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        created++;
+        pool.push(conn);
+    }
+    returned.notify_one();
+}
+
+DBPoolStats DBPool::stats() {
     std::lock_guard<std::mutex> lock(mtx);
-    pool.push(conn);
+    return {pool.size(), in_use, created, closed, static_cast<size_t>(std::max(0L, result_bytes.load(std::memory_order_relaxed)))};
+}
+
+size_t DBPool::trim(size_t keep_idle) {
+    std::vector<MYSQL*> victims;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        while (pool.size() > keep_idle) {
+            victims.push_back(pool.front());
+            pool.pop();
+        }
+        closed += victims.size();
+    }
+    // mysql_close habla con el servidor (COM_QUIT): fuera del candado
+    for (MYSQL* conn : victims) mysql_close(conn);
+    if (!victims.empty()) returned.notify_all();   // Huecos libres para quien espera
+    return victims.size();
+}
+
+void DBPool::track_result(long bytes) {
+    result_bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+MemoryUsage DBPoolMemory::GetMemoryUsage() const {
+    auto s = DBPool::stats();
+    size_t connections = s.idle + s.in_use;
+    MemoryUsage usage;
+    usage.items = connections;
+    usage.parts = {{"connections", connections * kConnectionBytes}, {"result_buffers", s.result_bytes}};
+    usage.bytes = connections * kConnectionBytes + s.result_bytes;
+    return usage;
+}
+
+size_t DBPoolMemory::ReleaseMemory(size_t target_bytes) {
+    auto s = DBPool::stats();
+    size_t used = (s.idle + s.in_use) * kConnectionBytes + s.result_bytes;
+    if (used <= target_bytes) return 0;
+    size_t excess_connections = (used - target_bytes + kConnectionBytes - 1) / kConnectionBytes;
+    size_t keep_idle = s.idle > excess_connections ? s.idle - excess_connections : 0;
+    return DBPool::trim(keep_idle) * kConnectionBytes;
 }
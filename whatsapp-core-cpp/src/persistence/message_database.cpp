@@ -1,7 +1,15 @@
 #include "persistence/message_database.h"
+#include "persistence/database_pool.h"
+#include "utils/logger.h"
 #include <spdlog/spdlog.h>
 #include <stdexcept>
 #include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <algorithm>
+#include <cctype>
 
 // ==========================================
 // 1. Función Helper para conectar (Tu código original)
@@ -9,12 +17,25 @@
 MYSQL* db_connect() {
     MYSQL* conn = mysql_init(nullptr);
 
+    // Sin esto una query colgada bloquea /chat indefinidamente (el plazo de la petición no llega a MariaDB)
+    unsigned int connect_timeout_s = 5;
+    unsigned int io_timeout_s = 10;
+    mysql_options(conn, MYSQL_OPT_CONNECT_TIMEOUT, &connect_timeout_s);
+    mysql_options(conn, MYSQL_OPT_READ_TIMEOUT, &io_timeout_s);
+    mysql_options(conn, MYSQL_OPT_WRITE_TIMEOUT, &io_timeout_s);
+
+    // DB_HOST / DB_USER / DB_PASSWORD / DB_NAME: por defecto los del despliegue (core_bench y las
+    // pruebas locales apuntan así a otra base)
+    auto env_or = [](const char* name, const char* fallback) {
+        const char* value = std::getenv(name);
+        return value ? value : fallback;
+    };
     if (!mysql_real_connect(
             conn,
-            "mariadb-service",
-            "qwenuser",
-            "mypassword",
-            "STRIX_MAIN",
+            env_or("DB_HOST", "mariadb-service"),
+            env_or("DB_USER", "qwenuser"),
+            env_or("DB_PASSWORD", "mypassword"),
+            env_or("DB_NAME", "STRIX_MAIN"),
             0, nullptr, 0)) {
         throw std::runtime_error(mysql_error(conn));
     }
@@ -24,6 +45,65 @@ MYSQL* db_connect() {
     return conn;
 }
 
+// Escapa un valor para meterlo entre comillas simples en una query
+static std::string escape(MYSQL* conn, const std::string& value) {
+    std::string out(value.length() * 2 + 1, '\0');
+    unsigned long len = mysql_real_escape_string(conn, out.data(), value.c_str(), value.length());
+    out.resize(len);
+    return out;
+}
+
+// La columna timestamp puede venir como epoch (BIGINT) o como DATETIME ("YYYY-MM-DD HH:MM:SS")
+static long long parse_timestamp(const char* raw) {
+    if (!raw || !*raw) return 0;
+    std::tm t{};
+    if (std::strlen(raw) >= 19 && raw[4] == '-' &&
+        std::sscanf(raw, "%d-%d-%d %d:%d:%d", &t.tm_year, &t.tm_mon, &t.tm_mday, &t.tm_hour, &t.tm_min, &t.tm_sec) == 6) {
+        t.tm_year -= 1900;
+        t.tm_mon -= 1;
+        return static_cast<long long>(timegm(&t));
+    }
+    return std::atoll(raw);
+}
+
+// Resultado de mysql_store_result: todas las filas quedan en memoria del cliente hasta liberarlo.
+// Cada fila leída con Next cuenta en el pool (db_pool.result_buffers en /debug/memory) hasta que
+// se libera. Se cuenta al recorrerla, sin una pasada extra: los llamantes leen sus resultados enteros
+// (las consultas de una sola fila llevan LIMIT 1).
+class StoredResult {
+public:
+    explicit StoredResult(MYSQL* conn) : m_result(mysql_store_result(conn)) {
+        if (m_result) m_fields = mysql_num_fields(m_result);
+    }
+    ~StoredResult() {
+        if (!m_result) return;
+        mysql_free_result(m_result);
+        DBPool::track_result(-static_cast<long>(m_bytes));
+    }
+
+    StoredResult(const StoredResult&) = delete;
+    StoredResult& operator=(const StoredResult&) = delete;
+
+    // mysql_fetch_row + contabilidad de la fila
+    MYSQL_ROW Next() {
+        MYSQL_ROW row = mysql_fetch_row(m_result);
+        if (!row) return row;
+        unsigned long* lengths = mysql_fetch_lengths(m_result);
+        size_t bytes = m_fields * (sizeof(char*) + 1) + 3 * sizeof(void*);   // Punteros de la fila + '\0' + nodo
+        for (unsigned int i = 0; i < m_fields; ++i) bytes += row[i] ? lengths[i] : 0;
+        m_bytes += bytes;
+        DBPool::track_result(static_cast<long>(bytes));
+        return row;
+    }
+
+    explicit operator bool() const { return m_result != nullptr; }
+
+private:
+    MYSQL_RES* m_result;
+    unsigned int m_fields = 0;
+    size_t m_bytes = 0;
+};
+
 // ==========================================
 // 2. Implementación de la Clase MessageDatabase
 // ==========================================
@@ -32,11 +112,22 @@ MYSQL* db_connect() {
 MessageDatabase::MessageDatabase(MYSQL* conn) : m_conn(conn) {
     if (m_conn == nullptr) {
         spdlog::critical("MessageDatabase inicializada con conexión NULL");
+        return;
     }
+
+    // Índice para GetMessageWindow (vecinos de un mensaje dentro de su chat)
+    if (mysql_query(m_conn, "CREATE INDEX IF NOT EXISTS idx_messages_chat_ts ON messages (chat_jid, timestamp)")) {
+        spdlog::warn("No se pudo crear el índice (chat_jid, timestamp): {}", mysql_error(m_conn));
+    }
+
+    // La conexión inicial pasa al pool; a partir de aquí cada método toma prestada una (ScopedConnection)
+    DBPool::adopt(m_conn);
 }
 
 void MessageDatabase::upsert_chat(const nlohmann::json& msg) {
     if (!m_conn) return;
+    ScopedConnection lease; // Conexión propia: /ingest y /chat llegan en paralelo
+    MYSQL* conn = lease.get();
 
     // Extraemos datos básicos con seguridad (evita crash si faltan campos)
     std::string jid = msg.value("chat_jid", "");
@@ -48,13 +139,15 @@ void MessageDatabase::upsert_chat(const nlohmann::json& msg) {
     std::string query = "INSERT INTO chats (jid, name) VALUES ('" + jid + "', '" + name + "') "
                         "ON DUPLICATE KEY UPDATE name = VALUES(name)";
 
-    if (mysql_query(m_conn, query.c_str())) {
-        spdlog::error("Error upsert_chat: {}", mysql_error(m_conn));
+    if (mysql_query(conn, query.c_str())) {
+        spdlog::error("Error upsert_chat: {}", mysql_error(conn));
     }
 }
 
 void MessageDatabase::insert_message(const nlohmann::json& msg) {
     if (!m_conn) return;
+    ScopedConnection lease;
+    MYSQL* conn = lease.get();
 
     // Extraer campos del JSON
     std::string id = msg.value("id", "");
@@ -69,16 +162,17 @@ void MessageDatabase::insert_message(const nlohmann::json& msg) {
 
     // Escapar el contenido para evitar errores SQL con comillas simples ' o caracteres raros
     char* escaped_content = new char[content.length() * 2 + 1];
-    mysql_real_escape_string(m_conn, escaped_content, content.c_str(), content.length());
+    mysql_real_escape_string(conn, escaped_content, content.c_str(), content.length());
 
     std::string query = "INSERT IGNORE INTO messages (id, chat_jid, sender, content, timestamp, is_from_me) "
                         "VALUES ('" + id + "', '" + chat_jid + "', '" + sender_name + "', '" + 
                         std::string(escaped_content) + "', " + std::to_string(timestamp) + ", " + (is_from_me ? "1" : "0") + ")";
 
-    if (mysql_query(m_conn, query.c_str())) {
-        spdlog::error("Error insert_message: {}", mysql_error(m_conn));
+    if (mysql_query(conn, query.c_str())) {
+        spdlog::error("Error insert_message: {}", mysql_error(conn));
     } else {
-        spdlog::info("💾 Mensaje guardado en DB: {}", id);
+        // Una línea por mensaje a ritmo de ingesta: como mucho 5 por segundo
+        LOG_SAMPLED("db.insert_message", 1, 5, spdlog::level::info, "💾 Mensaje guardado en DB: {}", id);
     }
 
     delete[] escaped_content;
@@ -87,32 +181,35 @@ void MessageDatabase::insert_message(const nlohmann::json& msg) {
 std::vector<DBMessage> MessageDatabase::GetAllMessages(int limit) {
     std::vector<DBMessage> messages;
     if (!m_conn) return messages;
+    ScopedConnection lease;
+    MYSQL* conn = lease.get();
 
     // Ordenamos descendente para coger los últimos, y luego invertimos o procesamos
     // Aquí cogemos los últimos 'limit' mensajes
-    std::string query = "SELECT id, sender, content FROM messages ORDER BY timestamp DESC LIMIT " + std::to_string(limit);
+    std::string query = "SELECT id, sender, content, chat_jid, timestamp FROM messages ORDER BY timestamp DESC LIMIT " + std::to_string(limit);
  
-    if (mysql_query(m_conn, query.c_str())) {
-        spdlog::error("Error cargando historial: {}", mysql_error(m_conn));
+    if (mysql_query(conn, query.c_str())) {
+        spdlog::error("Error cargando historial: {}", mysql_error(conn));
         return messages;
     }
 
-    MYSQL_RES* result = mysql_store_result(m_conn);
+    StoredResult result(conn);
     if (!result) return messages;
 
     MYSQL_ROW row;
-    while ((row = mysql_fetch_row(result))) {
+    while ((row = result.Next())) {
         DBMessage msg;
         msg.id = row[0] ? row[0] : "";
         msg.sender = row[1] ? row[1] : "Unknown";
         msg.content = row[2] ? row[2] : "";
+        msg.chat_jid = row[3] ? row[3] : "";
+        msg.timestamp = parse_timestamp(row[4]);
         
         // Solo añadimos si tiene contenido válido
         if (!msg.content.empty() && !msg.id.empty()) {
             messages.push_back(msg);
         }
     }
-    mysql_free_result(result);
     
     spdlog::info("📂 Recuperados {} mensajes antiguos de la base de datos.", messages.size());
     return messages;
@@ -121,20 +218,22 @@ std::vector<DBMessage> MessageDatabase::GetAllMessages(int limit) {
 // NUEVO MÉTODO PARA RAG
 std::string MessageDatabase::GetMessageContentById(const std::string& id) {
     if (!m_conn) return "";
+    ScopedConnection lease;
+    MYSQL* conn = lease.get();
 
     // Query para obtener solo el contenido
     std::string query = "SELECT sender, content FROM messages WHERE id = '" + id + "' LIMIT 1";
 
-    if (mysql_query(m_conn, query.c_str())) {
-        spdlog::error("Error buscando mensaje por ID: {}", mysql_error(m_conn));
+    if (mysql_query(conn, query.c_str())) {
+        spdlog::error("Error buscando mensaje por ID: {}", mysql_error(conn));
         return "";
     }
 
-    MYSQL_RES* result = mysql_store_result(m_conn);
+    StoredResult result(conn);
     if (!result) return "";
 
     std::string full_text = "";
-    if (MYSQL_ROW row = mysql_fetch_row(result)) {
+    if (MYSQL_ROW row = result.Next()) {
         std::string sender = row[0] ? row[0] : "Desconocido";
         std::string content = row[1] ? row[1] : "";
         
@@ -142,6 +241,124 @@ std::string MessageDatabase::GetMessageContentById(const std::string& id) {
         full_text = sender + ": " + content;
     }
 
-    mysql_free_result(result);
     return full_text;
-}
\ No newline at end of file
+}
+
+std::optional<DBMessage> MessageDatabase::GetMessageById(const std::string& id) {
+    if (!m_conn) return std::nullopt;
+    ScopedConnection lease;
+    MYSQL* conn = lease.get();
+
+    std::string query = "SELECT id, sender, content, chat_jid, timestamp FROM messages WHERE id = '" +
+                        escape(conn, id) + "' LIMIT 1";
+
+    if (mysql_query(conn, query.c_str())) {
+        spdlog::error("Error buscando mensaje por ID: {}", mysql_error(conn));
+        return std::nullopt;
+    }
+
+    StoredResult result(conn);
+    if (!result) return std::nullopt;
+
+    std::optional<DBMessage> msg;
+    if (MYSQL_ROW row = result.Next()) {
+        msg = DBMessage{};
+        msg->id = row[0] ? row[0] : "";
+        msg->sender = row[1] ? row[1] : "Desconocido";
+        msg->content = row[2] ? row[2] : "";
+        msg->chat_jid = row[3] ? row[3] : "";
+        msg->timestamp = parse_timestamp(row[4]);
+    }
+
+    return msg;
+}
+
+std::vector<DBMessage> MessageDatabase::GetMessageWindow(const std::string& id, int radius) {
+    std::vector<DBMessage> window;
+    if (!m_conn) return window;
+    ScopedConnection lease;
+    MYSQL* conn = lease.get();
+
+    // Ancla = el propio mensaje. Parte 1: él y los 'radius' anteriores; parte 2: los 'radius' siguientes.
+    // Ambas usan el índice (chat_jid, timestamp), así que es un único viaje a MariaDB por hit.
+    // Orden total (timestamp, id) en las dos mitades: con varios mensajes en el mismo segundo, el
+    // ancla no puede quedarse fuera de su propia ventana ni un vecino salir dos veces.
+    std::string safe_id = escape(conn, id);
+    std::string anchor = "(SELECT id, chat_jid, timestamp FROM messages WHERE id = '" + safe_id + "' LIMIT 1)";
+    std::string cols = "SELECT m.id, m.sender, m.content, m.chat_jid, m.timestamp FROM messages m JOIN " + anchor + " a ON m.chat_jid = a.chat_jid ";
+
+    std::string query =
+        "(" + cols + "WHERE m.timestamp < a.timestamp OR (m.timestamp = a.timestamp AND m.id <= a.id) "
+        "ORDER BY m.timestamp DESC, m.id DESC LIMIT " + std::to_string(radius + 1) + ") "
+        "UNION ALL "
+        "(" + cols + "WHERE m.timestamp > a.timestamp OR (m.timestamp = a.timestamp AND m.id > a.id) "
+        "ORDER BY m.timestamp ASC, m.id ASC LIMIT " + std::to_string(radius) + ")";
+
+    if (mysql_query(conn, query.c_str())) {
+        spdlog::error("Error buscando ventana de conversación: {}", mysql_error(conn));
+        return window;
+    }
+
+    StoredResult result(conn);
+    if (!result) return window;
+
+    MYSQL_ROW row;
+    while ((row = result.Next())) {
+        DBMessage msg;
+        msg.id = row[0] ? row[0] : "";
+        msg.sender = row[1] ? row[1] : "Desconocido";
+        msg.content = row[2] ? row[2] : "";
+        msg.chat_jid = row[3] ? row[3] : "";
+        msg.timestamp = parse_timestamp(row[4]);
+        if (!msg.id.empty()) window.push_back(std::move(msg));
+    }
+
+    // La primera parte llega en orden descendente: dejamos todo cronológico
+    std::sort(window.begin(), window.end(), [](const DBMessage& a, const DBMessage& b) {
+        return a.timestamp != b.timestamp ? a.timestamp < b.timestamp : a.id < b.id;
+    });
+    return window;
+}
+
+std::vector<std::string> MessageDatabase::SearchMessagesByText(const std::string& text, int limit) {
+    std::vector<std::string> ids;
+    if (!m_conn) return ids;
+    ScopedConnection lease;
+    MYSQL* conn = lease.get();
+
+    // Palabras clave: las 5 más largas de la pregunta (>= 4 letras), para no hacer LIKE de "que" o "el"
+    std::vector<std::string> words;
+    std::string current;
+    for (char c : text + " ") {
+        if (std::isalnum(static_cast<unsigned char>(c)) || (c & 0x80)) {
+            current += c;
+        } else {
+            if (current.size() >= 4) words.push_back(current);
+            current.clear();
+        }
+    }
+    if (words.empty()) return ids;
+    std::sort(words.begin(), words.end(), [](const std::string& a, const std::string& b) { return a.size() > b.size(); });
+    words.resize(std::min<size_t>(words.size(), 5));
+
+    std::string where;
+    for (const auto& w : words) {
+        if (!where.empty()) where += " OR ";
+        where += "content LIKE '%" + escape(conn, w) + "%'";
+    }
+    std::string query = "SELECT id FROM messages WHERE " + where + " ORDER BY timestamp DESC LIMIT " + std::to_string(limit);
+
+    if (mysql_query(conn, query.c_str())) {
+        spdlog::error("Error en búsqueda léxica: {}", mysql_error(conn));
+        return ids;
+    }
+
+    StoredResult result(conn);
+    if (!result) return ids;
+
+    MYSQL_ROW row;
+    while ((row = result.Next())) {
+        if (row[0]) ids.emplace_back(row[0]);
+    }
+    return ids;
+}
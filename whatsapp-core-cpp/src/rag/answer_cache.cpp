@@ -0,0 +1,149 @@
+#include "rag/answer_cache.h"
+#include <spdlog/spdlog.h>
+#include <cmath>
+
+static std::vector<float> normalize(const std::vector<float>& v) {
+    float norm = 0.0f;
+    for (float x : v) norm += x * x;
+    norm = std::sqrt(norm);
+
+    std::vector<float> out(v.size());
+    float scale = norm > 0.0f ? 1.0f / norm : 0.0f;
+    for (size_t i = 0; i < v.size(); ++i) out[i] = v[i] * scale;
+    return out;
+}
+
+static float dot(const std::vector<float>& a, const std::vector<float>& b) {
+    if (a.size() != b.size()) return -1.0f;
+    float sum = 0.0f;
+    for (size_t i = 0; i < a.size(); ++i) sum += a[i] * b[i];
+    return sum;
+}
+
+AnswerCache::AnswerCache(size_t capacity, float cosine_threshold)
+    : m_capacity(capacity), m_threshold(cosine_threshold) {}
+
+std::optional<std::string> AnswerCache::Lookup(const std::vector<float>& query_vec,
+                                               const std::vector<std::string>& context_ids) {
+    auto q = normalize(query_vec);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Búsqueda lineal: con unos cientos de entradas son microsegundos frente a segundos de LLM
+    auto best = m_entries.end();
+    float best_sim = m_threshold;
+    for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+        if (it->context_ids != context_ids) continue;
+        float sim = dot(q, it->query_vec);
+        if (sim >= best_sim) {
+            best_sim = sim;
+            best = it;
+        }
+    }
+
+    if (best == m_entries.end()) {
+        m_stats.misses++;
+        return std::nullopt;
+    }
+
+    m_stats.hits++;
+    m_stats.saved_ms += best->cost_ms;
+    m_entries.splice(m_entries.begin(), m_entries, best); // LRU: pasa a ser el más reciente
+    spdlog::info("⚡ Caché de respuestas: acierto (coseno {:.3f})", best_sim);
+    return m_entries.front().answer;
+}
+
+uint64_t AnswerCache::Generation() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_generation;
+}
+
+void AnswerCache::Insert(const std::vector<float>& query_vec,
+                         const std::vector<std::string>& context_ids,
+                         const std::set<std::string>& chats,
+                         const std::string& answer,
+                         double cost_ms,
+                         uint64_t generation) {
+    if (m_capacity == 0) return;
+
+    Entry entry;
+    entry.query_vec = normalize(query_vec);
+    entry.context_ids = context_ids;
+    entry.chats = chats;
+    entry.answer = answer;
+    entry.cost_ms = cost_ms;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto& chat : entry.chats) {
+        auto it = m_chat_generation.find(chat);
+        if (it != m_chat_generation.end() && it->second > generation) {
+            m_stats.invalidations++;
+            return;
+        }
+    }
+    m_bytes += EntryBytes(entry);
+    m_entries.push_front(std::move(entry));
+    while (m_entries.size() > m_capacity) PopBack();
+}
+
+size_t AnswerCache::EntryBytes(const Entry& entry) {
+    // Nodo de la lista (2 punteros) + Entry + lo que cada miembro tiene en el heap.
+    // std::set: 32 B de árbol + el string por nodo
+    size_t bytes = 2 * sizeof(void*) + sizeof(Entry);
+    bytes += entry.query_vec.capacity() * sizeof(float);
+    bytes += entry.context_ids.capacity() * sizeof(std::string);
+    for (const auto& id : entry.context_ids) bytes += StringHeapBytes(id);
+    for (const auto& chat : entry.chats) bytes += 32 + sizeof(std::string) + StringHeapBytes(chat);
+    bytes += StringHeapBytes(entry.answer);
+    return bytes;
+}
+
+void AnswerCache::PopBack() {
+    m_bytes -= EntryBytes(m_entries.back());
+    m_entries.pop_back();
+}
+
+void AnswerCache::InvalidateChat(const std::string& chat_jid) {
+    if (chat_jid.empty()) return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto [generation, inserted] = m_chat_generation.try_emplace(chat_jid, 0);
+    generation->second = ++m_generation;
+    if (inserted) m_generation_bytes += 2 * sizeof(void*) + sizeof(std::string) + sizeof(uint64_t) + StringHeapBytes(chat_jid);
+
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+        if (it->chats.count(chat_jid)) {
+            m_bytes -= EntryBytes(*it);
+            it = m_entries.erase(it);
+            m_stats.invalidations++;
+        } else {
+            ++it;
+        }
+    }
+}
+
+AnswerCacheStats AnswerCache::GetStats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    AnswerCacheStats stats = m_stats;
+    stats.entries = m_entries.size();
+    stats.bytes = m_bytes + m_generation_bytes;
+    return stats;
+}
+
+MemoryUsage AnswerCache::GetMemoryUsage() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    MemoryUsage usage;
+    usage.bytes = m_bytes + m_generation_bytes + m_chat_generation.bucket_count() * sizeof(void*);
+    usage.items = m_entries.size();
+    return usage;
+}
+
+size_t AnswerCache::ReleaseMemory(size_t target_bytes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t before = m_bytes;
+    while (!m_entries.empty() && m_bytes > target_bytes) {
+        PopBack();
+        m_stats.evictions++;
+    }
+    return before - m_bytes;
+}
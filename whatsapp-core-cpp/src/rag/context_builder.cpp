@@ -0,0 +1,161 @@
+#include "rag/context_builder.h"
+#include <algorithm>
+#include <cctype>
+#include <unordered_set>
+
+int ApproxTokenCount(std::string_view text) {
+    int tokens = 0;
+    int word_chars = 0;
+
+    auto flush_word = [&]() {
+        if (word_chars > 0) tokens += 1 + (word_chars - 1) / 4;
+        word_chars = 0;
+    };
+
+    for (size_t i = 0; i < text.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+
+        if (c < 0x80) {
+            if (std::isalnum(c)) {
+                word_chars++;
+            } else {
+                flush_word();
+                if (!std::isspace(c)) tokens++;  // Puntuación / símbolos
+            }
+            continue;
+        }
+
+        // UTF-8: contamos caracteres, no bytes (los bytes 10xxxxxx son continuación)
+        if ((c & 0xC0) == 0x80) continue;
+        if (c >= 0xF0) {
+            // Emojis y demás planos altos: el BPE suele partirlos en varios tokens
+            flush_word();
+            tokens += 2;
+        } else {
+            word_chars++;  // Tildes, ñ... forman parte de la palabra
+        }
+    }
+    flush_word();
+    return tokens;
+}
+
+std::string BuildUserPrompt(const std::string& context, const std::string& question) {
+    static constexpr std::string_view kHeader = "### CONTEXTO ###\n";
+    static constexpr std::string_view kFooter = "### FIN CONTEXTO ###\n\nPREGUNTA: ";
+    std::string prompt;
+    prompt.reserve(kHeader.size() + context.size() + kFooter.size() + question.size());
+    prompt.append(kHeader).append(context).append(kFooter).append(question);
+    return prompt;
+}
+
+void ContextBuilder::Merge(Window& into, std::vector<DBMessage>&& extra) {
+    std::unordered_set<std::string> seen;
+    for (const auto& m : into.messages) seen.insert(m.id);
+    for (auto& m : extra) {
+        if (seen.insert(m.id).second) into.messages.push_back(std::move(m));
+    }
+    // Mismo orden que GetMessageWindow: (timestamp, id), para que mensajes del mismo segundo no
+    // cambien de sitio según qué ventana llegó primero
+    std::sort(into.messages.begin(), into.messages.end(), [](const DBMessage& a, const DBMessage& b) {
+        return a.timestamp != b.timestamp ? a.timestamp < b.timestamp : a.id < b.id;
+    });
+}
+
+bool ContextBuilder::Overlaps(const Window& a, const Window& b) {
+    if (a.chat_jid != b.chat_jid) return false;
+    return a.messages.front().timestamp <= b.messages.back().timestamp &&
+           b.messages.front().timestamp <= a.messages.back().timestamp;
+}
+
+void ContextBuilder::AddWindow(std::vector<DBMessage> window, const std::string& hit_id) {
+    if (window.empty()) return;
+
+    Window incoming;
+    incoming.chat_jid = window.front().chat_jid;
+    incoming.hit_ids.insert(hit_id);
+    Merge(incoming, std::move(window));
+
+    // La ventana nueva puede unir dos existentes: todas acaban en la más relevante
+    auto first = std::find_if(m_windows.begin(), m_windows.end(),
+                              [&](const Window& w) { return Overlaps(w, incoming); });
+    if (first == m_windows.end()) {
+        m_windows.push_back(std::move(incoming));
+        return;
+    }
+
+    first->hit_ids.insert(hit_id);
+    Merge(*first, std::move(incoming.messages));
+
+    for (auto it = first + 1; it != m_windows.end();) {
+        if (Overlaps(*it, *first)) {
+            first->hit_ids.insert(it->hit_ids.begin(), it->hit_ids.end());
+            Merge(*first, std::move(it->messages));
+            it = m_windows.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+BuiltContext ContextBuilder::Build(int token_budget) const {
+    BuiltContext out;
+
+    for (const auto& window : m_windows) {
+        const auto& msgs = window.messages;
+        std::vector<std::string> lines;
+        std::vector<int> costs;
+        int window_cost = 1;  // Línea en blanco separadora
+        for (const auto& m : msgs) {
+            lines.push_back("- " + m.sender + ": " + m.content + "\n");
+            costs.push_back(ApproxTokenCount(lines.back()) + 1);
+            window_cost += costs.back();
+        }
+
+        std::vector<bool> keep(msgs.size(), false);
+        int remaining = token_budget - out.tokens;
+
+        if (window_cost <= remaining) {
+            std::fill(keep.begin(), keep.end(), true);
+            remaining -= window_cost;
+        } else {
+            // No cabe entera: primero los hits, luego vecinos alternando antes/después
+            remaining -= 1;
+            std::vector<size_t> hits;
+            for (size_t i = 0; i < msgs.size(); ++i) {
+                if (window.hit_ids.count(msgs[i].id) && costs[i] <= remaining) {
+                    keep[i] = true;
+                    remaining -= costs[i];
+                    hits.push_back(i);
+                }
+            }
+            if (hits.empty()) continue;
+
+            // Paramos en cuanto un vecino no cabe (no queremos huecos en la conversación)
+            bool blocked = false;
+            for (size_t dist = 1; dist < msgs.size() && !blocked; ++dist) {
+                for (size_t h : hits) {
+                    for (long idx : {static_cast<long>(h) - static_cast<long>(dist), static_cast<long>(h + dist)}) {
+                        if (idx < 0 || idx >= static_cast<long>(msgs.size()) || keep[idx]) continue;
+                        if (costs[idx] > remaining) {
+                            blocked = true;
+                            continue;
+                        }
+                        keep[idx] = true;
+                        remaining -= costs[idx];
+                    }
+                }
+            }
+        }
+
+        if (out.windows > 0) out.text += "\n";
+        for (size_t i = 0; i < msgs.size(); ++i) {
+            if (!keep[i]) continue;
+            out.text += lines[i];
+            out.messages++;
+        }
+        out.windows++;
+        out.chats.insert(window.chat_jid);
+        out.tokens = token_budget - remaining;
+    }
+    return out;
+}
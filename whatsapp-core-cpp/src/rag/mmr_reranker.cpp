@@ -0,0 +1,60 @@
+#include "rag/mmr_reranker.h"
+#include <faiss/utils/distances.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+std::vector<ScoredHit> MmrReranker::Rerank(const SearchCandidates& candidates, int k) const {
+    const size_t n = candidates.ids.size();
+    const size_t d = candidates.dim;
+    if (n == 0 || d == 0 || k <= 0) return {};
+
+    // Normas para pasar de producto escalar a coseno (los embeddings de Ollama no vienen normalizados)
+    auto inv_norm = [d](const float* v) {
+        float norm = std::sqrt(faiss::fvec_norm_L2sqr(v, d));
+        return norm > 0 ? 1.0f / norm : 0.0f;
+    };
+    const float* xb = candidates.vectors.data();
+    std::vector<float> inv_norms(n);
+    for (size_t i = 0; i < n; ++i) inv_norms[i] = inv_norm(xb + i * d);
+
+    // Relevancia: coseno de cada candidato con la pregunta (un único barrido vectorizado)
+    std::vector<float> relevance(n);
+    faiss::fvec_inner_products_ny(relevance.data(), candidates.query.data(), xb, d, n);
+    const float query_inv = inv_norm(candidates.query.data());
+    for (size_t i = 0; i < n; ++i) relevance[i] *= query_inv * inv_norms[i];
+
+    // max_sim[i]: parecido del candidato i con el más parecido de los ya elegidos.
+    // Se actualiza con un barrido por cada elegido en vez de precalcular la matriz n*n.
+    std::vector<float> max_sim(n, -std::numeric_limits<float>::infinity());
+    std::vector<float> sims(n);
+    std::vector<char> taken(n, 0);
+
+    std::vector<ScoredHit> result;
+    const size_t want = std::min<size_t>(k, n);
+    result.reserve(want);
+
+    while (result.size() < want) {
+        size_t best = n;
+        float best_score = -std::numeric_limits<float>::infinity();
+        for (size_t i = 0; i < n; ++i) {
+            if (taken[i]) continue;
+            float redundancy = result.empty() ? 0.0f : max_sim[i];
+            float score = m_lambda * relevance[i] - (1.0f - m_lambda) * redundancy;
+            if (score > best_score) {
+                best_score = score;
+                best = i;
+            }
+        }
+        if (best == n) break;
+
+        taken[best] = 1;
+        result.push_back({candidates.ids[best], relevance[best], best_score});
+
+        faiss::fvec_inner_products_ny(sims.data(), xb + best * d, xb, d, n);
+        for (size_t i = 0; i < n; ++i) {
+            max_sim[i] = std::max(max_sim[i], sims[i] * inv_norms[best] * inv_norms[i]);
+        }
+    }
+    return result;
+}
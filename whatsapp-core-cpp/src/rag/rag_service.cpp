@@ -1,121 +1,873 @@
 #include "rag/rag_service.h"
 #include "llm/ollama_client.h"
+#include "llm/embedder.h"
+#include "llm/request_scheduler.h"
 #include "rag/vector_store.h"
+#include "rag/answer_cache.h"
+#include "rag/context_builder.h"
+#include "rag/single_flight.h"
+#include "rag/mmr_reranker.h"
+#include "utils/executor.h"
+#include "utils/metrics.h"
+#include "utils/logger.h"
 #include "persistence/repository.h"
 #include <spdlog/spdlog.h>
-#include <sstream>
+#include <set>
+#include <unordered_map>
+#include <chrono>
+#include <algorithm>
+#include <future>
+
+// =========================================================================
+// 🧠 SYSTEM PROMPT: EL CEREBRO DEL ASISTENTE
+// =========================================================================
+// Constante y byte a byte idéntica en todas las peticiones (y en el warm-up):
+// Ollama reutiliza su caché KV para este prefijo y solo evalúa contexto + pregunta.
+// Las instrucciones que antes iban al principio del user prompt viven aquí por el mismo motivo.
+static const std::string kSystemPrompt =
+    "Eres un Asistente de Memoria Personal inteligente y útil. "
+    "Tu trabajo es responder a mis preguntas basándote en el historial de mis chats recuperados.\n"
+    "\nFORMATO: Cada mensaje te llega con los fragmentos relevantes de mi historial de chat entre "
+    "'### CONTEXTO ###' y '### FIN CONTEXTO ###' (conversaciones separadas por una línea en blanco), "
+    "seguidos de mi pregunta tras 'PREGUNTA:'. Responde basándote en ese contexto."
+    "\n\nINSTRUCCIONES CLAVE:"
+    "\n1. INTERPRETACIÓN DE USUARIOS: El nombre 'Yo (Sistema)' o 'Yo' se refiere a MÍ (el usuario actual). Cuando hables de lo que dije, usa 'Tú dijiste...'. Los otros nombres son mis contactos."
+    "\n2. FUENTE DE VERDAD: Usa ÚNICAMENTE el bloque de 'CONTEXTO'. Si la respuesta no está ahí, di 'No recuerdo haber hablado de eso'."
+    "\n3. CONTRADICCIONES: Si encuentras información contradictoria (ej. dos colores favoritos o dos claves distintas), menciona AMBAS opciones indicando que aparecen en momentos diferentes."
+    "\n4. PRIVACIDAD: Estos son mis datos personales. Si pregunto por un dato exacto (como una clave, dirección o número) que aparece en el contexto, tienes permiso para mostrármelo.";
+
+// Nodo de m_backfill_keys (siguiente + clave + hash cacheado) y el heap de la clave
+static size_t BackfillKeyBytes(const std::string& key) {
+    return 2 * sizeof(void*) + sizeof(std::string) + StringHeapBytes(key);
+}
+
+void RagService::WarmUp() {
+    m_llm->WarmUp(kSystemPrompt);
+}
+
+ChatStats RagService::GetLlmStats() const {
+    return m_llm->GetChatStats();
+}
+
+HttpStats RagService::GetHttpStats() const {
+    return m_llm->GetHttpStats();
+}
+
+ResilienceStats RagService::GetResilienceStats() const {
+    return m_llm->GetResilienceStats();
+}
+
+SchedulerStats RagService::GetSchedulerStats() const {
+    return m_scheduler->GetStats();
+}
+
+size_t RagService::IndexSize() const {
+    return m_vec_store->Size();
+}
+
+IoPoolStats RagService::GetIoPoolStats() const {
+    return {m_io_pool->Size(), m_io_pool->Busy(), m_io_pool->Pending()};
+}
+
+TransformReport RagService::GetTransformReport() const {
+    return m_vec_store->GetTransformReport();
+}
+
+MemoryUsage RagService::GetMemoryUsage() const {
+    MemoryUsage usage;
+    size_t parked_bytes = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_parked_mutex);
+        usage.items += m_parked.size();
+        parked_bytes = m_parked_bytes;
+    }
+    size_t backfill_bytes = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_backfill_mutex);
+        usage.items += m_backfill.total - m_backfill.done;
+        backfill_bytes = m_backfill_bytes + m_backfill_key_bytes + m_backfill_keys.bucket_count() * sizeof(void*);
+    }
+    size_t window_bytes = m_chunker ? m_chunker->MemoryBytes() : 0;
+
+    usage.parts = {{"parked", parked_bytes}, {"backfill", backfill_bytes}, {"windows", window_bytes}};
+    usage.bytes = parked_bytes + backfill_bytes + window_bytes;
+    return usage;
+}
 
 void RagService::LoadHistoryFromDB() {
+    RunHistoryBackfill(SnapshotHistory());
+}
+
+std::vector<RagService::BackfillItem> RagService::SnapshotHistory() {
     spdlog::info("⏳ Iniciando carga de historial en RAG (Esto puede tardar)...");
     
-    // 1. Pedimos los últimos 50 mensajes (puedes cambiar el número)
+    // 1. Pedimos los últimos mensajes (RagOptions::history_limit)
     // Si pones muchos, Ollama tardará bastante en generar los embeddings.
-    auto history = m_db->GetAllMessages(1000); 
+    auto history = m_db->GetAllMessages(m_options.history_limit); 
+    // Las ventanas se construyen en orden cronológico (la consulta devuelve los más recientes primero)
+    if (m_chunker) std::reverse(history.begin(), history.end());
+
+    // 2. Qué hay que embeber. Solo esto toca el estado compartido, y es rápido (sin red)
+    std::vector<BackfillItem> items;
+    if (!m_chunker) {
+        for (const auto& msg : history) {
+            // Mismo filtro y mismo texto que IngestMessage
+            if (msg.content.length() < 2) continue;
+            items.push_back({msg.id, msg.sender + ": " + msg.content, false});
+        }
+    } else {
+        std::vector<WindowUpdate> updates;
+        {
+            // En modo ventana no refrescamos la ventana abierta a cada paso: solo cuenta la versión final.
+            // Las colas de cada chat quedan abiertas para los mensajes en vivo, pero ya indexadas.
+            std::lock_guard<std::mutex> lock(m_ingest_mutex);
+            for (const auto& msg : history) {
+                if (msg.content.empty()) continue;
+                auto closed = m_chunker->Add(msg, false);
+                updates.insert(updates.end(), closed.begin(), closed.end());
+            }
+            auto tails = m_chunker->Flush();
+            updates.insert(updates.end(), tails.begin(), tails.end());
+            auto stats = m_chunker->GetStats();
+            spdlog::info("🪟 Ventanas: {} mensajes -> {} ventanas", stats.messages, stats.windows);
+        }
+        // Una ventana puede salir varias veces: solo vale su última versión
+        std::unordered_map<std::string, size_t> position;
+        for (auto& update : updates) {
+            auto [it, inserted] = position.emplace(update.key, items.size());
+            if (inserted) {
+                items.push_back({update.key, std::move(update.text), true});
+            } else {
+                items[it->second].text = std::move(update.text);
+            }
+        }
+        std::lock_guard<std::mutex> lock(m_backfill_mutex);
+        for (const auto& item : items) {
+            if (m_backfill_keys.insert(item.key).second) m_backfill_key_bytes += BackfillKeyBytes(item.key);
+        }
+    }
+    spdlog::info("📂 Historial: {} mensajes, {} embeddings por calcular", history.size(), items.size());
+    return items;
+}
+
+void RagService::RunHistoryBackfill(std::vector<BackfillItem> items) {
+    // 3. Embeddings en paralelo con concurrencia acotada
+    RunBackfill(std::move(items));
+    {
+        std::lock_guard<std::mutex> lock(m_backfill_mutex);
+        if (m_backfill_cancel) return;
+        m_backfill.state = "done";
+        m_backfill.elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_backfill_started).count();
+        m_ready = true;
+    }
 
-    int count = 0;
-    int total = history.size();
+    auto progress = GetBackfillProgress();
+    spdlog::info("✅ Carga de historial completada. {} embeddings ({} a la cola de reintentos) en {:.1f} s.",
+                 progress.done, progress.failed, progress.elapsed_s);
+}
 
-    for (const auto& msg : history) {
-        count++;
-        // Usamos spdlog para mostrar progreso en la misma línea si es posible, o log normal
-        if (count % 5 == 0) spdlog::info("PROGRESO: Indexando {}/{}", count, total);
+void RagService::RunBackfill(std::vector<BackfillItem> items) {
+    const int limit = std::max(1, m_options.backfill_concurrency);
+    {
+        std::lock_guard<std::mutex> lock(m_backfill_mutex);
+        m_backfill.state = "running";
+        m_backfill.total += items.size();
+        m_backfill_started = std::chrono::steady_clock::now();
+        for (const auto& item : items) m_backfill_bytes += item.Bytes();
+    }
 
-        // Llamamos a nuestra propia función de ingesta.
-        // Como IngestMessage tiene mutex, es seguro.
-        IngestMessage(msg.id, msg.content, msg.sender);
+    for (auto& item : items) {
+        {
+            std::unique_lock<std::mutex> lock(m_backfill_mutex);
+            // Aquí solo se acota lo que encolamos; quién pasa primero a Ollama lo decide el planificador
+            m_backfill_cv.wait(lock, [&] { return m_backfill_cancel || m_backfill_in_flight < limit; });
+            // Memoria bajo presión: el historial espera (es lo que más hace crecer el índice)
+            while (!m_backfill_cancel && Memory().UnderPressure()) {
+                m_backfill_cv.wait_for(lock, std::chrono::seconds(1));
+            }
+            if (m_backfill_cancel) break;
+            m_backfill_in_flight++;
+        }
+        auto shared = std::make_shared<BackfillItem>(std::move(item));
+        ScheduleEmbed(RequestClass::Backfill, shared->text, {}, [this, shared](std::vector<float> embedding) {
+            // El callback llega en el event loop de Ollama: la escritura en FAISS (que puede disparar
+            // un reentreno de PCA con el índice bloqueado) no debe frenar las demás transferencias
+            m_io_pool->Post([this, shared, embedding = std::move(embedding)]() mutable {
+                OnBackfillEmbedding(*shared, std::move(embedding));
+            });
+        });
     }
 
-    spdlog::info("✅ Carga de historial completada. {} mensajes listos en memoria.", total);
+    // Los callbacks usan 'this': no salimos hasta que vuelva el último
+    std::unique_lock<std::mutex> lock(m_backfill_mutex);
+    m_backfill_cv.wait(lock, [this] { return m_backfill_in_flight == 0; });
+    m_backfill_bytes = 0;   // Lo que quedó sin lanzar (cancelado) ya no está pendiente
 }
+
+// Se ejecuta en m_io_pool: FAISS en memoria y contadores
+void RagService::OnBackfillEmbedding(const BackfillItem& item, std::vector<float> embedding) {
+    bool ok = !embedding.empty();
+    if (!ok) {
+        ParkEmbedding({item.key, item.text, item.upsert});
+    } else if (item.upsert) {
+        std::lock_guard<std::mutex> lock(m_backfill_mutex);
+        if (m_backfill_keys.erase(item.key)) {
+            m_backfill_key_bytes -= BackfillKeyBytes(item.key);
+            m_vec_store->Upsert(item.key, embedding);
+        }
+    } else {
+        m_vec_store->AddIndex(item.key, embedding);
+    }
+
+    size_t done, total;
+    double elapsed_s;
+    {
+        std::lock_guard<std::mutex> lock(m_backfill_mutex);
+        m_backfill_in_flight--;
+        m_backfill_bytes -= std::min(m_backfill_bytes, item.Bytes());
+        done = ++m_backfill.done;
+        if (!ok) m_backfill.failed++;
+        total = m_backfill.total;
+        elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_backfill_started).count();
+    }
+    m_backfill_cv.notify_all();
+
+    if (done % 50 == 0 || done == total) {
+        double rate = elapsed_s > 0 ? done / elapsed_s : 0;
+        spdlog::info("PROGRESO: Indexando {}/{} ({:.0f} %, {:.1f}/s, ETA {:.0f} s)", done, total,
+                     total ? 100.0 * done / total : 100.0, rate, rate > 0 ? (total - done) / rate : 0.0);
+    }
+}
+
+BackfillProgress RagService::GetBackfillProgress() const {
+    std::lock_guard<std::mutex> lock(m_backfill_mutex);
+    BackfillProgress progress = m_backfill;
+    if (progress.state == "pending") return progress;
+    progress.percent = progress.total ? 100.0 * progress.done / progress.total : 100.0;
+    if (progress.state == "running") {
+        progress.elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_backfill_started).count();
+        progress.rate_per_s = progress.elapsed_s > 0 ? progress.done / progress.elapsed_s : 0;
+        progress.eta_s = progress.rate_per_s > 0 ? (progress.total - progress.done) / progress.rate_per_s : 0;
+    }
+    return progress;
+}
+
+void RagService::StartBackgroundLoad(bool warm_up) {
+    {
+        std::lock_guard<std::mutex> lock(m_backfill_mutex);
+        m_backfill.state = "running";
+        m_backfill_started = std::chrono::steady_clock::now();
+    }
+    // La foto del historial (y, con ventanas, su paso por el chunker) se toma aquí, antes de que el
+    // servidor acepte /ingest: lo que llegue en vivo durante el warm-up es posterior y no se
+    // indexa dos veces ni entra en las ventanas antes que los mensajes viejos de su chat.
+    // Es una sola consulta acotada por history_limit; los embeddings van en el hilo.
+    std::vector<BackfillItem> items;
+    try {
+        items = SnapshotHistory();
+    } catch (const std::exception& e) {
+        spdlog::error("🔥 Error cargando el historial: {}", e.what());
+        std::lock_guard<std::mutex> lock(m_backfill_mutex);
+        m_backfill.state = "failed";
+        m_backfill.error = e.what();
+        return;
+    }
+    m_backfill_thread = std::thread([this, warm_up, items = std::move(items)]() mutable {
+        try {
+            if (warm_up) WarmUp();
+            RunHistoryBackfill(std::move(items));
+            if (m_ready) spdlog::info("🟢 Listo para /readyz: índice cargado");
+        } catch (const std::exception& e) {
+            spdlog::error("🔥 Error cargando el historial: {}", e.what());
+            std::lock_guard<std::mutex> lock(m_backfill_mutex);
+            m_backfill.state = "failed";
+            m_backfill.error = e.what();
+        }
+    });
+}
+
 // Constructor
 RagService::RagService(std::shared_ptr<OllamaClient> llm, 
                        std::shared_ptr<VectorStore> v_store,
-                       std::shared_ptr<Repository> db)
-    : m_llm(llm), m_vec_store(v_store), m_db(db) {}
+                       std::shared_ptr<Repository> db,
+                       std::shared_ptr<AnswerCache> answer_cache,
+                       RagOptions options,
+                       std::shared_ptr<Embedder> embedder)
+    : m_llm(llm), m_embedder(embedder ? embedder : std::make_shared<OllamaEmbedder>(llm)),
+      m_scheduler(std::make_shared<RequestScheduler>(
+          SchedulerOptions{options.embed_concurrency, options.chat_concurrency})),
+      m_vec_store(v_store), m_db(db), m_answer_cache(answer_cache), m_options(options),
+      m_io_pool(std::make_shared<ThreadPool>(options.io_threads, "rag-io")),
+      m_single_flight(options.single_flight ? std::make_unique<SingleFlight>() : nullptr),
+      m_chunker(options.window_ingest ? std::make_unique<WindowChunker>(options.window) : nullptr),
+      m_retry_thread([this] { RetryParkedLoop(); }) {}
 
-void RagService::IngestMessage(const std::string& msg_id, const std::string& content, const std::string& sender) {
-    
-    // =================================================================================
-    // 🔒 CANDADO DE SEGURIDAD (MUTEX)
-    // =================================================================================
-    // Esto obliga a que los mensajes se procesen UNO A UNO, aunque lleguen 100 a la vez.
-    // Evita que FAISS explote por concurrencia y evita timeouts de Ollama.
-    std::lock_guard<std::mutex> lock(m_ingest_mutex);
-    // =================================================================================
+// El destructor va aquí, donde SingleFlight es un tipo completo (unique_ptr)
+RagService::~RagService() {
+    {
+        // Los callbacks de la ingesta en vivo usan 'this'
+        std::unique_lock<std::mutex> lock(m_live_mutex);
+        m_live_cv.wait(lock, [this] { return m_live_in_flight == 0; });
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_backfill_mutex);
+        m_backfill_cancel = true;
+    }
+    m_backfill_cv.notify_all();
+    if (m_backfill_thread.joinable()) m_backfill_thread.join();
+    {
+        std::lock_guard<std::mutex> lock(m_parked_mutex);
+        m_stopping = true;
+    }
+    m_parked_cv.notify_all();
+    m_retry_thread.join();
+}
+
+void RagService::ScheduleEmbed(RequestClass cls, std::string text, Deadline deadline,
+                               std::function<void(std::vector<float>)> done, bool requeue) {
+    static MetricHistogram& s_embedding = StageHistogram("embedding");
+    m_scheduler->Submit(RequestLane::Embed, cls, [this, cls, text, deadline, done](RequestScheduler::SlotPtr slot) {
+        auto started = std::chrono::steady_clock::now();
+        auto cancel = m_embedder->StartEmbed(text, deadline, [this, cls, text, deadline, done, slot, started](std::vector<float> embedding) {
+            // Si el corte llegó tarde y el embedding está, lo aprovechamos
+            bool preempted = slot->Preempted() && embedding.empty();
+            slot->Release();
+            if (preempted) {
+                ScheduleEmbed(cls, text, deadline, done, true);
+                return;
+            }
+            s_embedding.Observe(std::chrono::steady_clock::now() - started);
+            done(std::move(embedding));
+        });
+        slot->SetPreempt(std::move(cancel));
+    }, requeue);
+}
+
+std::vector<float> RagService::EmbedScheduled(RequestClass cls, const std::string& text) {
+    auto promise = std::make_shared<std::promise<std::vector<float>>>();
+    auto future = promise->get_future();
+    ScheduleEmbed(cls, text, {}, [promise](std::vector<float> embedding) { promise->set_value(std::move(embedding)); });
+    return future.get();
+}
+
+void RagService::IngestMessage(const DBMessage& msg, RequestTrace* trace) {
+    // Primero invalidamos: una pregunta que llegue justo ahora ya no debe ver la respuesta vieja
+    if (m_answer_cache) m_answer_cache->InvalidateChat(msg.chat_jid);
+    if (!m_chunker) {
+        // Asíncrono: la segunda invalidación la hace el callback cuando el vector ya está en FAISS
+        IngestAsync(msg.id, msg.content, msg.sender, msg.chat_jid);
+        return;
+    }
+    if (!msg.content.empty()) {
+        // Aquí no se descartan los mensajes cortos: no cuestan un embedding y dan contexto a la ventana.
+        // Solo esperan entre sí los mensajes del mismo chat: las versiones de su ventana se escriben en orden
+        std::shared_ptr<std::mutex> chat_mutex;
+        {
+            std::lock_guard<std::mutex> lock(m_ingest_mutex);
+            auto& slot = m_chat_ingest[msg.chat_jid];
+            if (!slot) slot = std::make_shared<std::mutex>();
+            chat_mutex = slot;
+        }
+        {
+            TraceSpan wait_span(trace, "ingest_wait");
+            std::lock_guard<std::mutex> chat_lock(*chat_mutex);
+            wait_span.End();
+            std::vector<WindowUpdate> updates;
+            {
+                std::lock_guard<std::mutex> lock(m_ingest_mutex);
+                updates = m_chunker->Add(msg);
+            }
+            IndexWindows(updates, trace);
+        }
+        std::lock_guard<std::mutex> lock(m_ingest_mutex);
+        // Nadie más espera en este chat (el mapa y nosotros): fuera, para que no crezca con cada chat visto
+        auto it = m_chat_ingest.find(msg.chat_jid);
+        if (it != m_chat_ingest.end() && it->second.use_count() == 2) m_chat_ingest.erase(it);
+    }
+    // Y otra vez ya indexado: una pregunta que recuperó contexto mientras se embebía no vio este mensaje
+    if (m_answer_cache) m_answer_cache->InvalidateChat(msg.chat_jid);
+}
+
+void RagService::IndexWindows(const std::vector<WindowUpdate>& updates, RequestTrace* trace) {
+    for (const auto& update : updates) {
+        {
+            // Esta versión es más nueva que la que pueda tener pendiente el backfill
+            std::lock_guard<std::mutex> lock(m_backfill_mutex);
+            if (m_backfill_keys.erase(update.key)) m_backfill_key_bytes -= BackfillKeyBytes(update.key);
+        }
+        TraceSpan embed_span(trace, "embedding");
+        auto embedding = EmbedScheduled(RequestClass::Live, update.text);
+        embed_span.End();
+        if (embedding.empty()) {
+            spdlog::warn("⚠️ Fallo al generar embedding para la ventana: {} (a la cola de reintentos)", update.key);
+            ParkEmbedding({update.key, update.text, true});
+            continue;
+        }
+        {
+            std::lock_guard<std::mutex> write_lock(m_window_write_mutex);
+            UnparkEmbedding(update.key);
+            TraceSpan upsert_span(trace, "index_upsert");
+            m_vec_store->Upsert(update.key, embedding);
+        }
+        LOG_SAMPLED("rag.window_indexed", 1, 5, spdlog::level::info, "🪟 Ventana indexada en RAG: {} ({} mensajes)",
+                    update.key, update.members);
+    }
+}
+
+AnswerCacheStats RagService::GetCacheStats() const {
+    return m_answer_cache ? m_answer_cache->GetStats() : AnswerCacheStats{};
+}
+
+SingleFlightStats RagService::GetSingleFlightStats() const {
+    return m_single_flight ? m_single_flight->GetStats() : SingleFlightStats{};
+}
+
+void RagService::IngestMessage(const std::string& msg_id, const std::string& content, const std::string& sender,
+                               RequestTrace*) {
+    IngestAsync(msg_id, content, sender, "");
+}
 
+void RagService::IngestAsync(const std::string& msg_id, const std::string& content, const std::string& sender,
+                             const std::string& chat_jid) {
     // 1. Validar limpieza (ignorar mensajes muy cortos)
     if (content.length() < 2) return;
 
     // 2. Crear texto enriquecido
     std::string text_to_embed = sender + ": " + content;
 
-    // 3. Obtener vector de Ollama (Esto puede tardar 0.2s - 1s)
-    auto embedding = m_llm->GetEmbedding(text_to_embed);
+    // 3. Pedimos el vector a Ollama sin esperarlo: el hilo de httplib responde ya y los mensajes no
+    //    se ponen en fila (el planificador acota lo que llega a Ollama; VectorStore tiene su propio candado)
+    {
+        std::lock_guard<std::mutex> lock(m_live_mutex);
+        m_live_in_flight++;
+    }
+    ScheduleEmbed(RequestClass::Live, text_to_embed, {}, [this, msg_id, text_to_embed, chat_jid](std::vector<float> embedding) {
+        // 4. Guardar en FAISS, fuera del event loop de Ollama (igual que el backfill)
+        m_io_pool->Post([this, msg_id, text_to_embed, chat_jid, embedding = std::move(embedding)] {
+            if (!embedding.empty()) {
+                m_vec_store->AddIndex(msg_id, embedding);
+                LOG_SAMPLED("rag.indexed", 1, 5, spdlog::level::info, "🧠 Mensaje indexado en RAG: {}", msg_id);
+            } else {
+                spdlog::warn("⚠️ Fallo al generar embedding para mensaje: {} (a la cola de reintentos)", msg_id);
+                ParkEmbedding({msg_id, text_to_embed, false});
+            }
+            // Ya indexado: una pregunta que recuperó contexto mientras se embebía no vio este mensaje
+            if (m_answer_cache && !chat_jid.empty()) m_answer_cache->InvalidateChat(chat_jid);
+            {
+                std::lock_guard<std::mutex> lock(m_live_mutex);
+                m_live_in_flight--;
+            }
+            m_live_cv.notify_all();
+        });
+    });
+}
 
-    // 4. Guardar en FAISS
-    if (!embedding.empty()) {
-        // NOTA: El orden suele ser (Vector, ID). Si tu VectorStore está al revés, cámbialo aquí.
-        m_vec_store->AddIndex(msg_id, embedding); 
-        spdlog::info("🧠 Mensaje indexado en RAG: {}", msg_id);
-    } else {
-        spdlog::warn("⚠️ Fallo al generar embedding para mensaje: {}", msg_id);
+// =========================================================================
+// COLA DE REINTENTOS DE EMBEDDINGS
+// =========================================================================
+namespace {
+constexpr size_t kMaxParked = 10000;          // Por encima se descartan los más antiguos
+constexpr int kMaxParkedAttempts = 20;
+constexpr size_t kRetryBatch = 8;             // Por ronda: la ingesta en vivo espera mientras tanto
+constexpr auto kRetryInterval = std::chrono::seconds(5);
+constexpr auto kIdleFlushInterval = std::chrono::seconds(30);
+}
+
+void RagService::ParkEmbedding(ParkedEmbedding item) {
+    std::lock_guard<std::mutex> lock(m_parked_mutex);
+    // Una ventana aparcada dos veces: solo cuenta su último texto
+    if (item.upsert) {
+        for (auto& parked : m_parked) {
+            if (parked.key == item.key) {
+                m_parked_bytes = m_parked_bytes - parked.Bytes() + item.Bytes();
+                parked = std::move(item);
+                return;
+            }
+        }
+    }
+    if (m_parked.size() >= kMaxParked) {
+        spdlog::error("❌ Cola de reintentos llena: se descarta el embedding de {}", m_parked.front().key);
+        m_parked_bytes -= m_parked.front().Bytes();
+        m_parked.pop_front();
+    }
+    m_parked_bytes += item.Bytes();
+    m_parked.push_back(std::move(item));
+}
+
+void RagService::UnparkEmbedding(const std::string& key) {
+    std::lock_guard<std::mutex> lock(m_parked_mutex);
+    if (key == m_retrying) m_retry_superseded = true;
+    if (m_parked.empty()) return;
+    m_parked.erase(std::remove_if(m_parked.begin(), m_parked.end(),
+                                  [&](const ParkedEmbedding& parked) {
+                                      if (parked.key != key) return false;
+                                      m_parked_bytes -= parked.Bytes();
+                                      return true;
+                                  }),
+                   m_parked.end());
+}
+
+size_t RagService::ParkedEmbeddings() const {
+    std::lock_guard<std::mutex> lock(m_parked_mutex);
+    return m_parked.size();
+}
+
+void RagService::FlushIdleWindows() {
+    std::vector<WindowUpdate> updates;
+    {
+        // El candado solo para cerrar: cualquier refresco en vivo de esas ventanas ya terminó, y lo que
+        // llegue después abre una ventana con clave nueva, así que esta versión es la última
+        std::lock_guard<std::mutex> lock(m_ingest_mutex);
+        updates = m_chunker->FlushIdle();
+    }
+    if (updates.empty()) return;
+    spdlog::debug("🪟 {} ventanas inactivas cerradas", updates.size());
+    IndexWindows(updates, nullptr);
+}
+
+void RagService::RetryParkedLoop() {
+    auto last_idle_flush = std::chrono::steady_clock::now();
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(m_parked_mutex);
+            m_parked_cv.wait_for(lock, kRetryInterval, [this] { return m_stopping; });
+            if (m_stopping) return;
+        }
+        if (m_chunker && std::chrono::steady_clock::now() - last_idle_flush >= kIdleFlushInterval) {
+            FlushIdleWindows();
+            last_idle_flush = std::chrono::steady_clock::now();
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_parked_mutex);
+            if (m_parked.empty()) continue;
+        }
+        // Con el breaker abierto ni lo intentamos: fallaría al instante
+        if (!m_embedder->Available()) continue;
+
+        // Sin el candado de ingesta: la ingesta en vivo no espera a estos reintentos. Si mientras
+        // embebemos una ventana se indexa una versión más nueva, UnparkEmbedding lo marca y la
+        // nuestra (más vieja) no se escribe
+        size_t recovered = 0;
+        for (size_t i = 0; i < kRetryBatch; ++i) {
+            ParkedEmbedding item;
+            {
+                std::lock_guard<std::mutex> lock(m_parked_mutex);
+                if (m_parked.empty() || m_stopping) break;
+                item = std::move(m_parked.front());
+                m_parked_bytes -= item.Bytes();
+                m_parked.pop_front();
+                if (item.upsert) m_retrying = item.key;
+                m_retry_superseded = false;
+            }
+
+            // Clase Backfill: nadie espera por estos embeddings
+            auto embedding = EmbedScheduled(RequestClass::Backfill, item.text);
+
+            std::unique_lock<std::mutex> write_lock(m_window_write_mutex, std::defer_lock);
+            if (item.upsert) write_lock.lock();
+            bool superseded;
+            {
+                std::lock_guard<std::mutex> lock(m_parked_mutex);
+                superseded = m_retry_superseded;
+                m_retrying.clear();
+            }
+            if (superseded) continue;
+
+            if (embedding.empty()) {
+                if (++item.attempts >= kMaxParkedAttempts) {
+                    spdlog::error("❌ Embedding de {} descartado tras {} intentos", item.key, item.attempts);
+                } else {
+                    ParkEmbedding(std::move(item));
+                }
+                break; // Ollama sigue mal: esperamos a la siguiente ronda
+            }
+            if (item.upsert) {
+                m_vec_store->Upsert(item.key, embedding);
+            } else {
+                m_vec_store->AddIndex(item.key, embedding);
+            }
+            recovered++;
+        }
+        if (recovered > 0) spdlog::info("🔁 Recuperados {} embeddings aparcados ({} pendientes)", recovered, ParkedEmbeddings());
     }
 }
 
-std::string RagService::Ask(const std::string& question) {
+Deadline RagService::DefaultDeadline() const {
+    if (m_options.default_deadline_ms <= 0) return {};
+    return Deadline::After(std::chrono::milliseconds(m_options.default_deadline_ms));
+}
+
+std::string RagService::Ask(const std::string& question, const TokenCallback& on_token, const Deadline& deadline,
+                            RequestTrace* trace) {
+    // Frontera con httplib: el handler espera aquí, pero el trabajo corre en corrutinas sobre m_io_pool
+    if (!m_single_flight) return SyncWait(AskAsync(question, on_token, deadline, trace));
+
+    const std::string key = SingleFlight::MakeKey(question);
+    auto ticket = m_single_flight->Join(key);
+    if (!ticket.leader) {
+        // Las etapas las mide la traza del líder; aquí solo cuánto esperamos su respuesta
+        TraceSpan follow_span(trace, "single_flight_follow");
+        return ticket.call->Follow(on_token, deadline);
+    }
+
+    // Líder: siempre generamos en streaming para poder republicar cada token a los seguidores.
+    // Si su cliente se va seguimos generando mientras quede algún seguidor.
+    auto call = ticket.call;
+    auto publish = [&](const std::string& token) {
+        call->Publish(token);
+        bool client_alive = !on_token || on_token(token);
+        return client_alive || call->HasFollowers();
+    };
+
+    std::string answer;
+    try {
+        answer = SyncWait(AskAsync(question, publish, deadline, trace));
+    } catch (const GenerationInterrupted& e) {
+        // Los seguidores que ya recibieron tokens también la ven lanzarse
+        call->Fail(e.what(), std::current_exception());
+        m_single_flight->Leave(key, call);
+        // El líder genera en streaming aunque su cliente no lo pida: sin on_token no vio nada a medias
+        if (on_token) throw;
+        return e.what();
+    } catch (...) {
+        call->Fail("Error interno procesando la pregunta.");
+        m_single_flight->Leave(key, call);
+        throw;
+    }
+    call->Finish(answer);
+    m_single_flight->Leave(key, call);
+    return answer;
+}
+
+// =========================================================================
+// ETAPAS DEL PIPELINE (cada llamada bloqueante va a m_io_pool con Offload)
+// =========================================================================
+
+Task<void> RagService::EmbedQuery(const std::string& question, const Deadline& deadline, std::vector<float>& out,
+                                  RequestTrace* trace) {
+    // Incluye la espera en el planificador (el histograma "embedding" mide solo a Ollama)
+    TraceSpan span(trace, "embedding");
+    // Sin bloquear ningún hilo mientras Ollama calcula: la petición va por el event loop de libcurl
+    out = co_await AwaitCallback<std::vector<float>>(*m_io_pool, [&](std::function<void(std::vector<float>)> resume) {
+        ScheduleEmbed(RequestClass::Interactive, question, deadline, std::move(resume));
+    });
+}
+
+Task<void> RagService::LexicalSearch(const std::string& question, std::vector<std::string>& out, RequestTrace* trace) {
+    TraceSpan span(trace, "lexical_search");
+    out = co_await Offload(*m_io_pool, [&] { return m_db->SearchMessagesByText(question, m_options.lexical_k); });
+}
+
+Task<void> RagService::FetchWindow(const std::string& id, int radius, const Deadline& deadline, std::vector<DBMessage>& out,
+                                   RequestTrace* trace, uint64_t parent_span) {
+    // Plazo agotado: esta ventana se queda vacía y seguimos con las que sí llegaron
+    if (deadline.Expired()) co_return;
+    TraceSpan span(trace, "db_window", parent_span);
+    span.SetAttribute("message.id", id);
+    out = co_await Offload(*m_io_pool, [&] { return m_db->GetMessageWindow(id, radius); });
+}
+
+Task<std::string> RagService::AskAsync(std::string question, TokenCallback on_token, Deadline deadline,
+                                       RequestTrace* trace) {
     spdlog::info("🤖 Usuario pregunta: {}", question);
 
-    // 1. Vectorizar la pregunta (Usando Nomic idealmente)
-    auto query_vec = m_llm->GetEmbedding(question);
-    if (query_vec.empty()) return "Tuve un problema procesando tu pregunta.";
+    // Respuestas que no pasan por el LLM: en modo streaming se envían como un único token
+    auto reply = [&on_token](const std::string& text) {
+        if (on_token) on_token(text);
+        return text;
+    };
+
+    // Antes de recuperar nada: si durante la generación llega un mensaje a un chat del contexto,
+    // Insert descarta la respuesta (ya no es la que daríamos con el índice actual)
+    uint64_t cache_generation = m_answer_cache ? m_answer_cache->Generation() : 0;
+
+    // 1. Vectorizar la pregunta (Usando Nomic idealmente) y, en paralelo, la búsqueda léxica opcional
+    std::vector<float> query_vec;
+    std::vector<std::string> lexical_ids;
+    {
+        std::vector<Task<void>> first_stage;
+        first_stage.push_back(EmbedQuery(question, deadline, query_vec, trace));
+        if (m_options.lexical_k > 0) first_stage.push_back(LexicalSearch(question, lexical_ids, trace));
+        co_await WhenAll(std::move(first_stage));
+    }
+    if (query_vec.empty()) co_return reply("Tuve un problema procesando tu pregunta.");
 
     // 2. Buscar contexto (Buscamos 8 para tener más margen de historia)
-    auto relevant_ids = m_vec_store->Search(query_vec, 8);
-    
-    std::stringstream context_ss;
-    bool found_data = false;
+    static MetricHistogram& s_search = StageHistogram("faiss_search");
+    TraceSpan search_span(trace, "faiss_search", &s_search);
+    std::vector<std::string> relevant_ids;
+    if (m_options.mmr_fetch_k > m_options.top_k) {
+        // Pedimos más candidatos y MMR se queda con top_k que no digan todos lo mismo
+        auto candidates = m_vec_store->SearchWithVectors(query_vec, m_options.mmr_fetch_k);
+        auto rerank_start = std::chrono::steady_clock::now();
+        auto hits = MmrReranker(m_options.mmr_lambda).Rerank(candidates, m_options.top_k);
+        auto rerank_end = std::chrono::steady_clock::now();
+        if (trace) trace->AddSpan(trace->NewSpanId(), "mmr_rerank", rerank_start, rerank_end, search_span.Id());
+        auto rerank_us = std::chrono::duration_cast<std::chrono::microseconds>(rerank_end - rerank_start).count();
+        spdlog::debug("🔀 MMR: {} de {} candidatos en {} µs", hits.size(), candidates.ids.size(), rerank_us);
+        for (const auto& hit : hits) {
+            spdlog::debug("   {} relevancia={:.3f} mmr={:.3f}", hit.id, hit.relevance, hit.score);
+            relevant_ids.push_back(hit.id);
+        }
+    } else {
+        relevant_ids = m_vec_store->Search(query_vec, m_options.top_k);
+    }
+    search_span.SetAttribute("hits", std::to_string(relevant_ids.size()));
+    search_span.End();
+    // Los hits léxicos van detrás de los semánticos (sin repetir)
+    for (const auto& id : lexical_ids) {
+        if (std::find(relevant_ids.begin(), relevant_ids.end(), id) == relevant_ids.end()) relevant_ids.push_back(id);
+    }
 
+    // 2.5 Caché semántica: pregunta parecida + mismo contexto => misma respuesta
+    if (m_answer_cache) {
+        TraceSpan lookup_span(trace, "cache_lookup");
+        auto cached = m_answer_cache->Lookup(query_vec, relevant_ids);
+        lookup_span.SetAttribute("hit", cached ? "true" : "false");
+        lookup_span.End();
+        if (cached) co_return reply(*cached);
+    }
+    auto generation_start = std::chrono::steady_clock::now();
+    
     // --- CONSTRUCCIÓN DEL CONTEXTO ---
-    for (const auto& id : relevant_ids) {
-        auto msg_text = m_db->GetMessageContentById(id); 
-        if (!msg_text.empty()) {
-            // Formateamos como lista para que el modelo lo lea fácil
-            context_ss << "- " << msg_text << "\n";
-            found_data = true;
-            
-            // Log para debug (Vital para ver qué encuentra)
-            spdlog::info("📄 RAG Contexto: {}", msg_text); 
+    // Cada hit viene con su conversación alrededor (una query por hit, todas a la vez);
+    // las ventanas solapadas se fusionan después respetando el orden de relevancia
+    // Los hits que son ventanas de conversación se anclan en su mensaje central, con radio
+    // suficiente para traer la ventana entera más los vecinos habituales. Una ventana ya olvidada
+    // (ver WindowOptions::max_tracked_windows) no trae nada y se salta
+    std::vector<std::string> anchors = relevant_ids;
+    std::vector<int> radii(relevant_ids.size(), m_options.neighbor_radius);
+    if (m_chunker) {
+        for (size_t i = 0; i < relevant_ids.size(); ++i) {
+            auto anchor = m_chunker->Anchor(relevant_ids[i]);
+            if (!anchor) continue;
+            anchors[i] = anchor->message_id;
+            radii[i] = static_cast<int>(anchor->members / 2) + m_options.neighbor_radius;
         }
     }
 
-    if (!found_data) return "No encontré información relacionada en tus chats.";
+    std::vector<std::vector<DBMessage>> windows(relevant_ids.size());
+    {
+        static MetricHistogram& s_fetch = StageHistogram("context_fetch");
+        TraceSpan fetch_span(trace, "context_fetch", &s_fetch);
+        std::vector<Task<void>> fetches;
+        for (size_t i = 0; i < relevant_ids.size(); ++i) {
+            fetches.push_back(FetchWindow(anchors[i], radii[i], deadline, windows[i], trace, fetch_span.Id()));
+        }
+        co_await WhenAll(std::move(fetches));
+    }
 
-    // =========================================================================
-    // 🧠 SYSTEM PROMPT: EL CEREBRO DEL ASISTENTE
-    // =========================================================================
-    std::string system_prompt = 
-        "Eres un Asistente de Memoria Personal inteligente y útil. "
-        "Tu trabajo es responder a mis preguntas basándote en el historial de mis chats recuperados.\n"
-        "\nINSTRUCCIONES CLAVE:"
-        "\n1. INTERPRETACIÓN DE USUARIOS: El nombre 'Yo (Sistema)' o 'Yo' se refiere a MÍ (el usuario actual). Cuando hables de lo que dije, usa 'Tú dijiste...'. Los otros nombres son mis contactos."
-        "\n2. FUENTE DE VERDAD: Usa ÚNICAMENTE el bloque de 'CONTEXTO'. Si la respuesta no está ahí, di 'No recuerdo haber hablado de eso'."
-        "\n3. CONTRADICCIONES: Si encuentras información contradictoria (ej. dos colores favoritos o dos claves distintas), menciona AMBAS opciones indicando que aparecen en momentos diferentes."
-        "\n4. PRIVACIDAD: Estos son mis datos personales. Si pregunto por un dato exacto (como una clave, dirección o número) que aparece en el contexto, tienes permiso para mostrármelo.";
+    ContextBuilder context_builder;
+    size_t fetched = 0;
+    for (size_t i = 0; i < relevant_ids.size(); ++i) {
+        if (windows[i].empty()) continue;
+        context_builder.AddWindow(std::move(windows[i]), anchors[i]);
+        fetched++;
+    }
+    if (deadline.Expired()) {
+        spdlog::warn("⏰ Plazo agotado recuperando contexto, se usan {} de {} hits", fetched, relevant_ids.size());
+    }
+
+    // Respuesta degradada: los fragmentos más relevantes, sin pasar por el LLM
+    auto snippets = [&]() {
+        auto top = context_builder.Build(m_options.snippet_tokens);
+        return reply("No me da tiempo a redactar una respuesta, pero esto es lo más relevante que encontré en tus chats:\n" + top.text);
+    };
+
+    // Presupuesto: lo que deja num_ctx tras el system prompt, la pregunta y la reserva para la respuesta
+    constexpr int kPromptOverheadTokens = 64; // Plantilla del user prompt + formato de mensajes del chat
+    int token_budget = m_llm->ContextSize() - m_options.answer_reserve_tokens - kPromptOverheadTokens
+                     - ApproxTokenCount(kSystemPrompt) - ApproxTokenCount(question);
+    auto context = context_builder.Build(token_budget);
+
+    if (context.messages == 0) co_return reply("No encontré información relacionada en tus chats.");
+
+    // Log para debug (Vital para ver qué encuentra)
+    spdlog::info("📄 RAG Contexto: {} mensajes en {} ventanas (~{} de {} tokens)",
+                 context.messages, context.windows, context.tokens, token_budget);
+    // El contexto entero son KB por pregunta: aunque se active debug en caliente, uno por segundo
+    LOG_SAMPLED("rag.context_dump", 1, 1, spdlog::level::debug, "📄 RAG Contexto:\n{}", context.text);
 
     // =========================================================================
     // 🗣️ USER PROMPT: LA PETICIÓN
     // =========================================================================
-    std::stringstream user_prompt_ss;
-    user_prompt_ss 
-        << "Consulta los siguientes fragmentos de mi historial de chat:\n\n"
-        << "### CONTEXTO ###\n"
-        << context_ss.str()
-        << "### FIN CONTEXTO ###\n\n"
-        << "Basado en lo anterior, responde: " << question;
+    // Todo lo fijo vive en kSystemPrompt; aquí solo va lo variable (contexto y, al final, la pregunta)
+    std::string user_prompt = BuildUserPrompt(context.text, question);
+
+    // 2.8 Con el breaker del chat abierto el LLM fallaría al instante: mejor los fragmentos
+    if (!m_llm->ChatAvailable()) {
+        spdlog::warn("🔴 Ollama (chat) no disponible: respuesta con fragmentos");
+        co_return snippets();
+    }
+
+    // 2.9 ¿Cabe la generación en lo que queda de plazo? (estimación con los tokens/s medidos)
+    GenerationOptions gen;
+    gen.deadline = deadline;
+    bool shortened = false;
+    if (deadline.IsSet()) {
+        constexpr double kSafetyMs = 250; // Red + primer token
+        int prompt_tokens = ApproxTokenCount(kSystemPrompt) + context.tokens + ApproxTokenCount(question);
+        double available_ms = deadline.RemainingMs() - kSafetyMs - m_llm->EstimateChatMs(prompt_tokens, 0);
+        int affordable = available_ms > 0 ? static_cast<int>(available_ms / m_llm->EstimateChatMs(0, 1)) : 0;
+
+        if (affordable < m_options.min_answer_tokens) {
+            spdlog::warn("⏰ Sin tiempo para el LLM ({} ms restantes): respuesta con fragmentos", deadline.RemainingMs());
+            co_return snippets();
+        }
+        if (affordable < m_options.answer_reserve_tokens) {
+            gen.num_predict = affordable;
+            shortened = true;
+            spdlog::info("⏰ Plazo ajustado: num_predict = {}", affordable);
+        }
+    }
 
     // 3. Enviar a Llama
     // Sugerencia: Usa temperatura baja (0.1 o 0.2) en OllamaClient para reducir alucinaciones
-    auto answer = m_llm->Chat(system_prompt, user_prompt_ss.str());
-    
-    return answer.value_or("El modelo no pudo generar una respuesta.");
+    // En modo streaming cada token sale hacia el cliente en cuanto Ollama lo genera
+    bool streamed = false;
+    // Con streaming on_token se llama desde el hilo del event loop de OllamaClient
+    OllamaClient::TokenCallback relay;
+    if (on_token) {
+        relay = [&](const std::string& token) {
+            streamed = true;
+            return on_token(token);
+        };
+    }
+    // La generación también pasa por el planificador (límite de chats simultáneos en Ollama)
+    if (trace) trace->SetAttribute("rag.context_tokens", std::to_string(context.tokens));
+    std::optional<std::string> answer = co_await AwaitCallback<std::optional<std::string>>(*m_io_pool,
+        [&](std::function<void(std::optional<std::string>)> resume) {
+            auto queued = std::chrono::steady_clock::now();
+            m_scheduler->Submit(RequestLane::Chat, RequestClass::Interactive, [&, resume, queued](RequestScheduler::SlotPtr slot) {
+                static MetricHistogram& s_generation = StageHistogram("llm_generation");
+                auto started = std::chrono::steady_clock::now();
+                // Los tramos del LLM se cierran en otro hilo: se registran a mano con sus instantes
+                if (trace) trace->AddSpan(trace->NewSpanId(), "llm_queue", queued, started);
+                m_llm->StartChat(kSystemPrompt, user_prompt, relay, gen, [slot, resume, started, trace](std::optional<std::string> result) {
+                    slot->Release();
+                    auto finished = std::chrono::steady_clock::now();
+                    s_generation.Observe(finished - started);
+                    if (trace) trace->AddSpan(trace->NewSpanId(), "llm_generation", started, finished);
+                    resume(std::move(result));
+                });
+            });
+        });
+
+    if (!answer) {
+        // El LLM no llegó a tiempo: mejor los fragmentos que un error (si aún no habíamos enviado nada)
+        // Lo mismo si los fallos de Ollama acaban de abrir el breaker
+        if (!streamed && ((deadline.IsSet() && deadline.Expired()) || !m_llm->ChatAvailable())) co_return snippets();
+        std::string fallback = "El modelo no pudo generar una respuesta.";
+        // Si ya enviamos tokens no mezclamos el mensaje de error con la respuesta a medias: quien
+        // hace el streaming tiene que cerrarlo como error
+        if (streamed) throw GenerationInterrupted(fallback);
+        co_return reply(fallback);
+    }
+
+    // Las respuestas recortadas por el plazo no se cachean: la siguiente pregunta igual puede tener más tiempo
+    if (m_answer_cache && !shortened) {
+        double cost_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - generation_start).count();
+        m_answer_cache->Insert(query_vec, relevant_ids, context.chats, *answer, cost_ms, cache_generation);
+    }
+    co_return *answer;
 }
\ No newline at end of file
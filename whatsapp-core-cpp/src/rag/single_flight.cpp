@@ -0,0 +1,131 @@
+#include "rag/single_flight.h"
+#include <spdlog/spdlog.h>
+#include <cctype>
+
+// ==========================================
+// InFlightAnswer
+// ==========================================
+void InFlightAnswer::Publish(const std::string& token) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tokens.push_back(token);
+    }
+    m_cv.notify_all();
+}
+
+void InFlightAnswer::Finish(const std::string& answer) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_answer = answer;
+        m_done = true;
+    }
+    m_cv.notify_all();
+}
+
+void InFlightAnswer::Fail(const std::string& message, std::exception_ptr error) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_error = error;
+    }
+    Finish(message);
+}
+
+bool InFlightAnswer::HasFollowers() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_followers > 0;
+}
+
+std::string InFlightAnswer::Follow(const TokenCallback& on_token, const Deadline& deadline) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_followers++;
+
+    size_t sent = 0;
+    std::string partial;
+    bool client_alive = true;
+
+    for (;;) {
+        // Reenviamos lo pendiente sin el candado (on_token escribe en el socket del cliente)
+        while (sent < m_tokens.size()) {
+            std::string token = m_tokens[sent++];
+            partial += token;
+            if (on_token && client_alive) {
+                lock.unlock();
+                client_alive = on_token(token);
+                lock.lock();
+            }
+        }
+        if (m_done || !client_alive) break;
+
+        auto has_news = [&] { return m_done || sent < m_tokens.size(); };
+        if (deadline.IsSet()) {
+            if (!m_cv.wait_for(lock, deadline.Remaining(), has_news)) break;
+        } else {
+            m_cv.wait(lock, has_news);
+        }
+    }
+
+    m_followers--;
+    // El líder falló con tokens ya reenviados: este cliente también tiene la respuesta a medias
+    if (m_done && m_error && on_token && sent > 0) std::rethrow_exception(m_error);
+    // Si el líder terminó devolvemos su respuesta final (incluye respuestas sin tokens, p. ej. errores)
+    return m_done ? m_answer : partial;
+}
+
+// ==========================================
+// SingleFlight
+// ==========================================
+std::string SingleFlight::MakeKey(const std::string& question, const std::string& filters) {
+    std::string key;
+    key.reserve(question.size() + filters.size() + 1);
+
+    bool pending_space = false;
+    for (size_t i = 0; i < question.size(); ++i) {
+        unsigned char c = question[i];
+        // ¿ ¡ « » en UTF-8 (0xC2 + byte) también son signos
+        if (c == 0xC2 && i + 1 < question.size()) {
+            unsigned char next = question[i + 1];
+            if (next == 0xBF || next == 0xA1 || next == 0xAB || next == 0xBB) {
+                pending_space = true;
+                ++i;
+                continue;
+            }
+        }
+        if (c >= 0x80 || std::isalnum(c)) {
+            if (pending_space && !key.empty()) key += ' ';
+            pending_space = false;
+            key += static_cast<char>(c < 0x80 ? std::tolower(c) : c);
+        } else {
+            // Espacios y signos ASCII (? ! . ,) cuentan como separador
+            pending_space = true;
+        }
+    }
+    key += '\x1f';
+    key += filters;
+    return key;
+}
+
+SingleFlight::Ticket SingleFlight::Join(const std::string& key) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_calls.find(key);
+    if (it != m_calls.end()) {
+        m_stats.followers++;
+        spdlog::info("🔗 Pregunta idéntica en curso: se comparte la generación");
+        return {it->second, false};
+    }
+
+    auto call = std::make_shared<InFlightAnswer>();
+    m_calls.emplace(key, call);
+    m_stats.leaders++;
+    return {call, true};
+}
+
+void SingleFlight::Leave(const std::string& key, const std::shared_ptr<InFlightAnswer>& call) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_calls.find(key);
+    if (it != m_calls.end() && it->second == call) m_calls.erase(it);
+}
+
+SingleFlightStats SingleFlight::GetStats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
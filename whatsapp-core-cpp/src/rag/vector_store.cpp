@@ -1,56 +1,393 @@
 #include "rag/vector_store.h"
 #include <faiss/index_io.h>
 #include <spdlog/spdlog.h>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <unordered_set>
 
-VectorStore::VectorStore(int dimension) : m_dimension(dimension) {
-    m_index = std::make_unique<faiss::IndexFlatL2>(dimension);
+namespace {
+// Vectores originales que guardamos para entrenar PCA y medir el recall (768 * 4096 * 4B ≈ 12 MB)
+constexpr size_t kSampleSize = 4096;
+// PCA no se activa hasta tener este mínimo; después se reentrena cada vez que el corpus se duplica
+constexpr long kMinTrainPoints = 2048;
+constexpr int kRecallQueries = 64;
+constexpr int kRecallK = 10;
+// Re-proyectamos el índice por bloques: cada bloque se reconstruye y se proyecta a la base nueva
+// bajo el candado compartido, sin copiar nunca el índice completo en el espacio original
+constexpr long kRebuildBatch = 4096;
+
+// Recall@10 de la búsqueda reducida frente a la exacta sobre la muestra de vectores originales
+double EstimateRecall(const VectorTransform& transform, const std::vector<float>& sample, int dimension) {
+    long n_sample = static_cast<long>(sample.size() / dimension);
+    if (!transform.IsTrained() || n_sample <= kRecallK) return -1;
+
+    int out_dim = transform.OutputDim();
+    int nq = static_cast<int>(std::min<long>(kRecallQueries, n_sample));
+    int k = kRecallK + 1; // +1 porque cada consulta se encuentra a sí misma
+
+    faiss::IndexFlatL2 exact(dimension);
+    exact.add(n_sample, sample.data());
+
+    std::vector<float> reduced_sample(static_cast<size_t>(n_sample) * out_dim);
+    transform.Apply(sample.data(), n_sample, reduced_sample.data());
+    faiss::IndexFlatL2 reduced(out_dim);
+    reduced.add(n_sample, reduced_sample.data());
+
+    std::vector<float> distances(static_cast<size_t>(nq) * k);
+    std::vector<faiss::idx_t> gt(static_cast<size_t>(nq) * k), got(static_cast<size_t>(nq) * k);
+    exact.search(nq, sample.data(), k, distances.data(), gt.data());
+    reduced.search(nq, reduced_sample.data(), k, distances.data(), got.data());
+
+    long hits = 0, total = 0;
+    for (int q = 0; q < nq; ++q) {
+        std::unordered_set<faiss::idx_t> truth;
+        for (int j = 0; j < k; ++j) {
+            auto id = gt[q * k + j];
+            if (id != q && id != -1 && truth.size() < kRecallK) truth.insert(id);
+        }
+        int found = 0;
+        for (int j = 0; j < k; ++j) {
+            auto id = got[q * k + j];
+            if (id != q && truth.count(id)) found++;
+        }
+        hits += found;
+        total += truth.size();
+    }
+    return total > 0 ? static_cast<double>(hits) / total : -1;
+}
+}
+
+VectorStore::VectorStore(int dimension, std::unique_ptr<VectorTransform> transform)
+    : m_dimension(dimension), m_transform(std::move(transform)) {
+    if (m_transform && m_transform->InputDim() != dimension) {
+        spdlog::warn("VectorStore: la transformación espera dimensión {}, se desactiva", m_transform->InputDim());
+        m_transform.reset();
+    }
+
+    m_report.input_dim = dimension;
+    if (m_transform) m_report.name = m_transform->Name();
+
+    // Hasta que la transformación esté lista, el índice trabaja con el vector completo
+    int index_dim = TransformActive() ? m_transform->OutputDim() : dimension;
+    m_index = std::make_unique<faiss::IndexFlatL2>(index_dim);
+    m_report.index_dim = index_dim;
+    m_report.active = TransformActive();
 }
 
 VectorStore::~VectorStore() = default;
 
+bool VectorStore::TransformActive() const {
+    return m_transform && m_transform->IsTrained();
+}
+
+std::vector<float> VectorStore::Project(const std::vector<float>& embedding) const {
+    if (!TransformActive()) return embedding;
+    std::vector<float> out(m_transform->OutputDim());
+    m_transform->Apply(embedding.data(), 1, out.data());
+    return out;
+}
+
 void VectorStore::AddIndex(const std::string& whatsapp_msg_id, const std::vector<float>& embedding) {
     if (embedding.size() != m_dimension) {
         spdlog::warn("VectorStore: Dimensión incorrecta. Esperada {}, Recibida {}", m_dimension, embedding.size());
         return;
     }
 
-    // FAISS acepta arrays crudos
-    m_index->add(1, embedding.data());
-    
+    bool retrain = false;
+    {
+        std::unique_lock lock(m_mutex);
+        // Mismo mensaje otra vez (reintento del bridge, historial que se cruza con la ingesta en vivo):
+        // una segunda fila haría que Search devolviera el mismo ID dos veces
+        if (m_key_to_id.count(whatsapp_msg_id)) return;
+        retrain = AddLocked(whatsapp_msg_id, embedding);
+    }
+    if (retrain) Retrain();
+}
+
+void VectorStore::Upsert(const std::string& key, const std::vector<float>& embedding) {
+    if (embedding.size() != m_dimension) {
+        spdlog::warn("VectorStore: Dimensión incorrecta. Esperada {}, Recibida {}", m_dimension, embedding.size());
+        return;
+    }
+
+    bool retrain = false;
+    {
+        std::unique_lock lock(m_mutex);
+        auto it = m_key_to_id.find(key);
+        if (it == m_key_to_id.end()) {
+            retrain = AddLocked(key, embedding);
+        } else {
+            // IndexFlat guarda los vectores contiguos: sobrescribimos la fila en el sitio.
+            // No entra en la muestra de entrenamiento (sesgaría PCA hacia las ventanas que más se refrescan).
+            auto projected = Project(embedding);
+            std::copy(projected.begin(), projected.end(), m_index->get_xb() + it->second * m_index->d);
+            m_index->clear_l2norms();
+            // Si Retrain ya pasó por esta fila, la vuelve a proyectar al hacer el cambio de índice
+            if (m_retraining) m_dirty_rows.push_back(it->second);
+        }
+    }
+    if (retrain) Retrain();
+}
+
+bool VectorStore::AddLocked(const std::string& key, const std::vector<float>& embedding) {
+    if (m_transform) SampleForTraining(embedding);
+
+    // FAISS acepta arrays crudos (ya reducidos si la transformación está activa)
+    auto projected = Project(embedding);
+    m_index->add(1, projected.data());
+
     // Guardamos la relación ID
-    m_id_map[m_current_faiss_id] = whatsapp_msg_id;
+    auto& stored_key = m_id_map[m_current_faiss_id];
+    stored_key = key;
+    auto [key_it, inserted] = m_key_to_id.insert_or_assign(key, m_current_faiss_id);
+    m_key_bytes += StringHeapBytes(stored_key) + (inserted ? StringHeapBytes(key_it->first) : 0);
     m_current_faiss_id++;
+
+    if (!m_transform || m_retraining) return false;
+
+    // Reentrenamiento online: primera vez al llegar al mínimo, después cada vez que el corpus se duplica
+    bool due = m_report.trained_at == 0 ? m_current_faiss_id >= kMinTrainPoints
+                                        : m_current_faiss_id >= 2 * m_report.trained_at;
+    if (!due) return false;
+
+    if (m_transform->RequiresTraining()) {
+        m_retraining = true;
+        return true;
+    }
+    // Matryoshka no se entrena, pero seguimos midiendo cuánto recall perdemos al crecer
+    m_report.trained_at = m_current_faiss_id;
+    MeasureRecall();
+    return false;
 }
 
 std::vector<std::string> VectorStore::Search(const std::vector<float>& query_embedding, int k) {
     if (query_embedding.empty()) return {};
+    if (query_embedding.size() != m_dimension) {
+        spdlog::warn("VectorStore: Dimensión de consulta incorrecta. Esperada {}, Recibida {}", m_dimension, query_embedding.size());
+        return {};
+    }
+
+    std::shared_lock lock(m_mutex);
+
+    // Misma transformación que en AddIndex: si no, las distancias no tienen sentido
+    auto projected = Project(query_embedding);
 
     std::vector<float> distances(k);
     std::vector<faiss::idx_t> labels(k);
 
-    m_index->search(1, query_embedding.data(), k, distances.data(), labels.data());
+    m_index->search(1, projected.data(), k, distances.data(), labels.data());
 
     std::vector<std::string> results;
     for (int i = 0; i < k; ++i) {
         long found_id = labels[i];
         // -1 indica que no encontró suficientes vecinos
-        if (found_id != -1 && m_id_map.count(found_id)) {
-            results.push_back(m_id_map[found_id]);
+        auto it = m_id_map.find(found_id);
+        if (found_id != -1 && it != m_id_map.end()) {
+            results.push_back(it->second);
         }
     }
     return results;
 }
 
+SearchCandidates VectorStore::SearchWithVectors(const std::vector<float>& query_embedding, int k) {
+    SearchCandidates out;
+    if (query_embedding.size() != m_dimension) {
+        if (!query_embedding.empty()) {
+            spdlog::warn("VectorStore: Dimensión de consulta incorrecta. Esperada {}, Recibida {}", m_dimension, query_embedding.size());
+        }
+        return out;
+    }
+
+    std::shared_lock lock(m_mutex);
+
+    out.dim = static_cast<int>(m_index->d);
+    out.query = Project(query_embedding);
+
+    std::vector<float> distances(k);
+    std::vector<faiss::idx_t> labels(k);
+    m_index->search(1, out.query.data(), k, distances.data(), labels.data());
+
+    // IndexFlat: el vector guardado de la etiqueta i está en get_xb() + i * d (copia bajo el candado,
+    // un Upsert o un reentreno posterior no nos cambia los datos a mitad del re-ranking)
+    const float* xb = m_index->get_xb();
+    out.vectors.reserve(static_cast<size_t>(k) * out.dim);
+    for (int i = 0; i < k; ++i) {
+        auto it = m_id_map.find(labels[i]);
+        if (labels[i] == -1 || it == m_id_map.end()) continue;
+        out.ids.push_back(it->second);
+        out.distances.push_back(distances[i]);
+        const float* row = xb + labels[i] * out.dim;
+        out.vectors.insert(out.vectors.end(), row, row + out.dim);
+    }
+    return out;
+}
+
+TransformReport VectorStore::GetTransformReport() const {
+    std::shared_lock lock(m_mutex);
+    return m_report;
+}
+
+size_t VectorStore::Size() const {
+    std::shared_lock lock(m_mutex);
+    return static_cast<size_t>(m_index->ntotal);
+}
+
+MemoryUsage VectorStore::GetMemoryUsage() const {
+    // Tamaños de nodo de libstdc++: std::map = 32 B de árbol + par; unordered_map = siguiente +
+    // par + hash cacheado, más el array de buckets
+    constexpr size_t kMapNode = 32 + sizeof(std::pair<const long, std::string>);
+    constexpr size_t kHashNode = sizeof(void*) + sizeof(std::pair<const std::string, long>) + sizeof(size_t);
+
+    std::shared_lock lock(m_mutex);
+    MemoryUsage usage;
+    usage.items = static_cast<size_t>(m_index->ntotal);
+
+    // IndexFlat: vectores contiguos; el vector crece por duplicación, así que cuenta la capacidad
+    const auto& codes = m_index->codes;
+    size_t index_bytes = (codes.is_owned ? codes.owned_data.capacity() : codes.size()) +
+                         m_index->cached_l2norms.capacity() * sizeof(float);
+    size_t id_bytes = m_id_map.size() * kMapNode + m_key_to_id.size() * kHashNode +
+                      m_key_to_id.bucket_count() * sizeof(void*) + m_key_bytes;
+    size_t sample_bytes = m_sample.capacity() * sizeof(float);
+    // PCA: matriz completa InputDim² que guarda faiss::PCAMatrix + la proyección OutputDim x InputDim
+    size_t transform_bytes = 0;
+    if (m_transform && m_transform->RequiresTraining() && m_transform->IsTrained()) {
+        size_t in = m_transform->InputDim(), out = m_transform->OutputDim();
+        transform_bytes = (in * in + out * in) * sizeof(float);
+    }
+
+    usage.parts = {{"index", index_bytes}, {"id_map", id_bytes}, {"training_sample", sample_bytes},
+                   {"transform", transform_bytes}};
+    usage.bytes = index_bytes + id_bytes + sample_bytes + transform_bytes;
+    return usage;
+}
+
+// ==========================================
+// REDUCCIÓN DE DIMENSIÓN (entrenamiento online)
+// ==========================================
+
+void VectorStore::SampleForTraining(const std::vector<float>& embedding) {
+    // Muestreo por reservorio: cada vector visto tiene la misma probabilidad de estar en la muestra
+    m_seen++;
+    size_t stored = m_sample.size() / m_dimension;
+    if (stored < kSampleSize) {
+        m_sample.insert(m_sample.end(), embedding.begin(), embedding.end());
+        return;
+    }
+
+    std::uniform_int_distribution<long> dist(0, m_seen - 1);
+    long slot = dist(m_rng);
+    if (slot < static_cast<long>(kSampleSize)) {
+        std::copy(embedding.begin(), embedding.end(), m_sample.begin() + slot * m_dimension);
+    }
+}
+
+void VectorStore::ReconstructLocked(long i0, long n, float* out) const {
+    // Antes del primer entrenamiento el índice guarda el vector completo (exacto);
+    // después reconstruimos con la base con la que se proyectó la fila
+    const float* rows = m_index->get_xb() + i0 * m_index->d;
+    if (TransformActive()) {
+        m_transform->Reverse(rows, n, out);
+    } else {
+        std::copy(rows, rows + n * m_dimension, out);
+    }
+}
+
+void VectorStore::Retrain() {
+    auto start = std::chrono::steady_clock::now();
+
+    // 1. Foto bajo el candado compartido: muestra de entrenamiento y tamaño del índice.
+    //    Las filas < snapshot no se mueven (el índice solo crece y se cambia bajo el exclusivo).
+    std::vector<float> sample;
+    long snapshot = 0;
+    std::string name;
+    int target_dim = 0;
+    {
+        std::shared_lock lock(m_mutex);
+        sample = m_sample;
+        snapshot = m_index->ntotal;
+        name = m_transform->Name();
+        target_dim = m_transform->OutputDim();
+    }
+
+    // 2. Entrenamos una base nueva aparte: la actual sigue sirviendo Search y los AddIndex que lleguen
+    size_t n_sample = sample.size() / m_dimension;
+    auto next = MakeVectorTransform(name, m_dimension, target_dim);
+    next->Train(sample.data(), n_sample);
+    double recall = EstimateRecall(*next, sample, m_dimension);
+
+    // 3. Re-proyectamos la foto por bloques (original -> base nueva), cada bloque bajo el candado compartido.
+    //    Las filas ya proyectadas con PCA se reconstruyen con la base anterior: lo que esa base descartó
+    //    no vuelve, así que la pérdida se acumula de un reentreno al siguiente.
+    int out_dim = next->OutputDim();
+    auto new_index = std::make_unique<faiss::IndexFlatL2>(out_dim);
+    std::vector<float> originals(kRebuildBatch * m_dimension);
+    std::vector<float> batch(kRebuildBatch * out_dim);
+    auto project_block = [&](long i0, long n) {
+        ReconstructLocked(i0, n, originals.data());
+        next->Apply(originals.data(), n, batch.data());
+    };
+    for (long i0 = 0; i0 < snapshot; i0 += kRebuildBatch) {
+        long n = std::min(kRebuildBatch, snapshot - i0);
+        std::shared_lock lock(m_mutex);
+        project_block(i0, n);
+        new_index->add(n, batch.data());
+    }
+
+    // 4. Exclusivo solo para lo llegado desde la foto (cola nueva + filas sustituidas) y el cambio de índice
+    std::unique_lock lock(m_mutex);
+    long ntotal = m_index->ntotal;
+    for (long i0 = snapshot; i0 < ntotal; i0 += kRebuildBatch) {
+        long n = std::min(kRebuildBatch, ntotal - i0);
+        project_block(i0, n);
+        new_index->add(n, batch.data());
+    }
+    for (long row : m_dirty_rows) {
+        if (row >= snapshot) continue;  // Ya proyectada con la cola
+        project_block(row, 1);
+        std::copy(batch.begin(), batch.begin() + out_dim, new_index->get_xb() + row * out_dim);
+    }
+    if (!m_dirty_rows.empty()) new_index->clear_l2norms();
+    size_t dirty = m_dirty_rows.size();
+    m_dirty_rows.clear();
+
+    m_index = std::move(new_index);
+    m_transform = std::move(next);
+    m_retraining = false;
+
+    m_report.active = true;
+    m_report.index_dim = out_dim;
+    m_report.trained_at = ntotal;
+    m_report.recall_at_10 = recall;
+    m_report.last_train_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    spdlog::info("📐 VectorStore: {} reentrenada con {} muestras ({} vectores, {} en la cola, {} sustituidos, {} -> {} dims) "
+                 "en {:.1f} ms, recall@{} = {:.3f}",
+                 m_report.name, n_sample, ntotal, ntotal - snapshot, dirty, m_dimension, out_dim,
+                 m_report.last_train_ms, kRecallK, recall);
+}
+
+void VectorStore::MeasureRecall() {
+    if (!TransformActive()) return;
+    m_report.recall_at_10 = EstimateRecall(*m_transform, m_sample, m_dimension);
+    spdlog::info("📐 VectorStore: recall@{} estimado con {} ({} dims) = {:.3f}",
+                 kRecallK, m_report.name, m_transform->OutputDim(), m_report.recall_at_10);
+}
+
 void VectorStore::Save(const std::string& filepath) {
     // Nota: Esto solo guarda el índice vectorial, no el mapa de IDs.
     // Para producción, deberías serializar m_id_map a un JSON también.
+    // Con una transformación activa el índice guardado está en la dimensión reducida.
+    std::shared_lock lock(m_mutex);
     faiss::write_index(m_index.get(), filepath.c_str());
 }
 
 void VectorStore::Load(const std::string& filepath) {
     // Carga básica
+    std::unique_lock lock(m_mutex);
     faiss::Index* idx = faiss::read_index(filepath.c_str());
     if (auto flat_idx = dynamic_cast<faiss::IndexFlatL2*>(idx)) {
         m_index.reset(flat_idx);
     }
-}
\ No newline at end of file
+}
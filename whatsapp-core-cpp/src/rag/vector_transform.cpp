@@ -0,0 +1,82 @@
+#include "rag/vector_transform.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+// ==========================================
+// MATRYOSHKA (truncado + renormalización)
+// ==========================================
+MatryoshkaTransform::MatryoshkaTransform(int input_dim, int output_dim)
+    : m_input_dim(input_dim), m_output_dim(output_dim) {
+    if (output_dim <= 0 || output_dim > input_dim) {
+        throw std::invalid_argument("MatryoshkaTransform: dimensión de salida inválida");
+    }
+}
+
+void MatryoshkaTransform::Apply(const float* in, size_t n, float* out) const {
+    for (size_t i = 0; i < n; ++i) {
+        const float* src = in + i * m_input_dim;
+        float* dst = out + i * m_output_dim;
+
+        float norm = 0.0f;
+        for (int j = 0; j < m_output_dim; ++j) norm += src[j] * src[j];
+        norm = std::sqrt(norm);
+
+        // Un vector nulo se queda nulo (evita dividir entre 0)
+        float scale = norm > 0.0f ? 1.0f / norm : 0.0f;
+        for (int j = 0; j < m_output_dim; ++j) dst[j] = src[j] * scale;
+    }
+}
+
+void MatryoshkaTransform::Reverse(const float* in, size_t n, float* out) const {
+    // Las componentes descartadas se pierden: rellenamos con ceros
+    for (size_t i = 0; i < n; ++i) {
+        std::memcpy(out + i * m_input_dim, in + i * m_output_dim, sizeof(float) * m_output_dim);
+        std::fill(out + i * m_input_dim + m_output_dim, out + (i + 1) * m_input_dim, 0.0f);
+    }
+}
+
+// ==========================================
+// PCA (faiss::PCAMatrix)
+// ==========================================
+PcaTransform::PcaTransform(int input_dim, int output_dim)
+    : m_input_dim(input_dim), m_output_dim(output_dim) {
+    if (output_dim <= 0 || output_dim > input_dim) {
+        throw std::invalid_argument("PcaTransform: dimensión de salida inválida");
+    }
+}
+
+bool PcaTransform::IsTrained() const {
+    return m_pca && m_pca->is_trained;
+}
+
+void PcaTransform::Train(const float* x, size_t n) {
+    // Entrenamos una matriz nueva y la cambiamos de golpe, así Apply nunca ve una a medias
+    auto pca = std::make_unique<faiss::PCAMatrix>(m_input_dim, m_output_dim);
+    pca->train(static_cast<faiss::idx_t>(n), x);
+    m_pca = std::move(pca);
+}
+
+void PcaTransform::Apply(const float* in, size_t n, float* out) const {
+    if (!IsTrained()) throw std::logic_error("PcaTransform: Apply antes de Train");
+    m_pca->apply_noalloc(static_cast<faiss::idx_t>(n), in, out);
+}
+
+void PcaTransform::Reverse(const float* in, size_t n, float* out) const {
+    if (!IsTrained()) throw std::logic_error("PcaTransform: Reverse antes de Train");
+    m_pca->reverse_transform(static_cast<faiss::idx_t>(n), in, out);
+}
+
+// ==========================================
+// FÁBRICA
+// ==========================================
+std::unique_ptr<VectorTransform> MakeVectorTransform(const std::string& kind, int input_dim, int output_dim) {
+    if (kind.empty() || kind == "none") return nullptr;
+    if (kind == "pca") return std::make_unique<PcaTransform>(input_dim, output_dim);
+    if (kind == "matryoshka") return std::make_unique<MatryoshkaTransform>(input_dim, output_dim);
+
+    spdlog::warn("VectorTransform desconocida '{}', se usa el vector completo", kind);
+    return nullptr;
+}
@@ -0,0 +1,193 @@
+#include "rag/window_chunker.h"
+#include "rag/context_builder.h"
+#include "utils/memory.h"
+#include <algorithm>
+
+namespace {
+const std::string kWindowPrefix = "win:";
+
+// Nodo de unordered_map: siguiente + par + hash cacheado
+size_t NodeBytes(size_t value_size) {
+    return 2 * sizeof(void*) + sizeof(std::string) + value_size;
+}
+}
+
+WindowChunker::WindowChunker(WindowOptions options) : m_options(options) {
+    if (m_options.refresh_every < 1) m_options.refresh_every = 1;
+    if (m_options.max_messages < 1) m_options.max_messages = 1;
+    m_options.overlap_messages = std::clamp(m_options.overlap_messages, 0, m_options.max_messages - 1);
+}
+
+bool WindowChunker::IsWindowKey(const std::string& key) {
+    return key.compare(0, kWindowPrefix.size(), kWindowPrefix) == 0;
+}
+
+int WindowChunker::MessageTokens(const DBMessage& msg) {
+    // Misma estimación que el contexto del prompt: "sender: content\n"
+    return ApproxTokenCount(msg.sender) + ApproxTokenCount(msg.content) + 2;
+}
+
+std::vector<WindowUpdate> WindowChunker::Add(const DBMessage& msg, bool refresh_open) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stats.messages++;
+
+    std::vector<WindowUpdate> updates;
+    CollectExpired(msg.timestamp, msg.chat_jid, updates);
+
+    int msg_tokens = MessageTokens(msg);
+    auto [it, inserted] = m_open.try_emplace(msg.chat_jid);
+    OpenWindow& window = it->second;
+    if (inserted) m_bytes += NodeBytes(sizeof(OpenWindow)) + StringHeapBytes(it->first);
+    size_t window_bytes = WindowBytes(window);   // Lo que cambie la ventana se ajusta al final
+
+    if (inserted) {
+        OpenNext(msg.chat_jid, window, false);
+    } else if (!window.messages.empty()) {
+        const DBMessage& last = window.messages.back();
+        // Timestamps a 0 (desconocidos) no cortan por tiempo; un mensaje "del pasado" sí corta
+        bool gap = msg.timestamp > 0 && last.timestamp > 0 &&
+                   (msg.timestamp - last.timestamp > m_options.max_gap_seconds || msg.timestamp < last.timestamp);
+        bool full = window.tokens + msg_tokens > m_options.max_tokens ||
+                    static_cast<int>(window.messages.size()) >= m_options.max_messages;
+
+        if (gap || full) {
+            // La ventana se cierra: último embedding si tiene mensajes sin embeber
+            if (window.pending > 0) updates.push_back(MakeUpdate(window));
+            OpenNext(msg.chat_jid, window, !gap);
+        }
+    }
+
+    window.messages.push_back(msg);
+    window.tokens += msg_tokens;
+    window.pending++;
+    window.touched = std::chrono::steady_clock::now();
+    m_bytes = m_bytes - window_bytes + WindowBytes(window);
+
+    if (refresh_open && window.pending >= m_options.refresh_every) updates.push_back(MakeUpdate(window));
+    return updates;
+}
+
+std::vector<WindowUpdate> WindowChunker::Flush() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<WindowUpdate> updates;
+    for (auto& [chat, window] : m_open) {
+        if (window.pending > 0) updates.push_back(MakeUpdate(window));
+    }
+    return updates;
+}
+
+std::vector<WindowUpdate> WindowChunker::FlushIdle() {
+    auto idle_since = std::chrono::steady_clock::now() - std::chrono::seconds(m_options.max_gap_seconds);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<WindowUpdate> updates;
+    for (auto it = m_open.begin(); it != m_open.end();) {
+        OpenWindow& window = it->second;
+        if (window.touched > idle_since) {
+            ++it;
+            continue;
+        }
+        if (window.pending > 0) updates.push_back(MakeUpdate(window));
+        Close(window);
+        // El siguiente mensaje del chat abre otra ventana (m_next_seq sigue contando)
+        m_bytes -= NodeBytes(sizeof(OpenWindow)) + StringHeapBytes(it->first) + WindowBytes(window);
+        it = m_open.erase(it);
+    }
+    return updates;
+}
+
+std::optional<WindowAnchor> WindowChunker::Anchor(const std::string& key) const {
+    if (!IsWindowKey(key)) return std::nullopt;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_anchors.find(key);
+    if (it != m_anchors.end()) return it->second;
+
+    // Aún abierta: "win:<chat_jid>#<n>"
+    size_t hash = key.rfind('#');
+    if (hash == std::string::npos) return std::nullopt;
+    auto open = m_open.find(key.substr(kWindowPrefix.size(), hash - kWindowPrefix.size()));
+    if (open == m_open.end() || open->second.key != key || open->second.messages.empty()) return std::nullopt;
+    const auto& messages = open->second.messages;
+    return WindowAnchor{messages[messages.size() / 2].id, messages.size()};
+}
+
+WindowStats WindowChunker::GetStats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+size_t WindowChunker::MemoryBytes() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_bytes + (m_open.bucket_count() + m_next_seq.bucket_count() + m_anchors.bucket_count()) * sizeof(void*);
+}
+
+size_t WindowChunker::WindowBytes(const OpenWindow& window) {
+    size_t bytes = StringHeapBytes(window.key) + window.messages.capacity() * sizeof(DBMessage);
+    for (const auto& msg : window.messages) {
+        bytes += StringHeapBytes(msg.id) + StringHeapBytes(msg.sender) + StringHeapBytes(msg.content) +
+                 StringHeapBytes(msg.chat_jid);
+    }
+    return bytes;
+}
+
+void WindowChunker::Close(const OpenWindow& window) {
+    if (window.messages.empty()) return;
+    auto [it, inserted] = m_anchors.try_emplace(window.key);
+    if (!inserted) return;   // Una ventana se cierra una sola vez
+    it->second = {window.messages[window.messages.size() / 2].id, window.messages.size()};
+    m_bytes += NodeBytes(sizeof(WindowAnchor)) + StringHeapBytes(it->first) + StringHeapBytes(it->second.message_id);
+    m_anchor_order.push_back(window.key);
+    m_bytes += sizeof(std::string) + StringHeapBytes(m_anchor_order.back());
+
+    // Las más viejas se olvidan: un hit en ellas se queda sin contexto, como tras un reinicio
+    while (m_anchor_order.size() > std::max<size_t>(m_options.max_tracked_windows, 1)) {
+        const std::string& oldest = m_anchor_order.front();
+        auto old = m_anchors.find(oldest);
+        if (old != m_anchors.end()) {
+            m_bytes -= NodeBytes(sizeof(WindowAnchor)) + StringHeapBytes(old->first) + StringHeapBytes(old->second.message_id);
+            m_anchors.erase(old);
+        }
+        m_bytes -= sizeof(std::string) + StringHeapBytes(oldest);
+        m_anchor_order.pop_front();
+    }
+}
+
+void WindowChunker::OpenNext(const std::string& chat_jid, OpenWindow& window, bool carry_overlap) {
+    Close(window);
+    OpenWindow next;
+    auto [seq, inserted] = m_next_seq.try_emplace(chat_jid, 0);
+    if (inserted) m_bytes += NodeBytes(sizeof(long)) + StringHeapBytes(seq->first);
+    next.key = kWindowPrefix + chat_jid + "#" + std::to_string(seq->second++);
+
+    // Solape: la respuesta que abre la ventana nueva conserva la pregunta que cerró la anterior
+    if (carry_overlap && m_options.overlap_messages > 0) {
+        size_t keep = std::min<size_t>(m_options.overlap_messages, window.messages.size());
+        for (size_t i = window.messages.size() - keep; i < window.messages.size(); ++i) {
+            next.tokens += MessageTokens(window.messages[i]);
+            next.messages.push_back(std::move(window.messages[i]));
+        }
+    }
+
+    window = std::move(next);
+    m_stats.windows++;
+}
+
+WindowUpdate WindowChunker::MakeUpdate(OpenWindow& window) {
+    WindowUpdate update;
+    update.key = window.key;
+    update.members = window.messages.size();
+    for (const auto& msg : window.messages) {
+        update.text += msg.sender + ": " + msg.content + "\n";
+    }
+    window.pending = 0;
+    m_stats.updates++;
+    return update;
+}
+
+void WindowChunker::CollectExpired(long long now, const std::string& except_chat, std::vector<WindowUpdate>& out) {
+    if (now <= 0) return;
+    for (auto& [chat, window] : m_open) {
+        if (window.pending == 0 || chat == except_chat || window.messages.empty()) continue;
+        long long last = window.messages.back().timestamp;
+        if (last > 0 && now - last > m_options.max_gap_seconds) out.push_back(MakeUpdate(window));
+    }
+}
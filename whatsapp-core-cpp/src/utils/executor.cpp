@@ -0,0 +1,61 @@
+#include "utils/executor.h"
+#include <spdlog/spdlog.h>
+
+ThreadPool::ThreadPool(size_t threads, std::string name) : m_name(std::move(name)) {
+    if (threads == 0) threads = 1;
+    m_workers.reserve(threads);
+    for (size_t i = 0; i < threads; ++i) {
+        m_workers.emplace_back([this] { WorkerLoop(); });
+    }
+    spdlog::info("🧵 Pool '{}' con {} hilos", m_name, threads);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_cv.notify_all();
+    for (auto& t : m_workers) t.join();
+}
+
+void ThreadPool::Post(std::function<void()> fn) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue.push_back(std::move(fn));
+    }
+    m_cv.notify_one();
+}
+
+size_t ThreadPool::Pending() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_queue.size();
+}
+
+size_t ThreadPool::Busy() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_busy;
+}
+
+void ThreadPool::WorkerLoop() {
+    for (;;) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+            if (m_stopping && m_queue.empty()) return;
+            job = std::move(m_queue.front());
+            m_queue.pop_front();
+            m_busy++;
+        }
+
+        try {
+            job();
+        } catch (const std::exception& e) {
+            spdlog::error("Pool '{}': excepción no capturada: {}", m_name, e.what());
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_busy--;
+    }
+}
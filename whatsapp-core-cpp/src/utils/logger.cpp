@@ -1,9 +1,191 @@
-#include "logger.h"
+#include "utils/logger.h"
+#include "utils/metrics.h"
+#include <spdlog/async.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/sinks/stdout_sinks.h>
+#include <spdlog/pattern_formatter.h>
+#include <fmt/chrono.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
 
-void init_logger() {
-    auto logger = spdlog::stdout_color_mt("core");
+namespace {
+void AppendJsonString(spdlog::memory_buf_t& dest, spdlog::string_view_t text) {
+    dest.push_back('"');
+    for (char c : text) {
+        switch (c) {
+            case '"': dest.append(std::string_view("\\\"")); break;
+            case '\\': dest.append(std::string_view("\\\\")); break;
+            case '\n': dest.append(std::string_view("\\n")); break;
+            case '\r': dest.append(std::string_view("\\r")); break;
+            case '\t': dest.append(std::string_view("\\t")); break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    fmt::format_to(std::back_inserter(dest), "\\u{:04x}", static_cast<int>(c));
+                } else {
+                    dest.push_back(c);   // UTF-8 (emojis incluidos) va tal cual
+                }
+        }
+    }
+    dest.push_back('"');
+}
+
+// {"ts":"2026-01-01T12:00:00.123Z","level":"info","thread":1234,"site":"ingest.indexed","msg":"..."}
+class JsonFormatter : public spdlog::formatter {
+public:
+    void format(const spdlog::details::log_msg& msg, spdlog::memory_buf_t& dest) override {
+        auto seconds = std::chrono::time_point_cast<std::chrono::seconds>(msg.time);
+        auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(msg.time - seconds).count();
+        // El hilo que escribe es uno solo: cachear el segundo formateado ahorra el gmtime casi siempre
+        if (seconds != m_cached_second) {
+            m_cached_second = seconds;
+            m_cached_ts = fmt::format("{:%Y-%m-%dT%H:%M:%S}", fmt::gmtime(std::chrono::system_clock::to_time_t(seconds)));
+        }
+        fmt::format_to(std::back_inserter(dest), "{{\"ts\":\"{}.{:03}Z\",\"level\":\"{}\",\"thread\":{}",
+                       m_cached_ts, millis, spdlog::level::to_string_view(msg.level), msg.thread_id);
+        if (msg.source.funcname) {
+            dest.append(std::string_view(",\"site\":"));
+            AppendJsonString(dest, msg.source.funcname);
+        }
+        dest.append(std::string_view(",\"msg\":"));
+        AppendJsonString(dest, msg.payload);
+        dest.append(std::string_view("}\n"));
+    }
+
+    std::unique_ptr<spdlog::formatter> clone() const override {
+        return std::make_unique<JsonFormatter>();
+    }
+
+private:
+    std::chrono::system_clock::time_point m_cached_second{};
+    std::string m_cached_ts;
+};
+
+// Sitios de LOG_SAMPLED vistos hasta ahora y muestreos pedidos (incluso antes de que el sitio exista)
+struct SiteRegistry {
+    std::mutex mutex;
+    std::vector<LogSite*> sites;
+    std::map<std::string, LogSampling> overrides;   // "*" = todos
+};
+
+SiteRegistry& Sites() {
+    static SiteRegistry registry;
+    return registry;
+}
+
+const std::map<std::string, spdlog::level::level_enum>& LevelNames() {
+    static const std::map<std::string, spdlog::level::level_enum> names{
+        {"trace", spdlog::level::trace}, {"debug", spdlog::level::debug}, {"info", spdlog::level::info},
+        {"warn", spdlog::level::warn}, {"error", spdlog::level::err}, {"critical", spdlog::level::critical},
+        {"off", spdlog::level::off}};
+    return names;
+}
+}
+
+void init_logger(const LoggerOptions& options) {
+    // Un solo hilo escritor: el orden de los logs se mantiene. Con la cola llena se pisa el mensaje
+    // más viejo en lugar de bloquear al que loguea (un stdout lento no frena /ingest)
+    spdlog::init_thread_pool(options.queue_size, 1);
+    std::shared_ptr<spdlog::logger> logger;
+    if (options.json) {
+        logger = spdlog::create_async_nb<spdlog::sinks::stdout_sink_mt>("core");
+        logger->set_formatter(std::make_unique<JsonFormatter>());
+    } else {
+        logger = spdlog::create_async_nb<spdlog::sinks::stdout_color_sink_mt>("core");
+        logger->set_pattern("[%Y-%m-%d %H:%M:%S] [%^%l%$] %v");
+    }
     spdlog::set_default_logger(logger);
-    spdlog::set_pattern("[%Y-%m-%d %H:%M:%S] [%^%l%$] %v");
-    spdlog::set_level(spdlog::level::info);
+    if (!SetLogLevel(options.level)) {
+        spdlog::set_level(spdlog::level::info);
+        spdlog::warn("⚠️ LOG_LEVEL desconocido: {} (se usa info)", options.level);
+    }
+    spdlog::flush_on(spdlog::level::warn);
+    spdlog::flush_every(std::chrono::seconds(1));
+}
+
+bool SetLogLevel(const std::string& level) {
+    auto it = LevelNames().find(level);
+    if (it == LevelNames().end()) return false;
+    spdlog::set_level(it->second);
+    return true;
+}
+
+std::string GetLogLevel() {
+    auto current = spdlog::get_level();
+    for (const auto& [name, level] : LevelNames()) {
+        if (level == current) return name;
+    }
+    return "info";
+}
+
+LogSite::LogSite(const char* name, LogSampling defaults)
+    : m_name(name), m_every_n(defaults.every_n), m_per_second(defaults.per_second),
+      m_suppressed(&Metrics().GetCounter("whatsapp_log_suppressed_total",
+                                         "Logs descartados por el muestreo de su sitio", {{"site", name}})) {
+    auto& registry = Sites();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    auto it = registry.overrides.find(name);
+    if (it == registry.overrides.end()) it = registry.overrides.find("*");
+    if (it != registry.overrides.end()) Configure(it->second);
+    registry.sites.push_back(this);
+}
+
+bool LogSite::ShouldLog() {
+    uint64_t call = m_calls.fetch_add(1, std::memory_order_relaxed);
+    uint32_t every_n = m_every_n.load(std::memory_order_relaxed);
+    if (every_n > 1 && call % every_n != 0) {
+        m_suppressed->Inc();
+        return false;
+    }
+
+    uint32_t per_second = m_per_second.load(std::memory_order_relaxed);
+    if (per_second > 0) {
+        // Ventana de un segundo. Si dos hilos la renuevan a la vez el límite se pasa por poco: da igual
+        int64_t now = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        int64_t window = m_window.load(std::memory_order_relaxed);
+        if (window != now && m_window.compare_exchange_strong(window, now, std::memory_order_relaxed)) {
+            m_in_window.store(0, std::memory_order_relaxed);
+        }
+        if (m_in_window.fetch_add(1, std::memory_order_relaxed) >= per_second) {
+            m_suppressed->Inc();
+            return false;
+        }
+    }
+    m_logged.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void LogSite::Configure(LogSampling sampling) {
+    m_every_n.store(std::max<uint32_t>(sampling.every_n, 1), std::memory_order_relaxed);
+    m_per_second.store(sampling.per_second, std::memory_order_relaxed);
+}
+
+LogSiteStats LogSite::Stats() const {
+    return {m_name,
+            {m_every_n.load(std::memory_order_relaxed), m_per_second.load(std::memory_order_relaxed)},
+            m_logged.load(std::memory_order_relaxed),
+            m_suppressed->Value()};
+}
+
+void SetLogSampling(const std::string& site, LogSampling sampling) {
+    auto& registry = Sites();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    if (site == "*") {
+        // El comodín manda sobre lo configurado antes sitio a sitio
+        registry.overrides.clear();
+    }
+    registry.overrides[site] = sampling;
+    for (LogSite* log_site : registry.sites) {
+        if (site == "*" || site == log_site->Name()) log_site->Configure(sampling);
+    }
+}
+
+std::vector<LogSiteStats> GetLogSites() {
+    auto& registry = Sites();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    std::vector<LogSiteStats> stats;
+    for (const LogSite* site : registry.sites) stats.push_back(site->Stats());
+    return stats;
 }
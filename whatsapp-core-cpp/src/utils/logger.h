@@ -1,4 +0,0 @@
-#pragma once
-#include <spdlog/spdlog.h>
-
-void init_logger();
@@ -0,0 +1,270 @@
+#include "utils/memory.h"
+#include "utils/metrics.h"
+#include <spdlog/spdlog.h>
+#include <malloc.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+
+namespace {
+constexpr size_t kMB = 1024 * 1024;
+constexpr auto kTrimInterval = std::chrono::seconds(30);
+
+// cgroup v2 (memory.max) o v1 (memory.limit_in_bytes). "max" o un valor absurdo = sin límite
+size_t ReadCgroupLimit() {
+    for (const char* path : {"/sys/fs/cgroup/memory.max", "/sys/fs/cgroup/memory/memory.limit_in_bytes"}) {
+        std::ifstream in(path);
+        std::string value;
+        if (!(in >> value)) continue;
+        if (value == "max") return 0;
+        unsigned long long limit = std::strtoull(value.c_str(), nullptr, 10);
+        return limit > 0 && limit < (1ull << 60) ? static_cast<size_t>(limit) : 0;
+    }
+    return 0;
+}
+
+std::string Trim(const std::string& s) {
+    size_t start = s.find_first_not_of(" \t");
+    if (start == std::string::npos) return "";
+    size_t end = s.find_last_not_of(" \t");
+    return s.substr(start, end - start + 1);
+}
+}
+
+AllocatorStats ReadAllocatorStats() {
+    AllocatorStats stats;
+    // statm: tamaño total y residente, en páginas
+    std::ifstream statm("/proc/self/statm");
+    size_t total_pages = 0, resident_pages = 0;
+    if (statm >> total_pages >> resident_pages) {
+        stats.rss = resident_pages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    }
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+    // mallinfo2 recorre todas las arenas con sus candados: barato, pero no para cada petición
+    struct mallinfo2 info = mallinfo2();
+    stats.heap_in_use = info.uordblks + info.hblkhd;
+    stats.heap_free = info.fordblks;
+    stats.mmapped = info.hblkhd;
+    stats.releasable = info.keepcost;
+#endif
+    stats.cgroup_limit = ReadCgroupLimit();
+    return stats;
+}
+
+std::map<std::string, size_t> ParseMemoryLimits(const std::string& spec) {
+    std::map<std::string, size_t> limits;
+    std::stringstream items(spec);
+    std::string item;
+    while (std::getline(items, item, ',')) {
+        size_t eq = item.find('=');
+        std::string name = Trim(item.substr(0, eq));
+        long mb = eq != std::string::npos ? std::atol(item.c_str() + eq + 1) : 0;
+        if (name.empty() || mb <= 0) {
+            if (!Trim(item).empty()) spdlog::warn("⚠️ MEMORY_LIMITS: entrada ignorada '{}'", item);
+            continue;
+        }
+        limits[name] = static_cast<size_t>(mb) * kMB;
+    }
+    return limits;
+}
+
+MemoryAccounting& Memory() {
+    static MemoryAccounting accounting;
+    return accounting;
+}
+
+MemoryAccounting::~MemoryAccounting() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_cv.notify_all();
+    if (m_thread.joinable()) m_thread.join();
+}
+
+void MemoryAccounting::Register(const std::string& name, std::shared_ptr<MemoryReporter> reporter) {
+    std::weak_ptr<MemoryReporter> weak = reporter;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries.push_back({name, weak, 0});
+    }
+    Metrics().AddCallbackGauge("whatsapp_memory_bytes", "Memoria estimada por componente", {{"component", name}},
+                               [weak] {
+                                   auto reporter = weak.lock();
+                                   return reporter ? static_cast<double>(reporter->GetMemoryUsage().bytes) : 0.0;
+                               });
+}
+
+void MemoryAccounting::Configure(const MemoryLimits& limits) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_limits = limits;
+        if (m_limits.process_soft_limit == 0) {
+            // Sin límite explícito: un margen por debajo del del pod, que es donde llega el OOM killer
+            m_limits.process_soft_limit = ReadCgroupLimit() / 100 * 85;
+        }
+        m_limits.check_interval_ms = std::max(m_limits.check_interval_ms, 100);
+    }
+
+    auto& registry = Metrics();
+    registry.AddCallbackGauge("whatsapp_process_rss_bytes", "Memoria residente del proceso", {},
+                              [] { return static_cast<double>(ReadAllocatorStats().rss); });
+    registry.AddCallbackGauge("whatsapp_memory_soft_limit_bytes", "Límite blando de memoria del proceso (0 = sin límite)", {},
+                              [this] { return static_cast<double>(ProcessLimit()); });
+    registry.AddCallbackGauge("whatsapp_memory_pressure", "1 mientras /ingest y el historial están frenados por memoria", {},
+                              [this] { return UnderPressure() ? 1.0 : 0.0; });
+
+    bool any = ProcessLimit() > 0 || !limits.components.empty();
+    if (!any || m_thread.joinable()) return;
+    m_thread = std::thread([this] { MonitorLoop(); });
+}
+
+size_t MemoryAccounting::ProcessLimit() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_limits.process_soft_limit;
+}
+
+void MemoryAccounting::MonitorLoop() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stopping) {
+        auto interval = std::chrono::milliseconds(m_limits.check_interval_ms);
+        if (m_cv.wait_for(lock, interval, [this] { return m_stopping; })) break;
+        lock.unlock();
+        try {
+            Enforce();
+        } catch (const std::exception& e) {
+            spdlog::error("Error vigilando la memoria: {}", e.what());
+        }
+        lock.lock();
+    }
+}
+
+void MemoryAccounting::Enforce() {
+    std::lock_guard<std::mutex> enforce_lock(m_enforce_mutex);
+
+    // Copia bajo el candado: ReleaseMemory toma los candados de cada componente
+    struct Target {
+        size_t index;
+        std::string name;
+        std::shared_ptr<MemoryReporter> reporter;
+        size_t limit;
+    };
+    std::vector<Target> targets;
+    size_t process_limit;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (size_t i = 0; i < m_entries.size(); ++i) {
+            auto reporter = m_entries[i].reporter.lock();
+            if (!reporter) continue;
+            auto it = m_limits.components.find(m_entries[i].name);
+            targets.push_back({i, m_entries[i].name, std::move(reporter), it != m_limits.components.end() ? it->second : 0});
+        }
+        process_limit = m_limits.process_soft_limit;
+    }
+
+    std::vector<size_t> released(targets.size(), 0);
+    bool acted = false;
+    std::string reason;
+
+    // 1. Componentes por encima de su propio límite. Se baja al 90 % para no volver a pasarlo
+    //    con el siguiente mensaje
+    for (size_t i = 0; i < targets.size(); ++i) {
+        auto& target = targets[i];
+        if (target.limit == 0) continue;
+        size_t bytes = target.reporter->GetMemoryUsage().bytes;
+        if (bytes <= target.limit) continue;
+        size_t freed = target.reporter->ReleaseMemory(target.limit / 10 * 9);
+        released[i] += freed;
+        if (freed > 0) acted = true;
+        size_t after = target.reporter->GetMemoryUsage().bytes;
+        if (after > target.limit && reason.empty()) {
+            reason = target.name + ": " + std::to_string(after / kMB) + " MB, límite " + std::to_string(target.limit / kMB) + " MB";
+        }
+    }
+
+    // 2. El proceso entero. Con la presión ya activa no se suelta hasta bajar del 95 % (histéresis)
+    if (process_limit > 0) {
+        size_t threshold = m_pressure.load() ? process_limit / 20 * 19 : process_limit;
+        size_t rss = ReadAllocatorStats().rss;
+        if (rss > threshold) {
+            size_t excess = rss - std::min(rss, process_limit / 10 * 9);
+            size_t freed_total = 0;
+            for (size_t i = 0; i < targets.size() && excess > 0; ++i) {
+                size_t bytes = targets[i].reporter->GetMemoryUsage().bytes;
+                // Si ni vaciándolo entero se nota, no se toca: lo único que conseguiríamos es tirar
+                // la caché (o cerrar conexiones) en cada pasada mientras dure la presión
+                if (bytes < excess / 10) continue;
+                size_t freed = targets[i].reporter->ReleaseMemory(bytes > excess ? bytes - excess : 0);
+                released[i] += freed;
+                freed_total += freed;
+                excess -= std::min(excess, freed);
+            }
+            // Lo liberado vuelve a malloc, no al sistema: sin esto el RSS no baja. malloc_trim recorre
+            // todo el heap con sus candados, así que con la presión sostenida y nada nuevo que soltar
+            // se repite como mucho cada kTrimInterval
+            auto now = std::chrono::steady_clock::now();
+            if (freed_total > 0 || now - m_last_trim >= kTrimInterval) {
+                malloc_trim(0);
+                m_last_trim = now;
+                acted = true;
+            }
+            rss = ReadAllocatorStats().rss;
+            if (rss > threshold && reason.empty()) {
+                reason = "RSS " + std::to_string(rss / kMB) + " MB, límite blando " + std::to_string(process_limit / kMB) + " MB";
+            }
+        }
+    }
+
+    bool pressure = !reason.empty();
+    bool was = m_pressure.exchange(pressure);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (size_t i = 0; i < targets.size(); ++i) m_entries[targets[i].index].released += released[i];
+        if (acted) m_trims++;
+        m_pressure_reason = reason;
+    }
+
+    size_t total_released = 0;
+    for (size_t freed : released) total_released += freed;
+    if (pressure && !was) {
+        spdlog::warn("🧯 Memoria bajo presión ({}): /ingest responde 503 y el historial se pausa", reason);
+    } else if (!pressure && was) {
+        spdlog::info("🧯 Presión de memoria resuelta");
+    }
+    if (total_released > 0) {
+        spdlog::info("🧹 Liberados {:.1f} MB por límites de memoria", total_released / static_cast<double>(kMB));
+    }
+}
+
+MemoryReport MemoryAccounting::Report() const {
+    std::vector<std::pair<MemoryComponentReport, std::shared_ptr<MemoryReporter>>> entries;
+    MemoryReport report;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const auto& entry : m_entries) {
+            auto reporter = entry.reporter.lock();
+            if (!reporter) continue;
+            MemoryComponentReport component;
+            component.name = entry.name;
+            auto it = m_limits.components.find(entry.name);
+            if (it != m_limits.components.end()) component.soft_limit = it->second;
+            component.released = entry.released;
+            entries.emplace_back(std::move(component), std::move(reporter));
+        }
+        report.process_soft_limit = m_limits.process_soft_limit;
+        report.pressure_reason = m_pressure_reason;
+        report.trims = m_trims;
+    }
+
+    // Fuera del candado: cada componente toma el suyo
+    for (auto& [component, reporter] : entries) {
+        component.usage = reporter->GetMemoryUsage();
+        report.accounted += component.usage.bytes;
+        report.components.push_back(std::move(component));
+    }
+    report.allocator = ReadAllocatorStats();
+    report.pressure = UnderPressure();
+    return report;
+}
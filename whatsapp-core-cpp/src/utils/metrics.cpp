@@ -0,0 +1,187 @@
+#include "utils/metrics.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <stdexcept>
+#include <fmt/format.h>
+
+namespace {
+// Límites (en segundos) de los cubos que ve Prometheus: de 100 µs a 1 min
+constexpr std::array<double, 18> kExportBounds{
+    0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05,
+    0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60};
+
+std::string EscapeLabel(const std::string& value) {
+    std::string out;
+    out.reserve(value.size());
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            out += '\\';
+            out += c;
+        } else if (c == '\n') {
+            out += "\\n";
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+// {a="1",b="2"} (vacío si no hay etiquetas)
+std::string FormatLabels(const MetricLabels& labels) {
+    if (labels.empty()) return "";
+    std::string out = "{";
+    for (const auto& [key, value] : labels) {
+        if (out.size() > 1) out += ',';
+        out += key + "=\"" + EscapeLabel(value) + "\"";
+    }
+    return out + "}";
+}
+
+// Añade 'extra' (el "le" de los histogramas) a unas etiquetas ya formateadas
+std::string WithLabel(const std::string& formatted, const std::string& extra) {
+    if (formatted.empty()) return "{" + extra + "}";
+    return formatted.substr(0, formatted.size() - 1) + "," + extra + "}";
+}
+
+std::string FormatValue(double value) {
+    if (std::isnan(value)) return "NaN";
+    if (std::isinf(value)) return value > 0 ? "+Inf" : "-Inf";
+    return fmt::format("{}", value);
+}
+}
+
+size_t MetricShard() {
+    static std::atomic<size_t> next{0};
+    thread_local size_t shard = next.fetch_add(1, std::memory_order_relaxed) % kMetricShards;
+    return shard;
+}
+
+uint64_t MetricCounter::Value() const {
+    uint64_t total = 0;
+    for (const auto& shard : m_shards) total += shard.value.load(std::memory_order_relaxed);
+    return total;
+}
+
+size_t MetricHistogram::BucketIndex(uint64_t us) {
+    if (us < kSub) return static_cast<size_t>(us);
+    int exponent = std::bit_width(us) - 1;
+    if (exponent > kMaxExponent) return kBuckets - 1;
+    int shift = exponent - kSubBits;
+    uint64_t sub = (us >> shift) - kSub;   // Los kSubBits bits tras el más alto
+    return static_cast<size_t>((shift + 1) * kSub + sub);
+}
+
+uint64_t MetricHistogram::BucketUpperBound(size_t index) {
+    if (index < kSub) return index + 1;
+    uint64_t shift = index / kSub - 1;
+    uint64_t sub = index % kSub;
+    return (kSub + sub + 1) << shift;
+}
+
+MetricHistogram::Snapshot MetricHistogram::Collect() const {
+    Snapshot snapshot;
+    uint64_t sum_us = 0;
+    for (const auto& shard : m_shards) {
+        for (size_t i = 0; i < kBuckets; ++i) snapshot.buckets[i] += shard.buckets[i].load(std::memory_order_relaxed);
+        sum_us += shard.sum_us.load(std::memory_order_relaxed);
+    }
+    for (uint64_t n : snapshot.buckets) snapshot.count += n;
+    snapshot.sum_seconds = sum_us / 1e6;
+    return snapshot;
+}
+
+double MetricHistogram::Snapshot::Percentile(double p) const {
+    if (count == 0) return 0;
+    uint64_t rank = static_cast<uint64_t>(std::ceil(std::clamp(p, 0.0, 1.0) * count));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBuckets; ++i) {
+        seen += buckets[i];
+        if (seen >= rank && buckets[i] > 0) return BucketUpperBound(i) / 1e6;
+    }
+    return BucketUpperBound(kBuckets - 1) / 1e6;
+}
+
+MetricsRegistry::Series& MetricsRegistry::GetSeries(const std::string& name, const std::string& help, Type type,
+                                                    const MetricLabels& labels) {
+    auto [it, inserted] = m_families.try_emplace(name);
+    auto& family = it->second;
+    if (inserted) {
+        family.help = help;
+        family.type = type;
+    } else if (family.type != type) {
+        throw std::logic_error("Métrica registrada con otro tipo: " + name);
+    }
+    return family.series[FormatLabels(labels)];
+}
+
+MetricCounter& MetricsRegistry::GetCounter(const std::string& name, const std::string& help, const MetricLabels& labels) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto& series = GetSeries(name, help, Type::Counter, labels);
+    if (!series.counter) series.counter = std::make_unique<MetricCounter>();
+    return *series.counter;
+}
+
+MetricGauge& MetricsRegistry::GetGauge(const std::string& name, const std::string& help, const MetricLabels& labels) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto& series = GetSeries(name, help, Type::Gauge, labels);
+    if (!series.gauge) series.gauge = std::make_unique<MetricGauge>();
+    return *series.gauge;
+}
+
+MetricHistogram& MetricsRegistry::GetHistogram(const std::string& name, const std::string& help, const MetricLabels& labels) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto& series = GetSeries(name, help, Type::Histogram, labels);
+    if (!series.histogram) series.histogram = std::make_unique<MetricHistogram>();
+    return *series.histogram;
+}
+
+void MetricsRegistry::AddCallbackGauge(const std::string& name, const std::string& help, const MetricLabels& labels,
+                                       std::function<double()> read) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    GetSeries(name, help, Type::Gauge, labels).read = std::move(read);
+}
+
+std::string MetricsRegistry::Render() const {
+    std::string out;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto& [name, family] : m_families) {
+        const char* type = family.type == Type::Counter ? "counter" : family.type == Type::Gauge ? "gauge" : "histogram";
+        out += fmt::format("# HELP {} {}\n# TYPE {} {}\n", name, family.help, name, type);
+
+        for (const auto& [labels, series] : family.series) {
+            if (series.counter) {
+                out += fmt::format("{}{} {}\n", name, labels, series.counter->Value());
+            } else if (series.gauge || series.read) {
+                double value = series.read ? series.read() : series.gauge->Value();
+                out += fmt::format("{}{} {}\n", name, labels, FormatValue(value));
+            } else if (series.histogram) {
+                auto snapshot = series.histogram->Collect();
+                // Cubo HDR i => cuenta para 'le' si su límite superior no lo pasa
+                size_t i = 0;
+                uint64_t cumulative = 0;
+                for (double bound : kExportBounds) {
+                    const uint64_t bound_us = static_cast<uint64_t>(bound * 1e6);
+                    while (i < MetricHistogram::kBuckets && MetricHistogram::BucketUpperBound(i) <= bound_us) {
+                        cumulative += snapshot.buckets[i++];
+                    }
+                    out += fmt::format("{}_bucket{} {}\n", name, WithLabel(labels, fmt::format("le=\"{}\"", bound)), cumulative);
+                }
+                out += fmt::format("{}_bucket{} {}\n", name, WithLabel(labels, "le=\"+Inf\""), snapshot.count);
+                out += fmt::format("{}_sum{} {}\n", name, labels, FormatValue(snapshot.sum_seconds));
+                out += fmt::format("{}_count{} {}\n", name, labels, snapshot.count);
+            }
+        }
+    }
+    return out;
+}
+
+MetricsRegistry& Metrics() {
+    static MetricsRegistry registry;
+    return registry;
+}
+
+MetricHistogram& StageHistogram(const std::string& stage) {
+    return Metrics().GetHistogram("whatsapp_stage_duration_seconds",
+                                  "Latencia de cada etapa de /ingest y /chat", {{"stage", stage}});
+}
@@ -0,0 +1,285 @@
+#include "utils/trace.h"
+#include "utils/metrics.h"
+#include <algorithm>
+#include <cctype>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <random>
+#include <thread>
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+using json = nlohmann::json;
+
+namespace {
+std::mt19937_64& Rng() {
+    thread_local std::mt19937_64 rng{std::random_device{}()};
+    return rng;
+}
+
+uint64_t RandomId() {
+    uint64_t id = 0;
+    while (id == 0) id = Rng()();
+    return id;
+}
+
+std::string Hex(uint64_t value) {
+    return fmt::format("{:016x}", value);
+}
+
+bool IsHex(const std::string& s) {
+    return !s.empty() && std::all_of(s.begin(), s.end(), [](char c) { return std::isxdigit(static_cast<unsigned char>(c)); });
+}
+
+json OtlpAttributes(const RequestTrace::Attributes& attributes) {
+    json out = json::array();
+    for (const auto& [key, value] : attributes) out.push_back({{"key", key}, {"value", {{"stringValue", value}}}});
+    return out;
+}
+
+// Escribe las trazas en un hilo propio: la petición solo encola
+class TraceExporter {
+public:
+    static TraceExporter& Instance() {
+        static TraceExporter exporter;
+        return exporter;
+    }
+
+    void Configure(const TraceOptions& options) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_options = options;
+        if (m_options.export_path.empty() || m_thread.joinable()) return;
+        m_thread = std::thread([this] { Run(); });
+        spdlog::info("🔭 Trazas OTLP/JSON en {} (muestreo {:.0f} %, lentas > {} ms)", m_options.export_path,
+                     m_options.sample_rate * 100, m_options.slow_ms);
+    }
+
+    bool ShouldExport(double elapsed_ms) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_options.export_path.empty()) return false;
+        if (m_options.slow_ms > 0 && elapsed_ms >= m_options.slow_ms) return true;
+        if (m_options.sample_rate <= 0) return false;
+        return std::uniform_real_distribution<double>(0.0, 1.0)(Rng()) < m_options.sample_rate;
+    }
+
+    void Enqueue(json trace) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            // Si el disco no da abasto se pierden trazas, no memoria
+            if (m_queue.size() >= kMaxQueued) {
+                m_dropped->Inc();
+                return;
+            }
+            m_queue.push_back(std::move(trace));
+        }
+        m_cv.notify_one();
+    }
+
+    ~TraceExporter() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_cv.notify_all();
+        if (m_thread.joinable()) m_thread.join();
+    }
+
+private:
+    static constexpr size_t kMaxQueued = 1000;
+
+    TraceExporter()
+        : m_dropped(&Metrics().GetCounter("whatsapp_trace_dropped_total",
+                                          "Trazas descartadas porque la cola de exportación estaba llena")) {}
+
+    void Run() {
+        std::ofstream out;
+        for (;;) {
+            std::deque<json> batch;
+            std::string path;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cv.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+                if (m_queue.empty()) return;   // m_stopping y nada pendiente
+                batch.swap(m_queue);
+                path = m_options.export_path;
+            }
+            if (!out.is_open()) {
+                out.open(path, std::ios::app);
+                if (!out) {
+                    spdlog::error("❌ No se pueden escribir trazas en {}", path);
+                    continue;
+                }
+            }
+            for (const auto& trace : batch) out << trace.dump() << '\n';
+            out.flush();
+        }
+    }
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<json> m_queue;
+    TraceOptions m_options;
+    MetricCounter* m_dropped;
+    bool m_stopping = false;
+    std::thread m_thread;
+};
+}
+
+void ConfigureTracing(const TraceOptions& options) {
+    TraceExporter::Instance().Configure(options);
+}
+
+RequestTrace::RequestTrace(std::string name, const std::string& traceparent)
+    : m_name(std::move(name)), m_root_id(RandomId()), m_start(Clock::now()),
+      m_start_wall(std::chrono::system_clock::now()), m_end(m_start) {
+    // traceparent: "00-<trace-id 32 hex>-<parent-id 16 hex>-<flags 2 hex>"
+    if (traceparent.size() == 55 && traceparent[2] == '-' && traceparent[35] == '-' && traceparent[52] == '-') {
+        std::string trace_id = traceparent.substr(3, 32);
+        std::string parent_id = traceparent.substr(36, 16);
+        if (IsHex(trace_id) && IsHex(parent_id) && trace_id != std::string(32, '0')) {
+            m_trace_id = trace_id;
+            m_remote_parent = parent_id;
+        }
+    }
+    if (m_trace_id.empty()) m_trace_id = Hex(RandomId()) + Hex(RandomId());
+}
+
+uint64_t RequestTrace::NewSpanId() {
+    return RandomId();
+}
+
+void RequestTrace::AddSpan(uint64_t id, std::string name, Clock::time_point start, Clock::time_point end,
+                           uint64_t parent, Attributes attributes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_spans.push_back({id, parent ? parent : m_root_id, std::move(name), start, end, std::move(attributes)});
+}
+
+void RequestTrace::SetAttribute(std::string key, std::string value) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_attributes.emplace_back(std::move(key), std::move(value));
+}
+
+double RequestTrace::ElapsedMs() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto end = m_finished ? m_end : Clock::now();
+    return std::chrono::duration<double, std::milli>(end - m_start).count();
+}
+
+json RequestTrace::TimingJson() const {
+    json out = json::object();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto& span : m_spans) {
+        if (span.parent != m_root_id) continue;
+        // Un nombre repetido (p. ej. dos reintentos) suma
+        double ms = std::chrono::duration<double, std::milli>(span.end - span.start).count();
+        out[span.name] = out.value(span.name, 0.0) + ms;
+    }
+    auto end = m_finished ? m_end : Clock::now();
+    out["total"] = std::chrono::duration<double, std::milli>(end - m_start).count();
+    return out;
+}
+
+std::string RequestTrace::ServerTiming() const {
+    std::vector<std::pair<std::string, double>> entries;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::vector<const Span*> top;
+        for (const auto& span : m_spans) {
+            if (span.parent == m_root_id) top.push_back(&span);
+        }
+        std::sort(top.begin(), top.end(), [](const Span* a, const Span* b) { return a->start < b->start; });
+        for (const Span* span : top) {
+            double ms = std::chrono::duration<double, std::milli>(span->end - span->start).count();
+            auto it = std::find_if(entries.begin(), entries.end(), [&](const auto& e) { return e.first == span->name; });
+            if (it != entries.end()) {
+                it->second += ms;
+            } else {
+                entries.emplace_back(span->name, ms);
+            }
+        }
+        auto end = m_finished ? m_end : Clock::now();
+        entries.emplace_back("total", std::chrono::duration<double, std::milli>(end - m_start).count());
+    }
+    std::string out;
+    for (const auto& [name, ms] : entries) {
+        if (!out.empty()) out += ", ";
+        out += fmt::format("{};dur={:.1f}", name, ms);
+    }
+    return out;
+}
+
+void RequestTrace::Finish(int http_status) {
+    double elapsed_ms;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_finished) return;
+        m_finished = true;
+        m_end = Clock::now();
+        m_attributes.emplace_back("http.status_code", std::to_string(http_status));
+        elapsed_ms = std::chrono::duration<double, std::milli>(m_end - m_start).count();
+    }
+    auto& exporter = TraceExporter::Instance();
+    if (exporter.ShouldExport(elapsed_ms)) exporter.Enqueue(ToOtlp());
+}
+
+json RequestTrace::ToOtlp() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto unix_ns = [this](Clock::time_point t) {
+        auto wall = m_start_wall + std::chrono::duration_cast<std::chrono::system_clock::duration>(t - m_start);
+        // OTLP/JSON: los enteros de 64 bits van como string
+        return std::to_string(std::chrono::duration_cast<std::chrono::nanoseconds>(wall.time_since_epoch()).count());
+    };
+
+    json spans = json::array();
+    json root = {
+        {"traceId", m_trace_id},
+        {"spanId", Hex(m_root_id)},
+        {"name", m_name},
+        {"kind", 2},   // SPAN_KIND_SERVER
+        {"startTimeUnixNano", unix_ns(m_start)},
+        {"endTimeUnixNano", unix_ns(m_finished ? m_end : Clock::now())},
+        {"attributes", OtlpAttributes(m_attributes)}
+    };
+    if (!m_remote_parent.empty()) root["parentSpanId"] = m_remote_parent;
+    spans.push_back(std::move(root));
+
+    for (const auto& span : m_spans) {
+        spans.push_back({
+            {"traceId", m_trace_id},
+            {"spanId", Hex(span.id)},
+            {"parentSpanId", Hex(span.parent)},
+            {"name", span.name},
+            {"kind", 1},   // SPAN_KIND_INTERNAL
+            {"startTimeUnixNano", unix_ns(span.start)},
+            {"endTimeUnixNano", unix_ns(span.end)},
+            {"attributes", OtlpAttributes(span.attributes)}
+        });
+    }
+
+    return {{"resourceSpans", json::array({{
+        {"resource", {{"attributes", OtlpAttributes({{"service.name", "whatsapp-core"}})}}},
+        {"scopeSpans", json::array({{
+            {"scope", {{"name", "whatsapp-core"}}},
+            {"spans", std::move(spans)}
+        }})}
+    }})}};
+}
+
+TraceSpan::TraceSpan(RequestTrace* trace, std::string name, uint64_t parent, MetricHistogram* histogram)
+    : m_trace(trace), m_name(std::move(name)), m_parent(parent), m_histogram(histogram),
+      m_start(RequestTrace::Clock::now()) {
+    if (m_trace) m_id = m_trace->NewSpanId();
+}
+
+void TraceSpan::SetAttribute(std::string key, std::string value) {
+    if (m_trace) m_attributes.emplace_back(std::move(key), std::move(value));
+}
+
+void TraceSpan::End() {
+    if (m_ended) return;
+    m_ended = true;
+    auto end = RequestTrace::Clock::now();
+    if (m_histogram) m_histogram->Observe(end - m_start);
+    if (m_trace) m_trace->AddSpan(m_id, std::move(m_name), m_start, end, m_parent, std::move(m_attributes));
+}
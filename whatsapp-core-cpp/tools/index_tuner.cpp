@@ -0,0 +1,393 @@
+// Banco de pruebas de recall frente a latencia para el índice vectorial. Carga un corpus de
+// embeddings, calcula la verdad exacta con IndexFlatL2 (lo que usa hoy VectorStore) y barre
+// configuraciones aproximadas de FAISS: HNSW (M, efSearch), IVF (nlist, nprobe) y códigos SQ/PQ.
+// Para cada una: recall@k, QPS, p50/p99 por consulta, tiempo de construcción y memoria, y marca
+// la frontera de Pareto recall/QPS.
+//
+//   ./index_tuner --index-file rag.index          (lo que escribe VectorStore::Save)
+//   ./index_tuner --fvecs corpus.fvecs [--query-fvecs queries.fvecs]
+//   ./index_tuner --synthetic 200000 --dim 768    (solo para probar la herramienta: sin datos reales
+//                                                  las cifras de recall no dicen nada)
+// Opciones: --queries 1000 --k 10 --threads 1 --ef 16,32,64,128,256 --nprobe 1,2,4,8,16,32,64
+//           --ef-construction 40 --train-max 100000 --configs "HNSW32;IVF{nlist},SQ8" --json out.json
+//
+// Sin --query-fvecs las consultas son vectores del corpus que se apartan antes de indexar.
+// Memoria = tamaño del índice serializado (vectores + grafo/listas + codebooks).
+#include <faiss/AutoTune.h>
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/index_factory.h>
+#include <faiss/index_io.h>
+#include <faiss/impl/io.h>
+#include <nlohmann/json.hpp>
+#include <omp.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+using json = nlohmann::json;
+
+namespace {
+struct TunerOptions {
+    std::string index_file;
+    std::string fvecs;
+    std::string query_fvecs;
+    long synthetic = 0;
+    int dim = 768;
+    long queries = 1000;
+    int k = 10;
+    int threads = 1;
+    int ef_construction = 40;
+    long train_max = 100000;
+    std::vector<int> ef{16, 32, 64, 128, 256};
+    std::vector<int> nprobe{1, 2, 4, 8, 16, 32, 64};
+    std::vector<std::string> configs{"Flat", "SQ8", "HNSW16", "HNSW32", "HNSW32,SQ8",
+                                     "IVF{nlist},Flat", "IVF{nlist},SQ8", "IVF{nlist},PQ{pq}"};
+    std::string json_out;
+};
+
+struct Corpus {
+    int dim = 0;
+    std::vector<float> base;
+    std::vector<float> queries;
+    size_t Size() const { return base.size() / dim; }
+    size_t QueryCount() const { return queries.size() / dim; }
+};
+
+std::vector<std::string> Split(const std::string& list, char separator) {
+    std::vector<std::string> items;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, separator)) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+std::vector<int> SplitInts(const std::string& list) {
+    std::vector<int> values;
+    for (const auto& item : Split(list, ',')) values.push_back(std::stoi(item));
+    return values;
+}
+
+TunerOptions ParseArgs(int argc, char** argv) {
+    TunerOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&]() -> std::string {
+            if (i + 1 >= argc) throw std::invalid_argument("Falta el valor de " + arg);
+            return argv[++i];
+        };
+        if (arg == "--index-file") options.index_file = next();
+        else if (arg == "--fvecs") options.fvecs = next();
+        else if (arg == "--query-fvecs") options.query_fvecs = next();
+        else if (arg == "--synthetic") options.synthetic = std::stol(next());
+        else if (arg == "--dim") options.dim = std::stoi(next());
+        else if (arg == "--queries") options.queries = std::stol(next());
+        else if (arg == "--k") options.k = std::stoi(next());
+        else if (arg == "--threads") options.threads = std::stoi(next());
+        else if (arg == "--ef-construction") options.ef_construction = std::stoi(next());
+        else if (arg == "--train-max") options.train_max = std::stol(next());
+        else if (arg == "--ef") options.ef = SplitInts(next());
+        else if (arg == "--nprobe") options.nprobe = SplitInts(next());
+        // ';' separa configuraciones: las cadenas de index_factory ya llevan comas
+        else if (arg == "--configs") options.configs = Split(next(), ';');
+        else if (arg == "--json") options.json_out = next();
+        else throw std::invalid_argument("Argumento desconocido: " + arg);
+    }
+    if (options.index_file.empty() && options.fvecs.empty() && options.synthetic <= 0) {
+        throw std::invalid_argument("Indica el corpus: --index-file, --fvecs o --synthetic N");
+    }
+    return options;
+}
+
+// .fvecs: por vector, un int32 con la dimensión y luego los floats
+std::vector<float> ReadFvecs(const std::string& path, int& dim) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw std::runtime_error("No se puede abrir " + path);
+    std::vector<float> data;
+    int32_t d = 0;
+    while (in.read(reinterpret_cast<char*>(&d), sizeof(d))) {
+        if (dim == 0) dim = d;
+        if (d != dim) throw std::runtime_error(path + ": dimensiones mezcladas");
+        size_t offset = data.size();
+        data.resize(offset + d);
+        if (!in.read(reinterpret_cast<char*>(data.data() + offset), d * sizeof(float))) {
+            throw std::runtime_error(path + ": vector truncado");
+        }
+    }
+    return data;
+}
+
+// Nubes gaussianas normalizadas: algo de estructura para que IVF/PQ tengan qué aprender
+std::vector<float> MakeSynthetic(long count, int dim) {
+    std::mt19937 rng(42);
+    std::normal_distribution<float> dist(0.0f, 1.0f);
+    const int clusters = std::max(16, static_cast<int>(std::sqrt(count) / 4));
+    std::vector<float> centers(static_cast<size_t>(clusters) * dim);
+    for (auto& x : centers) x = dist(rng);
+    std::vector<float> data(static_cast<size_t>(count) * dim);
+    for (long i = 0; i < count; ++i) {
+        const float* center = centers.data() + static_cast<size_t>(rng() % clusters) * dim;
+        float* v = data.data() + static_cast<size_t>(i) * dim;
+        float norm = 0;
+        for (int j = 0; j < dim; ++j) {
+            v[j] = center[j] + 0.6f * dist(rng);
+            norm += v[j] * v[j];
+        }
+        norm = std::sqrt(norm);
+        for (int j = 0; j < dim; ++j) v[j] /= norm;
+    }
+    return data;
+}
+
+Corpus LoadCorpus(const TunerOptions& options) {
+    Corpus corpus;
+    std::vector<float> all;
+    if (!options.index_file.empty()) {
+        std::unique_ptr<faiss::Index> stored(faiss::read_index(options.index_file.c_str()));
+        corpus.dim = stored->d;
+        all.resize(static_cast<size_t>(stored->ntotal) * stored->d);
+        stored->reconstruct_n(0, stored->ntotal, all.data());
+    } else if (!options.fvecs.empty()) {
+        all = ReadFvecs(options.fvecs, corpus.dim);
+    } else {
+        corpus.dim = options.dim;
+        all = MakeSynthetic(options.synthetic, options.dim);
+    }
+    const size_t dim = corpus.dim;
+    const size_t total = all.size() / dim;
+
+    if (!options.query_fvecs.empty()) {
+        int query_dim = corpus.dim;
+        corpus.queries = ReadFvecs(options.query_fvecs, query_dim);
+        corpus.base = std::move(all);
+        return corpus;
+    }
+    // Consultas apartadas al azar (no están en el índice, como una pregunta nueva)
+    size_t nq = std::min<size_t>(options.queries, total / 10);
+    std::vector<size_t> order(total);
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), std::mt19937(7));
+    std::vector<bool> is_query(total, false);
+    for (size_t i = 0; i < nq; ++i) is_query[order[i]] = true;
+    corpus.base.reserve((total - nq) * dim);
+    corpus.queries.reserve(nq * dim);
+    for (size_t i = 0; i < total; ++i) {
+        auto& target = is_query[i] ? corpus.queries : corpus.base;
+        target.insert(target.end(), all.begin() + i * dim, all.begin() + (i + 1) * dim);
+    }
+    return corpus;
+}
+
+// {nlist}: ~4·sqrt(n) en potencia de 2, con al menos 39 vectores de entrenamiento por lista.
+// {pq}: subcuantizadores de 8 bits, ~8 dimensiones cada uno (divisor exacto de dim)
+std::string ExpandConfig(std::string config, size_t n, int dim) {
+    long nlist = 1;
+    while (nlist * 2 <= 4 * std::sqrt(static_cast<double>(n)) && static_cast<size_t>(nlist * 2 * 39) <= n) nlist *= 2;
+    int pq = std::max(1, dim / 8);
+    while (dim % pq != 0) pq--;
+    for (auto [key, value] : {std::pair<std::string, long>{"{nlist}", nlist}, {"{pq}", pq}}) {
+        for (size_t pos; (pos = config.find(key)) != std::string::npos;) config.replace(pos, key.size(), std::to_string(value));
+    }
+    return config;
+}
+
+size_t SerializedBytes(const faiss::Index* index) {
+    faiss::VectorIOWriter writer;
+    faiss::write_index(index, &writer);
+    return writer.data.size();
+}
+
+struct Row {
+    std::string config;
+    std::string param;    // "efSearch=64", "nprobe=8" o vacío
+    double recall = 0;    // recall@k medio
+    double top1 = 0;      // Fracción de consultas cuyo primer resultado es el vecino exacto
+    double qps = 0;
+    double p50_us = 0;
+    double p99_us = 0;
+    double build_s = 0;
+    double memory_mb = 0;
+    bool pareto = false;
+};
+
+// Una consulta cada vez, como llegan desde /chat
+Row Evaluate(faiss::Index& index, const Corpus& corpus, const std::vector<faiss::idx_t>& truth, int k) {
+    const size_t nq = corpus.QueryCount();
+    std::vector<faiss::idx_t> labels(k);
+    std::vector<float> distances(k);
+    std::vector<double> latencies(nq);
+    double hits = 0;
+    size_t top1 = 0;
+    for (size_t q = 0; q < nq; ++q) {
+        auto start = std::chrono::steady_clock::now();
+        index.search(1, corpus.queries.data() + q * corpus.dim, k, distances.data(), labels.data());
+        latencies[q] = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+        const faiss::idx_t* expected = truth.data() + q * k;
+        std::unordered_set<faiss::idx_t> exact(expected, expected + k);
+        for (faiss::idx_t label : labels) hits += exact.count(label);
+        if (labels[0] == expected[0]) top1++;
+    }
+    Row row;
+    row.recall = hits / (static_cast<double>(nq) * k);
+    row.top1 = static_cast<double>(top1) / nq;
+    double total_us = std::accumulate(latencies.begin(), latencies.end(), 0.0);
+    row.qps = total_us > 0 ? nq / (total_us / 1e6) : 0;
+    std::sort(latencies.begin(), latencies.end());
+    row.p50_us = latencies[nq / 2];
+    row.p99_us = latencies[std::min(nq - 1, static_cast<size_t>(std::ceil(nq * 0.99)) - 1)];
+    return row;
+}
+
+// Frontera de Pareto: nadie la supera a la vez en recall y en QPS
+void MarkPareto(std::vector<Row>& rows) {
+    std::vector<Row*> sorted;
+    for (auto& row : rows) sorted.push_back(&row);
+    std::sort(sorted.begin(), sorted.end(), [](const Row* a, const Row* b) {
+        return a->recall != b->recall ? a->recall > b->recall : a->qps > b->qps;
+    });
+    double best_qps = -1;
+    for (Row* row : sorted) {
+        if (row->qps > best_qps) {
+            row->pareto = true;
+            best_qps = row->qps;
+        }
+    }
+}
+}
+
+int main(int argc, char** argv) {
+    TunerOptions options;
+    try {
+        options = ParseArgs(argc, argv);
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "❌ %s\n", e.what());
+        return 2;
+    }
+    omp_set_num_threads(options.threads);
+
+    try {
+        Corpus corpus = LoadCorpus(options);
+        const size_t n = corpus.Size();
+        const size_t nq = corpus.QueryCount();
+        const int k = options.k;
+        if (n < static_cast<size_t>(k) || nq == 0) throw std::runtime_error("Corpus demasiado pequeño");
+        std::fprintf(stderr, "📚 Corpus: %zu vectores de %d dims, %zu consultas, k=%d, %d hilos\n",
+                     n, corpus.dim, nq, k, options.threads);
+
+        // Verdad exacta: IndexFlatL2, lo mismo que VectorStore hoy (en lote y con todos los hilos)
+        std::vector<faiss::idx_t> truth(nq * k);
+        {
+            faiss::IndexFlatL2 exact(corpus.dim);
+            exact.add(n, corpus.base.data());
+            std::vector<float> distances(nq * k);
+            omp_set_num_threads(omp_get_num_procs());
+            exact.search(nq, corpus.queries.data(), k, distances.data(), truth.data());
+            omp_set_num_threads(options.threads);
+        }
+
+        // Muestra de entrenamiento para IVF/PQ/SQ
+        const size_t train_n = std::min<size_t>(n, options.train_max);
+        std::vector<float> train(corpus.base.begin(), corpus.base.begin() + train_n * corpus.dim);
+        if (train_n < n) {
+            std::mt19937 rng(3);
+            for (size_t i = 0; i < train_n; ++i) {
+                size_t pick = rng() % n;
+                std::copy_n(corpus.base.begin() + pick * corpus.dim, corpus.dim, train.begin() + i * corpus.dim);
+            }
+        }
+
+        std::vector<Row> rows;
+        faiss::ParameterSpace params;
+        for (const auto& raw : options.configs) {
+            const std::string config = ExpandConfig(raw, n, corpus.dim);
+            std::unique_ptr<faiss::Index> index;
+            auto start = std::chrono::steady_clock::now();
+            try {
+                index.reset(faiss::index_factory(corpus.dim, config.c_str(), faiss::METRIC_L2));
+                if (auto hnsw = dynamic_cast<faiss::IndexHNSW*>(index.get())) {
+                    hnsw->hnsw.efConstruction = options.ef_construction;
+                }
+                // Construir sí con todos los hilos: lo que medimos es la búsqueda
+                omp_set_num_threads(omp_get_num_procs());
+                if (!index->is_trained) index->train(train_n, train.data());
+                index->add(n, corpus.base.data());
+                omp_set_num_threads(options.threads);
+            } catch (const std::exception& e) {
+                std::fprintf(stderr, "⚠️ %s: %s\n", config.c_str(), e.what());
+                continue;
+            }
+            double build_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            double memory_mb = SerializedBytes(index.get()) / (1024.0 * 1024.0);
+
+            // Parámetro de búsqueda que barremos según el tipo de índice
+            std::string param_name;
+            std::vector<int> values{0};
+            if (dynamic_cast<faiss::IndexHNSW*>(index.get())) {
+                param_name = "efSearch";
+                values = options.ef;
+            } else if (config.rfind("IVF", 0) == 0) {
+                param_name = "nprobe";
+                values = options.nprobe;
+            }
+
+            for (int value : values) {
+                if (!param_name.empty()) {
+                    if (param_name == "efSearch" && value < k) continue;   // efSearch < k no devuelve k vecinos
+                    params.set_index_parameter(index.get(), param_name, value);
+                }
+                Row row = Evaluate(*index, corpus, truth, k);
+                row.config = config;
+                row.param = param_name.empty() ? "" : param_name + "=" + std::to_string(value);
+                row.build_s = build_s;
+                row.memory_mb = memory_mb;
+                std::fprintf(stderr, "   %-22s %-14s recall@%d %.4f  %9.0f QPS\n", row.config.c_str(),
+                             row.param.c_str(), k, row.recall, row.qps);
+                rows.push_back(std::move(row));
+            }
+        }
+        MarkPareto(rows);
+
+        std::sort(rows.begin(), rows.end(), [](const Row& a, const Row& b) { return a.recall > b.recall; });
+        std::printf("\n%-22s %-14s %9s %7s %10s %9s %9s %9s %9s  %s\n", "config", "param",
+                    ("recall@" + std::to_string(k)).c_str(), "top1", "QPS", "p50 µs", "p99 µs", "build s", "MB", "pareto");
+        for (const auto& row : rows) {
+            std::printf("%-22s %-14s %9.4f %7.4f %10.0f %9.1f %9.1f %9.2f %9.1f  %s\n", row.config.c_str(),
+                        row.param.c_str(), row.recall, row.top1, row.qps, row.p50_us, row.p99_us, row.build_s,
+                        row.memory_mb, row.pareto ? "*" : "");
+        }
+
+        if (!options.json_out.empty()) {
+            json results = json::array();
+            for (const auto& row : rows) {
+                results.push_back({
+                    {"config", row.config}, {"param", row.param}, {"recall", row.recall}, {"top1", row.top1},
+                    {"qps", row.qps}, {"p50_us", row.p50_us}, {"p99_us", row.p99_us},
+                    {"build_s", row.build_s}, {"memory_mb", row.memory_mb}, {"pareto", row.pareto}
+                });
+            }
+            json report = {
+                {"corpus", {{"vectors", n}, {"dim", corpus.dim}, {"queries", nq}}},
+                {"k", k}, {"threads", options.threads}, {"results", results}
+            };
+            std::ofstream(options.json_out) << report.dump(2) << "\n";
+            std::fprintf(stderr, "📄 Resultados en %s\n", options.json_out.c_str());
+        }
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "❌ %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
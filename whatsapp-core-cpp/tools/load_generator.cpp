@@ -0,0 +1,547 @@
+// Generador de carga de extremo a extremo: reproduce tráfico de WhatsApp contra /ingest (una traza
+// grabada o una sintética con ráfagas de conversación) y lanza preguntas a /chat a un ritmo fijo.
+// Bucle abierto: cada petición tiene su instante programado y la latencia se mide desde ahí, así
+// que si el core se atasca la cola del generador cuenta como latencia (sin "coordinated omission").
+//
+// El core debe ir contra el stub de Ollama (o con EMBEDDER=hashing) para medir el core y no la GPU:
+//   ./ollama_stub & OLLAMA_HOST=http://localhost:11435 ./whatsapp_core & ./load_generator
+//
+// Configuración por variables de entorno:
+//   LOADGEN_TARGET          (http://localhost:8080)  core a probar
+//   LOADGEN_TRACE           ()       JSONL con cuerpos de /ingest (con "timestamp" en s); vacío => sintético
+//   LOADGEN_SPEEDUP         (1)      la traza se reproduce N veces más rápido (huecos > LOADGEN_MAX_GAP_MS se recortan)
+//   LOADGEN_MAX_GAP_MS      (5000)
+//   LOADGEN_INGEST_RATE     (50)     mensajes/s de la carga sintética (media)
+//   LOADGEN_BURST_SIZE      (8)      mensajes medios por ráfaga de conversación en un mismo chat
+//   LOADGEN_BURST_GAP_MS    (400)    hueco medio entre mensajes de una ráfaga
+//   LOADGEN_CHATS           (200)    chats distintos (los primeros hablan más)
+//   LOADGEN_CHAT_RATE       (1)      preguntas/s a /chat (0 = ninguna)
+//   LOADGEN_DURATION_S      (30)     duración (de cada escalón si se busca la saturación)
+//   LOADGEN_WORKERS         (64)     conexiones keep-alive en paralelo
+//   LOADGEN_TIMEOUT_S       (30)
+//   LOADGEN_SATURATE        ()       "ingest" o "chat": sube ese ritmo por escalones hasta romper el SLO
+//   LOADGEN_STEP_FACTOR     (1.5)    multiplicador del ritmo entre escalones
+//   LOADGEN_MAX_STEPS       (12)
+//   LOADGEN_SLO_P99_MS      (500)    SLO: p99 de la ruta que se satura...
+//   LOADGEN_SLO_ERRORS      (0.01)   ...fracción de errores...
+//   LOADGEN_SLO_THROUGHPUT  (0.9)    ...y fracción del ritmo ofrecido que debe completarse
+//   LOADGEN_OUT             ()       fichero del informe JSON (vacío => stdout)
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <spdlog/spdlog.h>
+#include <nlohmann/json.hpp>
+#include "cpp-httplib/httplib.h"
+#include "utils/metrics.h"
+
+using json = nlohmann::json;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+struct LoadOptions {
+    std::string target = "http://localhost:8080";
+    std::string trace;
+    double speedup = 1.0;
+    int max_gap_ms = 5000;
+    double ingest_rate = 50;
+    double burst_size = 8;
+    int burst_gap_ms = 400;
+    int chats = 200;
+    double chat_rate = 1;
+    int duration_s = 30;
+    int workers = 64;
+    int timeout_s = 30;
+    std::string saturate;
+    double step_factor = 1.5;
+    int max_steps = 12;
+    double slo_p99_ms = 500;
+    double slo_errors = 0.01;
+    double slo_throughput = 0.9;
+    std::string out;
+};
+
+int EnvInt(const char* name, int fallback) {
+    const char* value = std::getenv(name);
+    return value ? std::atoi(value) : fallback;
+}
+
+double EnvDouble(const char* name, double fallback) {
+    const char* value = std::getenv(name);
+    return value ? std::strtod(value, nullptr) : fallback;
+}
+
+std::string EnvString(const char* name, const std::string& fallback) {
+    const char* value = std::getenv(name);
+    return value ? value : fallback;
+}
+
+// Resultados de una ruta en un escalón
+struct RouteStats {
+    std::atomic<uint64_t> sent{0};
+    std::atomic<uint64_t> ok{0};
+    std::atomic<uint64_t> client_errors{0};   // 4xx
+    std::atomic<uint64_t> server_errors{0};   // 5xx
+    std::atomic<uint64_t> transport_errors{0};// Sin respuesta (conexión, timeout)
+    MetricHistogram latency;                  // Desde el instante programado hasta la respuesta
+
+    uint64_t Errors() const { return client_errors + server_errors + transport_errors; }
+};
+
+struct StepStats {
+    RouteStats ingest;
+    RouteStats chat;
+};
+
+struct Job {
+    Clock::time_point due;
+    bool chat = false;
+    std::string body;
+    std::shared_ptr<StepStats> stats;
+};
+
+// Cola del despachador hacia los workers
+class JobQueue {
+public:
+    void Push(Job job) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_jobs.push_back(std::move(job));
+        }
+        m_cv.notify_one();
+    }
+
+    bool Pop(Job& job) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this] { return m_closed || !m_jobs.empty(); });
+        if (m_jobs.empty()) return false;
+        job = std::move(m_jobs.front());
+        m_jobs.pop_front();
+        m_busy++;
+        return true;
+    }
+
+    void Done() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_busy--;
+        if (m_jobs.empty() && m_busy == 0) m_idle_cv.notify_all();
+    }
+
+    // Espera a que se vacíe (fin de escalón). false si no lo hace antes de 'timeout'
+    bool WaitIdle(std::chrono::seconds timeout) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return m_idle_cv.wait_for(lock, timeout, [this] { return m_jobs.empty() && m_busy == 0; });
+    }
+
+    size_t Backlog() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_jobs.size();
+    }
+
+    void Close() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closed = true;
+        }
+        m_cv.notify_all();
+    }
+
+private:
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::condition_variable m_idle_cv;
+    std::deque<Job> m_jobs;
+    int m_busy = 0;
+    bool m_closed = false;
+};
+
+// =========================================================================
+// FUENTES DE MENSAJES
+// =========================================================================
+const std::vector<std::string> kSenders{"María", "Juan", "Lucía", "Pedro", "Carmen", "Javi", "Ana", "Luis"};
+const std::vector<std::string> kWords{
+    "mañana", "quedamos", "estación", "cargador", "cena", "viernes", "reunión", "factura", "piso",
+    "vacaciones", "billetes", "tren", "cumpleaños", "regalo", "médico", "cita", "partido", "llaves",
+    "coche", "oficina", "proyecto", "entrega", "vale", "genial", "luego", "hablamos", "foto", "👍", "😂"};
+const std::vector<std::string> kQuestions{
+    "¿A qué hora quedamos mañana en la estación?",
+    "¿Quién se iba a traer el cargador?",
+    "¿Cuándo es la cita del médico?",
+    "¿Qué dijimos del regalo de cumpleaños?",
+    "¿Cuánto era la factura del piso?",
+    "¿Qué tren cogemos para las vacaciones?",
+    "¿Dónde dejé las llaves del coche?",
+    "¿Cuándo es la entrega del proyecto?"};
+
+// Un mensaje de /ingest con instante relativo al inicio de la reproducción
+struct TraceMessage {
+    double at_s;
+    json body;
+};
+
+class MessageSource {
+public:
+    virtual ~MessageSource() = default;
+    // Siguiente mensaje; 'rate_factor' escala el ritmo (escalones de saturación)
+    virtual TraceMessage Next(double rate_factor) = 0;
+};
+
+// Ráfagas de conversación: empiezan como un proceso de Poisson (ritmo / tamaño medio) y cada una
+// deja una serie geométrica de mensajes en su chat, separados por huecos exponenciales. Varias
+// ráfagas se solapan, como varios grupos hablando a la vez. Los escalones solo aceleran la llegada
+// de ráfagas: cada conversación mantiene su cadencia.
+class SyntheticSource : public MessageSource {
+public:
+    explicit SyntheticSource(const LoadOptions& options) : m_options(options), m_rng(42) {}
+
+    TraceMessage Next(double rate_factor) override {
+        // Abrimos ráfagas nuevas hasta que la próxima sea posterior al siguiente mensaje pendiente
+        while (m_active.empty() || m_next_burst <= m_active.top().at_s) {
+            double u = std::uniform_real_distribution<double>(0.0, 1.0)(m_rng);
+            Burst burst;
+            burst.at_s = m_next_burst;
+            // Popularidad sesgada: unos pocos grupos concentran la mayoría del tráfico
+            burst.chat = static_cast<int>(m_options.chats * u * u);
+            burst.left = std::geometric_distribution<int>(1.0 / std::max(1.0, m_options.burst_size))(m_rng) + 1;
+            m_active.push(burst);
+            double burst_rate = m_options.ingest_rate * rate_factor / std::max(1.0, m_options.burst_size);
+            m_next_burst += std::exponential_distribution<double>(burst_rate)(m_rng);
+        }
+
+        Burst burst = m_active.top();
+        m_active.pop();
+        if (--burst.left > 0) {
+            Burst rest = burst;
+            rest.at_s += std::exponential_distribution<double>(1000.0 / std::max(1, m_options.burst_gap_ms))(m_rng);
+            m_active.push(rest);
+        }
+
+        int length = std::uniform_int_distribution<int>(3, 25)(m_rng);
+        std::string content;
+        for (int i = 0; i < length; ++i) {
+            if (i) content += ' ';
+            content += kWords[m_rng() % kWords.size()];
+        }
+        json body = {
+            {"id", "lg-" + std::to_string(m_next_id++)},
+            {"chat_jid", "loadgen-" + std::to_string(burst.chat) + "@g.us"},
+            {"chat_name", "Grupo " + std::to_string(burst.chat)},
+            {"sender", kSenders[m_rng() % kSenders.size()]},
+            {"content", content},
+            {"is_from_me", false}
+        };
+        return {burst.at_s, std::move(body)};
+    }
+
+private:
+    struct Burst {
+        double at_s = 0;   // Instante del siguiente mensaje de la ráfaga
+        int chat = 0;
+        int left = 0;
+        bool operator>(const Burst& other) const { return at_s > other.at_s; }
+    };
+
+    const LoadOptions& m_options;
+    std::mt19937_64 m_rng;
+    std::priority_queue<Burst, std::vector<Burst>, std::greater<Burst>> m_active;
+    double m_next_burst = 0;
+    uint64_t m_next_id = 0;
+};
+
+// Traza grabada: se respetan los huecos entre mensajes (acelerados) y se repite en bucle
+class ReplaySource : public MessageSource {
+public:
+    ReplaySource(const LoadOptions& options, std::vector<json> messages)
+        : m_options(options), m_messages(std::move(messages)) {}
+
+    TraceMessage Next(double rate_factor) override {
+        const json& original = m_messages[m_index % m_messages.size()];
+        if (m_index > 0) {
+            const json& previous = m_messages[(m_index - 1) % m_messages.size()];
+            double gap_s = (original.value("timestamp", 0LL) - previous.value("timestamp", 0LL));
+            // Al dar la vuelta (o con timestamps desordenados) el hueco sale negativo: sin espera
+            gap_s = std::clamp(gap_s, 0.0, m_options.max_gap_ms / 1000.0);
+            m_at += gap_s / (m_options.speedup * rate_factor);
+        }
+        json body = original;
+        // Id único por pasada: INSERT IGNORE se tragaría las repeticiones
+        body["id"] = "lg" + std::to_string(m_index / m_messages.size()) + "-" + original.value("id", std::to_string(m_index));
+        m_index++;
+        return {m_at, std::move(body)};
+    }
+
+private:
+    const LoadOptions& m_options;
+    std::vector<json> m_messages;
+    size_t m_index = 0;
+    double m_at = 0;
+};
+
+std::unique_ptr<MessageSource> MakeSource(const LoadOptions& options) {
+    if (options.trace.empty()) return std::make_unique<SyntheticSource>(options);
+    std::ifstream in(options.trace);
+    if (!in) throw std::runtime_error("No se puede abrir la traza " + options.trace);
+    std::vector<json> messages;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty()) continue;
+        messages.push_back(json::parse(line));
+    }
+    if (messages.empty()) throw std::runtime_error("Traza vacía: " + options.trace);
+    spdlog::info("📼 Traza {}: {} mensajes", options.trace, messages.size());
+    return std::make_unique<ReplaySource>(options, std::move(messages));
+}
+
+// =========================================================================
+// EJECUCIÓN
+// =========================================================================
+void Worker(const LoadOptions& options, JobQueue& queue) {
+    httplib::Client client(options.target);
+    client.set_keep_alive(true);
+    client.set_connection_timeout(5);
+    client.set_read_timeout(options.timeout_s);
+    client.set_write_timeout(options.timeout_s);
+
+    Job job;
+    while (queue.Pop(job)) {
+        RouteStats& route = job.chat ? job.stats->chat : job.stats->ingest;
+        auto res = client.Post(job.chat ? "/chat" : "/ingest", job.body, "application/json");
+        auto elapsed = Clock::now() - job.due;
+        if (!res) {
+            route.transport_errors++;
+        } else if (res->status >= 500) {
+            route.server_errors++;
+        } else if (res->status >= 400) {
+            route.client_errors++;
+        } else {
+            route.ok++;
+            route.latency.Observe(elapsed);
+        }
+        queue.Done();
+    }
+}
+
+json RouteReport(const RouteStats& route, double offered_rate, double seconds) {
+    auto snapshot = route.latency.Collect();
+    uint64_t sent = route.sent;
+    return {
+        {"offered_per_s", offered_rate},
+        {"sent", sent},
+        {"ok", route.ok.load()},
+        {"throughput_per_s", route.ok / seconds},
+        {"error_rate", sent ? static_cast<double>(route.Errors()) / sent : 0.0},
+        {"errors", {{"4xx", route.client_errors.load()}, {"5xx", route.server_errors.load()},
+                    {"transport", route.transport_errors.load()}}},
+        {"p50_ms", snapshot.Percentile(0.50) * 1e3},
+        {"p95_ms", snapshot.Percentile(0.95) * 1e3},
+        {"p99_ms", snapshot.Percentile(0.99) * 1e3},
+        {"max_ms", snapshot.Percentile(1.0) * 1e3}
+    };
+}
+
+// Un escalón: programa /ingest y /chat durante duration_s a su ritmo y espera a que terminen
+json RunStep(const LoadOptions& options, JobQueue& queue, MessageSource& source,
+             double ingest_factor, double chat_rate) {
+    auto stats = std::make_shared<StepStats>();
+    std::mt19937_64 rng(7);
+    const double duration = options.duration_s;
+    const auto start = Clock::now();
+    auto at = [&](double seconds) {
+        return start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+    };
+
+    // La fuente lleva su propio reloj (continúa entre escalones): lo alineamos con este inicio
+    TraceMessage next_msg = source.Next(ingest_factor);
+    const double source_offset = next_msg.at_s;
+    double next_chat = chat_rate > 0 ? std::exponential_distribution<double>(chat_rate)(rng) : duration;
+    size_t max_backlog = 0;
+
+    for (;;) {
+        double msg_at = next_msg.at_s - source_offset;
+        bool chat = next_chat < msg_at;
+        double due_s = chat ? next_chat : msg_at;
+        if (due_s >= duration) break;
+
+        std::this_thread::sleep_until(at(due_s));
+        Job job;
+        job.due = at(due_s);
+        job.chat = chat;
+        job.stats = stats;
+        if (chat) {
+            job.body = json{{"query", kQuestions[rng() % kQuestions.size()]}}.dump();
+            stats->chat.sent++;
+            next_chat += std::exponential_distribution<double>(chat_rate)(rng);
+        } else {
+            // Timestamp de "ahora": /chat y las ventanas de conversación lo usan para ordenar
+            next_msg.body["timestamp"] = static_cast<long long>(std::time(nullptr));
+            job.body = next_msg.body.dump();
+            stats->ingest.sent++;
+            next_msg = source.Next(ingest_factor);
+        }
+        queue.Push(std::move(job));
+        max_backlog = std::max(max_backlog, queue.Backlog());
+    }
+
+    // Lo que sigue en vuelo cuenta para este escalón (su latencia ya corre desde su instante)
+    bool drained = queue.WaitIdle(std::chrono::seconds(options.timeout_s + 5));
+    double offered_ingest = options.trace.empty() ? options.ingest_rate * ingest_factor
+                                                  : stats->ingest.sent / duration;
+    json report = {
+        {"duration_s", duration},
+        {"ingest", RouteReport(stats->ingest, offered_ingest, duration)},
+        {"chat", RouteReport(stats->chat, chat_rate, duration)},
+        {"max_backlog", max_backlog},
+        {"drained", drained}
+    };
+    return report;
+}
+
+// ¿El escalón cumple el SLO en la ruta que se está saturando?
+bool MeetsSlo(const LoadOptions& options, const json& route) {
+    double offered = route["offered_per_s"];
+    return route["p99_ms"].get<double>() <= options.slo_p99_ms &&
+           route["error_rate"].get<double>() <= options.slo_errors &&
+           route["throughput_per_s"].get<double>() >= options.slo_throughput * offered;
+}
+
+bool WaitReady(const LoadOptions& options) {
+    httplib::Client client(options.target);
+    client.set_connection_timeout(2);
+    for (int attempt = 0; attempt < 300; ++attempt) {
+        auto res = client.Get("/readyz");
+        if (res && res->status == 200) return true;
+        if (attempt % 10 == 0) spdlog::info("⏳ Esperando a que el core esté listo ({})...", options.target);
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+    return false;
+}
+}
+
+int main() {
+    LoadOptions opt;
+    opt.target = EnvString("LOADGEN_TARGET", opt.target);
+    opt.trace = EnvString("LOADGEN_TRACE", opt.trace);
+    opt.speedup = EnvDouble("LOADGEN_SPEEDUP", opt.speedup);
+    opt.max_gap_ms = EnvInt("LOADGEN_MAX_GAP_MS", opt.max_gap_ms);
+    opt.ingest_rate = EnvDouble("LOADGEN_INGEST_RATE", opt.ingest_rate);
+    opt.burst_size = EnvDouble("LOADGEN_BURST_SIZE", opt.burst_size);
+    opt.burst_gap_ms = EnvInt("LOADGEN_BURST_GAP_MS", opt.burst_gap_ms);
+    opt.chats = std::max(1, EnvInt("LOADGEN_CHATS", opt.chats));
+    opt.chat_rate = EnvDouble("LOADGEN_CHAT_RATE", opt.chat_rate);
+    opt.duration_s = std::max(1, EnvInt("LOADGEN_DURATION_S", opt.duration_s));
+    opt.workers = std::max(1, EnvInt("LOADGEN_WORKERS", opt.workers));
+    opt.timeout_s = EnvInt("LOADGEN_TIMEOUT_S", opt.timeout_s);
+    opt.saturate = EnvString("LOADGEN_SATURATE", opt.saturate);
+    opt.step_factor = EnvDouble("LOADGEN_STEP_FACTOR", opt.step_factor);
+    opt.max_steps = EnvInt("LOADGEN_MAX_STEPS", opt.max_steps);
+    opt.slo_p99_ms = EnvDouble("LOADGEN_SLO_P99_MS", opt.slo_p99_ms);
+    opt.slo_errors = EnvDouble("LOADGEN_SLO_ERRORS", opt.slo_errors);
+    opt.slo_throughput = EnvDouble("LOADGEN_SLO_THROUGHPUT", opt.slo_throughput);
+    opt.out = EnvString("LOADGEN_OUT", opt.out);
+
+    if (!opt.saturate.empty() && opt.saturate != "ingest" && opt.saturate != "chat") {
+        spdlog::error("❌ LOADGEN_SATURATE debe ser \"ingest\" o \"chat\"");
+        return 2;
+    }
+    if (opt.saturate == "chat" && opt.chat_rate <= 0) opt.chat_rate = 1;
+
+    try {
+        auto source = MakeSource(opt);
+        if (!WaitReady(opt)) {
+            spdlog::error("❌ {} no responde 200 en /readyz", opt.target);
+            return 1;
+        }
+
+        JobQueue queue;
+        std::vector<std::thread> workers;
+        for (int i = 0; i < opt.workers; ++i) workers.emplace_back(Worker, std::cref(opt), std::ref(queue));
+
+        json steps = json::array();
+        json saturation = nullptr;
+        const int max_steps = opt.saturate.empty() ? 1 : opt.max_steps;
+        double ingest_factor = 1.0;
+        double chat_rate = opt.chat_rate;
+        for (int step = 0; step < max_steps; ++step) {
+            spdlog::info("🚦 Escalón {}: /ingest x{:.2f}, /chat {:.2f}/s durante {} s", step + 1, ingest_factor,
+                         chat_rate, opt.duration_s);
+            json report = RunStep(opt, queue, *source, ingest_factor, chat_rate);
+            report["step"] = step + 1;
+            steps.push_back(report);
+
+            const json& ingest = report["ingest"];
+            const json& chat = report["chat"];
+            spdlog::info("   /ingest {:.1f}/s (ofrecido {:.1f}) p50 {:.1f} p95 {:.1f} p99 {:.1f} ms, errores {:.2f} %",
+                         ingest["throughput_per_s"].get<double>(), ingest["offered_per_s"].get<double>(),
+                         ingest["p50_ms"].get<double>(), ingest["p95_ms"].get<double>(),
+                         ingest["p99_ms"].get<double>(), ingest["error_rate"].get<double>() * 100);
+            spdlog::info("   /chat   {:.2f}/s (ofrecido {:.2f}) p50 {:.1f} p95 {:.1f} p99 {:.1f} ms, errores {:.2f} %",
+                         chat["throughput_per_s"].get<double>(), chat["offered_per_s"].get<double>(),
+                         chat["p50_ms"].get<double>(), chat["p95_ms"].get<double>(),
+                         chat["p99_ms"].get<double>(), chat["error_rate"].get<double>() * 100);
+
+            if (opt.saturate.empty()) break;
+            const json& route = report[opt.saturate];
+            if (!MeetsSlo(opt, route)) {
+                spdlog::warn("🧱 SLO roto en el escalón {} ({})", step + 1, opt.saturate);
+                break;
+            }
+            // Último escalón que cumple: el punto de saturación está entre este y el siguiente
+            saturation = {
+                {"route", opt.saturate},
+                {"max_sustained_per_s", route["throughput_per_s"]},
+                {"offered_per_s", route["offered_per_s"]},
+                {"p99_ms", route["p99_ms"]},
+                {"step", step + 1}
+            };
+            if (opt.saturate == "ingest") {
+                ingest_factor *= opt.step_factor;
+            } else {
+                chat_rate *= opt.step_factor;
+            }
+        }
+
+        queue.Close();
+        for (auto& worker : workers) worker.join();
+
+        if (!opt.saturate.empty()) {
+            if (saturation.is_null()) {
+                spdlog::warn("🧱 Ni el primer escalón cumple el SLO: baja LOADGEN_INGEST_RATE / LOADGEN_CHAT_RATE");
+            } else {
+                spdlog::info("📈 Saturación ({}): ~{:.1f}/s con p99 {:.1f} ms (escalón {})", opt.saturate,
+                             saturation["max_sustained_per_s"].get<double>(), saturation["p99_ms"].get<double>(),
+                             saturation["step"].get<int>());
+            }
+        }
+
+        json report = {
+            {"target", opt.target},
+            {"source", opt.trace.empty() ? "synthetic" : opt.trace},
+            {"slo", {{"p99_ms", opt.slo_p99_ms}, {"error_rate", opt.slo_errors}, {"throughput", opt.slo_throughput}}},
+            {"steps", steps},
+            {"saturation", saturation}
+        };
+        if (opt.out.empty()) {
+            std::printf("%s\n", report.dump(2).c_str());
+        } else {
+            std::ofstream(opt.out) << report.dump(2) << "\n";
+            spdlog::info("📄 Informe en {}", opt.out);
+        }
+    } catch (const std::exception& e) {
+        spdlog::critical("🔥 {}", e.what());
+        return 1;
+    }
+    return 0;
+}
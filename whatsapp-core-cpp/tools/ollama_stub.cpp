@@ -0,0 +1,233 @@
+// Servidor local compatible con la API de Ollama, para pruebas de extremo a extremo y de carga
+// sin GPU ni modelos. Los embeddings salen de HashingEmbedder (deterministas) y el chat devuelve
+// un texto de relleno token a token, con la latencia que se configure.
+//
+// Configuración por variables de entorno:
+//   OLLAMA_STUB_PORT       (11435)  puerto de escucha
+//   OLLAMA_STUB_EMBED_MS   (20)     latencia de cada embedding
+//   OLLAMA_STUB_CHAT_MS    (150)    prompt-eval: hasta el primer token
+//   OLLAMA_STUB_TOKEN_MS   (15)     entre tokens de la respuesta
+//   OLLAMA_STUB_JITTER     (0.2)    variación aleatoria de las latencias (+-20 %)
+//   OLLAMA_STUB_FAIL_RATE  (0)      fracción de peticiones que responden 500
+//   OLLAMA_STUB_DIM        (768)    dimensión de los embeddings
+//   OLLAMA_STUB_THREADS    (64)     peticiones atendidas a la vez
+//
+// Uso: OLLAMA_STUB_EMBED_MS=5 ./ollama_stub & OLLAMA_HOST=http://localhost:11435 ./whatsapp_core
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <spdlog/spdlog.h>
+#include <nlohmann/json.hpp>
+#include "cpp-httplib/httplib.h"
+#include "llm/embedding_decoder.h"
+#include "llm/hashing_embedder.h"
+
+using json = nlohmann::json;
+
+namespace {
+struct StubOptions {
+    int port = 11435;
+    int embed_ms = 20;
+    int chat_ms = 150;
+    int token_ms = 15;
+    double jitter = 0.2;
+    double fail_rate = 0.0;
+    int dim = 768;
+    int threads = 64;
+};
+
+int EnvInt(const char* name, int fallback) {
+    const char* value = std::getenv(name);
+    return value ? std::atoi(value) : fallback;
+}
+
+double EnvDouble(const char* name, double fallback) {
+    const char* value = std::getenv(name);
+    return value ? std::strtod(value, nullptr) : fallback;
+}
+
+std::mt19937& Rng() {
+    thread_local std::mt19937 rng{std::random_device{}()};
+    return rng;
+}
+
+void Sleep(int ms, double jitter) {
+    if (ms <= 0) return;
+    std::uniform_real_distribution<double> dist(1.0 - jitter, 1.0 + jitter);
+    std::this_thread::sleep_for(std::chrono::microseconds(static_cast<long>(ms * 1000.0 * dist(Rng()))));
+}
+
+bool ShouldFail(double rate) {
+    if (rate <= 0) return false;
+    std::uniform_real_distribution<double> dist(0.0, 1.0);
+    return dist(Rng()) < rate;
+}
+
+void Fail(httplib::Response& res) {
+    res.status = 500;
+    res.set_content(json{{"error", "ollama_stub: fallo simulado"}}.dump(), "application/json");
+}
+
+// Respuesta de relleno: las palabras de la pregunta, recortadas a 'tokens' trozos
+std::vector<std::string> FakeAnswer(const std::string& question, int tokens) {
+    std::vector<std::string> words{"Según", "el", "contexto,"};
+    std::istringstream in(question);
+    std::string word;
+    while (in >> word) words.push_back(word);
+    std::vector<std::string> out;
+    for (int i = 0; i < tokens; ++i) out.push_back(words[i % words.size()] + " ");
+    return out;
+}
+
+// Campos de cierre de Ollama (duraciones en ns) para que RecordTimings tenga algo que medir
+json DoneChunk(const std::string& model, int prompt_tokens, int eval_tokens, const StubOptions& opt) {
+    const double ms_to_ns = 1e6;
+    return {
+        {"model", model},
+        {"done", true},
+        {"message", {{"role", "assistant"}, {"content", ""}}},
+        {"prompt_eval_count", prompt_tokens},
+        {"prompt_eval_duration", static_cast<long long>(opt.chat_ms * ms_to_ns)},
+        {"load_duration", static_cast<long long>(1 * ms_to_ns)},
+        {"eval_count", eval_tokens},
+        {"eval_duration", static_cast<long long>(eval_tokens * opt.token_ms * ms_to_ns)},
+        {"total_duration", static_cast<long long>((opt.chat_ms + eval_tokens * opt.token_ms) * ms_to_ns)}
+    };
+}
+}
+
+int main() {
+    StubOptions opt;
+    opt.port = EnvInt("OLLAMA_STUB_PORT", opt.port);
+    opt.embed_ms = EnvInt("OLLAMA_STUB_EMBED_MS", opt.embed_ms);
+    opt.chat_ms = EnvInt("OLLAMA_STUB_CHAT_MS", opt.chat_ms);
+    opt.token_ms = EnvInt("OLLAMA_STUB_TOKEN_MS", opt.token_ms);
+    opt.jitter = EnvDouble("OLLAMA_STUB_JITTER", opt.jitter);
+    opt.fail_rate = EnvDouble("OLLAMA_STUB_FAIL_RATE", opt.fail_rate);
+    opt.dim = EnvInt("OLLAMA_STUB_DIM", opt.dim);
+    opt.threads = EnvInt("OLLAMA_STUB_THREADS", opt.threads);
+
+    HashingEmbedder embedder(opt.dim);
+    httplib::Server server;
+    // Las latencias simuladas duermen el hilo: hacen falta tantos como peticiones simultáneas
+    server.new_task_queue = [threads = opt.threads] { return new httplib::ThreadPool(threads); };
+
+    server.Get("/api/version", [](const httplib::Request&, httplib::Response& res) {
+        res.set_content(json{{"version", "0.0.0-stub"}}.dump(), "application/json");
+    });
+
+    server.Get("/api/tags", [&](const httplib::Request&, httplib::Response& res) {
+        res.set_content(json{{"models", json::array({{{"name", "stub"}}})}}.dump(), "application/json");
+    });
+
+    // API clásica: {"prompt": "..."} => {"embedding": [...]}, o float32 en binario si se acepta
+    server.Post("/api/embeddings", [&](const httplib::Request& req, httplib::Response& res) {
+        auto j = json::parse(req.body, nullptr, false);
+        if (j.is_discarded()) {
+            res.status = 400;
+            res.set_content(json{{"error", "invalid JSON"}}.dump(), "application/json");
+            return;
+        }
+        Sleep(opt.embed_ms, opt.jitter);
+        if (ShouldFail(opt.fail_rate)) return Fail(res);
+
+        auto embedding = embedder.Embed(j.value("prompt", ""));
+        if (req.get_header_value("Accept").find(kEmbeddingBinaryMime) != std::string::npos) {
+            std::string body(reinterpret_cast<const char*>(embedding.data()), embedding.size() * sizeof(float));
+            res.set_content(body, kEmbeddingBinaryMime);
+            return;
+        }
+        res.set_content(json{{"embedding", embedding}}.dump(), "application/json");
+    });
+
+    // API nueva: {"input": "..." | ["...", ...]} => {"embeddings": [[...], ...]}
+    server.Post("/api/embed", [&](const httplib::Request& req, httplib::Response& res) {
+        auto j = json::parse(req.body, nullptr, false);
+        if (j.is_discarded() || !j.contains("input")) {
+            res.status = 400;
+            res.set_content(json{{"error", "invalid JSON"}}.dump(), "application/json");
+            return;
+        }
+        // Como Ollama: un texto suelto o una lista de textos; cualquier otra cosa es un 400, no un 500
+        const json& input = j["input"];
+        std::vector<std::string> inputs;
+        bool valid = input.is_string() || input.is_array();
+        if (input.is_string()) {
+            inputs.push_back(input.get<std::string>());
+        } else if (input.is_array()) {
+            for (const auto& item : input) {
+                valid = valid && item.is_string();
+                if (valid) inputs.push_back(item.get<std::string>());
+            }
+        }
+        if (!valid) {
+            res.status = 400;
+            res.set_content(json{{"error", "input must be a string or an array of strings"}}.dump(), "application/json");
+            return;
+        }
+        Sleep(opt.embed_ms, opt.jitter);
+        if (ShouldFail(opt.fail_rate)) return Fail(res);
+
+        json embeddings = json::array();
+        for (const auto& input : inputs) embeddings.push_back(embedder.Embed(input));
+        res.set_content(json{{"model", j.value("model", "stub")}, {"embeddings", embeddings}}.dump(), "application/json");
+    });
+
+    // Chat: NDJSON token a token (stream, por defecto en Ollama) o un único objeto
+    server.Post("/api/chat", [&](const httplib::Request& req, httplib::Response& res) {
+        auto j = json::parse(req.body, nullptr, false);
+        if (j.is_discarded()) {
+            res.status = 400;
+            res.set_content(json{{"error", "invalid JSON"}}.dump(), "application/json");
+            return;
+        }
+        if (ShouldFail(opt.fail_rate)) return Fail(res);
+
+        std::string model = j.value("model", "stub");
+        std::string prompt;
+        std::string question;
+        for (const auto& message : j.value("messages", json::array())) {
+            prompt += message.value("content", "");
+            if (message.value("role", "") == "user") question = message.value("content", "");
+        }
+        int num_predict = j.value("/options/num_predict"_json_pointer, -1);
+        int tokens = num_predict > 0 ? std::min(num_predict, 64) : 32;
+        int prompt_tokens = static_cast<int>(prompt.size() / 4);
+        auto answer = FakeAnswer(question, tokens);
+
+        if (!j.value("stream", true)) {
+            Sleep(opt.chat_ms + tokens * opt.token_ms, opt.jitter);
+            json done = DoneChunk(model, prompt_tokens, tokens, opt);
+            std::string content;
+            for (const auto& token : answer) content += token;
+            done["message"]["content"] = content;
+            res.set_content(done.dump(), "application/json");
+            return;
+        }
+
+        res.set_chunked_content_provider("application/x-ndjson",
+            [answer, model, prompt_tokens, tokens, &opt](size_t, httplib::DataSink& sink) {
+                Sleep(opt.chat_ms, opt.jitter);
+                for (const auto& token : answer) {
+                    std::string line = json{{"model", model}, {"done", false},
+                                            {"message", {{"role", "assistant"}, {"content", token}}}}.dump() + "\n";
+                    if (!sink.write(line.data(), line.size())) return false; // El cliente cortó
+                    Sleep(opt.token_ms, opt.jitter);
+                }
+                std::string last = DoneChunk(model, prompt_tokens, tokens, opt).dump() + "\n";
+                sink.write(last.data(), last.size());
+                sink.done();
+                return true;
+            });
+    });
+
+    spdlog::info("🧪 Ollama stub en :{} (embed {} ms, chat {} ms + {} ms/token, jitter {:.0f} %, fallos {:.0f} %, {} dims)",
+                 opt.port, opt.embed_ms, opt.chat_ms, opt.token_ms, opt.jitter * 100, opt.fail_rate * 100, opt.dim);
+    server.listen("0.0.0.0", opt.port);
+    return 0;
+}